@@ -1,7 +1,23 @@
 #include "bench/bench-util.h"
+#include "cache/adapt-size.h"
 #include "cache/arc.h"
+#include "cache/car.h"
+#include "cache/clock-pro.h"
+#include "cache/flat-index.h"
 #include "cache/flex-arc.h"
+#include "cache/ghost.h"
+#include "cache/lfu.h"
+#include "cache/lirs.h"
+#include "cache/lru-k.h"
+#include "cache/s3-fifo.h"
+#include "cache/sampled.h"
+#include "cache/sharded-arc.h"
+#include "cache/slru.h"
 #include "cache/tiered-cache.h"
+#include "cache/tiny-lfu.h"
+#include "cache/two-queue.h"
+#include "cache/unified-arc.h"
+#include "cache/w-tinylfu.h"
 #include "util/belady.h"
 #include "util/table-printer.h"
 #include "util/trace-gen.h"
@@ -9,56 +25,73 @@
 #include "gflags/gflags.h"
 
 #include <chrono>
+#include <limits>
 #include <map>
 
 /**
-trace            cache            hits  misses  evicts     p  max_p  hit %  LRU %  LFU %  miss %  LRU Ghost %  LFU Ghost %  filters   micros/val
-------------------------------------------------------------------------------------------------------------------------------------------------
-med-seq-cycle    arc-25         400000  400000  300000     0      0     50     25     75      50            0            0        -     0.347035
-med-seq-cycle    arc-25-filter  300000  500000       0     0      0     37     33     66      62            0            0   400000     0.286021
-med-seq-cycle    lru-25         400000  400000  300000     -      -     50      -      -      50            -            -        -     0.203671
-med-seq-cycle    farc-25-400    400000  400000  300000     0      0     50     25     75      50            0            0        -     0.268634
-
-seq-cycle-10%    arc-25         360000   40000       0     0      0     90     11     88      10            0            0        -     0.079740
-seq-cycle-10%    arc-25-filter  320000   80000       0     0      0     80     12     87      20            0            0    40000     0.126828
-seq-cycle-10%    lru-25         360000   40000       0     -      -     90      -      -      10            -            -        -     0.058572
-seq-cycle-10%    farc-25-400    360000   40000       0     0      0     90     11     88      10            0            0        -     0.103008
-
-seq-cycle-50%    arc-25             20  399980  299980  5000   5000      0    100      0      99            0           37        -     0.660722
-seq-cycle-50%    arc-25-filter       0  400000  100000     0      0      0      -      -     100            0            0   200000     0.431517
-seq-cycle-50%    lru-25              0  400000  300000     -      -      0      -      -     100            -            -        -     0.369670
-seq-cycle-50%    farc-25-400     50000  350000  250000  5000   5000     12    100      0      87            0           42        -     0.557948
-
-seq-unique       arc-25              0  400000  300000     0   5000      0      -      -     100            0            0        -     0.636285
-seq-unique       arc-25-filter       0  400000       0     0      0      0      -      -     100            0            0   400000     0.405140
-seq-unique       lru-25              0  400000  300000     -      -      0      -      -     100            -            -        -     0.368667
-seq-unique       farc-25-400         0  400000  300000     0   5000      0      -      -     100            0            0        -     0.675765
-
-tiny-seq-cycle   arc-25         400000  400000  300000     0   5000     50      1     99      50            0            0        -     0.337612
-tiny-seq-cycle   arc-25-filter  396000  404000       0     0      0     49      1     98      50            0            0   400000     0.212765
-tiny-seq-cycle   lru-25         400000  400000  300000     -      -     50      -      -      50            -            -        -     0.196477
-tiny-seq-cycle   farc-25-400    400000  400000  300000     0   5000     50      1     99      50            0            0        -     0.316476
-
-zipf-.7          arc-25         190340  209660  109660  1021   5000     47     26     73      52            0            9        -     0.383600
-zipf-.7          arc-25-filter  139440  260560       0     0      0     34     22     77      65            0            0   187560     0.286070
-zipf-.7          lru-25         187680  212320  112320     -      -     46      -      -      53            -            -        -     0.231547
-zipf-.7          farc-25-400    190340  209660  109660  1105   5000     47     26     73      52            0           10        -     0.351245
-
-zipf-1           arc-25         292360  107640    7640    10   5000     73     12     87      26            0            0        -     0.172180
-zipf-1           arc-25-filter  254660  145340       0     0      0     63      7     92      36            0            0   107440     0.194488
-zipf-1           lru-25         292340  107660    7660     -      -     73      -      -      26            -            -        -     0.112543
-zipf-1           farc-25-400    292360  107640    7640    10   5000     73     12     87      26            0            0        -     0.192735
-
-zipf-seq         arc-25         481180  718820  618820     7   5000     40     11     88      59            0           16        -     0.473558
-zipf-seq         arc-25-filter  464120  735880  168600    86   1128     38     11     88      61            0           12   467280     0.425268
-zipf-seq         lru-25         417920  782080  682080     -      -     34      -      -      65            -            -        -     0.279900
-zipf-seq         farc-25-400    451340  748660  648660     0   5000     37     11     88      62            0           46        -     0.569691
+Hit % of each policy on the generated traces, from bench-cache --iters=1 and
+the policy's --include_* flag. The columns are med-seq-cycle, seq-cycle-10%,
+seq-cycle-50%, seq-unique, tiny-seq-cycle, zipf-.7, zipf-1 and zipf-seq:
+
+cache                  med    10%    50%   uniq   tiny    z.7     z1   zseq
+---------------------------------------------------------------------------
+arc-25                50.0   90.0    0.0    0.0   50.0   47.3   73.3   40.2
+arc-25-filter         37.5   80.0    0.0    0.0   49.5   35.0   64.4   38.5
+uarc-25               50.0   90.0    0.0    0.0   50.0   47.3   73.3   40.2
+lru-25                50.0   90.0    0.0    0.0   50.0   46.8   73.3   34.7
+farc-25-400           50.0   90.0   12.5    0.0   50.0   47.3   73.3   37.5
+arc-25-tinylfu        50.0   90.0   12.5    0.0   50.0   47.7   73.3   41.4
+farc-25-400-tinylfu   50.0   90.0   12.5    0.0   50.0   47.7   73.3   41.4
+wtlfu-25              50.0   90.0   16.8    0.0   50.0   47.7   73.3   47.0
+clock-pro-25          50.0   90.0   24.8    0.0   50.0   47.6   73.3   40.7
+car-25                50.0   90.0    0.0    0.0   50.0   47.3   73.3   43.1
+lirs-25               50.0   90.0   24.8    0.0   50.0   47.6   73.3   41.7
+s3fifo-25             50.0   90.0    0.0    0.0   50.0   47.3   73.3   41.4
+2q-25                 50.0   90.0    0.0    0.0   50.0   44.5   72.9   39.3
+slru2-25              50.0   90.0    0.0    0.0   50.0   47.3   73.3   40.0
+slru4-25              50.0   90.0    0.0    0.0   50.0   47.3   73.3   42.5
+lfu-25                50.0   90.0    0.0    0.0   50.0   47.3   73.3   42.6
+lfu-da-25             50.0   90.0    0.0    0.0   50.0   47.2   73.3   35.8
+lru2-25               50.0   90.0    0.0    0.0   50.0   47.3   73.3   42.0
+as-arc-25             50.0   90.0    0.0    0.0   50.0   47.3   73.3   45.7
+as-farc-25-400        50.0   90.0   12.5    0.0   50.0   47.3   73.3   39.8
+as-lru-25             50.0   90.0    0.0    0.0   50.0   46.7   73.3   33.7
+lhd-25                50.0   90.0   18.8    0.0   50.0   45.0   73.2   34.8
+hyperbolic-25         50.0   90.0    0.0    0.0   50.0   47.2   73.3   36.0
+gdsf-25               50.0   90.0    0.0    0.0   50.0   47.4   73.3   36.6
+sampled-lru-25        50.0   90.0    0.0    0.0   50.0   46.8   73.3   34.7
 
 **/
 
 DEFINE_bool(include_lru, true, "Include lru cache in tests.");
 DEFINE_bool(include_belady, false, "Include belady cache in tests.");
 DEFINE_bool(include_tiered, false, "Include tiered cache in tests.");
+DEFINE_bool(include_flat, false, "Include caches using the flat hash index.");
+DEFINE_bool(include_clock_pro, false, "Include clock-pro cache in tests.");
+DEFINE_bool(include_car, false, "Include CAR cache in tests.");
+DEFINE_bool(include_lirs, false, "Include LIRS cache in tests.");
+DEFINE_bool(include_s3fifo, false, "Include S3-FIFO cache in tests.");
+DEFINE_bool(include_2q, false, "Include 2Q cache in tests.");
+DEFINE_bool(include_slru, false, "Include segmented LRU caches in tests.");
+DEFINE_bool(include_lfu, false, "Include LFU and LFU-DA caches in tests.");
+DEFINE_bool(include_lru2, false, "Include LRU-2 cache in tests.");
+DEFINE_bool(include_adapt_size, false,
+            "Include ARC, FlexARC and LRU with AdaptSize admission.");
+DEFINE_bool(include_sampled, false,
+            "Include sampled eviction caches (LHD, hyperbolic, GDSF, LRU).");
+DEFINE_bool(include_unified, false,
+            "Include ARC with one index for cache and ghost lists.");
+DEFINE_bool(include_sized_ghost, false,
+            "Include ARCs whose ghost lists and p are sized in bytes.");
+DEFINE_bool(include_tinylfu, false,
+            "Include ARCs with a TinyLFU admission filter.");
+DEFINE_bool(include_wtinylfu, false, "Include W-TinyLFU caches in tests.");
+DEFINE_bool(include_sharded, false,
+            "Include 16 shard ARCs with per shard and shared p.");
+DEFINE_bool(include_fp_ghost, false,
+            "Compare caches with full key and fingerprint ghost lists.");
+DEFINE_int64(ghost_key_len, 170,
+             "Key length used when comparing ghost list memory.");
 
 DEFINE_bool(minimal, true, "Include minimal (aka) smoke caches in tests.");
 DEFINE_int64(unique_keys, 20000, "Number of unique keys to test.");
@@ -70,15 +103,138 @@ DEFINE_int64(trace_limits, 0, "How much of the trace to use. 0 means run all");
 using namespace std;
 using namespace cache;
 
-typedef TieredCache<RefCountKey, int64_t,
-                    AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer>>
+typedef AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer> TierArc;
+typedef TieredCache<RefCountKey, int64_t, TierArc, NopLock, TraceSizer>
     TieredArc;
+typedef LRUCache<RefCountKey, int64_t, NopLock, TraceSizer, FlatIndex> FlatLru;
+typedef AdaptiveCache<string, int64_t, NopLock, TraceSizer> StringArc;
+typedef AdaptiveCache<string, int64_t, NopLock, TraceSizer, NodeIndex,
+                      FingerprintGhost<string>>
+    FpArc;
+typedef FlexARC<string, int64_t, NopLock, TraceSizer> StringFarc;
+typedef FlexARC<string, int64_t, NopLock, TraceSizer, NodeIndex,
+                FingerprintGhost<string>>
+    FpFarc;
+typedef AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer, FlatIndex>
+    FlatArc;
+typedef UnifiedARC<RefCountKey, int64_t, NopLock, TraceSizer> UnifiedArc;
+typedef UnifiedARC<RefCountKey, int64_t, NopLock, TraceSizer, FlatIndex>
+    FlatUnifiedArc;
+typedef ShardedCache<RefCountKey, int64_t,
+                     UnifiedARC<RefCountKey, int64_t, NopLock, TraceSizer>, 16>
+    ShardedUnifiedArc;
+typedef ShardedARC<RefCountKey, int64_t, 16, TraceSizer> SharedPArc;
+typedef AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer, NodeIndex,
+                      SizedGhost<RefCountKey>>
+    SizedArc;
+typedef FlexARC<RefCountKey, int64_t, NopLock, TraceSizer, NodeIndex,
+                SizedGhost<RefCountKey>>
+    SizedFarc;
+typedef AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer, NodeIndex,
+                      KeyGhost<RefCountKey>, shared_ptr<int64_t>,
+                      TinyLFU<RefCountKey>>
+    TinyLfuArc;
+typedef FlexARC<RefCountKey, int64_t, NopLock, TraceSizer, NodeIndex,
+                KeyGhost<RefCountKey>, shared_ptr<int64_t>,
+                TinyLFU<RefCountKey>>
+    TinyLfuFarc;
+typedef WTinyLFU<RefCountKey, int64_t, NopLock, TraceSizer> WTinyLfu;
+typedef CARCache<RefCountKey, int64_t, NopLock, TraceSizer> Car;
+typedef LIRSCache<RefCountKey, int64_t, NopLock, TraceSizer> Lirs;
+typedef S3FIFOCache<RefCountKey, int64_t, NopLock, TraceSizer> S3Fifo;
+typedef TwoQueueCache<RefCountKey, int64_t, NopLock, TraceSizer> TwoQueue;
+typedef SLRUCache<RefCountKey, int64_t, NopLock, TraceSizer> Slru;
+typedef LFUCache<RefCountKey, int64_t, NopLock, TraceSizer> Lfu;
+typedef LRUKCache<RefCountKey, int64_t, NopLock, TraceSizer> Lru2;
+typedef AdaptSizeCache<RefCountKey, int64_t,
+                       AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer>>
+    AsArc;
+typedef AdaptSizeCache<RefCountKey, int64_t,
+                       FlexARC<RefCountKey, int64_t, NopLock, TraceSizer>>
+    AsFarc;
+typedef AdaptSizeCache<RefCountKey, int64_t,
+                       LRUCache<RefCountKey, int64_t, NopLock, TraceSizer>>
+    AsLru;
+typedef SampledCache<RefCountKey, int64_t, NopLock, TraceSizer> Lhd;
+typedef SampledCache<RefCountKey, int64_t, NopLock, TraceSizer, NodeIndex,
+                     Hyperbolic>
+    HyperbolicCache;
+typedef SampledCache<RefCountKey, int64_t, NopLock, TraceSizer, NodeIndex, GDSF>
+    Gdsf;
+typedef SampledCache<RefCountKey, int64_t, NopLock, TraceSizer, NodeIndex,
+                     SampledLRU>
+    SampledLru;
 
 map<string, Trace*> traces;
 vector<AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer>*> arcs;
 vector<LRUCache<RefCountKey, int64_t, NopLock, TraceSizer>*> lrus;
 vector<FlexARC<RefCountKey, int64_t, NopLock, TraceSizer>*> farcs;
 vector<TieredArc*> tiered_caches;
+vector<ClockProCache<RefCountKey, int64_t, NopLock, TraceSizer>*> clock_pros;
+vector<FlatLru*> flat_lrus;
+vector<FlatArc*> flat_arcs;
+vector<UnifiedArc*> unified_arcs;
+vector<FlatUnifiedArc*> flat_unified_arcs;
+vector<ShardedUnifiedArc*> sharded_arcs;
+vector<SharedPArc*> shared_p_arcs;
+vector<SizedArc*> sized_arcs;
+vector<SizedFarc*> sized_farcs;
+vector<TinyLfuArc*> tinylfu_arcs;
+vector<TinyLfuFarc*> tinylfu_farcs;
+vector<WTinyLfu*> wtinylfus;
+vector<Car*> cars;
+vector<Lirs*> lirses;
+vector<S3Fifo*> s3fifos;
+vector<TwoQueue*> two_queues;
+vector<Slru*> slrus;
+vector<Lfu*> lfus;
+vector<Lru2*> lru2s;
+vector<AsArc*> as_arcs;
+vector<AsFarc*> as_farcs;
+vector<AsLru*> as_lrus;
+vector<Lhd*> lhds;
+vector<HyperbolicCache*> hyperbolics;
+vector<Gdsf*> gdsfs;
+vector<SampledLru*> sampled_lrus;
+
+// Copy of trace with every key padded to len bytes, so keys are heap
+// allocated like long object paths are.
+FixedTrace* PadKeys(Trace* trace, int64_t len) {
+  vector<Request> requests;
+  trace->Reset();
+  while (const Request* r = trace->next()) {
+    string key = r->key;
+    key.insert(0, max<int64_t>(len - (int64_t)key.size(), 0), '/');
+    requests.emplace_back(key, r->value, nullptr);
+  }
+  return new FixedTrace(requests);
+}
+
+// Runs a freshly constructed cache, reporting its memory footprint.
+template <class Cache, typename... Args>
+void RunFresh(TablePrinter* results, int64_t base_size, const string& name,
+              Trace* trace, CacheType type, int iters, const string& suffix,
+              Args... args) {
+  int64_t live_bytes = AllocCounter::live_bytes();
+  unique_ptr<Cache> cache(new Cache(args...));
+  Run<string>(results, base_size, name, trace, cache.get(), type, iters,
+              cache->label(base_size) + suffix, live_bytes);
+}
+
+// Full key vs fingerprint ghost lists, with long std::string keys.
+void TestGhosts(TablePrinter* results, int64_t base_size, const string& name,
+                Trace* trace, int iters) {
+  unique_ptr<FixedTrace> padded(PadKeys(trace, FLAGS_ghost_key_len));
+  RunFresh<StringArc>(results, base_size, name, padded.get(), CacheType::Arc,
+                      iters, "-key", base_size * .25);
+  RunFresh<FpArc>(results, base_size, name, padded.get(), CacheType::Arc,
+                  iters, "-fp", base_size * .25);
+  RunFresh<StringFarc>(results, base_size, name, padded.get(),
+                       CacheType::Farc, iters, "-key", base_size * .25,
+                       base_size);
+  RunFresh<FpFarc>(results, base_size, name, padded.get(), CacheType::Farc,
+                   iters, "-fp", base_size * .25, base_size);
+}
 
 void Test(TablePrinter* results, int64_t base_size, int iters) {
   for (auto trace : traces) {
@@ -86,6 +242,18 @@ void Test(TablePrinter* results, int64_t base_size, int iters) {
       Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
                        CacheType::Arc, iters);
     }
+    for (UnifiedArc* cache : unified_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (ShardedUnifiedArc* cache : sharded_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (SharedPArc* cache : shared_p_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
     for (LRUCache<RefCountKey, int64_t, NopLock, TraceSizer>* cache : lrus) {
       Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
                        CacheType::Lru, iters);
@@ -94,9 +262,113 @@ void Test(TablePrinter* results, int64_t base_size, int iters) {
       Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
                        CacheType::Farc, iters);
     }
-    for (TieredArc* cache : tiered_caches) {
+    for (SizedArc* cache : sized_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters,
+                       cache->label(base_size) + "-sized");
+    }
+    for (SizedFarc* cache : sized_farcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Farc, iters,
+                       cache->label(base_size) + "-sized");
+    }
+    for (TinyLfuArc* cache : tinylfu_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (TinyLfuFarc* cache : tinylfu_farcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Farc, iters);
+    }
+    for (WTinyLfu* cache : wtinylfus) {
       Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
-                       CacheType::Tiered, iters);
+                       CacheType::Arc, iters);
+    }
+    for (ClockProCache<RefCountKey, int64_t, NopLock, TraceSizer>* cache :
+         clock_pros) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (Car* cache : cars) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (Lirs* cache : lirses) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (S3Fifo* cache : s3fifos) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (TwoQueue* cache : two_queues) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (Slru* cache : slrus) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (Lfu* cache : lfus) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (Lru2* cache : lru2s) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (AsArc* cache : as_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (AsFarc* cache : as_farcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (AsLru* cache : as_lrus) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Lru, iters);
+    }
+    for (Lhd* cache : lhds) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (HyperbolicCache* cache : hyperbolics) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (Gdsf* cache : gdsfs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    for (SampledLru* cache : sampled_lrus) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters);
+    }
+    // The first without rebalancing.
+    for (size_t i = 0; i < tiered_caches.size(); ++i) {
+      TieredArc* cache = tiered_caches[i];
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Tiered, iters,
+                       cache->label(base_size) + (i == 0 ? "-fixed" : ""));
+    }
+    for (FlatArc* cache : flat_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters,
+                       cache->label(base_size) + "-flat");
+    }
+    for (FlatUnifiedArc* cache : flat_unified_arcs) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Arc, iters,
+                       cache->label(base_size) + "-flat");
+    }
+    for (FlatLru* cache : flat_lrus) {
+      Run<RefCountKey>(results, base_size, trace.first, trace.second, cache,
+                       CacheType::Lru, iters,
+                       cache->label(base_size) + "-flat");
+    }
+    if (FLAGS_include_fp_ghost) {
+      TestGhosts(results, base_size, trace.first, trace.second, iters);
     }
     if (FLAGS_include_belady) {
       BeladyCache<string, int64_t> cache(base_size * .25, trace.second);
@@ -135,6 +407,7 @@ int main(int argc, char** argv) {
   results.AddColumn("p", false);
   results.AddColumn("max_p", false);
   results.AddColumn("hit %", false);
+  results.AddColumn("byte hit %", false);
   results.AddColumn("LRU %", false);
   results.AddColumn("LFU %", false);
   results.AddColumn("miss %", false);
@@ -142,6 +415,8 @@ int main(int argc, char** argv) {
   results.AddColumn("LFU Ghost %", false);
   results.AddColumn("filters", false);
   results.AddColumn("micros/val", false);
+  results.AddColumn("allocs/op", false);
+  results.AddColumn("KB", false);
 
   const int keys = FLAGS_unique_keys;
   int64_t base_size = keys;
@@ -195,20 +470,125 @@ int main(int argc, char** argv) {
         base_size * .25));
     arcs.push_back(new AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer>(
         base_size * .25, base_size * .5));
+    if (FLAGS_include_unified) {
+      unified_arcs.push_back(new UnifiedArc(base_size * .25));
+    }
+    if (FLAGS_include_sharded) {
+      sharded_arcs.push_back(new ShardedUnifiedArc(base_size * .25));
+      shared_p_arcs.push_back(new SharedPArc(base_size * .25));
+    }
+    if (FLAGS_include_sized_ghost) {
+      sized_arcs.push_back(new SizedArc(base_size * .25));
+      sized_farcs.push_back(new SizedFarc(base_size * .25, base_size));
+    }
+    if (FLAGS_include_tinylfu) {
+      // The sketch counts keys, size it for a quarter of them whatever the
+      // Sizer.
+      tinylfu_arcs.push_back(new TinyLfuArc(base_size * .25, keys * .25));
+      tinylfu_farcs.push_back(
+          new TinyLfuFarc(base_size * .25, base_size, keys * .25));
+    }
+    if (FLAGS_include_wtinylfu) {
+      wtinylfus.push_back(new WTinyLfu(base_size * .25, keys * .25));
+    }
     farcs.push_back(new FlexARC<RefCountKey, int64_t, NopLock, TraceSizer>(
         base_size * .25, base_size));
     lrus.push_back(
         new LRUCache<RefCountKey, int64_t, NopLock, TraceSizer>(base_size * .25));
+    if (FLAGS_include_clock_pro) {
+      clock_pros.push_back(
+          new ClockProCache<RefCountKey, int64_t, NopLock, TraceSizer>(
+              base_size * .25));
+    }
+    if (FLAGS_include_car) {
+      cars.push_back(new Car(base_size * .25));
+    }
+    if (FLAGS_include_lirs) {
+      lirses.push_back(new Lirs(base_size * .25));
+    }
+    if (FLAGS_include_s3fifo) {
+      s3fifos.push_back(new S3Fifo(base_size * .25));
+    }
+    if (FLAGS_include_2q) {
+      two_queues.push_back(new TwoQueue(base_size * .25));
+    }
+    if (FLAGS_include_slru) {
+      slrus.push_back(new Slru(base_size * .25));
+      slrus.push_back(new Slru(base_size * .25, 4));
+    }
+    if (FLAGS_include_lfu) {
+      lfus.push_back(new Lfu(base_size * .25));
+      lfus.push_back(new Lfu(base_size * .25, true));
+    }
+    if (FLAGS_include_lru2) {
+      lru2s.push_back(new Lru2(base_size * .25));
+    }
+    if (FLAGS_include_adapt_size) {
+      as_arcs.push_back(new AsArc(base_size * .25));
+      as_farcs.push_back(new AsFarc(base_size * .25, base_size * .25 * 4));
+      as_lrus.push_back(new AsLru(base_size * .25));
+    }
+    if (FLAGS_include_sampled) {
+      lhds.push_back(new Lhd(base_size * .25));
+      hyperbolics.push_back(new HyperbolicCache(base_size * .25));
+      gdsfs.push_back(new Gdsf(base_size * .25));
+      sampled_lrus.push_back(new SampledLru(base_size * .25));
+    }
   } else {
     const vector<double> cache_sizes{.05, .1, .5, 1.0};
     const vector<double> ghost_sizes{.5, 1.0, 2.0, 3.0};
     for (double sz : cache_sizes) {
       arcs.push_back(new AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer>(
           base_size * sz));
+      if (FLAGS_include_unified) {
+        unified_arcs.push_back(new UnifiedArc(base_size * sz));
+      }
       if (FLAGS_include_lru) {
         lrus.push_back(
             new LRUCache<RefCountKey, int64_t, NopLock, TraceSizer>(base_size * sz));
       }
+      if (FLAGS_include_clock_pro) {
+        clock_pros.push_back(
+            new ClockProCache<RefCountKey, int64_t, NopLock, TraceSizer>(
+                base_size * sz));
+      }
+      if (FLAGS_include_car) {
+        cars.push_back(new Car(base_size * sz));
+      }
+      if (FLAGS_include_lirs) {
+        lirses.push_back(new Lirs(base_size * sz));
+      }
+      if (FLAGS_include_s3fifo) {
+        s3fifos.push_back(new S3Fifo(base_size * sz));
+      }
+      if (FLAGS_include_2q) {
+        two_queues.push_back(new TwoQueue(base_size * sz));
+      }
+      if (FLAGS_include_slru) {
+        slrus.push_back(new Slru(base_size * sz));
+        slrus.push_back(new Slru(base_size * sz, 4));
+      }
+      if (FLAGS_include_lfu) {
+        lfus.push_back(new Lfu(base_size * sz));
+        lfus.push_back(new Lfu(base_size * sz, true));
+      }
+      if (FLAGS_include_lru2) {
+        lru2s.push_back(new Lru2(base_size * sz));
+      }
+      if (FLAGS_include_adapt_size) {
+        as_arcs.push_back(new AsArc(base_size * sz));
+        as_farcs.push_back(new AsFarc(base_size * sz, base_size * sz * 4));
+        as_lrus.push_back(new AsLru(base_size * sz));
+      }
+      if (FLAGS_include_sampled) {
+        lhds.push_back(new Lhd(base_size * sz));
+        hyperbolics.push_back(new HyperbolicCache(base_size * sz));
+        gdsfs.push_back(new Gdsf(base_size * sz));
+        sampled_lrus.push_back(new SampledLru(base_size * sz));
+      }
+      if (FLAGS_include_wtinylfu) {
+        wtinylfus.push_back(new WTinyLfu(base_size * sz, keys * sz));
+      }
       for (double gs : ghost_sizes) {
         farcs.push_back(new FlexARC<RefCountKey, int64_t, NopLock, TraceSizer>(
             base_size * sz, base_size * sz * gs));
@@ -216,12 +596,25 @@ int main(int argc, char** argv) {
     }
   }
 
+  if (FLAGS_include_flat) {
+    flat_arcs.push_back(new FlatArc(base_size * .25));
+    flat_lrus.push_back(new FlatLru(base_size * .25));
+    if (FLAGS_include_unified) {
+      flat_unified_arcs.push_back(new FlatUnifiedArc(base_size * .25));
+    }
+  }
+
   if (FLAGS_include_tiered) {
-    TieredArc* tiered = new TieredArc();
-    tiered->add_cache(
-        10, make_shared<AdaptiveCache<RefCountKey, int64_t, NopLock, TraceSizer>>(
-                base_size * .25));
-    tiered_caches.push_back(tiered);
+    // Tiers for values up to 4K, up to 128K and larger, each with a third.
+    for (bool rebalance : {false, true}) {
+      TieredArc* tiered = new TieredArc(rebalance);
+      int64_t third = base_size * .25 / 3;
+      tiered->add_cache(4096, make_shared<TierArc>(third));
+      tiered->add_cache(128 << 10, make_shared<TierArc>(third));
+      tiered->add_cache(std::numeric_limits<int64_t>::max(),
+                        make_shared<TierArc>(base_size * .25 - 2 * third));
+      tiered_caches.push_back(tiered);
+    }
   }
 
   Test(&results, base_size, FLAGS_iters);
@@ -234,5 +627,31 @@ int main(int argc, char** argv) {
   del(lrus);
   del(farcs);
   del(tiered_caches);
+  del(clock_pros);
+  del(flat_lrus);
+  del(flat_arcs);
+  del(unified_arcs);
+  del(flat_unified_arcs);
+  del(sharded_arcs);
+  del(shared_p_arcs);
+  del(sized_arcs);
+  del(sized_farcs);
+  del(tinylfu_arcs);
+  del(tinylfu_farcs);
+  del(wtinylfus);
+  del(cars);
+  del(lirses);
+  del(s3fifos);
+  del(two_queues);
+  del(slrus);
+  del(lfus);
+  del(lru2s);
+  del(as_arcs);
+  del(as_farcs);
+  del(as_lrus);
+  del(lhds);
+  del(hyperbolics);
+  del(gdsfs);
+  del(sampled_lrus);
   return 0;
 }
@@ -0,0 +1,537 @@
+#include "cache/arc.h"
+#include "cache/buffered-cache.h"
+#include "cache/concurrent-index.h"
+#include "cache/flat-index.h"
+#include "cache/flex-arc.h"
+#include "cache/lru.h"
+#include "cache/pinned.h"
+#include "cache/s3-fifo.h"
+#include "cache/sharded-arc.h"
+#include "cache/sharded-cache.h"
+#include "cache/unified-arc.h"
+#include "util/lock.h"
+#include "util/table-printer.h"
+#include "util/trace-gen.h"
+
+#include "gflags/gflags.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+
+/**
+ * Multi-threaded throughput. Every thread replays the same zipf trace from its
+ * own offset, calling get() and add_to_cache() on a miss. Throughput is the total
+ * number of operations over wall clock time.
+ *
+ * shared_ptr vs Pinned values, Mops/sec. This was measured on a single core,
+ * so the 32-thread runs are time sliced and measure lock handoff cost, not
+ * scaling. Runs vary by about 20%, and by more than that between sessions:
+ * the tables with sharded caches below are the average of two runs from one
+ * later session, after shards were picked by the top bits of the hash.
+ *
+ * Pinned saves 16 bytes per entry: 84 vs 100 bytes for an int64_t LRU. get()
+ * still does one atomic increment with either handle, so throughput does not
+ * change meaningfully:
+ *
+ * cache       threads  shared_ptr  pinned
+ * ---------------------------------------
+ * lru               1        3.63    3.99
+ * lru              32        3.15    2.97
+ * s16-lru           1        2.73    3.68
+ * s16-lru          32        2.62    2.80
+ * arc               1        1.97    2.51
+ * arc              32        1.65    1.72
+ * s16-arc           1        1.86    1.43
+ * s16-arc          32        1.22    1.12
+ *
+ * The batch sweep replays the trace through multi_get() and multi_add(),
+ * Mops/sec by batch size, same machine and noise. Batches take the lock once
+ * and, with FlatIndex, prefetch the index slots of a batch before probing it,
+ * which is worth about 50% to ARC at 16 keys. NodeIndex can only prefetch the
+ * first node of each bucket, and getting at it loads the bucket itself, so it
+ * gains less.
+ * Shards used to be picked by the same hash bits FlatIndex homes keys by, so
+ * each shard's index homed into only 1/16 of its slots and probed long runs;
+ * with that fixed s16-arc-flat trails arc-flat by about 15% single threaded
+ * rather than a third:
+ *
+ * cache         threads     1     4    16    64
+ * ---------------------------------------------
+ * lru-flat            1  4.04  4.55  4.12  4.69
+ * lru-flat           32  3.37  3.47  3.51  3.31
+ * arc-flat            1  2.41  3.50  3.84  2.86
+ * arc-flat           32  2.09  2.78  2.54  2.37
+ * s16-arc-flat        1  2.07  2.20  2.48  2.45
+ * s16-arc-flat       32  1.50  1.81  1.78  2.03
+ *
+ * The read heavy runs use a cache of 60% of the keys, about 93% hits once
+ * warm (the 1 thread runs are mostly warm up). With ConcurrentIndex (-epoch)
+ * LRU hits and ARC T2 hits take no lock. On one core this only shows as
+ * cheaper hits once warm, the lock is never contended across cores; the 1
+ * thread runs pay for EpochGuards during warm up:
+ *
+ * cache          threads  Mops/sec  hit %
+ * ---------------------------------------
+ * rh-lru               1      3.77     75
+ * rh-lru              64      2.28     92
+ * rh-lru-epoch         1      3.33     75
+ * rh-lru-epoch        64      2.73     94
+ * rh-arc               1      3.08     75
+ * rh-arc              64      1.65     92
+ * rh-arc-epoch         1      1.90     75
+ * rh-arc-epoch        64      1.80     95
+ * rh-s16-arc          64      1.49     94
+ *
+ * The buf- runs wrap the policy in BufferedCache: gets take no lock and hits
+ * are replayed into the policy in batches of 32, inserts go through a write
+ * buffer. That removes the lock from the hot path on many cores, but on one
+ * core it is pure overhead (a key copy per hit and a second lookup on replay),
+ * so here it trails the locked policies:
+ *
+ * cache     threads  Mops/sec  hit %
+ * ----------------------------------
+ * arc             1      2.73     71
+ * arc            32      1.82     77
+ * buf-arc         1      1.98     71
+ * buf-arc        32      1.06     78
+ * farc            1      2.75     71
+ * farc           32      1.32     76
+ * buf-farc        1      2.09     71
+ * buf-farc       32      1.13     78
+ *
+ * UnifiedARC locked as a whole, and 16 shards with a p per shard or with one
+ * p shared by all shards (ShardedARC), average of four runs. On this trace p
+ * barely matters, so hit rates agree, see bench-cache for traces where the
+ * shared p pays off:
+ *
+ * cache              threads  Mops/sec  hit %
+ * -------------------------------------------
+ * uarc                     1      3.33     71
+ * uarc                    32      2.05     77
+ * s16-uarc                 1      2.18     71
+ * s16-uarc                32      1.82     78
+ * s16-uarc-shared-p        1      2.44     71
+ * s16-uarc-shared-p       32      1.82     78
+ *
+ * S3-FIFO locked as a whole, with ConcurrentIndex (-epoch, hits take no lock)
+ * and in a BufferedCache (buf-, inserts go through its lock-free ring too).
+ * Locked S3-FIFO is the fastest policy here: a hit bumps a counter instead of
+ * relinking, and it hits as often as ARC. The lock-free variants pay for
+ * EpochGuards and atomics that only pay back when threads contend across
+ * cores, which one core can not show:
+ *
+ * cache           threads  Mops/sec  hit %
+ * ----------------------------------------
+ * arc                   1      2.44     71
+ * arc                   8      1.82     76
+ * arc                  64      0.98     77
+ * farc                  1      2.82     71
+ * farc                  8      1.75     75
+ * farc                 64      1.53     76
+ * s3fifo                1      3.31     71
+ * s3fifo                8      2.55     77
+ * s3fifo               64      2.20     79
+ * s3fifo-epoch          1      3.26     71
+ * s3fifo-epoch          8      1.38     77
+ * s3fifo-epoch         64      1.59     80
+ * buf-s3fifo            1      2.26     71
+ * buf-s3fifo            8      1.44     77
+ * buf-s3fifo           64      1.25     79
+ * rh-arc-epoch         64      2.17     95
+ * rh-s3fifo-epoch      64      2.62     95
+ *
+ * With --scrape one more thread calls stats() back to back, mean ns per call,
+ * before and after composite caches published their parts' stats into a
+ * StatsAggregate, average of two runs. Sharded stats() used to take every
+ * shard lock in turn and waited behind the workers; now it reads the stripes
+ * without locks, at the same cost with any number of threads. BufferedCache
+ * used to copy the policy's stats under its lock, cheap while it was free but
+ * holding up drains; the stripes cost more to read but never block. Scraping
+ * back to back on one core takes a share of it from the workers, so Mops/sec
+ * under --scrape mean little; without it they did not change beyond noise:
+ *
+ * cache     threads  before  after
+ * --------------------------------
+ * s16-lru         1    1142    305
+ * s16-lru         8    6073    339
+ * s16-lru        32   53510    347
+ * s16-arc         1    3231    298
+ * s16-arc         8   13670    342
+ * s16-arc        32   39315    386
+ * buf-arc         1      81    345
+ * buf-arc         8     243    424
+ * buf-arc        32     921    599
+ *
+ * These were measured with a stripe per thread; each part now has its own
+ * stripe, so s16 caches read 16 and BufferedCache one.
+ */
+
+DEFINE_string(threads, "1,2,4,8,16,32,64", "Comma separated thread counts.");
+DEFINE_int64(unique_keys, 100000, "Number of unique keys in the trace.");
+DEFINE_int64(trace_length, 1000000, "Number of requests in the trace.");
+DEFINE_double(zipf, 0.9, "Zipf parameter of the trace.");
+DEFINE_int64(ops_per_thread, 200000, "Number of operations per thread.");
+DEFINE_double(cache_size, .25, "Cache size as a fraction of unique keys.");
+DEFINE_string(batch_sizes, "1,4,16,64",
+              "Comma separated batch sizes for multi_get/multi_add.");
+DEFINE_string(batch_threads, "1,32", "Thread counts for the batch sweep.");
+DEFINE_string(read_heavy_threads, "1,64",
+              "Thread counts for the read heavy runs.");
+DEFINE_double(read_heavy_cache_size, .6,
+              "Cache size of the read heavy runs, as a fraction of unique "
+              "keys. The default gives about 90% hits.");
+DEFINE_bool(scrape, false,
+            "Call stats() back to back from one more thread during each run "
+            "and report its mean latency. Only sharded and buffered caches "
+            "may be read while others change them.");
+
+using namespace std;
+using namespace cache;
+
+typedef AdaptiveCache<string, int64_t, WordLock> LockedArc;
+typedef LRUCache<string, int64_t, WordLock> LockedLru;
+typedef ShardedCache<string, int64_t, AdaptiveCache<string, int64_t>, 16>
+    ShardedArc;
+typedef ShardedCache<string, int64_t, LRUCache<string, int64_t>, 16>
+    ShardedLru;
+
+// Open addressing indexes, where batches can prefetch index slots.
+typedef LRUCache<string, int64_t, WordLock, ElementCount<int64_t>, FlatIndex>
+    FlatLockedLru;
+typedef AdaptiveCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                      FlatIndex>
+    FlatLockedArc;
+typedef ShardedCache<string, int64_t,
+                     AdaptiveCache<string, int64_t, NopLock,
+                                   ElementCount<int64_t>, FlatIndex>,
+                     16>
+    FlatShardedArc;
+
+// Lookups without the lock, see ConcurrentIndex.
+typedef LRUCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                 ConcurrentIndex>
+    ConcurrentLru;
+typedef AdaptiveCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                      ConcurrentIndex>
+    ConcurrentArc;
+
+// Policy updates buffered and applied in batches, see BufferedCache.
+typedef FlexARC<string, int64_t, WordLock> LockedFarc;
+typedef BufferedCache<string, int64_t,
+                      AdaptiveCache<string, int64_t, NopLock,
+                                    ElementCount<int64_t>, ConcurrentIndex>>
+    BufferedArc;
+typedef BufferedCache<string, int64_t,
+                      FlexARC<string, int64_t, NopLock, ElementCount<int64_t>,
+                              ConcurrentIndex>>
+    BufferedFarc;
+
+// Sharded ARC with a p per shard vs one p shared by all shards.
+typedef UnifiedARC<string, int64_t, WordLock> LockedUnifiedArc;
+typedef ShardedCache<string, int64_t, UnifiedARC<string, int64_t>, 16>
+    ShardedUnifiedArc;
+typedef ShardedARC<string, int64_t, 16> SharedPArc;
+
+// S3-FIFO hits only bump a counter, so with ConcurrentIndex they take no lock.
+// Wrapped in BufferedCache its inserts go through a lock-free ring too.
+typedef S3FIFOCache<string, int64_t, WordLock> LockedS3Fifo;
+typedef S3FIFOCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                    ConcurrentIndex>
+    ConcurrentS3Fifo;
+typedef BufferedCache<string, int64_t,
+                      S3FIFOCache<string, int64_t, NopLock,
+                                  ElementCount<int64_t>, ConcurrentIndex>>
+    BufferedS3Fifo;
+
+// Same caches holding Pinned values rather than shared_ptrs.
+typedef Pinned<int64_t> PinnedInt;
+typedef AdaptiveCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                      NodeIndex, KeyGhost<string>, PinnedInt>
+    PinnedLockedArc;
+typedef LRUCache<string, int64_t, WordLock, ElementCount<int64_t>, NodeIndex,
+                 PinnedInt>
+    PinnedLockedLru;
+typedef ShardedCache<string, int64_t,
+                     AdaptiveCache<string, int64_t, NopLock,
+                                   ElementCount<int64_t>, NodeIndex,
+                                   KeyGhost<string>, PinnedInt>,
+                     16>
+    PinnedShardedArc;
+typedef ShardedCache<string, int64_t,
+                     LRUCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                              NodeIndex, PinnedInt>,
+                     16>
+    PinnedShardedLru;
+
+template <typename Ptr> Ptr MakeValue(int64_t v);
+
+template <> shared_ptr<int64_t> MakeValue(int64_t v) {
+  return make_shared<int64_t>(v);
+}
+
+template <> PinnedInt MakeValue(int64_t v) { return make_pinned<int64_t>(v); }
+
+// Ops/sec with one thread, per cache, to report scaling.
+map<string, double> single_thread_ops;
+
+// Replays ops requests of trace from idx with get() and add_to_cache().
+template <class Cache>
+void ReplaySingle(Cache* cache, const vector<Request>& trace, size_t idx,
+                  int64_t ops) {
+  for (int64_t i = 0; i < ops; ++i) {
+    const Request& r = trace[idx];
+    if (++idx == trace.size()) {
+      idx = 0;
+    }
+    if (!cache->get(r.key)) {
+      cache->add_to_cache(r.key,
+                          MakeValue<typename Cache::ValuePtr>(r.value));
+    }
+  }
+}
+
+// As ReplaySingle, but batch requests at a time: one multi_get() for the
+// batch, then one multi_add() for its misses.
+template <class Cache>
+void ReplayBatched(Cache* cache, const vector<Request>& trace, size_t idx,
+                   int64_t ops, size_t batch) {
+  typedef typename Cache::ValuePtr Ptr;
+  vector<string> keys(batch);
+  vector<int64_t> requested(batch);
+  vector<Ptr> values(batch);
+  vector<string> miss_keys;
+  vector<Ptr> miss_values;
+  for (int64_t i = 0; i < ops; i += batch) {
+    size_t n = min<int64_t>(batch, ops - i);
+    for (size_t j = 0; j < n; ++j) {
+      keys[j] = trace[idx].key;
+      requested[j] = trace[idx].value;
+      if (++idx == trace.size()) {
+        idx = 0;
+      }
+    }
+    cache->multi_get(keys.data(), n, values.data());
+    miss_keys.clear();
+    miss_values.clear();
+    for (size_t j = 0; j < n; ++j) {
+      if (!values[j]) {
+        miss_keys.push_back(keys[j]);
+        miss_values.push_back(MakeValue<Ptr>(requested[j]));
+      }
+    }
+    cache->multi_add(miss_keys.data(), miss_keys.size(), miss_values.data());
+  }
+}
+
+// batch == 0 uses the single key API.
+template <class Cache>
+void RunThreads(TablePrinter* results, const string& label, Cache* cache,
+                const vector<Request>& trace, int threads, size_t batch = 0) {
+  cerr << "Testing " << label << " with " << threads << " threads";
+  if (batch > 0) {
+    cerr << ", batch " << batch;
+  }
+  cerr << endl;
+  cache->clear();
+
+  atomic<bool> start{false};
+  atomic<bool> done{false};
+  int64_t scrapes = 0;
+  double scrape_secs = 0;
+  thread scraper;
+  if (FLAGS_scrape) {
+    scraper = thread([&]() {
+      while (!start.load()) {
+        this_thread::yield();
+      }
+      chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+      while (!done.load()) {
+        cache->stats();
+        ++scrapes;
+      }
+      chrono::steady_clock::time_point end = chrono::steady_clock::now();
+      scrape_secs = chrono::duration<double>(end - begin).count();
+    });
+  }
+  vector<thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    workers.emplace_back([&, t]() {
+      size_t idx = trace.size() / threads * t;
+      while (!start.load()) {
+        this_thread::yield();
+      }
+      if (batch > 0) {
+        ReplayBatched(cache, trace, idx, FLAGS_ops_per_thread, batch);
+      } else {
+        ReplaySingle(cache, trace, idx, FLAGS_ops_per_thread);
+      }
+    });
+  }
+
+  chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+  start = true;
+  for (thread& w : workers) {
+    w.join();
+  }
+  chrono::steady_clock::time_point end = chrono::steady_clock::now();
+  if (FLAGS_scrape) {
+    done = true;
+    scraper.join();
+  }
+  double secs = chrono::duration_cast<chrono::microseconds>(end - begin).count() /
+                1000000.0;
+  double ops = threads * FLAGS_ops_per_thread / secs;
+  const string key = label + "/" + to_string(batch);
+  if (threads == 1) {
+    single_thread_ops[key] = ops;
+  }
+
+  const Stats& stats = cache->stats();
+  int64_t total = max(stats.num_hits + stats.num_misses, (int64_t)1);
+  vector<string> row;
+  row.push_back(label);
+  row.push_back(to_string(threads));
+  row.push_back(batch > 0 ? to_string(batch) : "-");
+  row.push_back(to_string(ops / 1000000));
+  if (single_thread_ops.count(key) > 0) {
+    row.push_back(to_string(ops / single_thread_ops[key]));
+  } else {
+    row.push_back("-");
+  }
+  row.push_back(to_string(stats.num_hits * 100 / total));
+  if (FLAGS_scrape) {
+    row.push_back(to_string(scrape_secs * 1e9 / max(scrapes, (int64_t)1)));
+  }
+  results->AddRow(row);
+}
+
+template <class Cache>
+void RunAll(TablePrinter* results, const string& label, Cache* cache,
+            const vector<Request>& trace, const vector<int>& threads) {
+  for (int t : threads) {
+    RunThreads(results, label, cache, trace, t);
+  }
+  results->AddEmptyRow();
+}
+
+// Runs every batch size at every thread count.
+template <class Cache>
+void RunBatches(TablePrinter* results, const string& label, Cache* cache,
+                const vector<Request>& trace, const vector<int>& threads,
+                const vector<int>& batches) {
+  for (int b : batches) {
+    for (int t : threads) {
+      RunThreads(results, label, cache, trace, t, b);
+    }
+  }
+  results->AddEmptyRow();
+}
+
+vector<int> ParseInts(const string& s) {
+  vector<int> ints;
+  stringstream ss(s);
+  string t;
+  while (getline(ss, t, ',')) {
+    ints.push_back(stoi(t));
+  }
+  return ints;
+}
+
+int main(int argc, char** argv) {
+  gflags::SetUsageMessage("Multi-threaded cache throughput");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  TablePrinter results;
+  results.AddColumn("cache", true);
+  results.AddColumn("threads", false);
+  results.AddColumn("batch", false);
+  results.AddColumn("Mops/sec", false);
+  results.AddColumn("scaling", false);
+  results.AddColumn("hit %", false);
+  if (FLAGS_scrape) {
+    results.AddColumn("stats ns", false);
+  }
+
+  vector<Request> trace = TraceGen::ZipfianDistribution(
+      42, FLAGS_trace_length, FLAGS_unique_keys, FLAGS_zipf, 1);
+  const int64_t size = FLAGS_unique_keys * FLAGS_cache_size;
+  const vector<int> threads = ParseInts(FLAGS_threads);
+  const vector<int> batch_threads = ParseInts(FLAGS_batch_threads);
+  const vector<int> batches = ParseInts(FLAGS_batch_sizes);
+
+  LockedLru lru(size);
+  LockedArc arc(size);
+  ShardedLru sharded_lru(size);
+  ShardedArc sharded_arc(size);
+  PinnedLockedLru pinned_lru(size);
+  PinnedLockedArc pinned_arc(size);
+  PinnedShardedLru pinned_sharded_lru(size);
+  PinnedShardedArc pinned_sharded_arc(size);
+  FlatLockedLru flat_lru(size);
+  FlatLockedArc flat_arc(size);
+  FlatShardedArc flat_sharded_arc(size);
+
+  RunAll(&results, "lru", &lru, trace, threads);
+  RunAll(&results, "lru-pinned", &pinned_lru, trace, threads);
+  RunAll(&results, "s16-lru", &sharded_lru, trace, threads);
+  RunAll(&results, "s16-lru-pinned", &pinned_sharded_lru, trace, threads);
+  RunAll(&results, "arc", &arc, trace, threads);
+  RunAll(&results, "arc-pinned", &pinned_arc, trace, threads);
+  RunAll(&results, "s16-arc", &sharded_arc, trace, threads);
+  RunAll(&results, "s16-arc-pinned", &pinned_sharded_arc, trace, threads);
+
+  LockedFarc farc(size, size * 4);
+  BufferedArc buffered_arc(size);
+  BufferedFarc buffered_farc(size, size * 4);
+  RunAll(&results, "buf-arc", &buffered_arc, trace, threads);
+  RunAll(&results, "farc", &farc, trace, threads);
+  RunAll(&results, "buf-farc", &buffered_farc, trace, threads);
+
+  LockedUnifiedArc unified_arc(size);
+  ShardedUnifiedArc sharded_unified_arc(size);
+  SharedPArc shared_p_arc(size);
+  RunAll(&results, "uarc", &unified_arc, trace, threads);
+  RunAll(&results, "s16-uarc", &sharded_unified_arc, trace, threads);
+  RunAll(&results, "s16-uarc-shared-p", &shared_p_arc, trace, threads);
+
+  LockedS3Fifo s3fifo(size);
+  ConcurrentS3Fifo concurrent_s3fifo(size);
+  BufferedS3Fifo buffered_s3fifo(size);
+  RunAll(&results, "s3fifo", &s3fifo, trace, threads);
+  RunAll(&results, "s3fifo-epoch", &concurrent_s3fifo, trace, threads);
+  RunAll(&results, "buf-s3fifo", &buffered_s3fifo, trace, threads);
+
+  // Read heavy: a larger cache, so most gets hit and take no lock with
+  // ConcurrentIndex.
+  const int64_t rh_size = FLAGS_unique_keys * FLAGS_read_heavy_cache_size;
+  const vector<int> rh_threads = ParseInts(FLAGS_read_heavy_threads);
+  LockedLru rh_lru(rh_size);
+  ConcurrentLru rh_concurrent_lru(rh_size);
+  LockedArc rh_arc(rh_size);
+  ConcurrentArc rh_concurrent_arc(rh_size);
+  ShardedArc rh_sharded_arc(rh_size);
+  ConcurrentS3Fifo rh_concurrent_s3fifo(rh_size);
+  RunAll(&results, "rh-lru", &rh_lru, trace, rh_threads);
+  RunAll(&results, "rh-lru-epoch", &rh_concurrent_lru, trace, rh_threads);
+  RunAll(&results, "rh-arc", &rh_arc, trace, rh_threads);
+  RunAll(&results, "rh-arc-epoch", &rh_concurrent_arc, trace, rh_threads);
+  RunAll(&results, "rh-s16-arc", &rh_sharded_arc, trace, rh_threads);
+  RunAll(&results, "rh-s3fifo-epoch", &rh_concurrent_s3fifo, trace,
+         rh_threads);
+
+  RunBatches(&results, "lru", &lru, trace, batch_threads, batches);
+  RunBatches(&results, "lru-flat", &flat_lru, trace, batch_threads, batches);
+  RunBatches(&results, "arc", &arc, trace, batch_threads, batches);
+  RunBatches(&results, "arc-flat", &flat_arc, trace, batch_threads, batches);
+  RunBatches(&results, "s16-arc", &sharded_arc, trace, batch_threads,
+             batches);
+  RunBatches(&results, "s16-arc-flat", &flat_sharded_arc, trace,
+             batch_threads, batches);
+
+  printf("%s\n", results.ToString().c_str());
+  return 0;
+}
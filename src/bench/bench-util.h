@@ -3,9 +3,12 @@
 #include <chrono>
 #include <iostream>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 #include "cache/cache.h"
 #include "cache/flex-arc.h"
+#include "util/alloc-counter.h"
 #include "util/table-printer.h"
 #include "util/trace-gen.h"
 
@@ -53,10 +56,33 @@ inline int64_t ParseMemSpec(const std::string& mem_spec_str) {
   return bytes;
 }
 
+// The key of r that Run() looks up as Key. A std::string_view views the
+// request's external copy of the key, so the cache is probed without building
+// a std::string.
+template <class Key> inline decltype(auto) LookupKey(const Request& r) {
+  if constexpr (std::is_same<Key, std::string_view>::value) {
+    return r.key_view();
+  } else {
+    return r.get_key<Key>();
+  }
+}
+
+// The key of r that Run() inserts as Key, a std::string copy for a view.
+template <class Key> inline decltype(auto) InsertKey(const Request& r) {
+  if constexpr (std::is_same<Key, std::string_view>::value) {
+    return std::string(r.key_view());
+  } else {
+    return r.get_key<Key>();
+  }
+}
+
+// If live_bytes_base is set, the cache footprint at the end of the run is
+// reported relative to it. Pass AllocCounter::live_bytes() from before the
+// cache was constructed.
 template <class Key, class Cache>
 inline void Run(TablePrinter* results, int64_t n, const std::string& name,
                 Trace* trace, Cache* cache, CacheType type, int iters,
-                std::string label = "") {
+                std::string label = "", int64_t live_bytes_base = -1) {
   if (label.empty()) {
     label = cache->label(n);
   }
@@ -66,6 +92,11 @@ inline void Run(TablePrinter* results, int64_t n, const std::string& name,
 
   int64_t total_vals = 0;
   double total_micros = 0;
+  // Heap allocations made inside the cache calls, values are allocated before
+  // the call so they are not counted.
+  int64_t total_allocs = 0;
+  // Requested bytes, with TraceSizer the value is the size of the object.
+  int64_t total_bytes = 0;
   for (int i = 0; i < iters; ++i) {
     trace->Reset();
     cache->reset();
@@ -75,13 +106,19 @@ inline void Run(TablePrinter* results, int64_t n, const std::string& name,
       if (r == nullptr) {
         break;
       }
-      std::shared_ptr<int64_t> val = cache->get(r->get_key<Key>());
+      int64_t allocs = AllocCounter::num_allocs();
+      std::shared_ptr<int64_t> val = cache->get(LookupKey<Key>(*r));
+      total_allocs += AllocCounter::num_allocs() - allocs;
       ++total_vals;
+      total_bytes += r->value;
       if (total_vals % 2500000 == 0) {
         std::cerr << "   ...tested " << total_vals << " values" << std::endl;
       }
       if (!val) {
-        cache->add_to_cache(r->get_key<Key>(), std::make_shared<int64_t>(r->value));
+        std::shared_ptr<int64_t> v = std::make_shared<int64_t>(r->value);
+        allocs = AllocCounter::num_allocs();
+        cache->add_to_cache(InsertKey<Key>(*r), std::move(v));
+        total_allocs += AllocCounter::num_allocs() - allocs;
       }
     }
     std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now();
@@ -89,6 +126,7 @@ inline void Run(TablePrinter* results, int64_t n, const std::string& name,
         std::chrono::duration_cast<std::chrono::microseconds>(end - start).count();
   }
   std::cerr << "    Completed in  " << total_micros / 1000 << " ms" << std::endl;
+  int64_t live_bytes = AllocCounter::live_bytes() - live_bytes_base;
 
   Stats stats = cache->stats();
   int64_t total = std::max(stats.num_hits + stats.num_misses, (int64_t)1);
@@ -106,6 +144,8 @@ inline void Run(TablePrinter* results, int64_t n, const std::string& name,
     row.push_back(std::to_string(cache->max_p()));
   }
   row.push_back(std::to_string(stats.num_hits * 100 / total));
+  row.push_back(std::to_string(stats.bytes_hit * 100 /
+                               std::max(total_bytes, (int64_t)1)));
   if (type == CacheType::Lru) {
     row.push_back("-");
     row.push_back("-");
@@ -137,6 +177,12 @@ inline void Run(TablePrinter* results, int64_t n, const std::string& name,
     row.push_back("-");
   }
   row.push_back(std::to_string(total_micros / total_vals));
+  row.push_back(std::to_string((double)total_allocs / total_vals));
+  if (live_bytes_base >= 0) {
+    row.push_back(std::to_string(live_bytes / 1024));
+  } else {
+    row.push_back("-");
+  }
 
   results->AddRow(row);
 }
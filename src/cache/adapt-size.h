@@ -0,0 +1,346 @@
+#pragma once
+
+/*
+ * Implements a cache wrapper that admits values with a probability falling
+ * with their size, tuned online from a model of recent requests.
+ *
+ * Berger, Sitaraman and Harchol-Balter. "AdaptSize: Orchestrating the Hot
+ * Object Memory Cache in a Content Delivery Network". NSDI 2017.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "cache/cache.h"
+
+namespace cache {
+
+// Wraps a cache C, e.g. AdaptiveCache, FlexARC or LRUCache, so that a value
+// is only added with probability exp(-size / c). Small values nearly always
+// get in, values much larger than c nearly never, so one large object seen
+// once does not evict dozens of small ones that are hit again.
+//
+// c is tuned about every interval() requests, where a request is a hit or an
+// add_to_cache(). The wrapper counts the requests for a sample of the keys,
+// picked by hash, and their sizes, decayed by kDecay every interval. It
+// samples half as many keys whenever it counts more than kModelKeys, and
+// estimates the requests of all keys from those of the sample. It models the
+// cache as in the paper:
+// with request rate r and admission probability a, a key is cached with
+// probability a (e^(rT) - 1) / (1 + a (e^(rT) - 1)), where the characteristic
+// time T is such that the expected bytes cached fill the cache. c is set to
+// the power of 2, or infinity, that maximizes the expected object hit ratio,
+// the largest on a tie. The model looks at the sampled keys against their
+// share of the cache. Until the first tuning everything is admitted.
+//
+// C must use the same Sizer, and its own lock protects it. Lock protects the
+// wrapper's counts, and is only taken for requests to sampled keys. The
+// request that ends an interval copies the counts under it, then tunes c
+// after releasing it, so other requests do not wait for the tuning.
+//
+// Values turned away are counted in stats().arc_filter, and one turned away
+// for a key already cached removes the old value. C must have peek().
+template <typename K, typename V, typename C, typename Sizer = TraceSizer,
+          typename Lock = NopLock>
+class AdaptSizeCache : public Cache<K, V> {
+public:
+  using ValuePtr = typename C::ValuePtr;
+  using SizerType = Sizer;
+
+  // Constructs the wrapped cache with args.
+  template <typename... Args>
+  explicit AdaptSizeCache(Args... args) : _cache(args...) {}
+
+  inline int64_t max_size() const { return _cache.max_size(); }
+  inline int64_t size() const { return _cache.size(); }
+  inline int64_t num_entries() const { return _cache.num_entries(); }
+  inline int64_t p() const { return _cache.p(); }
+  inline int64_t max_p() const { return _cache.max_p(); }
+  inline int64_t filter_size() const { return _cache.filter_size(); }
+
+  // The size admitted with probability 1/e, infinite until the first tuning
+  // and when everything is admitted.
+  inline double c() const { return _c.load(std::memory_order_relaxed); }
+  inline int64_t interval() const { return _interval; }
+  // Requests between tunings, kInterval by default.
+  void set_interval(int64_t requests) {
+    std::lock_guard<Lock> l(_lock);
+    _interval = std::max(requests, int64_t(1));
+  }
+
+  // The wrapped cache's stats, with the values turned away as arc_filter.
+  Stats stats() {
+    Stats s = _cache.stats();
+    s.arc_filter += _rejected.load(std::memory_order_relaxed);
+    return s;
+  }
+
+  const std::string label(int64_t n) const { return "as-" + _cache.label(n); }
+
+  ValuePtr get(const K& key) {
+    ValuePtr value = _cache.get(key);
+    if (value) {
+      record(std::hash<K>{}(key), _sizer(value.get()));
+    }
+    return value;
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  ValuePtr get(const Q& key) {
+    ValuePtr value = _cache.get(key);
+    if (value) {
+      record(std::hash<Q>{}(key), _sizer(value.get()));
+    }
+    return value;
+  }
+
+  void add_to_cache(const K& key, ValuePtr value) {
+    int64_t sz = _sizer(value.get());
+    record(std::hash<K>{}(key), sz);
+    bool admit = admits(sz);
+    if (!admit) {
+      _rejected.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (admit) {
+      _cache.add_to_cache(key, std::move(value));
+    } else if (_cache.peek(key)) {
+      // Only a cached value is removed: removing a key the cache does not
+      // hold would drop its ghost entries, which ARC still adapts on.
+      _cache.remove_from_cache(key);
+    }
+  }
+
+  ValuePtr remove_from_cache(const K& key) {
+    return _cache.remove_from_cache(key);
+  }
+
+  // Empties the cache and forgets the model.
+  void reset() {
+    _cache.reset();
+    std::lock_guard<Lock> l(_lock);
+    _keys.clear();
+    _requests = 0;
+    _weight = 0;
+    _shift.store(0, std::memory_order_relaxed);
+    _c.store(std::numeric_limits<double>::infinity(),
+             std::memory_order_relaxed);
+  }
+
+  void clear() {
+    _cache.clear();
+    _rejected.store(0, std::memory_order_relaxed);
+    reset();
+  }
+
+  AdaptSizeCache() = delete;
+  AdaptSizeCache(const AdaptSizeCache&) = delete;
+  AdaptSizeCache operator=(const AdaptSizeCache&) = delete;
+
+private:
+  // Requests for a key, decayed, and its last size.
+  struct KeyStats {
+    double requests = 0;
+    int64_t size = 0;
+  };
+
+  static constexpr int64_t kInterval = 1 << 14;
+  // Share of the counts kept from one interval to the next.
+  static constexpr double kDecay = 0.5;
+  // Keys whose decayed count falls below this are forgotten.
+  static constexpr double kMinRequests = 0.1;
+  // Keys counted before the sample halves.
+  static constexpr int64_t kModelKeys = 1 << 10;
+  // Steps of the bisection on log2(T).
+  static constexpr int kSteps = 24;
+
+  C _cache;
+  Lock _lock;
+  Sizer _sizer;
+  int64_t _interval = kInterval;
+  // Counts of the sampled keys, by mixed hash.
+  std::unordered_map<uint64_t, KeyStats> _keys;
+  // Requests since the last tuning, estimated from the sampled ones, and sum
+  // of the decayed counts.
+  int64_t _requests = 0;
+  double _weight = 0;
+  // Whether a request is tuning c outside the lock.
+  bool _tuning = false;
+  // One in 2^shift keys is sampled. Read without the lock.
+  std::atomic<int> _shift{0};
+  std::atomic<double> _c{std::numeric_limits<double>::infinity()};
+  std::atomic<int64_t> _rejected{0};
+
+  static inline uint64_t mix(size_t hash) {
+    return hash * 0x9E3779B97F4A7C15ull;
+  }
+
+  // Whether the key with mixed hash m is in the sample, which only drops keys
+  // as shift grows.
+  static inline bool sampled(uint64_t m, int shift) {
+    return shift == 0 || (m >> (64 - shift)) == 0;
+  }
+
+  // Counts a request for the key with hash. Returns at once for keys not
+  // sampled, and the request that ends an interval tunes c.
+  inline void record(size_t hash, int64_t size) {
+    uint64_t m = mix(hash);
+    if (!sampled(m, _shift.load(std::memory_order_relaxed))) {
+      return;
+    }
+    Model model;
+    {
+      std::lock_guard<Lock> l(_lock);
+      int shift = _shift.load(std::memory_order_relaxed);
+      if (!sampled(m, shift)) {
+        return;
+      }
+      KeyStats& s = _keys[m];
+      s.requests += 1;
+      s.size = size;
+      _weight += 1;
+      _requests += int64_t(1) << shift;
+      if (_keys.size() > kModelKeys) {
+        halve_sample();
+      }
+      if (_requests < _interval || _tuning) {
+        return;
+      }
+      snapshot(&model);
+      _tuning = true;
+    }
+    _c.store(tune(model), std::memory_order_relaxed);
+    std::lock_guard<Lock> l(_lock);
+    _tuning = false;
+  }
+
+  inline bool admits(int64_t size) {
+    double c = _c.load(std::memory_order_relaxed);
+    if (std::isinf(c)) {
+      return true;
+    }
+    // xorshift64*, uniform in [0, 1).
+    static thread_local uint64_t rng = 0x9e3779b97f4a7c15ull;
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+    double u = (rng * 0x2545f4914f6cdd1dull >> 11) * 0x1.0p-53;
+    return u < std::exp(-size / c);
+  }
+
+  // Lock taken. Drops the keys no longer sampled with one more bit of shift.
+  void halve_sample() {
+    int shift = _shift.load(std::memory_order_relaxed) + 1;
+    _shift.store(shift, std::memory_order_relaxed);
+    for (auto it = _keys.begin(); it != _keys.end();) {
+      if (sampled(it->first, shift)) {
+        ++it;
+      } else {
+        _weight -= it->second.requests;
+        it = _keys.erase(it);
+      }
+    }
+  }
+
+  // Expected hit ratio and bytes cached of the keys in model, with rates
+  // r = requests / weight, admission parameter c and characteristic time T,
+  // against capacity bytes.
+  struct Model {
+    std::vector<KeyStats> keys;
+    double weight = 0;
+    double capacity = 0;
+
+    inline double bytes(double c, double t) const {
+      double b = 0;
+      for (const KeyStats& k : keys) {
+        b += k.size * in_cache(k, c, t);
+      }
+      return b;
+    }
+
+    inline double hit_ratio(double c, double t) const {
+      double hits = 0;
+      double requests = 0;
+      for (const KeyStats& k : keys) {
+        hits += k.requests * in_cache(k, c, t);
+        requests += k.requests;
+      }
+      return requests > 0 ? hits / requests : 0;
+    }
+
+    // a (e^(rT) - 1) / (1 + a (e^(rT) - 1)), as a (1 - x) / (x + a (1 - x))
+    // with x = e^(-rT) so that it does not overflow.
+    inline double in_cache(const KeyStats& k, double c, double t) const {
+      double a = std::exp(-k.size / c);
+      double x = std::exp(-k.requests / weight * t);
+      double d = x + a * (1 - x);
+      return d > 0 ? a * (1 - x) / d : 0;
+    }
+  };
+
+  // Lock taken. Copies the counts so far into model, then decays them.
+  void snapshot(Model* model) {
+    model->weight = _weight;
+    model->capacity = std::ldexp((double)max_size(),
+                                 -_shift.load(std::memory_order_relaxed));
+    model->keys.reserve(_keys.size());
+    _weight = 0;
+    for (auto it = _keys.begin(); it != _keys.end();) {
+      model->keys.push_back(it->second);
+      it->second.requests *= kDecay;
+      if (it->second.requests < kMinRequests) {
+        it = _keys.erase(it);
+      } else {
+        _weight += it->second.requests;
+        ++it;
+      }
+    }
+    _requests = 0;
+  }
+
+  // Returns the c that maximizes the expected hit ratio of model.
+  static double tune(const Model& model) {
+    int64_t max_key = 1;
+    for (const KeyStats& k : model.keys) {
+      max_key = std::max(max_key, k.size);
+    }
+    double capacity = model.capacity;
+
+    // From admitting everything down, so that when the cache holds everything
+    // whatever c, nothing is turned away.
+    double best = -1;
+    double best_c = std::numeric_limits<double>::infinity();
+    double c = best_c;
+    double next = std::exp2(std::ceil(std::log2(4.0 * max_key)));
+    for (; c >= 1; c = next, next /= 2) {
+      // Bytes cached grow with T, bisect on log2(T) for the T that fills the
+      // cache. If nothing does, every key is as cached as it gets.
+      double lo = 0;
+      double hi = 64;
+      for (int n = 0; n < kSteps; ++n) {
+        double mid = (lo + hi) / 2;
+        if (model.bytes(c, std::exp2(mid)) < capacity) {
+          lo = mid;
+        } else {
+          hi = mid;
+        }
+      }
+      double ratio = model.hit_ratio(c, std::exp2(lo));
+      if (ratio > best) {
+        best = ratio;
+        best_c = c;
+      }
+    }
+    return best_c;
+  }
+};
+
+} // namespace cache
@@ -9,16 +9,43 @@
 #include <iostream>
 #include <memory>
 #include <mutex>
+#include <type_traits>
 
 #include "cache/cache.h"
+#include "cache/ghost.h"
 #include "cache/lru.h"
+#include "cache/mpsc-ring.h"
+#include "cache/tiny-lfu.h"
+#include "util/striped-counter.h"
 
 namespace cache {
 
+// With Index = ConcurrentIndex hits in the frequency list (T2) take no lock,
+// they only mark the entry referenced, see LRUCache. Hits in T1 move the entry
+// to T2 and misses update the ghosts, so both still take Lock.
+//
+// The ghost lists hold max_size entries and p adapts by entry counts. With a
+// byte counting Sizer, Ghost = SizedGhost<K, Index> makes them hold max_size
+// bytes and p adapt by the bytes of the keys hit instead, as does the filter.
+//
+// Filter is the admission filter used when filter_size > 0, a ghost list of
+// keys seen once by default or a TinyLFU<K> of filter_size keys. TinyLFU is
+// not thread safe, so T2 hits taken without the lock queue their key's hash
+// and whoever next takes the lock counts them. If the queue is full the hit
+// counts itself when the lock is free and is dropped otherwise.
 template <typename K, typename V, typename Lock = NopLock,
-          typename Sizer = ElementCount<V>>
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ghost = KeyGhost<K, Index>,
+          typename Ptr = std::shared_ptr<V>, typename Filter = Ghost>
 class AdaptiveCache : public Cache<K, V> {
 public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  static constexpr bool kConcurrentReads =
+      LRUCache<K, V, NopLock, Sizer, Index, Ptr>::kConcurrentReads;
+
   AdaptiveCache(int64_t size, int64_t filter_size = 0)
       : _max_size{size}, _lru_cache{size}, _lfu_cache{size}, _lru_ghost{size},
         _lfu_ghost{size}, _filter(filter_size) {}
@@ -28,7 +55,16 @@ public:
   inline int64_t num_entries() const {
     return _lru_cache.num_entries() + _lfu_cache.num_entries();
   }
-  const Stats& stats() const { return _stats; }
+  Stats stats() const {
+    Stats s = _stats;
+    if constexpr (kConcurrentReads) {
+      int64_t hits = _read_stats.hits.sum();
+      s.num_hits += hits;
+      s.lfu_hits += hits;
+      s.bytes_hit += _read_stats.bytes_hit.sum();
+    }
+    return s;
+  }
   inline int64_t p() const { return _p; }
   inline int64_t max_p() const { return _max_p; }
   inline int64_t filter_size() const { return _filter.max_size(); }
@@ -36,7 +72,9 @@ public:
   void enable_trace(bool v) { _trace = v; }
 
   const std::string label(int64_t n) const {
-    if (filter_size() > 0) {
+    if (filter_size() > 0 && kIsTinyLFU<Filter>) {
+      return "arc-" + std::to_string(max_size() * 100 / n) + "-tinylfu";
+    } else if (filter_size() > 0) {
       return "arc-" + std::to_string(max_size() * 100 / n) + "-filter";
     } else {
       return "arc-" + std::to_string(max_size() * 100 / n);
@@ -45,8 +83,318 @@ public:
 
   // Add an item to the cache. The difference here is we try to use existing
   // information to decide if the item was previously cached.
-  void add_to_cache(const K& key, std::shared_ptr<V> value) {
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    add_impl(key, std::move(value));
+  }
+
+  // Adds keys[0, n) with values[0, n) under one lock acquisition, as if by n
+  // calls to add_to_cache(). Each batch of keys is hashed and prefetched in
+  // both caches before any of them is added.
+  template <typename KeyArray, typename ValueArray>
+  void multi_add(KeyArray keys, size_t n, ValueArray values) {
+    std::lock_guard<Lock> l(_lock);
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        prefetch(_lru_cache.hash(keys[b + i]));
+      }
+      for (size_t i = 0; i < m; ++i) {
+        add_impl(keys[b + i], values[b + i]);
+      }
+    }
+  }
+
+  // Update a cached element if it exists, do nothing otherwise. Boolean returns
+  // whether or not value was updated.
+  bool update_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    debug_trace("update_cache");
+
+    if (_lru_cache.contains(key)) {
+      // Given it was already in the LRU cache, we need to add it
+      // to the lfu cache and call it a day.
+      // No evict is safe here since we are removing from LRU moving
+      // to LFU.
+      _lru_cache.remove_from_cache(key);
+      _lfu_cache.add_to_cache_no_evict(key, value);
+      return true;
+    } else {
+      return _lfu_cache.update_cache(key, value);
+    }
+  }
+
+  // Get an item from the cache. This is one half of what the ARC paper does.
+  Ptr get(const K& key) { return lookup(key); }
+
+  // As get(key) for a KeyView<K>, e.g. a std::string_view. The key is only
+  // copied if the lookup moves it from T1 to T2.
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    return lookup(key);
+  }
+
+  // Gets keys[0, n) into values[0, n) under one lock acquisition, as if by n
+  // calls to get(). Each batch of keys is hashed once and prefetched in both
+  // caches before any of them is probed. KeyArray and ValueArray are pointers
+  // or anything else indexable with [].
+  template <typename KeyArray, typename ValueArray>
+  void multi_get(KeyArray keys, size_t n, ValueArray values) {
+    if constexpr (kConcurrentReads) {
+      multi_get_concurrent(keys, n, values);
+      return;
+    }
+    std::lock_guard<Lock> l(_lock);
+    size_t hashes[kPrefetchBatch];
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        hashes[i] = _lfu_cache.hash(keys[b + i]);
+        prefetch(hashes[i]);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        values[b + i] = get_impl(keys[b + i], hashes[i]);
+      }
+    }
+  }
+
+  // Returns the value for key without counting the lookup or updating the
+  // lists. With a concurrent index this takes no lock, but may miss a key
+  // that is moving from T1 to T2 at the same time.
+  Ptr peek(const K& key) {
+    if constexpr (kConcurrentReads) {
+      return peek_impl(key);
+    } else {
+      std::lock_guard<Lock> l(_lock);
+      return peek_impl(key);
+    }
+  }
+
+  // Moves key as a hit on it would, without counting the lookup. Does nothing
+  // if key is not cached, in particular it does not look at the ghosts.
+  void touch(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    record(key);
+    if (_lfu_cache.contains(key)) {
+      return;
+    }
+    Ptr value = _lru_cache.remove_from_cache(key);
+    if (value) {
+      _lfu_cache.add_to_cache_no_evict(key, std::move(value));
+    }
+  }
+
+  // Calls fn(key) for every cached key, those in T1 then those in T2.
+  template <typename Fn> void for_each_key(Fn fn) {
+    std::lock_guard<Lock> l(_lock);
+    _lru_cache.for_each_key(fn);
+    _lfu_cache.for_each_key(fn);
+  }
+
+  // Remove key from the cache.
+  Ptr remove_from_cache(const K& key) { return remove_key(key); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr remove_from_cache(const Q& key) {
+    return remove_key(key);
+  }
+
+  // Set the maximum cache size, evicting until the cache fits.
+  void set_max_size(int64_t size) {
+    std::lock_guard<Lock> l(_lock);
+    debug_trace("set_max_size");
+    if (_p > size) {
+      // p must be between 0 and _max_size, but what this is telling us is
+      // that we should be dedicating all of the cache space to LRU. So let us
+      // just do that.
+      // NOTE[apanda]: There is an argument to be made for proportional
+      // reduction but I am not sure it makes sense, so might need to revisit.
+      _p = size;
+    }
+    _max_size = size;
+    _lru_ghost.set_max_size(size);
+    _lfu_ghost.set_max_size(size);
+    fit(false);
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    debug_trace("reset");
+
+    _lru_cache.clear();
+    _lfu_cache.clear();
+    _lru_ghost.clear();
+    _lfu_ghost.clear();
+    record_queued();
+    _filter.clear();
+    _p = 0;
+    _op_id = 0;
+  }
+
+  void clear() {
+    _stats.clear();
+    if constexpr (kConcurrentReads) {
+      _read_stats.hits.clear();
+      _read_stats.bytes_hit.clear();
+    }
+    reset();
+  }
+
+  AdaptiveCache() = delete;
+  AdaptiveCache(const AdaptiveCache&) = delete;
+  AdaptiveCache operator=(const AdaptiveCache&) = delete;
+
+protected:
+  // Prefetches the index slots of hash in both caches.
+  inline void prefetch(size_t hash) const {
+    _lfu_cache.prefetch(hash);
+    _lru_cache.prefetch(hash);
+  }
+
+  // T1 first: entries only move from T1 to T2.
+  inline Ptr peek_impl(const K& key) {
+    size_t hash = _lru_cache.hash(key);
+    Ptr value = _lru_cache.peek(key, hash);
+    return value ? value : _lfu_cache.peek(key, hash);
+  }
+
+  // get() for K and KeyView<K>.
+  template <typename Q> inline Ptr lookup(const Q& key) {
+    size_t hash = _lfu_cache.hash(key);
+    if constexpr (kConcurrentReads) {
+      Ptr value = get_lock_free(key, hash);
+      if (value) {
+        return value;
+      }
+    }
     std::lock_guard<Lock> l(_lock);
+    return get_impl(key, hash);
+  }
+
+  // Lock not taken. T2 hits are counted in _read_stats.
+  template <typename Q> inline Ptr get_lock_free(const Q& key, size_t hash) {
+    Ptr value = _lfu_cache.get(key, hash);
+    if (value) {
+      _read_stats.hits.add(1);
+      _read_stats.bytes_hit.add(_sizer(value.get()));
+      if constexpr (kIsTinyLFU<Filter>) {
+        record_lock_free(Filter::hash(key));
+      }
+    }
+    return value;
+  }
+
+  // Lock not taken. Queues a T2 hit for the filter, or counts it now if the
+  // queue is full and the lock is free.
+  inline void record_lock_free(uint64_t filter_hash) {
+    if (_read_stats.filter_hashes.push(filter_hash)) {
+      return;
+    }
+    std::unique_lock<Lock> l(_lock, std::try_to_lock);
+    if (l.owns_lock()) {
+      record_queued();
+      _filter.record_hash(filter_hash);
+    }
+  }
+
+  // Lock taken. Counts a lookup of key in the filter, after the queued ones.
+  template <typename Q> inline void record(const Q& key) {
+    if constexpr (kIsTinyLFU<Filter>) {
+      record_queued();
+      _filter.record(key);
+    }
+  }
+
+  // Lock taken. Counts the T2 hits queued by get_lock_free().
+  inline void record_queued() {
+    if constexpr (kConcurrentReads && kIsTinyLFU<Filter>) {
+      uint64_t h;
+      while (_read_stats.filter_hashes.pop(h)) {
+        _filter.record_hash(h);
+      }
+    }
+  }
+
+  // As multi_get(), T2 hits without the lock then one lock acquisition per
+  // kPrefetchBatch keys for the rest.
+  template <typename KeyArray, typename ValueArray>
+  void multi_get_concurrent(KeyArray keys, size_t n, ValueArray values) {
+    size_t hashes[kPrefetchBatch];
+    size_t rest[kPrefetchBatch];
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        hashes[i] = _lfu_cache.hash(keys[b + i]);
+        prefetch(hashes[i]);
+      }
+      size_t r = 0;
+      for (size_t i = 0; i < m; ++i) {
+        values[b + i] = get_lock_free(keys[b + i], hashes[i]);
+        if (!values[b + i]) {
+          rest[r++] = i;
+        }
+      }
+      if (r > 0) {
+        std::lock_guard<Lock> l(_lock);
+        for (size_t j = 0; j < r; ++j) {
+          size_t i = rest[j];
+          values[b + i] = get_impl(keys[b + i], hashes[i]);
+        }
+      }
+    }
+  }
+
+  template <typename Q> inline Ptr remove_key(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    debug_trace("remove_from_cache");
+
+    // Semantics make this safe.
+    auto value = _lru_cache.remove_from_cache(key);
+    if (value) {
+      return value;
+    } else if ((value = _lfu_cache.remove_from_cache(key))) {
+      return value;
+    }
+    _lru_ghost.remove(key);
+    _lfu_ghost.remove(key);
+    return value;
+  }
+
+  // Lock taken. Both caches share Index, so one hash serves both.
+  template <typename Q> inline Ptr get_impl(const Q& key, size_t hash) {
+    debug_trace("get");
+    record(key);
+
+    Ptr lfu_value = _lfu_cache.get(key, hash);
+    if (lfu_value) {
+      ++_stats.num_hits;
+      _stats.bytes_hit += _sizer(lfu_value.get());
+      ++_stats.lfu_hits;
+      assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
+      return lfu_value;
+    }
+
+    Ptr lru_value = _lru_cache.remove_from_cache(key, hash);
+    if (lru_value) {
+      _lfu_cache.add_to_cache_no_evict(to_key<K>(key), lru_value);
+      ++_stats.num_hits;
+      _stats.bytes_hit += _sizer(lru_value.get());
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.num_misses;
+      // Access ghosts.
+      bool lru_ghost = _lru_ghost.contains(key);
+      bool lfu_ghost = _lfu_ghost.contains(key);
+      _stats.lfu_ghost_hits += (int64_t)lfu_ghost;
+      _stats.lru_ghost_hits += (int64_t)lru_ghost;
+      assert((!(lru_ghost || lfu_ghost)) || (lru_ghost ^ lfu_ghost));
+    }
+    assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
+    return lru_value;
+  }
+
+  // Lock taken
+  inline void add_impl(const K& key, Ptr value) {
     debug_trace("add");
 
     // Simple cases where it is in the LRU or LFU cache
@@ -72,48 +420,49 @@ public:
     bool lfu_ghost_hit = _lfu_ghost.contains(key);
 
     // Filter should only kick in for entries evicted far enough in the past.
-    if (!(lfu_ghost_hit || lru_ghost_hit) && _filter.max_size() > 0) {
-      // Add a "double-hit" pre filter. This is intended to prevent single scan
-      // keys from invalidating the cache.
-      if (!_filter.contains(key)) {
-        ++_stats.arc_filter;
-        _filter.add_to_cache(key, nullptr);
-        return;
-      }
+    if (!(lfu_ghost_hit || lru_ghost_hit) && _filter.max_size() > 0 &&
+        !admit(key, value)) {
+      ++_stats.arc_filter;
+      return;
     }
 
     if (lru_ghost_hit) {
       // We used to have this key, we recently evicted it, let us make this
       // a frequent key. Case II in Figure 4.
-      adapt_lru_ghost_hit();
-      // Make space.
-      replace(false);
+      adapt_lru_ghost_hit(_sizer(value.get()));
+      // Make space, unless there is room, e.g. after set_max_size() grew the
+      // cache.
+      if (size() + _sizer(value.get()) > _max_size) {
+        replace(false);
+      }
       // Add to LFU cache
       _lfu_cache.add_to_cache_no_evict(key, value);
-      _lru_ghost.remove_from_cache(key);
+      _lru_ghost.remove(key);
       fit(false);
     } else if (lfu_ghost_hit) {
       // Case III
-      adapt_lfu_ghost_hit();
+      adapt_lfu_ghost_hit(_sizer(value.get()));
       // Make space.
-      replace(true);
+      if (size() + _sizer(value.get()) > _max_size) {
+        replace(true);
+      }
       _lfu_cache.add_to_cache_no_evict(key, value);
-      _lfu_ghost.remove_from_cache(key);
+      _lfu_ghost.remove(key);
       fit(true);
     } else {
       // Case IV
       int64_t lru_size = _lru_cache.size() + _lru_ghost.size();
       int64_t total_size = _lfu_cache.size() + _lfu_ghost.size() + lru_size;
-      if (lru_size == _max_size) {
+      if (reaches(lru_size, _max_size)) {
         if (_lru_cache.size() < _max_size) {
           // IV(a)
-          _lru_ghost.evict_entry();
+          _lru_ghost.evict();
           replace(false);
         } else {
           size_t value_size = 0;
           auto key = _lru_cache.evict_entry(value_size); // Make space.
           if (key) {
-            _lru_ghost.add_to_cache(*key, nullptr);
+            _lru_ghost.add(*key, value_size);
             _stats.lru_evicts++;
             _stats.num_evicted++;
             _stats.bytes_evicted += value_size;
@@ -121,8 +470,8 @@ public:
         }
       } else if (lru_size < _max_size && total_size >= _max_size) {
         // IV(b)
-        if (total_size == 2 * _max_size) {
-          _lfu_ghost.evict_entry();
+        if (reaches(total_size, 2 * _max_size)) {
+          _lfu_ghost.evict();
         }
         replace(false);
       }
@@ -136,136 +485,57 @@ public:
     assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
   }
 
-  // Update a cached element if it exists, do nothing otherwise. Boolean returns
-  // whether or not value was updated.
-  bool update_cache(const K& key, std::shared_ptr<V> value) {
-    std::lock_guard<Lock> l(_lock);
-    debug_trace("update_cache");
-
-    if (_lru_cache.contains(key)) {
-      // Given it was already in the LRU cache, we need to add it
-      // to the lfu cache and call it a day.
-      // No evict is safe here since we are removing from LRU moving
-      // to LFU.
-      _lru_cache.remove_from_cache(key);
-      _lfu_cache.add_to_cache_no_evict(key, value);
-      return true;
-    } else {
-      return _lfu_cache.update_cache(key, value);
-    }
-  }
-
-  // Get an item from the cache. This is one half of what the ARC paper does.
-  std::shared_ptr<V> get(const K& key) {
-    std::lock_guard<Lock> l(_lock);
-    debug_trace("get");
-
-    std::shared_ptr<V> lfu_value = _lfu_cache.get(key);
-    if (lfu_value) {
-      ++_stats.num_hits;
-      _stats.bytes_hit += _sizer(lfu_value.get());
-      ++_stats.lfu_hits;
-      assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
-      return lfu_value;
-    }
-
-    std::shared_ptr<V> lru_value = _lru_cache.remove_from_cache(key);
-    if (lru_value) {
-      _lfu_cache.add_to_cache_no_evict(key, lru_value);
-      ++_stats.num_hits;
-      _stats.bytes_hit += _sizer(lru_value.get());
-      ++_stats.lru_hits;
-    } else {
-      ++_stats.num_misses;
-      // Access ghosts.
-      bool lru_ghost = _lru_ghost.contains(key);
-      bool lfu_ghost = _lfu_ghost.contains(key);
-      _stats.lfu_ghost_hits += (int64_t)lfu_ghost;
-      _stats.lfu_ghost_hits += (int64_t)lru_ghost;
-      assert((!(lru_ghost || lfu_ghost)) || (lru_ghost ^ lfu_ghost));
-    }
-    assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
-    return lru_value;
-  }
-
-  // Remove key from the cache.
-  std::shared_ptr<V> remove_from_cache(const K& key) {
-    std::lock_guard<Lock> l(_lock);
-    debug_trace("remove_from_cache");
-
-    // Semantics make this safe.
-    auto value = _lru_cache.remove_from_cache(key);
-    if (value) {
-      return value;
-    } else if ((value = _lfu_cache.remove_from_cache(key))) {
-      return value;
-    }
-    _lru_ghost.remove_from_cache(key);
-    _lfu_ghost.remove_from_cache(key);
-    return value;
-  }
-
-  // Set the maximum cache size.
-  void set_max_size(int64_t size) {
-    std::lock_guard<Lock> l(_lock);
-    debug_trace("remove_from_cache");
-    if (size < _max_size) {
-      if (_p > size) {
-        // p must be between 0 and _max_size, but what this is telling us is
-        // that we should be dedicating all of the cache space to LRU. So let us
-        // just do that.
-        // NOTE[apanda]: There is an argument to be made for proportional
-        // reduction but I am not sure it makes sense, so might need to revisit.
-        _p = size;
-        _max_size = size;
-        fit(false);
+  // Whether a key in none of the lists gets in. A ghost list filter is a
+  // "double-hit" pre filter, intended to prevent single scan keys from
+  // invalidating the cache: it admits keys it has seen and remembers the
+  // rest. TinyLFU admits any key while there is room, then only keys more
+  // frequent than the one replace(false) would evict.
+  inline bool admit(const K& key, const Ptr& value) {
+    if constexpr (kIsTinyLFU<Filter>) {
+      if (size() + _sizer(value.get()) <= _max_size) {
+        return true;
       }
+      record_queued();
+      const K* victim = _lru_cache.size() > _p || _lfu_cache.size() == 0
+                            ? _lru_cache.peek_tail_key()
+                            : _lfu_cache.peek_tail_key();
+      return victim == nullptr || _filter.admit(key, *victim);
     } else {
-      _max_size = size;
-      // Do not need to adjust anything.
+      if (_filter.contains(key)) {
+        return true;
+      }
+      _filter.add(key, _sizer(value.get()));
+      return false;
     }
   }
 
-  void reset() {
-    std::lock_guard<Lock> l(_lock);
-    debug_trace("reset");
-
-    _lru_cache.clear();
-    _lfu_cache.clear();
-    _lru_ghost.clear();
-    _lfu_ghost.clear();
-    _filter.clear();
-    _p = 0;
-    _op_id = 0;
-  }
-
-  void clear() {
-    _stats.clear();
-    reset();
+  // Whether lists of size add up to limit. Sized ghost lists rarely add up to
+  // it exactly, for them reaching it is enough.
+  static inline bool reaches(int64_t size, int64_t limit) {
+    return Ghost::kSized ? size >= limit : size == limit;
   }
 
-  AdaptiveCache() = delete;
-  AdaptiveCache(const AdaptiveCache&) = delete;
-  AdaptiveCache operator=(const AdaptiveCache&) = delete;
-
-protected:
-  inline void adapt_lru_ghost_hit() {
+  // size is the size of the value coming back, p moves by entries or, with
+  // a sized Ghost, by bytes.
+  inline void adapt_lru_ghost_hit(int64_t size) {
+    int64_t unit = Ghost::kSized ? size : 1;
     int64_t delta = 0;
     if (_lru_ghost.size() >= _lfu_ghost.size()) {
-      delta = 1;
+      delta = unit;
     } else {
-      delta = _lfu_ghost.size() / _lru_ghost.size();
+      delta = unit * _lfu_ghost.size() / _lru_ghost.size();
     }
     _p = std::min(_p + delta, _max_size);
     _max_p = std::max(_max_p, _p);
   }
 
-  inline void adapt_lfu_ghost_hit() {
+  inline void adapt_lfu_ghost_hit(int64_t size) {
+    int64_t unit = Ghost::kSized ? size : 1;
     int64_t delta = 0;
     if (_lfu_ghost.size() >= _lru_ghost.size()) {
-      delta = 1;
+      delta = unit;
     } else {
-      delta = _lru_ghost.size() / _lfu_ghost.size();
+      delta = unit * _lru_ghost.size() / _lfu_ghost.size();
     }
     _p = std::max(_p - delta, int64_t(0));
     // Don't need to update _max_p here
@@ -277,7 +547,7 @@ protected:
                                   (_lru_cache.size() == _p && in_lfu_ghost))) {
       std::optional<K> evicted = _lru_cache.evict_entry(bytes_evicted);
       if (evicted) {
-        _lru_ghost.add_to_cache(*evicted, nullptr);
+        _lru_ghost.add(*evicted, bytes_evicted);
         ++_stats.lru_evicts;
         _stats.bytes_evicted += bytes_evicted;
       } else {
@@ -288,7 +558,7 @@ protected:
         std::optional<K> evicted = _lfu_cache.evict_entry(bytes_evicted);
         assert(evicted);
         _stats.bytes_evicted += bytes_evicted;
-        _lfu_ghost.add_to_cache(*evicted, nullptr);
+        _lfu_ghost.add(*evicted, bytes_evicted);
         ++_stats.lfu_evicts;
       } else {
         // OK this is a weird situation to be. In general we expect that each
@@ -298,7 +568,7 @@ protected:
           std::optional<K> evicted = _lru_cache.evict_entry(bytes_evicted);
           assert(evicted);
           _stats.bytes_evicted += bytes_evicted;
-          _lru_ghost.add_to_cache(*evicted, nullptr);
+          _lru_ghost.add(*evicted, bytes_evicted);
           ++_stats.lru_evicts;
         } else {
           assert(_lru_cache.size() + _lfu_cache.size() < _max_size);
@@ -330,14 +600,28 @@ private:
   int64_t _max_size;
   int64_t _p = 0;
   int64_t _max_p = 0;
-  LRUCache<K, V, NopLock, Sizer> _lru_cache;
-  LRUCache<K, V, NopLock, Sizer> _lfu_cache;
-  LRUCache<K, V, NopLock> _lru_ghost;
-  LRUCache<K, V, NopLock> _lfu_ghost;
-  LRUCache<K, V, NopLock> _filter;
+  LRUCache<K, V, NopLock, Sizer, Index, Ptr> _lru_cache;
+  LRUCache<K, V, NopLock, Sizer, Index, Ptr> _lfu_cache;
+  Ghost _lru_ghost;
+  Ghost _lfu_ghost;
+  Filter _filter;
   Sizer _sizer;
   Stats _stats;
 
+  // T2 hits taken without the lock, added to _stats by stats(). With a
+  // TinyLFU the hashes of their keys wait in filter_hashes to be counted.
+  struct NoFilterHashes {};
+  static constexpr size_t kFilterHashes = 256;
+  struct ReadStats {
+    StripedCounter hits;
+    StripedCounter bytes_hit;
+    std::conditional_t<kIsTinyLFU<Filter>, MpscRing<uint64_t, kFilterHashes>,
+                       NoFilterHashes>
+        filter_hashes;
+  };
+  struct NoReadStats {};
+  std::conditional_t<kConcurrentReads, ReadStats, NoReadStats> _read_stats;
+
   int64_t _op_id = 0;
   bool _trace = false;
 };
@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+ * Implements a fixed size node arena, used to recycle cache nodes without
+ * going back to malloc.
+ */
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <vector>
+
+namespace cache {
+
+// Hands out blocks of a single size from large chunks. Freed blocks are kept on
+// an intrusive free list and handed out again, so once a cache has reached its
+// steady state size inserts and evictions do not allocate. Chunks are only
+// released when the arena is destroyed.
+//
+// The block size is fixed by the first call to serves().
+class NodeArena {
+public:
+  NodeArena() {}
+
+  ~NodeArena() {
+    for (void* chunk : _chunks) {
+      ::operator delete(chunk);
+    }
+  }
+
+  // Size the first chunk to hold n blocks, this should be called before the
+  // first allocation.
+  void reserve(int64_t n) { _next_chunk_blocks = std::max<int64_t>(n, 1); }
+
+  // Returns true if size byte allocations are served by this arena.
+  inline bool serves(size_t size) {
+    if (_block_size == 0) {
+      _block_size = round_up(std::max(size, sizeof(FreeBlock)));
+    }
+    return round_up(std::max(size, sizeof(FreeBlock))) == _block_size;
+  }
+
+  inline void* allocate() {
+    if (_free != nullptr) {
+      FreeBlock* block = _free;
+      _free = block->next;
+      return block;
+    }
+    if (_next == _end) {
+      add_chunk();
+    }
+    void* block = _next;
+    _next += _block_size;
+    return block;
+  }
+
+  inline void deallocate(void* p) {
+    FreeBlock* block = static_cast<FreeBlock*>(p);
+    block->next = _free;
+    _free = block;
+  }
+
+  inline int64_t num_chunks() const { return _chunks.size(); }
+
+  NodeArena(const NodeArena&) = delete;
+  NodeArena operator=(const NodeArena&) = delete;
+
+private:
+  static constexpr int64_t kMinChunkBlocks = 64;
+  static constexpr int64_t kMaxChunkBlocks = 4096;
+
+  struct FreeBlock {
+    FreeBlock* next;
+  };
+
+  size_t _block_size = 0;
+  int64_t _next_chunk_blocks = kMinChunkBlocks;
+  char* _next = nullptr;
+  char* _end = nullptr;
+  FreeBlock* _free = nullptr;
+  std::vector<void*> _chunks;
+
+  static inline size_t round_up(size_t size) {
+    const size_t align = alignof(std::max_align_t);
+    return (size + align - 1) & ~(align - 1);
+  }
+
+  void add_chunk() {
+    size_t bytes = _block_size * _next_chunk_blocks;
+    char* chunk = static_cast<char*>(::operator new(bytes));
+    _chunks.push_back(chunk);
+    _next = chunk;
+    _end = chunk + bytes;
+    // Later chunks grow geometrically, but not past kMaxChunkBlocks unless the
+    // reservation asked for more.
+    _next_chunk_blocks = std::max(
+        kMinChunkBlocks, std::min(_next_chunk_blocks * 2, kMaxChunkBlocks));
+  }
+};
+
+// STL allocator that serves single node allocations from a NodeArena, and
+// everything else (e.g. hash table bucket arrays) from the heap. All rebound
+// copies share the arena, which must outlive the container.
+template <typename T> class ArenaAllocator {
+public:
+  using value_type = T;
+
+  explicit ArenaAllocator(NodeArena* arena) : _arena(arena) {}
+
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U>& other) : _arena(other.arena()) {}
+
+  inline T* allocate(size_t n) {
+    if (n == 1 && from_arena()) {
+      return static_cast<T*>(_arena->allocate());
+    }
+    return static_cast<T*>(::operator new(n * sizeof(T)));
+  }
+
+  inline void deallocate(T* p, size_t n) {
+    if (n == 1 && from_arena()) {
+      _arena->deallocate(p);
+    } else {
+      ::operator delete(p);
+    }
+  }
+
+  NodeArena* arena() const { return _arena; }
+
+  template <typename U> bool operator==(const ArenaAllocator<U>& other) const {
+    return _arena == other.arena();
+  }
+
+  template <typename U> bool operator!=(const ArenaAllocator<U>& other) const {
+    return _arena != other.arena();
+  }
+
+private:
+  NodeArena* _arena;
+
+  inline bool from_arena() const {
+    return alignof(T) <= alignof(std::max_align_t) && _arena->serves(sizeof(T));
+  }
+};
+
+} // namespace cache
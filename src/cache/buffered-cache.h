@@ -0,0 +1,247 @@
+#pragma once
+
+/*
+ * Implements a cache wrapper that buffers policy updates so that the policy
+ * lock is taken once per batch of operations rather than once per operation.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+
+#include "cache/cache.h"
+#include "cache/mpsc-ring.h"
+#include "cache/stats-aggregate.h"
+#include "util/lock.h"
+#include "util/striped-counter.h"
+
+namespace cache {
+
+// Wraps a cache policy C so that lookups and inserts do not take the policy
+// lock one by one, after Caffeine. A get() looks the key up with C::peek(),
+// which must not need the lock (C instantiated with ConcurrentIndex and
+// NopLock), and records the hit in one of several per thread read buffers. An
+// add_to_cache() goes into a bounded write buffer. Whoever fills a buffer
+// drains both under try_lock(), replaying the hits through C::touch(), which
+// updates the policy as a hit would without counting it, and the inserts
+// through C::add_to_cache(); if the lock is busy its holder will get to them.
+// Values are sized by the policy's C::SizerType.
+//
+// Read buffers are lossy: a hit that finds its buffer full or in use by
+// another thread is dropped, which only costs the policy some recency
+// information. Writes are never dropped, a writer that finds the write buffer
+// full drains it under lock(). An inserted value is visible once drained.
+//
+// Inserts only add keys the policy does not hold when drained. Two threads
+// missing the same key, or a peek() missing a key moving from T1 to T2, both
+// buffer a write, and replaying the second through C::add_to_cache() would
+// count as a hit on the first and promote it. To replace a cached value,
+// remove_from_cache() it first.
+//
+// drain() may also be called periodically from a maintenance thread.
+template <typename K, typename V, typename C>
+class BufferedCache : public Cache<K, V> {
+  static_assert(C::kConcurrentReads,
+                "BufferedCache needs a policy with lock free peek(), e.g. one "
+                "using ConcurrentIndex");
+
+public:
+  using ValuePtr = typename C::ValuePtr;
+  using SizerType = typename C::SizerType;
+
+  template <typename... Args>
+  explicit BufferedCache(Args... args) : _cache(args...) {}
+
+  inline int64_t max_size() const { return _cache.max_size(); }
+  inline int64_t size() const { return _cache.size(); }
+  inline int64_t num_entries() const { return _cache.num_entries(); }
+  inline int64_t p() const { return _cache.p(); }
+  inline int64_t max_p() const { return _cache.max_p(); }
+  inline int64_t filter_size() const { return _cache.filter_size(); }
+
+  // The policy's stats as of the last drain, but for lookups: hits, misses
+  // and bytes hit are those seen by callers, and hits are not split into
+  // lru_hits and lfu_hits since replaying them counts nothing. Takes no lock,
+  // so scraping stats does not hold up draining.
+  Stats stats() const {
+    Stats s;
+    _published.read(&s);
+    s.num_hits = _hits.sum();
+    s.num_misses = _misses.sum();
+    s.bytes_hit = _bytes_hit.sum();
+    return s;
+  }
+
+  const std::string label(int64_t n) const { return "buf-" + _cache.label(n); }
+
+  ValuePtr get(const K& key) {
+    ValuePtr value = _cache.peek(key);
+    if (!value) {
+      _misses.add(1);
+      return value;
+    }
+    _hits.add(1);
+    _bytes_hit.add(_sizer(value.get()));
+    if (record(key)) {
+      try_drain();
+    }
+    return value;
+  }
+
+  void add_to_cache(const K& key, ValuePtr value) {
+    if (!_writes.push(Write{key, value})) {
+      std::lock_guard<WordLock> l(_lock);
+      drain_locked();
+      add_if_absent(key, std::move(value));
+      publish();
+      return;
+    }
+    try_drain();
+  }
+
+  // Batches gain nothing over single calls here: no call takes the lock.
+  template <typename KeyArray, typename ValueArray>
+  void multi_get(KeyArray keys, size_t n, ValueArray values) {
+    for (size_t i = 0; i < n; ++i) {
+      values[i] = get(keys[i]);
+    }
+  }
+
+  template <typename KeyArray, typename ValueArray>
+  void multi_add(KeyArray keys, size_t n, ValueArray values) {
+    for (size_t i = 0; i < n; ++i) {
+      add_to_cache(keys[i], values[i]);
+    }
+  }
+
+  ValuePtr remove_from_cache(const K& key) {
+    std::lock_guard<WordLock> l(_lock);
+    drain_locked();
+    ValuePtr value = _cache.remove_from_cache(key);
+    publish();
+    return value;
+  }
+
+  // Applies all buffered reads and writes to the policy.
+  void drain() {
+    std::lock_guard<WordLock> l(_lock);
+    drain_locked();
+  }
+
+  void reset() {
+    std::lock_guard<WordLock> l(_lock);
+    drain_locked();
+    _cache.reset();
+    publish();
+  }
+
+  void clear() {
+    std::lock_guard<WordLock> l(_lock);
+    drain_locked();
+    _cache.clear();
+    publish();
+    _hits.clear();
+    _misses.clear();
+    _bytes_hit.clear();
+  }
+
+  inline C* cache() { return &_cache; }
+
+  BufferedCache(const BufferedCache&) = delete;
+  BufferedCache operator=(const BufferedCache&) = delete;
+
+private:
+  static constexpr int kReadBuffers = 16;
+  static constexpr int kReadBufferSize = 32;
+  static constexpr size_t kWriteBufferSize = 128;
+
+  struct alignas(64) ReadBuffer {
+    // Held by the one thread appending to or draining the buffer.
+    std::atomic<bool> busy{false};
+    int count = 0;
+    K keys[kReadBufferSize];
+  };
+
+  struct Write {
+    K key;
+    ValuePtr value;
+  };
+
+  WordLock _lock;
+  C _cache;
+  std::array<ReadBuffer, kReadBuffers> _reads;
+  MpscRing<Write, kWriteBufferSize> _writes;
+  SizerType _sizer;
+  StripedCounter _hits;
+  StripedCounter _misses;
+  StripedCounter _bytes_hit;
+  // The policy's stats, published under _lock.
+  StatsAggregate _published;
+  Stats _last_published;
+
+  static inline int read_buffer() {
+    static std::atomic<int> next{0};
+    static thread_local int idx =
+        next.fetch_add(1, std::memory_order_relaxed) % kReadBuffers;
+    return idx;
+  }
+
+  // Records a hit on key, returns true if the buffer is now full.
+  inline bool record(const K& key) {
+    ReadBuffer& buffer = _reads[read_buffer()];
+    if (buffer.busy.exchange(true, std::memory_order_acquire)) {
+      return false;
+    }
+    bool full = buffer.count == kReadBufferSize;
+    if (!full) {
+      buffer.keys[buffer.count++] = key;
+      full = buffer.count == kReadBufferSize;
+    }
+    buffer.busy.store(false, std::memory_order_release);
+    return full;
+  }
+
+  inline void try_drain() {
+    if (_lock.try_lock()) {
+      drain_locked();
+      _lock.unlock();
+    }
+  }
+
+  // Lock taken. Reads first, so a key read and then written keeps the order.
+  void drain_locked() {
+    for (ReadBuffer& buffer : _reads) {
+      if (buffer.busy.exchange(true, std::memory_order_acquire)) {
+        continue;
+      }
+      for (int i = 0; i < buffer.count; ++i) {
+        _cache.touch(buffer.keys[i]);
+      }
+      buffer.count = 0;
+      buffer.busy.store(false, std::memory_order_release);
+    }
+    Write w;
+    while (_writes.pop(w)) {
+      add_if_absent(w.key, std::move(w.value));
+    }
+    publish();
+  }
+
+  // Lock taken, so no key is moving and peek() is exact.
+  inline void add_if_absent(const K& key, ValuePtr value) {
+    if (!_cache.peek(key)) {
+      _cache.add_to_cache(key, std::move(value));
+    }
+  }
+
+  // Lock taken.
+  inline void publish() {
+    _published.publish(0, _cache.stats(), &_last_published);
+  }
+};
+
+} // namespace cache
@@ -4,12 +4,48 @@
 #include <cstdint>
 #include <cstring>
 #include <string>
+#include <string_view>
+#include <type_traits>
 
 // Useful for variables only used in assertions.
 #define VARIABLE_UNUSED __attribute__((unused))
 
 namespace cache {
 
+// Batched operations (multi_get, multi_add) hash and prefetch this many keys
+// ahead of probing them, enough to overlap the misses without the prefetched
+// lines being evicted again before use.
+constexpr size_t kPrefetchBatch = 16;
+
+// The type a cache keyed by K also accepts for lookups, so a caller holding
+// the key's bytes elsewhere can probe without building a K: std::string_view
+// for std::string keys, none (void) otherwise. A view must hash equal with
+// std::hash and compare equal with == to the K it views. The K is only built
+// when the key is inserted.
+template <typename K> struct KeyView { using type = void; };
+template <> struct KeyView<std::string> { using type = std::string_view; };
+
+template <typename K, typename Q>
+constexpr bool kIsKeyView = std::is_same<typename KeyView<K>::type, Q>::value;
+
+// Enables the KeyView overloads of lookups, which sit next to those taking a
+// const K& so that arguments converting to K still pick the latter.
+template <typename K, typename Q>
+using EnableIfKeyView = std::enable_if_t<kIsKeyView<K, Q>>;
+
+// Index lookups are templated on the key type, K or its view.
+template <typename K, typename Q>
+constexpr bool kIsLookupKey = std::is_same<K, Q>::value || kIsKeyView<K, Q>;
+
+// Returns key as a K, which copies it only if it is a view.
+template <typename K, typename Q> inline decltype(auto) to_key(const Q& key) {
+  if constexpr (std::is_same<K, Q>::value) {
+    return (key);
+  } else {
+    return K(key);
+  }
+}
+
 struct Stats {
   int64_t num_hits = 0;
   int64_t num_misses = 0;
@@ -0,0 +1,294 @@
+#pragma once
+
+/*
+ * Implements a CAR (Clock with Adaptive Replacement) cache.
+ *
+ * Bansal and Modha. "CAR: Clock with Adaptive Replacement". FAST 2004.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "cache/cache.h"
+#include "cache/ghost.h"
+#include "cache/lru.h"
+
+namespace cache {
+
+// Entry of a CARCache, on the T1 or T2 clock.
+template <typename K, typename V, typename Ptr = std::shared_ptr<V>>
+struct CarLink {
+  K key;
+  Ptr value;
+  CarLink* prev;
+  CarLink* next;
+  // The clock the link is on, a CARCache::List.
+  uint8_t list;
+  // Set by hits, cleared when a hand passes the link.
+  bool referenced;
+
+  CarLink(K k, Ptr v)
+      : key{k}, value{std::move(v)}, prev{nullptr}, next{nullptr}, list{0},
+        referenced{false} {}
+  CarLink(const CarLink&) = delete;
+  CarLink operator=(const CarLink&) = delete;
+  CarLink(CarLink&&) = default;
+};
+
+// Same adaptation as AdaptiveCache: T1 holds keys seen once recently, T2 keys
+// seen at least twice, the ghost lists B1 and B2 remember keys evicted from
+// them, and p, the T1 size aimed for, grows on B1 hits and shrinks on B2 hits.
+// Unlike ARC, T1 and T2 are CLOCKs: a hit only sets the link's reference bit
+// and neither moves it nor copies the key, so hits in T1 and T2 cost the same.
+//
+// Each clock is a list whose tail is the hand. Making room looks at the hand
+// of T1 while T1 is at least p, of T2 otherwise. An unreferenced link there is
+// evicted to B1 or B2. A referenced one is cleared and goes to the head of T2,
+// so a T1 key seen again moves to T2 when the hand gets to it, not on the hit.
+// New keys enter T1, keys in B1 or B2 come back to T2.
+//
+// T1 and T2 share one index, as in UnifiedARC. The ghost lists hold max_size
+// entries and p adapts by entries, or by Sizer units with
+// Ghost = SizedGhost<K, Index>, see AdaptiveCache.
+//
+// Stats follow AdaptiveCache: T1 hits and evictions are lru_hits and
+// lru_evicts, T2 ones lfu_hits and lfu_evicts, and keys added back from B1 or
+// B2 lru_ghost_hits or lfu_ghost_hits.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ghost = KeyGhost<K, Index>,
+          typename Ptr = std::shared_ptr<V>>
+class CARCache : public Cache<K, V> {
+  using Link = CarLink<K, V, Ptr>;
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  explicit CARCache(int64_t size)
+      : _max_size{size}, _recent_ghost{size}, _frequent_ghost{size} {
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _sizes[kT1] + _sizes[kT2]; }
+  inline int64_t num_entries() const { return _index.size(); }
+  const Stats& stats() const { return _stats; }
+  inline int64_t p() const { return _p; }
+  inline int64_t max_p() const { return _max_p; }
+  inline int64_t filter_size() const { return 0; }
+  inline Lock* get_lock() { return &_lock; }
+
+  const std::string label(int64_t n) const {
+    return "car-" + std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache, setting its reference bit.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. Keys already cached take the new value and
+  // count as used.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    int64_t sz = _sizer(value.get());
+    Link* link = _index.find(key);
+    if (link) {
+      _sizes[link->list] += sz - _sizer(link->value.get());
+      link->value = std::move(value);
+      link->referenced = true;
+      fit(0);
+      return;
+    }
+
+    bool recent_ghost_hit = _recent_ghost.contains(key);
+    bool frequent_ghost_hit =
+        !recent_ghost_hit && _frequent_ghost.contains(key);
+    bool full = size() + sz > _max_size;
+    fit(sz);
+    if (recent_ghost_hit) {
+      ++_stats.lru_ghost_hits;
+      adapt_recent_ghost_hit(sz);
+      _recent_ghost.remove(key);
+    } else if (frequent_ghost_hit) {
+      ++_stats.lfu_ghost_hits;
+      adapt_frequent_ghost_hit(sz);
+      _frequent_ghost.remove(key);
+    } else if (full) {
+      // History replacement: keep T1 + B1 within the cache and all four lists
+      // within twice the cache.
+      int64_t recent = _sizes[kT1] + _recent_ghost.size();
+      if (reaches(recent, _max_size)) {
+        _recent_ghost.evict();
+      } else if (reaches(recent + _sizes[kT2] + _frequent_ghost.size(),
+                         2 * _max_size)) {
+        _frequent_ghost.evict();
+      }
+    }
+    List list = recent_ghost_hit || frequent_ghost_hit ? kT2 : kT1;
+    insert(_index.emplace(key, std::move(value)).first, list);
+    // Only a value larger than the cache is left over.
+    fit(0);
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      _recent_ghost.remove(key);
+      _frequent_ghost.remove(key);
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    _sizes[link->list] -= _sizer(value.get());
+    _clocks[link->list].remove(link);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    for (LRUList<K, V, Link>& clock : _clocks) {
+      clock.clear();
+    }
+    _index.clear();
+    _recent_ghost.clear();
+    _frequent_ghost.clear();
+    std::fill(std::begin(_sizes), std::end(_sizes), 0);
+    _p = 0;
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  CARCache() = delete;
+  CARCache(const CARCache&) = delete;
+  CARCache operator=(const CARCache&) = delete;
+
+private:
+  enum List : uint8_t { kT1, kT2 };
+
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  int64_t _p = 0;
+  int64_t _max_p = 0;
+  // Sizer units on T1 and T2.
+  int64_t _sizes[2] = {0, 0};
+  Index<K, Link> _index;
+  LRUList<K, V, Link> _clocks[2];
+  Ghost _recent_ghost;
+  Ghost _frequent_ghost;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    if (link->list == kT1) {
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.lfu_hits;
+    }
+    link->referenced = true;
+    return link->value;
+  }
+
+  inline void insert(Link* link, List list) {
+    link->list = list;
+    link->referenced = false;
+    _clocks[list].insert_head(link);
+    _sizes[list] += _sizer(link->value.get());
+  }
+
+  // Whether lists of size add up to limit, see AdaptiveCache.
+  static inline bool reaches(int64_t size, int64_t limit) {
+    return Ghost::kSized ? size >= limit : size == limit;
+  }
+
+  // size is the size of the value coming back, p moves by entries or, with
+  // a sized Ghost, by Sizer units.
+  inline void adapt_recent_ghost_hit(int64_t size) {
+    int64_t unit = Ghost::kSized ? size : 1;
+    int64_t delta = unit;
+    if (_recent_ghost.size() < _frequent_ghost.size()) {
+      delta = unit * _frequent_ghost.size() / _recent_ghost.size();
+    }
+    _p = std::min(_p + delta, _max_size);
+    _max_p = std::max(_max_p, _p);
+  }
+
+  inline void adapt_frequent_ghost_hit(int64_t size) {
+    int64_t unit = Ghost::kSized ? size : 1;
+    int64_t delta = unit;
+    if (_frequent_ghost.size() < _recent_ghost.size()) {
+      delta = unit * _recent_ghost.size() / _frequent_ghost.size();
+    }
+    _p = std::max(_p - delta, int64_t(0));
+  }
+
+  // Evicts until sz more fits.
+  inline void fit(int64_t sz) {
+    while (size() > 0 && size() + sz > _max_size) {
+      replace();
+    }
+  }
+
+  // Advances the hands until one evicts a link.
+  inline void replace() {
+    while (true) {
+      List list = kT2;
+      if (_sizes[kT1] >= std::max(_p, int64_t(1)) ||
+          _clocks[kT2].size() == 0) {
+        list = kT1;
+      }
+      Link* link = _clocks[list].remove_tail();
+      if (link->referenced) {
+        // T1 keys seen again move to T2, T2 keys go around again.
+        _sizes[list] -= _sizer(link->value.get());
+        insert(link, kT2);
+        continue;
+      }
+      int64_t sz = _sizer(link->value.get());
+      _sizes[list] -= sz;
+      if (list == kT1) {
+        _recent_ghost.add(link->key, sz);
+        ++_stats.lru_evicts;
+      } else {
+        _frequent_ghost.add(link->key, sz);
+        ++_stats.lfu_evicts;
+      }
+      ++_stats.num_evicted;
+      _stats.bytes_evicted += sz;
+      _index.erase(link);
+      return;
+    }
+  }
+};
+
+} // namespace cache
@@ -0,0 +1,421 @@
+#pragma once
+
+/*
+ * Implements a CLOCK-Pro cache.
+ *
+ * Jiang, Chen and Zhang. "CLOCK-Pro: An Effective Improvement of the CLOCK
+ * Replacement". USENIX ATC 2005.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cache/cache.h"
+#include "cache/ghost.h"
+#include "cache/lru.h"
+
+namespace cache {
+
+// Resident page of a ClockProCache. Unlike LRULink there are no list pointers,
+// a page's position in the clock is its slot.
+template <typename K, typename V, typename Ptr = std::shared_ptr<V>>
+struct ClockLink {
+  K key;
+  Ptr value;
+  uint32_t slot;
+
+  ClockLink(K k, Ptr v)
+      : key{k}, value{std::move(v)}, slot{0} {}
+  ClockLink(const ClockLink&) = delete;
+  ClockLink operator=(const ClockLink&) = delete;
+  ClockLink(ClockLink&&) = default;
+};
+
+// CLOCK-Pro keeps resident pages in a single clock, split into hot pages
+// (short reuse distance) and cold pages. A cold page starts a test period when
+// it is inserted; if it is reused during the test period it is promoted to
+// hot, if it is evicted during the test period it is remembered as a
+// non-resident page. Hitting a non-resident page grows the cold target
+// (m_c in the paper), a test period ending without reuse shrinks it.
+//
+// The clock is an array of slots with the per page state kept in bitmaps, 64
+// slots per group. A hit only sets the page's reference bit, it does not touch
+// any other page. The hands sweep the bitmaps a word at a time, skipping whole
+// groups of pages they have no business with.
+//
+// Differences from the paper: the hot and cold hands each sweep their own
+// pages over the same slot order, and non-resident pages are kept in a ghost
+// list instead of in the clock. A page leaves the list as soon as it is hit,
+// so the list stays in eviction order, and it holds at most as many pages as
+// are resident, as in the paper. A test period ends when the page falls off
+// the list rather than when the hot hand passes it. The cold target is
+// adjusted by the size of the page, rather than by one page.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ghost = KeyGhost<K, Index>,
+          typename Ptr = std::shared_ptr<V>>
+class ClockProCache : public Cache<K, V> {
+  using Link = ClockLink<K, V, Ptr>;
+  static_assert(!Ghost::kSized,
+                "Non-resident pages are bounded by count, not by size");
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+  ClockProCache(int64_t size) : _max_size{size}, _ghost{size} {
+    _cold_target = min_cold_target();
+    _max_cold_target = _cold_target;
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      int64_t n = std::min(size, kMaxReserve);
+      _index.reserve(n);
+      _free.reserve(n);
+      while ((int64_t)_slots.size() < n) {
+        grow();
+      }
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _hot_size + _cold_size; }
+  inline int64_t num_entries() const { return _index.size(); }
+  const Stats& stats() const { return _stats; }
+  // The cold target plays the role of p in ARC.
+  inline int64_t p() const { return _cold_target; }
+  inline int64_t max_p() const { return _max_cold_target; }
+  inline int64_t filter_size() const { return 0; }
+  inline int64_t hot_size() const { return _hot_size; }
+  inline int64_t cold_size() const { return _cold_size; }
+  inline int64_t ghost_size() const { return _ghost.size(); }
+
+  const std::string label(int64_t n) const {
+    return "clock-pro-" + std::to_string(max_size() * 100 / n);
+  }
+
+  // Get value from the cache. A hit only sets the page's reference bit.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link) {
+      Group& g = _groups[link->slot >> kGroupBits];
+      uint64_t bit = 1ull << (link->slot & kGroupMask);
+      g.ref |= bit;
+      ++_stats.num_hits;
+      _stats.bytes_hit += _sizer(link->value.get());
+      if (g.hot & bit) {
+        ++_stats.lfu_hits;
+      } else {
+        ++_stats.lru_hits;
+      }
+      return link->value;
+    } else {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+  }
+
+  // Insert element into the cache, evicting cold pages as necessary.
+  // If the same key is used then we replace the value.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    int64_t sz = _sizer(value.get());
+    auto [link, inserted] = _index.emplace(key, value);
+    if (!inserted) {
+      Group& g = _groups[link->slot >> kGroupBits];
+      uint64_t bit = 1ull << (link->slot & kGroupMask);
+      int64_t old = _sizer(link->value.get());
+      if (g.hot & bit) {
+        _hot_size += sz - old;
+      } else {
+        _cold_size += sz - old;
+      }
+      g.ref |= bit;
+      link->value = std::move(value);
+    } else {
+      uint32_t slot = allocate_slot();
+      link->slot = slot;
+      _slots[slot] = link;
+      Group& g = _groups[slot >> kGroupBits];
+      uint64_t bit = 1ull << (slot & kGroupMask);
+      g.occupied |= bit;
+      bool ghost_hit = _ghost.contains(key);
+      if (ghost_hit) {
+        // Reused during its test period, the cold area was too small to keep
+        // it.
+        _ghost.remove(key);
+        ++_stats.lru_ghost_hits;
+        grow_cold_target(sz);
+      }
+      // Until the cache fills up new pages go straight to the hot area, as in
+      // LIRS, so there is a hot set to protect from the first scan.
+      if (ghost_hit || size() + sz <= hot_target()) {
+        g.hot |= bit;
+        _hot_size += sz;
+        ++_hot_entries;
+      } else {
+        g.test |= bit;
+        _cold_size += sz;
+      }
+    }
+
+    while (_hot_size > hot_target()) {
+      run_hot_hand();
+    }
+    while (size() > _max_size) {
+      evict_cold();
+    }
+  }
+
+  // Remove element from cache, return value.
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link) {
+      auto value = std::move(link->value);
+      int64_t sz = _sizer(value.get());
+      Group& g = _groups[link->slot >> kGroupBits];
+      uint64_t bit = 1ull << (link->slot & kGroupMask);
+      if (g.hot & bit) {
+        _hot_size -= sz;
+        --_hot_entries;
+      } else {
+        _cold_size -= sz;
+      }
+      release(link);
+      return value;
+    }
+    _ghost.remove(key);
+    return nullptr;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    _index.clear();
+    _ghost.clear();
+    std::fill(_groups.begin(), _groups.end(), Group{});
+    std::fill(_slots.begin(), _slots.end(), nullptr);
+    _free.clear();
+    _next_slot = 0;
+    _hot_hand = 0;
+    _cold_hand = 0;
+    _hot_size = 0;
+    _cold_size = 0;
+    _hot_entries = 0;
+    _cold_target = min_cold_target();
+    _max_cold_target = _cold_target;
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  ClockProCache() = delete;
+  ClockProCache(const ClockProCache&) = delete;
+  ClockProCache operator=(const ClockProCache&) = delete;
+
+private:
+  static constexpr int64_t kMaxReserve = 1 << 16;
+  static constexpr uint32_t kGroupBits = 6;
+  static constexpr uint32_t kGroupSize = 1 << kGroupBits;
+  static constexpr uint32_t kGroupMask = kGroupSize - 1;
+
+  // Page state for 64 consecutive slots. A page is cold unless its hot bit is
+  // set; test is only meaningful for cold pages.
+  struct Group {
+    uint64_t occupied = 0;
+    uint64_t hot = 0;
+    uint64_t test = 0;
+    uint64_t ref = 0;
+  };
+
+  Lock _lock;
+  int64_t _max_size;
+  int64_t _hot_size = 0;
+  int64_t _cold_size = 0;
+  int64_t _hot_entries = 0;
+  int64_t _cold_target = 0;
+  int64_t _max_cold_target = 0;
+
+  Index<K, Link> _index;
+  std::vector<Group> _groups;
+  std::vector<Link*> _slots;
+  std::vector<uint32_t> _free;
+  uint32_t _next_slot = 0;
+  uint32_t _hot_hand = 0;
+  uint32_t _cold_hand = 0;
+
+  // Non-resident cold pages in their test period, oldest first out, no more
+  // of them than there are resident pages.
+  Ghost _ghost;
+  Sizer _sizer;
+  Stats _stats;
+
+  inline int64_t min_cold_target() const {
+    return std::max<int64_t>(_max_size / 100, 1);
+  }
+
+  inline int64_t hot_target() const {
+    return std::max<int64_t>(_max_size - _cold_target, 0);
+  }
+
+  inline void grow_cold_target(int64_t delta) {
+    _cold_target = std::min(_cold_target + delta, _max_size);
+    _max_cold_target = std::max(_max_cold_target, _cold_target);
+  }
+
+  inline void shrink_cold_target(int64_t delta) {
+    _cold_target = std::max(_cold_target - delta, min_cold_target());
+  }
+
+  inline uint32_t allocate_slot() {
+    if (!_free.empty()) {
+      uint32_t slot = _free.back();
+      _free.pop_back();
+      return slot;
+    }
+    if (_next_slot == _slots.size()) {
+      grow();
+    }
+    return _next_slot++;
+  }
+
+  void grow() {
+    size_t n = std::max<size_t>(kGroupSize, _slots.size() * 2);
+    _slots.resize(n, nullptr);
+    _groups.resize(n / kGroupSize);
+  }
+
+  // Clears the slot and removes link from the index.
+  inline void release(Link* link) {
+    uint32_t slot = link->slot;
+    Group& g = _groups[slot >> kGroupBits];
+    uint64_t bit = 1ull << (slot & kGroupMask);
+    g.occupied &= ~bit;
+    g.hot &= ~bit;
+    g.test &= ~bit;
+    g.ref &= ~bit;
+    _slots[slot] = nullptr;
+    _free.push_back(slot);
+    _index.erase(link);
+  }
+
+  inline uint32_t next_group(uint32_t hand) const {
+    uint32_t next = (hand | kGroupMask) + 1;
+    return next == _slots.size() ? 0 : next;
+  }
+
+  // Evicts one cold page. Hot pages are demoted if there are no cold pages
+  // left to evict.
+  inline void evict_cold() {
+    while (true) {
+      if (_hot_entries == num_entries()) {
+        run_hot_hand();
+      }
+      if (run_cold_hand()) {
+        return;
+      }
+      while (_hot_size > hot_target()) {
+        run_hot_hand();
+      }
+    }
+  }
+
+  // Sweeps cold pages from the cold hand up to the first unreferenced one,
+  // which is evicted. Referenced pages it passes either get promoted to hot
+  // (reused during their test period) or start a new test period. Returns
+  // false if a full sweep evicted nothing.
+  bool run_cold_hand() {
+    for (size_t i = 0; i <= _groups.size(); ++i) {
+      Group& g = _groups[_cold_hand >> kGroupBits];
+      uint64_t mask = ~0ull << (_cold_hand & kGroupMask);
+      uint64_t cold = g.occupied & ~g.hot & mask;
+      uint64_t victims = cold & ~g.ref;
+      // All cold pages before the first victim are referenced.
+      uint64_t passed = victims ? cold & ((victims & -victims) - 1) : cold;
+      uint64_t promoted = passed & g.test;
+      g.ref &= ~passed;
+      g.test = (g.test | passed) & ~promoted;
+      g.hot |= promoted;
+      uint32_t base = _cold_hand & ~kGroupMask;
+      for (; promoted; promoted &= promoted - 1) {
+        Link* link = _slots[base + __builtin_ctzll(promoted)];
+        int64_t sz = _sizer(link->value.get());
+        _cold_size -= sz;
+        _hot_size += sz;
+        ++_hot_entries;
+      }
+
+      if (victims) {
+        uint32_t slot = base + __builtin_ctzll(victims);
+        evict(_slots[slot], (g.test >> (slot & kGroupMask)) & 1);
+        _cold_hand = slot + 1 == _slots.size() ? 0 : slot + 1;
+        return true;
+      }
+      _cold_hand = next_group(_cold_hand);
+    }
+    return false;
+  }
+
+  // Sweeps hot pages from the hot hand up to the first unreferenced one, which
+  // is demoted to cold. Referenced hot pages it passes lose their reference
+  // bit and cold pages it passes end their test period.
+  void run_hot_hand() {
+    assert(_hot_entries > 0);
+    while (true) {
+      Group& g = _groups[_hot_hand >> kGroupBits];
+      uint64_t mask = ~0ull << (_hot_hand & kGroupMask);
+      uint64_t hot = g.occupied & g.hot & mask;
+      uint64_t victims = hot & ~g.ref;
+      uint64_t passed = victims ? mask & ((victims & -victims) - 1) : mask;
+      g.ref &= ~(hot & passed);
+      uint64_t expired = g.occupied & ~g.hot & g.test & passed;
+      g.test &= ~expired;
+      uint32_t base = _hot_hand & ~kGroupMask;
+      for (; expired; expired &= expired - 1) {
+        Link* link = _slots[base + __builtin_ctzll(expired)];
+        shrink_cold_target(_sizer(link->value.get()));
+      }
+
+      if (victims) {
+        uint32_t slot = base + __builtin_ctzll(victims);
+        g.hot &= ~(1ull << (slot & kGroupMask));
+        int64_t sz = _sizer(_slots[slot]->value.get());
+        _hot_size -= sz;
+        _cold_size += sz;
+        --_hot_entries;
+        _hot_hand = slot + 1 == _slots.size() ? 0 : slot + 1;
+        return;
+      }
+      _hot_hand = next_group(_hot_hand);
+    }
+  }
+
+  // Evicts a cold page, remembering it as non-resident if it is in its test
+  // period.
+  inline void evict(Link* link, bool in_test) {
+    int64_t sz = _sizer(link->value.get());
+    _cold_size -= sz;
+    ++_stats.num_evicted;
+    ++_stats.lru_evicts;
+    _stats.bytes_evicted += sz;
+    if (in_test) {
+      // The page is still indexed, it is not counted once released.
+      while (_ghost.size() > 0 && _ghost.size() >= num_entries() - 1) {
+        // Test period over without a reuse.
+        _ghost.evict();
+        shrink_cold_target(std::max<int64_t>(size() / num_entries(), 1));
+      }
+      _ghost.add(link->key);
+    }
+    release(link);
+  }
+};
+
+} // namespace cache
@@ -0,0 +1,276 @@
+#pragma once
+
+/*
+ * Implements an index that can be read without locks while a single writer
+ * modifies it, used by LRUCache and AdaptiveCache for lock-free lookups.
+ */
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "cache/cache.h"
+#include "util/compiler-util.h"
+#include "util/epoch.h"
+
+namespace cache {
+
+// Chained hash index whose lookups are safe to run concurrently with one
+// writer. Writers must be serialized by the caller (the cache lock); readers
+// call find() inside an EpochGuard and take no lock.
+//
+// Every link is its own node. A node is published with a release store of the
+// bucket it is pushed on, and an erased node is unlinked from its chain but
+// only destroyed once all readers that could still be walking over it have
+// left their epoch. Links are therefore never modified after they become
+// visible: a cache must replace a link to change its value.
+//
+// Nodes carry two chain pointers. Growing the table links every node into the
+// new buckets through the pointer the current table does not use, so readers
+// of the old table are undisturbed, then publishes the new table. Each node
+// also has a referenced bit which readers set (touch()) in place of moving the
+// link in the LRU list, see LRUCache.
+template <typename K, typename Link> class ConcurrentIndex {
+public:
+  static constexpr bool kConcurrentReads = true;
+
+  ConcurrentIndex() : _table{new Table(kMinBuckets, 0)} {}
+
+  ~ConcurrentIndex() {
+    // No reader can be using an index that is being destroyed.
+    Table* t = _table.load(std::memory_order_relaxed);
+    free_nodes(t);
+    delete t;
+    reclaim(EpochManager::kIdle);
+  }
+
+  inline int64_t size() const { return _size; }
+
+  // Sizes the table for n links.
+  inline void reserve(int64_t n) {
+    while ((int64_t)table()->mask + 1 < n) {
+      grow();
+    }
+    _retired.reserve(kReclaimBatch);
+  }
+
+  template <typename Q> inline size_t hash(const Q& key) const {
+    static_assert(kIsLookupKey<K, Q>, "Look up by K or KeyView<K>");
+    uint64_t h = std::hash<Q>()(key);
+    return h * 0x9E3779B97F4A7C15ull;
+  }
+
+  inline void prefetch(size_t hash) const {
+    Table* t = table();
+    PREFETCH(&t->buckets[bucket(t, hash)]);
+  }
+
+  // Returns the link for key or nullptr if it is not indexed. Readers that do
+  // not hold the writer's lock must call this inside an EpochGuard. Lookups
+  // take K or KeyView<K>.
+  template <typename Q> inline Link* find(const Q& key) {
+    return find(key, hash(key));
+  }
+
+  template <typename Q> inline Link* find(const Q& key, size_t hash) const {
+    Table* t = table();
+    int gen = t->gen;
+    Node* n = t->buckets[bucket(t, hash)].load(std::memory_order_acquire);
+    while (n && !(n->key == key)) {
+      n = n->chain[gen].load(std::memory_order_acquire);
+    }
+    return n;
+  }
+
+  // Returns the link for key, creating it from (key, value) if it does not
+  // exist. The boolean is true if the link was created, an existing link is
+  // returned unmodified.
+  template <typename P>
+  inline std::pair<Link*, bool> emplace(const K& key, P value) {
+    return emplace(key, std::move(value), hash(key));
+  }
+
+  template <typename P>
+  inline std::pair<Link*, bool> emplace(const K& key, P value, size_t hash) {
+    Link* existing = find(key, hash);
+    if (existing) {
+      return {existing, false};
+    }
+    if (_size + 1 > (int64_t)table()->mask + 1) {
+      grow();
+    }
+    Node* n = new Node(key, std::move(value));
+    push(table(), n, hash);
+    ++_size;
+    return {n, true};
+  }
+
+  // Unlinks link and destroys it once no reader can reach it.
+  // ASSUMES: link was returned by this index.
+  inline void erase(Link* link) {
+    Node* node = static_cast<Node*>(link);
+    Table* t = table();
+    int gen = t->gen;
+    std::atomic<Node*>* prev = &t->buckets[bucket(t, hash(node->key))];
+    while (prev->load(std::memory_order_relaxed) != node) {
+      Node* n = prev->load(std::memory_order_relaxed);
+      assert(n);
+      prev = &n->chain[gen];
+    }
+    // The node keeps its own chain pointer, so readers standing on it carry
+    // on down the chain.
+    prev->store(node->chain[gen].load(std::memory_order_relaxed),
+                std::memory_order_release);
+    retire(node);
+    --_size;
+  }
+
+  // Unlinks every link. Readers may still be walking the old chains.
+  inline void clear() {
+    Table* t = table();
+    for (uint64_t b = 0; b <= t->mask; ++b) {
+      Node* n = t->buckets[b].load(std::memory_order_relaxed);
+      t->buckets[b].store(nullptr, std::memory_order_release);
+      while (n) {
+        Node* next = n->chain[t->gen].load(std::memory_order_relaxed);
+        retire(n);
+        n = next;
+      }
+    }
+    _size = 0;
+  }
+
+  // Marks link as read since the writer last checked it.
+  static inline void touch(Link* link) {
+    Node* node = static_cast<Node*>(link);
+    // Skip the store when already set to keep hot links' lines shared.
+    if (!node->referenced.load(std::memory_order_relaxed)) {
+      node->referenced.store(true, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns whether link was touched since the last call, and clears it.
+  static inline bool clear_referenced(Link* link) {
+    Node* node = static_cast<Node*>(link);
+    if (!node->referenced.load(std::memory_order_relaxed)) {
+      return false;
+    }
+    node->referenced.store(false, std::memory_order_relaxed);
+    return true;
+  }
+
+  ConcurrentIndex(const ConcurrentIndex&) = delete;
+  ConcurrentIndex operator=(const ConcurrentIndex&) = delete;
+
+private:
+  static constexpr uint64_t kMinBuckets = 16;
+  // Retired nodes are freed in batches of about this many.
+  static constexpr size_t kReclaimBatch = 128;
+
+  struct Node : Link {
+    template <typename P>
+    Node(const K& key, P value)
+        : Link(key, std::move(value)), chain{{nullptr}, {nullptr}},
+          referenced{false} {}
+
+    std::atomic<Node*> chain[2];
+    std::atomic<bool> referenced;
+  };
+
+  struct Table {
+    Table(uint64_t n, int g)
+        : mask{n - 1}, gen{g}, buckets{new std::atomic<Node*>[n]} {
+      for (uint64_t b = 0; b < n; ++b) {
+        buckets[b].store(nullptr, std::memory_order_relaxed);
+      }
+    }
+
+    uint64_t mask;
+    // Which of the nodes' chain pointers this table's chains use.
+    int gen;
+    std::unique_ptr<std::atomic<Node*>[]> buckets;
+  };
+
+  std::atomic<Table*> _table;
+  int64_t _size = 0;
+  // Unlinked nodes and tables with the epoch they were retired in, oldest
+  // first.
+  std::vector<std::pair<uint64_t, Node*>> _retired;
+  std::vector<std::pair<uint64_t, Table*>> _retired_tables;
+
+  inline Table* table() const { return _table.load(std::memory_order_acquire); }
+
+  // Uses the high bits, which the multiply in hash() mixes best.
+  static inline uint64_t bucket(const Table* t, size_t hash) {
+    return (hash >> 32) & t->mask;
+  }
+
+  static inline void push(Table* t, Node* n, size_t hash) {
+    std::atomic<Node*>& head = t->buckets[bucket(t, hash)];
+    n->chain[t->gen].store(head.load(std::memory_order_relaxed),
+                           std::memory_order_relaxed);
+    head.store(n, std::memory_order_release);
+  }
+
+  inline void retire(Node* node) {
+    _retired.emplace_back(EpochManager::retire_epoch(), node);
+    if (_retired.size() >= kReclaimBatch) {
+      reclaim(EpochManager::min_active());
+    }
+  }
+
+  // Frees everything retired before epoch min.
+  void reclaim(uint64_t min) {
+    size_t n = 0;
+    while (n < _retired.size() && _retired[n].first < min) {
+      delete _retired[n++].second;
+    }
+    _retired.erase(_retired.begin(), _retired.begin() + n);
+    n = 0;
+    while (n < _retired_tables.size() && _retired_tables[n].first < min) {
+      delete _retired_tables[n++].second;
+    }
+    _retired_tables.erase(_retired_tables.begin(),
+                          _retired_tables.begin() + n);
+  }
+
+  void free_nodes(Table* t) {
+    for (uint64_t b = 0; b <= t->mask; ++b) {
+      Node* n = t->buckets[b].load(std::memory_order_relaxed);
+      while (n) {
+        Node* next = n->chain[t->gen].load(std::memory_order_relaxed);
+        delete n;
+        n = next;
+      }
+    }
+  }
+
+  void grow() {
+    Table* old = table();
+    // The new table reuses the chain pointers of the table before old, which
+    // must have no readers left.
+    reclaim(EpochManager::min_active());
+    if (!_retired_tables.empty()) {
+      EpochManager::synchronize();
+      reclaim(EpochManager::min_active());
+    }
+    assert(_retired_tables.empty());
+
+    Table* t = new Table((old->mask + 1) * 2, 1 - old->gen);
+    for (uint64_t b = 0; b <= old->mask; ++b) {
+      Node* n = old->buckets[b].load(std::memory_order_relaxed);
+      while (n) {
+        push(t, n, hash(n->key));
+        n = n->chain[old->gen].load(std::memory_order_relaxed);
+      }
+    }
+    _table.store(t, std::memory_order_release);
+    _retired_tables.emplace_back(EpochManager::retire_epoch(), old);
+  }
+};
+
+} // namespace cache
@@ -0,0 +1,236 @@
+#pragma once
+
+/*
+ * Implements an open addressing index that can be used by LRUCache in place
+ * of std::unordered_map.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "cache/cache.h"
+#include "util/compiler-util.h"
+
+namespace cache {
+
+// Robin hood hash index mapping keys to links. The table is one contiguous
+// array of 8 byte slots, each holding a 32 bit hash tag and the index of a
+// link, so a lookup walks neighbouring slots comparing tags and dereferences a
+// link only to confirm the key. Links live in fixed size chunks which are never
+// moved (the LRU list points at them) and erased links are recycled through a
+// free list.
+template <typename K, typename Link> class FlatIndex {
+public:
+  static constexpr bool kConcurrentReads = false;
+
+  FlatIndex() {}
+
+  ~FlatIndex() { clear(); }
+
+  inline int64_t size() const { return _size; }
+
+  // Returns the link for key or nullptr if it is not indexed. Lookups take K
+  // or KeyView<K>.
+  template <typename Q> inline Link* find(const Q& key) {
+    return find(key, hash(key));
+  }
+
+  // Mixes the user hash so weak hashes (e.g. identity on integers) still
+  // spread over the table. The low 32 bits are the tag, whose low bits pick
+  // the home slot.
+  template <typename Q> inline size_t hash(const Q& key) const {
+    static_assert(kIsLookupKey<K, Q>, "Look up by K or KeyView<K>");
+    uint64_t h = std::hash<Q>()(key);
+    return (h * 0x9E3779B97F4A7C15ull) >> 32;
+  }
+
+  // Prefetches the home slot of hash, where find() starts probing.
+  inline void prefetch(size_t hash) const {
+    if (_size > 0) {
+      PREFETCH(&_slots[hash & _mask]);
+    }
+  }
+
+  // As find(key) for hash == hash(key).
+  template <typename Q> inline Link* find(const Q& key, size_t hash) const {
+    if (_size == 0) {
+      return nullptr;
+    }
+    uint32_t tag = hash;
+    uint32_t pos = tag & _mask;
+    for (uint32_t dist = 0;; ++dist, pos = (pos + 1) & _mask) {
+      const Slot& slot = _slots[pos];
+      if (slot.idx == kEmpty || distance(slot, pos) < dist) {
+        return nullptr;
+      }
+      if (slot.tag == tag && link(slot.idx)->key == key) {
+        return link(slot.idx);
+      }
+    }
+  }
+
+  // Returns the link for key, creating it from (key, value) if it does not
+  // exist. The boolean is true if the link was created, an existing link is
+  // returned unmodified.
+  template <typename P>
+  inline std::pair<Link*, bool> emplace(const K& key, P value) {
+    return emplace(key, std::move(value), hash(key));
+  }
+
+  // As emplace(key, value) for hash == hash(key).
+  template <typename P>
+  inline std::pair<Link*, bool> emplace(const K& key, P value, size_t hash) {
+    uint32_t tag = hash;
+    Link* existing = find(key, tag);
+    if (existing) {
+      return {existing, false};
+    }
+    if ((_size + 1) * 5 > (int64_t)_slots.size() * 4) {
+      grow();
+    }
+    uint32_t idx = allocate(key, std::move(value));
+    insert(Slot{tag, idx});
+    ++_size;
+    return {link(idx), true};
+  }
+
+  // Presizes the table and link storage for n links.
+  inline void reserve(int64_t n) {
+    while (n * 5 > (int64_t)_slots.size() * 4) {
+      grow();
+    }
+    while ((int64_t)_chunks.size() * kChunkSize < n) {
+      _chunks.emplace_back(new Storage[kChunkSize]);
+    }
+    _free.reserve(n);
+  }
+
+  // Removes and destroys link.
+  // ASSUMES: link was returned by this index.
+  inline void erase(Link* entry) {
+    uint32_t pos = hash(entry->key) & _mask;
+    uint32_t idx = _slots[pos].idx;
+    while (link(idx) != entry) {
+      pos = (pos + 1) & _mask;
+      idx = _slots[pos].idx;
+      assert(idx != kEmpty);
+    }
+
+    // Backward shift deletion: pull displaced successors one slot closer to
+    // their home so lookups never need tombstones.
+    uint32_t next = (pos + 1) & _mask;
+    while (_slots[next].idx != kEmpty && distance(_slots[next], next) > 0) {
+      _slots[pos] = _slots[next];
+      pos = next;
+      next = (next + 1) & _mask;
+    }
+    _slots[pos] = Slot{0, kEmpty};
+
+    link(idx)->~Link();
+    _free.push_back(idx);
+    --_size;
+  }
+
+  // Removes all links. Storage is kept for reuse.
+  inline void clear() {
+    for (Slot& slot : _slots) {
+      if (slot.idx != kEmpty) {
+        link(slot.idx)->~Link();
+        slot = Slot{0, kEmpty};
+      }
+    }
+    _free.clear();
+    _next_idx = 0;
+    _size = 0;
+  }
+
+  FlatIndex(const FlatIndex&) = delete;
+  FlatIndex operator=(const FlatIndex&) = delete;
+
+private:
+  static constexpr uint32_t kEmpty = UINT32_MAX;
+  static constexpr uint32_t kChunkBits = 10;
+  static constexpr uint32_t kChunkSize = 1 << kChunkBits;
+  static constexpr uint32_t kMinSlots = 16;
+
+  struct Slot {
+    uint32_t tag;
+    uint32_t idx;
+  };
+
+  using Storage = std::aligned_storage_t<sizeof(Link), alignof(Link)>;
+
+  std::vector<Slot> _slots;
+  uint32_t _mask = 0;
+  int64_t _size = 0;
+
+  std::vector<std::unique_ptr<Storage[]>> _chunks;
+  std::vector<uint32_t> _free;
+  uint32_t _next_idx = 0;
+
+  // How far slot (stored at pos) is from its home slot.
+  inline uint32_t distance(const Slot& slot, uint32_t pos) const {
+    return (pos - (slot.tag & _mask)) & _mask;
+  }
+
+  inline Link* link(uint32_t idx) const {
+    Storage* chunk = _chunks[idx >> kChunkBits].get();
+    return reinterpret_cast<Link*>(&chunk[idx & (kChunkSize - 1)]);
+  }
+
+  template <typename P> inline uint32_t allocate(const K& key, P value) {
+    uint32_t idx;
+    if (!_free.empty()) {
+      idx = _free.back();
+      _free.pop_back();
+    } else {
+      idx = _next_idx++;
+      if ((idx >> kChunkBits) == _chunks.size()) {
+        _chunks.emplace_back(new Storage[kChunkSize]);
+      }
+    }
+    new (link(idx)) Link(key, std::move(value));
+    return idx;
+  }
+
+  // Robin hood insertion: an entry further from home takes the slot of one
+  // closer to home, which keeps probe sequences short and sorted by distance.
+  inline void insert(Slot entry) {
+    uint32_t pos = entry.tag & _mask;
+    uint32_t dist = 0;
+    while (true) {
+      Slot& slot = _slots[pos];
+      if (slot.idx == kEmpty) {
+        slot = entry;
+        return;
+      }
+      uint32_t d = distance(slot, pos);
+      if (d < dist) {
+        std::swap(slot, entry);
+        dist = d;
+      }
+      pos = (pos + 1) & _mask;
+      ++dist;
+    }
+  }
+
+  void grow() {
+    std::vector<Slot> old = std::move(_slots);
+    size_t n = std::max<size_t>(kMinSlots, old.size() * 2);
+    _slots.assign(n, Slot{0, kEmpty});
+    _mask = n - 1;
+    for (const Slot& slot : old) {
+      if (slot.idx != kEmpty) {
+        insert(slot);
+      }
+    }
+  }
+};
+
+} // namespace cache
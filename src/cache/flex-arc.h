@@ -10,15 +10,29 @@
 #include <mutex>
 
 #include "cache/cache.h"
+#include "cache/ghost.h"
 #include "cache/lru.h"
+#include "cache/tiny-lfu.h"
 
 namespace cache {
+// Filter is the admission filter, see AdaptiveCache.
 template <typename K, typename V, typename Lock = NopLock,
-          typename Sizer = ElementCount<V>>
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ghost = KeyGhost<K, Index>,
+          typename Ptr = std::shared_ptr<V>, typename Filter = Ghost>
 class FlexARC : public Cache<K, V> {
 public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  // Whether peek() can run without the lock, see ConcurrentIndex. get() still
+  // takes it.
+  static constexpr bool kConcurrentReads =
+      LRUCache<K, V, NopLock, Sizer, Index, Ptr>::kConcurrentReads;
+
   // Produces an ARC with ghost lists of size ghost_size, and cache of size
-  // size.
+  // size. ghost_size is in entries, or in Sizer units with a SizedGhost.
   FlexARC(int64_t size, int64_t ghost_size, int64_t filter_size = 0)
       : _max_size{size}, _p{0}, _max_p{0}, _ghost_size{ghost_size},
         _lru_cache{size}, _lfu_cache{size}, _lru_ghost{ghost_size},
@@ -38,78 +52,38 @@ public:
 
   const std::string label(int64_t n) const {
     return "farc-" + std::to_string(max_size() * 100 / n) + "-" +
-           std::to_string(ghost_size() * 100 / max_size());
+           std::to_string(ghost_size() * 100 / max_size()) +
+           (filter_size() > 0 && kIsTinyLFU<Filter> ? "-tinylfu" : "");
   }
 
   // Add an item to the cache. The difference here is we try to use existing
   // information to decide if the item was previously cached.
-  void add_to_cache(const K& key, std::shared_ptr<V> value) {
+  void add_to_cache(const K& key, Ptr value) {
     std::lock_guard<Lock> l(_lock);
-    bool lru_ghost_hit = _lru_ghost.contains(key);
-    bool lfu_ghost_hit = _lfu_ghost.contains(key);
-    bool in_lfu = false;
-    bool should_replace = true;
+    add_impl(key, std::move(value));
+  }
 
-    // Check if the key is already in LRU cache.
-    // We do so by removing the item since well that is what we would do
-    // eventually anyways.
-    if (_lru_cache.contains(key)) {
-      // Given it was already in the LRU cache, we need to add it
-      // to the lfu cache and call it a day.
-      _lru_cache.remove_from_cache(key);
-      _lfu_cache.add_to_cache_no_evict(key, value);
-      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
-      in_lfu = false;
-    } else if (_lfu_cache.contains(key)) {
-      // Just update the item, and don't worry about it.
-      _lfu_cache.add_to_cache_no_evict(key, value);
-      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
-      // Now we might need to make space.
-      in_lfu = true;
-    } else if (!(lfu_ghost_hit || lru_ghost_hit) && _filter.max_size() > 0 &&
-               !_filter.contains(key)) {
-      // Filter should only kick in for entries evicted far enough in the past.
-      // Add a "double-hit" pre filter. This is intended to prevent single scan
-      // keys from invalidating the cache.
-      ++_stats.arc_filter;
-      _filter.add_to_cache(key, nullptr);
-      // Do not call replace in this case
-      should_replace = false;
-    } else if (lru_ghost_hit) {
-      // We used to have this key, we recently evicted it, let us make this
-      // a frequent key. Case II in Figure 4.
-      adapt_lru_ghost_hit();
-      // Add things back
-      _lfu_cache.add_to_cache_no_evict(key, value);
-      _lru_ghost.remove_from_cache(key);
-      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
-      // Do this only after fixing all invariants, to evict.
-      in_lfu = false;
-    } else if (lfu_ghost_hit) {
-      // Case III
-      adapt_lfu_ghost_hit();
-      // Add things
-      _lfu_cache.add_to_cache_no_evict(key, value);
-      _lfu_ghost.remove_from_cache(key);
-      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
-      in_lfu = true;
-    } else {
-      // Case IV
-      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
-      _lru_cache.add_to_cache_no_evict(key, value);
-      in_lfu = false;
-    }
-    // The call to replace restores the size invariant.
-    if (should_replace) {
-      replace(in_lfu);
+  // Adds keys[0, n) with values[0, n) under one lock acquisition, as if by n
+  // calls to add_to_cache(). Each batch of keys is hashed and prefetched in
+  // both caches before any of them is added.
+  template <typename KeyArray, typename ValueArray>
+  void multi_add(KeyArray keys, size_t n, ValueArray values) {
+    std::lock_guard<Lock> l(_lock);
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        prefetch(_lru_cache.hash(keys[b + i]));
+      }
+      for (size_t i = 0; i < m; ++i) {
+        add_impl(keys[b + i], values[b + i]);
+      }
     }
-    assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
   }
 
   // Update a cached element if it exists, do nothing otherwise. Boolean returns
   // whether or not value was updated.
   // FIXME: THIS DOES NOT CURRENTLY HANDLE SIZERS.
-  bool update_cache(const K& key, std::shared_ptr<V> value) {
+  bool update_cache(const K& key, Ptr value) {
     std::lock_guard<Lock> l(_lock);
     if (_lru_cache.contains(key)) {
       // Given it was already in the LRU cache, we need to add it
@@ -130,46 +104,73 @@ public:
   }
 
   // Get an item from the cache. This is one half of what the ARC paper does.
-  std::shared_ptr<V> get(const K& key) {
+  Ptr get(const K& key) {
     std::lock_guard<Lock> l(_lock);
-    std::shared_ptr<V> lfu_value = _lfu_cache.get(key);
-    if (lfu_value) {
-      ++_stats.num_hits;
-      ++_stats.lfu_hits;
-      assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
-      return lfu_value;
+    return get_impl(key, _lfu_cache.hash(key));
+  }
+
+  // As get(key) for a KeyView<K>, e.g. a std::string_view. The key is only
+  // copied if the lookup moves it from T1 to T2.
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key, _lfu_cache.hash(key));
+  }
+
+  // Gets keys[0, n) into values[0, n) under one lock acquisition, as if by n
+  // calls to get(). Each batch of keys is hashed once and prefetched in both
+  // caches before any of them is probed. KeyArray and ValueArray are pointers
+  // or anything else indexable with [].
+  template <typename KeyArray, typename ValueArray>
+  void multi_get(KeyArray keys, size_t n, ValueArray values) {
+    std::lock_guard<Lock> l(_lock);
+    size_t hashes[kPrefetchBatch];
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        hashes[i] = _lfu_cache.hash(keys[b + i]);
+        prefetch(hashes[i]);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        values[b + i] = get_impl(keys[b + i], hashes[i]);
+      }
     }
+  }
 
-    std::shared_ptr<V> lru_value = _lru_cache.remove_from_cache(key);
-    if (lru_value) {
-      _lfu_cache.add_to_cache_no_evict(key, lru_value);
-      ++_stats.num_hits;
-      ++_stats.lru_hits;
+  // Returns the value for key without counting the lookup or updating the
+  // lists. With a concurrent index this takes no lock, but may miss a key
+  // that is moving from T1 to T2 at the same time.
+  Ptr peek(const K& key) {
+    if constexpr (kConcurrentReads) {
+      return peek_impl(key);
     } else {
-      ++_stats.num_misses;
-      // Access ghosts.
-      bool lru_ghost = _lru_ghost.contains(key);
-      bool lfu_ghost = _lfu_ghost.contains(key);
-      _stats.lfu_ghost_hits += (int64_t)lfu_ghost;
-      _stats.lfu_ghost_hits += (int64_t)lru_ghost;
-      assert((!(lru_ghost || lfu_ghost)) || (lru_ghost ^ lfu_ghost));
+      std::lock_guard<Lock> l(_lock);
+      return peek_impl(key);
     }
-    assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
-    return lru_value;
   }
 
-  // Remove key from the cache.
-  std::shared_ptr<V> remove_from_cache(const K& key) {
+  // Moves key as a hit on it would, without counting the lookup. Does nothing
+  // if key is not cached, in particular it does not look at the ghosts.
+  void touch(const K& key) {
     std::lock_guard<Lock> l(_lock);
-    auto value = _lru_cache.remove_from_cache(key);
+    if constexpr (kIsTinyLFU<Filter>) {
+      _filter.record(key);
+    }
+    if (_lfu_cache.contains(key)) {
+      return;
+    }
+    Ptr value = _lru_cache.remove_from_cache(key);
     if (value) {
-      return value;
-    } else if ((value = _lfu_cache.remove_from_cache(key))) {
-      return value;
+      _lfu_cache.add_to_cache_no_evict(key, std::move(value));
     }
-    _lru_ghost.remove_from_cache(key);
-    _lfu_ghost.remove_from_cache(key);
-    return value;
+  }
+
+  // Remove key from the cache.
+  Ptr remove_from_cache(const K& key) { return remove_key(key); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr remove_from_cache(const Q& key) {
+    return remove_key(key);
   }
 
   void reset() {
@@ -187,24 +188,19 @@ public:
     reset();
   }
 
-  // Set the maximum cache size.
+  // Set the maximum cache size, evicting until the cache fits.
   void set_max_size(int64_t size) {
     std::lock_guard<Lock> l(_lock);
-    if (size < _max_size) {
-      if (_p > size) {
-        // p must be between 0 and _max_size, but what this is telling us is
-        // that we should be dedicating all of the cache space to LRU. So let us
-        // just do that.
-        // NOTE[apanda]: There is an argument to be made for proportional
-        // reduction but I am not sure it makes sense, so might need to revisit.
-        _p = size;
-        _max_size = size;
-        replace(false);
-      }
-    } else {
-      _max_size = size;
-      // Do not need to adjust anything.
+    if (_p > size) {
+      // p must be between 0 and _max_size, but what this is telling us is
+      // that we should be dedicating all of the cache space to LRU. So let us
+      // just do that.
+      // NOTE[apanda]: There is an argument to be made for proportional
+      // reduction but I am not sure it makes sense, so might need to revisit.
+      _p = size;
     }
+    _max_size = size;
+    replace(false);
   }
 
   FlexARC() = delete;
@@ -212,25 +208,169 @@ public:
   FlexARC operator=(const FlexARC&) = delete;
 
 protected:
-  inline void adapt_lru_ghost_hit() {
+  // T1 first: entries only move from T1 to T2.
+  inline Ptr peek_impl(const K& key) {
+    size_t hash = _lru_cache.hash(key);
+    Ptr value = _lru_cache.peek(key, hash);
+    return value ? value : _lfu_cache.peek(key, hash);
+  }
+
+  // Prefetches the index slots of hash in both caches.
+  inline void prefetch(size_t hash) const {
+    _lfu_cache.prefetch(hash);
+    _lru_cache.prefetch(hash);
+  }
+
+  template <typename Q> inline Ptr remove_key(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    auto value = _lru_cache.remove_from_cache(key);
+    if (value) {
+      return value;
+    } else if ((value = _lfu_cache.remove_from_cache(key))) {
+      return value;
+    }
+    _lru_ghost.remove(key);
+    _lfu_ghost.remove(key);
+    return value;
+  }
+
+  // Lock taken. Both caches share Index, so one hash serves both.
+  template <typename Q> inline Ptr get_impl(const Q& key, size_t hash) {
+    if constexpr (kIsTinyLFU<Filter>) {
+      _filter.record(key);
+    }
+    Ptr lfu_value = _lfu_cache.get(key, hash);
+    if (lfu_value) {
+      ++_stats.num_hits;
+      _stats.bytes_hit += _sizer(lfu_value.get());
+      ++_stats.lfu_hits;
+      assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
+      return lfu_value;
+    }
+
+    Ptr lru_value = _lru_cache.remove_from_cache(key, hash);
+    if (lru_value) {
+      _lfu_cache.add_to_cache_no_evict(to_key<K>(key), lru_value);
+      ++_stats.num_hits;
+      _stats.bytes_hit += _sizer(lru_value.get());
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.num_misses;
+      // Access ghosts.
+      bool lru_ghost = _lru_ghost.contains(key);
+      bool lfu_ghost = _lfu_ghost.contains(key);
+      _stats.lfu_ghost_hits += (int64_t)lfu_ghost;
+      _stats.lru_ghost_hits += (int64_t)lru_ghost;
+      assert((!(lru_ghost || lfu_ghost)) || (lru_ghost ^ lfu_ghost));
+    }
+    assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
+    return lru_value;
+  }
+
+  // Lock taken
+  inline void add_impl(const K& key, Ptr value) {
+    bool lru_ghost_hit = _lru_ghost.contains(key);
+    bool lfu_ghost_hit = _lfu_ghost.contains(key);
+    bool in_lfu = false;
+    bool should_replace = true;
+
+    // Check if the key is already in LRU cache.
+    // We do so by removing the item since well that is what we would do
+    // eventually anyways.
+    if (_lru_cache.contains(key)) {
+      // Given it was already in the LRU cache, we need to add it
+      // to the lfu cache and call it a day.
+      _lru_cache.remove_from_cache(key);
+      _lfu_cache.add_to_cache_no_evict(key, value);
+      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
+      in_lfu = false;
+    } else if (_lfu_cache.contains(key)) {
+      // Just update the item, and don't worry about it.
+      _lfu_cache.add_to_cache_no_evict(key, value);
+      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
+      // Now we might need to make space.
+      in_lfu = true;
+    } else if (!(lfu_ghost_hit || lru_ghost_hit) && _filter.max_size() > 0 &&
+               !admit(key, value)) {
+      // Filter should only kick in for entries evicted far enough in the past.
+      ++_stats.arc_filter;
+      // Do not call replace in this case
+      should_replace = false;
+    } else if (lru_ghost_hit) {
+      // We used to have this key, we recently evicted it, let us make this
+      // a frequent key. Case II in Figure 4.
+      adapt_lru_ghost_hit(_sizer(value.get()));
+      // Add things back
+      _lfu_cache.add_to_cache_no_evict(key, value);
+      _lru_ghost.remove(key);
+      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
+      // Do this only after fixing all invariants, to evict.
+      in_lfu = false;
+    } else if (lfu_ghost_hit) {
+      // Case III
+      adapt_lfu_ghost_hit(_sizer(value.get()));
+      // Add things
+      _lfu_cache.add_to_cache_no_evict(key, value);
+      _lfu_ghost.remove(key);
+      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
+      in_lfu = true;
+    } else {
+      // Case IV
+      assert(!_lru_ghost.contains(key) && !_lfu_ghost.contains(key));
+      _lru_cache.add_to_cache_no_evict(key, value);
+      in_lfu = false;
+    }
+    // The call to replace restores the size invariant.
+    if (should_replace) {
+      replace(in_lfu);
+    }
+    assert(_lfu_cache.size() + _lru_cache.size() <= _max_size);
+  }
+
+  // As AdaptiveCache::admit(), the victim is what replace(false) would evict
+  // once key is in T1. If that is key itself no cached key is at stake and it
+  // is admitted.
+  inline bool admit(const K& key, const Ptr& value) {
+    if constexpr (kIsTinyLFU<Filter>) {
+      if (size() + _sizer(value.get()) <= _max_size) {
+        return true;
+      }
+      bool from_lru = _lru_cache.size() + _sizer(value.get()) > _p ||
+                      _lfu_cache.size() == 0;
+      const K* victim = from_lru ? _lru_cache.peek_tail_key()
+                                 : _lfu_cache.peek_tail_key();
+      return victim == nullptr || _filter.admit(key, *victim);
+    } else {
+      if (_filter.contains(key)) {
+        return true;
+      }
+      _filter.add(key, _sizer(value.get()));
+      return false;
+    }
+  }
+
+  // As AdaptiveCache, p moves by entries or with a sized Ghost by bytes.
+  inline void adapt_lru_ghost_hit(int64_t size) {
+    int64_t unit = Ghost::kSized ? size : 1;
     int64_t delta = 0;
     if (_lru_ghost.size() >= _lfu_ghost.size()) {
-      delta = 1;
+      delta = unit;
     } else {
       assert(_lru_ghost.size() != 0);
-      delta = (_lfu_ghost.size() / _lru_ghost.size());
+      delta = unit * _lfu_ghost.size() / _lru_ghost.size();
     }
     _p = std::min(_p + delta, _max_size);
     _max_p = std::max(_max_p, _p);
   }
 
-  inline void adapt_lfu_ghost_hit() {
+  inline void adapt_lfu_ghost_hit(int64_t size) {
+    int64_t unit = Ghost::kSized ? size : 1;
     int64_t delta = 0;
     if (_lfu_ghost.size() >= _lru_ghost.size()) {
-      delta = 1;
+      delta = unit;
     } else {
       assert(_lru_ghost.size() != 0);
-      delta = _lru_ghost.size() / _lfu_ghost.size();
+      delta = unit * _lru_ghost.size() / _lfu_ghost.size();
     }
     _p = std::max(_p - delta, int64_t(0));
     // Don't need to update _max_p here
@@ -245,7 +385,7 @@ protected:
            (_lru_cache.size() == _p && in_lfu_ghost))) {
         std::optional<K> evicted = _lru_cache.evict_entry(bytes_evicted);
         if (evicted) {
-          _lru_ghost.add_to_cache(*evicted, nullptr);
+          _lru_ghost.add(*evicted, bytes_evicted);
           assert(!_lfu_ghost.contains(*evicted) &&
                  !_lru_cache.contains(*evicted));
           ++_stats.lru_evicts;
@@ -254,7 +394,7 @@ protected:
       } else if (_lfu_cache.size() > 0) {
         std::optional<K> evicted = _lfu_cache.evict_entry(bytes_evicted);
         if (evicted) {
-          _lfu_ghost.add_to_cache(*evicted, nullptr);
+          _lfu_ghost.add(*evicted, bytes_evicted);
           assert(!_lru_ghost.contains(*evicted));
           ++_stats.lfu_evicts;
           _stats.bytes_evicted += bytes_evicted;
@@ -263,7 +403,7 @@ protected:
         // We need to evict something, so...
         std::optional<K> evicted = _lru_cache.evict_entry(bytes_evicted);
         if (evicted) {
-          _lru_ghost.add_to_cache(*evicted, nullptr);
+          _lru_ghost.add(*evicted, bytes_evicted);
           assert(!_lfu_ghost.contains(*evicted) &&
                  !_lru_cache.contains(*evicted));
           ++_stats.lru_evicts;
@@ -280,11 +420,12 @@ private:
   int64_t _p;
   int64_t _max_p;
   int64_t _ghost_size;
-  LRUCache<K, V, NopLock, Sizer> _lru_cache;
-  LRUCache<K, V, NopLock, Sizer> _lfu_cache;
-  LRUCache<K, V, NopLock> _lru_ghost;
-  LRUCache<K, V, NopLock> _lfu_ghost;
-  LRUCache<K, V, NopLock> _filter;
+  LRUCache<K, V, NopLock, Sizer, Index, Ptr> _lru_cache;
+  LRUCache<K, V, NopLock, Sizer, Index, Ptr> _lfu_cache;
+  Ghost _lru_ghost;
+  Ghost _lfu_ghost;
+  Filter _filter;
+  Sizer _sizer;
   Stats _stats;
 };
 } // namespace cache
@@ -0,0 +1,409 @@
+#pragma once
+
+/*
+ * Implements ghost lists: LRU lists that only remember which keys were
+ * recently evicted, used by ARC and FlexARC.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "cache/cache.h"
+#include "cache/lru.h"
+
+namespace cache {
+
+// Any ghost list must provide contains(), add(), remove(), evict(), size(),
+// max_size() and clear() with the semantics below. contains() and remove()
+// also take KeyView<K>.
+//
+// add() is passed the size of the evicted value in the cache's Sizer units.
+// kSized says whether the list keeps it: if so its sizes are in those units,
+// otherwise they are in entries and the size is ignored.
+
+// Ghost list that stores a copy of each key, this is exact.
+template <typename K, template <typename, typename> class Index = NodeIndex>
+class KeyGhost {
+public:
+  static constexpr bool kSized = false;
+
+  explicit KeyGhost(int64_t size) : _list{size} {}
+
+  inline int64_t size() const { return _list.size(); }
+  inline int64_t max_size() const { return _list.max_size(); }
+
+  // Returns true if key is in the list, moving it to the head.
+  inline bool contains(const K& key) { return _list.contains(key); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline bool contains(const Q& key) {
+    return _list.contains(key);
+  }
+
+  // Adds key at the head, evicting from the tail if the list is full.
+  inline void add(const K& key, int64_t /* size */ = 1) {
+    _list.add_to_cache(key, nullptr);
+  }
+
+  inline void remove(const K& key) { _list.remove_from_cache(key); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline void remove(const Q& key) {
+    _list.remove_from_cache(key);
+  }
+
+  // Removes the tail entry, if any.
+  inline void evict() { _list.evict_entry(); }
+
+  // Evicts from the tail until at most size entries are left.
+  inline void set_max_size(int64_t size) { _list.set_max_size(size); }
+
+  inline void clear() { _list.clear(); }
+
+private:
+  LRUCache<K, bool, NopLock, ElementCount<bool>, Index> _list;
+};
+
+// Ghost list that also remembers the size each key had when it was evicted,
+// so that size() and max_size() are in the cache's Sizer units rather than
+// entries. With it ARC compares its ghost lists against byte sized caches and
+// adapts p in bytes, see AdaptiveCache.
+template <typename K, template <typename, typename> class Index = NodeIndex>
+class SizedGhost {
+public:
+  static constexpr bool kSized = true;
+
+  explicit SizedGhost(int64_t size) : _max_size{size} {}
+
+  inline int64_t size() const { return _size; }
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t num_entries() const { return _list.size(); }
+
+  // Returns true if key is in the list, moving it to the head.
+  inline bool contains(const K& key) { return contains_impl(key); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline bool contains(const Q& key) {
+    return contains_impl(key);
+  }
+
+  // Adds key of size at the head, evicting from the tail until the list fits.
+  inline void add(const K& key, int64_t size) {
+    auto [link, inserted] = _index.emplace(key, size);
+    if (inserted) {
+      _list.insert_head(link);
+    } else {
+      _size -= link->size;
+      link->size = size;
+      _list.move_to_head(link);
+    }
+    _size += size;
+    while (_size > _max_size) {
+      evict();
+    }
+  }
+
+  inline void remove(const K& key) { remove_impl(key); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline void remove(const Q& key) {
+    remove_impl(key);
+  }
+
+  // Removes the tail entry, if any.
+  inline void evict() {
+    Link* link = _list.remove_tail();
+    if (link) {
+      _size -= link->size;
+      _index.erase(link);
+    }
+  }
+
+  // Evicts from the tail until the sizes add up to at most size.
+  void set_max_size(int64_t size) {
+    _max_size = size;
+    while (_size > _max_size) {
+      evict();
+    }
+  }
+
+  void clear() {
+    _list.clear();
+    _index.clear();
+    _size = 0;
+  }
+
+  SizedGhost(const SizedGhost&) = delete;
+  SizedGhost operator=(const SizedGhost&) = delete;
+
+private:
+  struct Link {
+    K key;
+    int64_t size;
+    Link* prev;
+    Link* next;
+
+    Link(K k, int64_t s) : key{k}, size{s}, prev{nullptr}, next{nullptr} {}
+    Link(const Link&) = delete;
+    Link operator=(const Link&) = delete;
+    Link(Link&&) = default;
+  };
+
+  int64_t _max_size;
+  int64_t _size = 0;
+  Index<K, Link> _index;
+  LRUList<K, bool, Link> _list;
+
+  template <typename Q> inline bool contains_impl(const Q& key) {
+    Link* link = _index.find(key);
+    if (link) {
+      _list.move_to_head(link);
+    }
+    return link != nullptr;
+  }
+
+  template <typename Q> inline void remove_impl(const Q& key) {
+    Link* link = _index.find(key);
+    if (link) {
+      _list.remove(link);
+      _size -= link->size;
+      _index.erase(link);
+    }
+  }
+};
+
+// Ghost list that stores only a 64 bit fingerprint of each key. Entries are
+// 16 byte nodes in one array, linked into an LRU list by index, and found
+// through an open addressing table of node indexes kept at most half full,
+// so an entry costs about 24 bytes however large the key is.
+//
+// Two keys with the same fingerprint are the same entry, so contains() can
+// return a false positive. Fingerprints are the key's std::hash mixed to 64
+// bits; for keys whose hash is only 32 bits (e.g. RefCountKey) the odds of a
+// false positive are about size / 2^32 per lookup.
+template <typename K> class FingerprintGhost {
+public:
+  static constexpr bool kSized = false;
+
+  explicit FingerprintGhost(int64_t size) : _max_size{size} {
+    grow();
+    if (size > 0) {
+      reserve(std::min(size, kMaxReserve));
+    }
+  }
+
+  inline int64_t size() const { return _size; }
+  inline int64_t max_size() const { return _max_size; }
+
+  // Returns true if key is in the list, moving it to the head.
+  inline bool contains(const K& key) { return contains_fp(fingerprint(key)); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline bool contains(const Q& key) {
+    return contains_fp(fingerprint(key));
+  }
+
+  // Adds key at the head, evicting from the tail if the list is full.
+  inline void add(const K& key, int64_t /* size */ = 1) {
+    uint64_t fp = fingerprint(key);
+    uint32_t pos = find(fp);
+    if (_table[pos] != kNil) {
+      move_to_head(_table[pos]);
+      return;
+    }
+    if (_max_size <= 0) {
+      return;
+    }
+    if (_size >= _max_size) {
+      evict();
+      pos = find(fp);
+    }
+    if ((_size + 1) * 2 > (int64_t)_table.size()) {
+      grow();
+      pos = find(fp);
+    }
+    uint32_t n = allocate(fp);
+    _table[pos] = n;
+    insert_head(n);
+    ++_size;
+  }
+
+  inline void remove(const K& key) { remove_fp(fingerprint(key)); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline void remove(const Q& key) {
+    remove_fp(fingerprint(key));
+  }
+
+  // Removes the tail entry, if any.
+  inline void evict() {
+    if (_tail != kNil) {
+      erase(find(_nodes[_tail].fp));
+    }
+  }
+
+  // Evicts from the tail until at most size entries are left.
+  void set_max_size(int64_t size) {
+    _max_size = size;
+    while (_size > std::max(_max_size, int64_t(0))) {
+      evict();
+    }
+  }
+
+  void clear() {
+    std::fill(_table.begin(), _table.end(), kNil);
+    _nodes.clear();
+    _free.clear();
+    _head = _tail = kNil;
+    _size = 0;
+  }
+
+  FingerprintGhost(const FingerprintGhost&) = delete;
+  FingerprintGhost operator=(const FingerprintGhost&) = delete;
+
+private:
+  static constexpr uint32_t kNil = UINT32_MAX;
+  static constexpr int64_t kMaxReserve = 1 << 16;
+  static constexpr int kMinTableBits = 4;
+
+  struct Node {
+    uint64_t fp;
+    uint32_t prev;
+    uint32_t next;
+  };
+
+  int64_t _max_size;
+  int64_t _size = 0;
+  std::vector<Node> _nodes;
+  std::vector<uint32_t> _free;
+  uint32_t _head = kNil;
+  uint32_t _tail = kNil;
+  // Node indexes, or kNil. Probing starts at the high bits of the fingerprint.
+  std::vector<uint32_t> _table;
+  uint32_t _mask = 0;
+  int _shift = 64;
+
+  template <typename Q> inline uint64_t fingerprint(const Q& key) const {
+    return std::hash<Q>()(key) * 0x9E3779B97F4A7C15ull;
+  }
+
+  inline bool contains_fp(uint64_t fp) {
+    uint32_t pos = find(fp);
+    if (_table[pos] == kNil) {
+      return false;
+    }
+    move_to_head(_table[pos]);
+    return true;
+  }
+
+  inline void remove_fp(uint64_t fp) {
+    uint32_t pos = find(fp);
+    if (_table[pos] != kNil) {
+      erase(pos);
+    }
+  }
+
+  inline uint32_t home(uint64_t fp) const { return fp >> _shift; }
+
+  // Returns the table position holding fp, or the empty position it would be
+  // inserted at.
+  inline uint32_t find(uint64_t fp) const {
+    uint32_t pos = home(fp);
+    while (_table[pos] != kNil && _nodes[_table[pos]].fp != fp) {
+      pos = (pos + 1) & _mask;
+    }
+    return pos;
+  }
+
+  void reserve(int64_t n) {
+    while (n * 2 > (int64_t)_table.size()) {
+      grow();
+    }
+    _nodes.reserve(n);
+  }
+
+  void grow() {
+    int bits = std::max(kMinTableBits, 65 - _shift);
+    _table.assign(size_t(1) << bits, kNil);
+    _mask = _table.size() - 1;
+    _shift = 64 - bits;
+    for (uint32_t n = _head; n != kNil; n = _nodes[n].next) {
+      _table[find(_nodes[n].fp)] = n;
+    }
+  }
+
+  inline uint32_t allocate(uint64_t fp) {
+    uint32_t n;
+    if (!_free.empty()) {
+      n = _free.back();
+      _free.pop_back();
+    } else {
+      n = _nodes.size();
+      _nodes.emplace_back();
+    }
+    _nodes[n].fp = fp;
+    return n;
+  }
+
+  inline void insert_head(uint32_t n) {
+    _nodes[n].prev = kNil;
+    _nodes[n].next = _head;
+    if (_head != kNil) {
+      _nodes[_head].prev = n;
+    } else {
+      _tail = n;
+    }
+    _head = n;
+  }
+
+  inline void unlink(uint32_t n) {
+    Node& node = _nodes[n];
+    if (node.prev != kNil) {
+      _nodes[node.prev].next = node.next;
+    } else {
+      _head = node.next;
+    }
+    if (node.next != kNil) {
+      _nodes[node.next].prev = node.prev;
+    } else {
+      _tail = node.prev;
+    }
+  }
+
+  inline void move_to_head(uint32_t n) {
+    if (n != _head) {
+      unlink(n);
+      insert_head(n);
+    }
+  }
+
+  // Removes the entry at table position pos. Later entries of the probe
+  // sequence are shifted back so lookups never need tombstones.
+  inline void erase(uint32_t pos) {
+    uint32_t n = _table[pos];
+    assert(n != kNil);
+    unlink(n);
+    _free.push_back(n);
+    --_size;
+
+    uint32_t next = pos;
+    while (true) {
+      next = (next + 1) & _mask;
+      if (_table[next] == kNil) {
+        break;
+      }
+      // Move the entry back unless its home lies after the hole.
+      uint32_t h = home(_nodes[_table[next]].fp);
+      if (((next - h) & _mask) >= ((next - pos) & _mask)) {
+        _table[pos] = _table[next];
+        pos = next;
+      }
+    }
+    _table[pos] = kNil;
+  }
+};
+
+} // namespace cache
@@ -0,0 +1,305 @@
+#pragma once
+
+/*
+ * Implements an LFU cache with O(1) operations, optionally with dynamic aging.
+ *
+ * Shah, Mitra and Matani. "An O(1) algorithm for implementing the LFU cache
+ * eviction scheme". 2010.
+ *
+ * Arlitt, Cherkasova, Dilley, Friedrich and Jin. "Evaluating Content
+ * Management Techniques for Web Proxy Caches". 2000 (LFU-DA).
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cache/cache.h"
+#include "cache/lru.h"
+
+namespace cache {
+
+// Evicts the least frequently used key, the least recently used of them on a
+// tie. Keys are kept in buckets, one per count in use, on a list ordered by
+// count, and each bucket holds an LRU list of its keys. A hit moves the key to
+// the bucket for its count + 1, which is the next one or a new one inserted
+// after its own, and eviction takes the tail of the first bucket, so every
+// operation is O(1). Emptied buckets are kept for reuse.
+//
+// Plain LFU never forgets: a key hit often long ago outlives everything newer.
+// With aging (LFU-DA) the count of the last key evicted, L, is remembered and
+// new keys start at L + 1 rather than 1, so keys that stop being hit are
+// overtaken by newer ones. L only grows and every count is at least L, so the
+// bucket for L + 1 is one of the first two.
+//
+// Counts are not size aware, a large value costs as much to keep as a small
+// one. Stats count every hit and eviction as lfu_hits and lfu_evicts.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ptr = std::shared_ptr<V>>
+class LFUCache : public Cache<K, V> {
+  struct Bucket;
+
+  // Entry on the list of its count's bucket.
+  struct Link {
+    K key;
+    Ptr value;
+    Link* prev;
+    Link* next;
+    Bucket* bucket;
+
+    Link(K k, Ptr v)
+        : key{k}, value{std::move(v)}, prev{nullptr}, next{nullptr},
+          bucket{nullptr} {}
+    Link(const Link&) = delete;
+    Link operator=(const Link&) = delete;
+    Link(Link&&) = default;
+  };
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  explicit LFUCache(int64_t size, bool aging = false)
+      : _max_size{size}, _aging{aging} {
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _size; }
+  inline int64_t num_entries() const { return _index.size(); }
+  inline bool aging() const { return _aging; }
+  const Stats& stats() const { return _stats; }
+  // L, the count new keys start above, takes the place of ARC's p.
+  inline int64_t p() const { return _age; }
+  inline int64_t max_p() const { return _age; }
+  inline int64_t filter_size() const { return 0; }
+  inline Lock* get_lock() { return &_lock; }
+
+  // The count of key, 0 if it is not cached.
+  int64_t count(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    return link ? link->bucket->count : 0;
+  }
+
+  const std::string label(int64_t n) const {
+    return (_aging ? "lfu-da-" : "lfu-") +
+           std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache, counting the hit.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. Keys already cached take the new value and
+  // count as used.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    int64_t sz = _sizer(value.get());
+    Link* link = _index.find(key);
+    if (link) {
+      _size += sz - _sizer(link->value.get());
+      link->value = std::move(value);
+      touch(link);
+    } else {
+      fit(sz);
+      link = _index.emplace(key, std::move(value)).first;
+      insert(link);
+      _size += sz;
+    }
+    // Only a value larger than the cache is left over.
+    fit(0);
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    _size -= _sizer(value.get());
+    unlink(link);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    while (_head) {
+      _head->entries.clear();
+      release(_head);
+    }
+    _index.clear();
+    _size = 0;
+    _age = 0;
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  LFUCache() = delete;
+  LFUCache(const LFUCache&) = delete;
+  LFUCache operator=(const LFUCache&) = delete;
+
+private:
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  // The keys with the same count, most recently used first.
+  struct Bucket {
+    int64_t count = 0;
+    Bucket* prev = nullptr;
+    Bucket* next = nullptr;
+    LRUList<K, V, Link> entries;
+  };
+
+  Lock _lock;
+  int64_t _max_size;
+  bool _aging;
+  int64_t _size = 0;
+  // L with aging, 0 otherwise.
+  int64_t _age = 0;
+  Index<K, Link> _index;
+  // Buckets in use by increasing count.
+  Bucket* _head = nullptr;
+  // Every bucket allocated, and the ones not in use.
+  std::vector<std::unique_ptr<Bucket>> _buckets;
+  std::vector<Bucket*> _free;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    ++_stats.lfu_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    touch(link);
+    return link->value;
+  }
+
+  // Returns a bucket for count, linked in after prev or first if prev is null.
+  inline Bucket* acquire(int64_t count, Bucket* prev) {
+    Bucket* b;
+    if (_free.empty()) {
+      _buckets.emplace_back(new Bucket());
+      b = _buckets.back().get();
+    } else {
+      b = _free.back();
+      _free.pop_back();
+    }
+    b->count = count;
+    b->prev = prev;
+    b->next = prev ? prev->next : _head;
+    if (b->next) {
+      b->next->prev = b;
+    }
+    if (prev) {
+      prev->next = b;
+    } else {
+      _head = b;
+    }
+    return b;
+  }
+
+  // Unlinks b, which must be empty.
+  inline void release(Bucket* b) {
+    assert(b->entries.size() == 0);
+    if (b->prev) {
+      b->prev->next = b->next;
+    } else {
+      _head = b->next;
+    }
+    if (b->next) {
+      b->next->prev = b->prev;
+    }
+    _free.push_back(b);
+  }
+
+  inline void link_to(Link* link, Bucket* b) {
+    link->bucket = b;
+    b->entries.insert_head(link);
+  }
+
+  inline void unlink(Link* link) {
+    Bucket* b = link->bucket;
+    b->entries.remove(link);
+    if (b->entries.size() == 0) {
+      release(b);
+    }
+  }
+
+  // Moves link to the bucket for its count + 1.
+  inline void touch(Link* link) {
+    Bucket* b = link->bucket;
+    Bucket* next = b->next;
+    if (next == nullptr || next->count != b->count + 1) {
+      next = acquire(b->count + 1, b);
+    }
+    unlink(link);
+    link_to(link, next);
+  }
+
+  // Links a new key into the bucket for L + 1.
+  inline void insert(Link* link) {
+    int64_t count = _age + 1;
+    Bucket* prev = nullptr;
+    Bucket* b = _head;
+    if (b && b->count < count) {
+      assert(b->count == _age);
+      prev = b;
+      b = b->next;
+    }
+    if (b == nullptr || b->count != count) {
+      b = acquire(count, prev);
+    }
+    link_to(link, b);
+  }
+
+  // Evicts until sz more fits.
+  inline void fit(int64_t sz) {
+    while (_size > 0 && _size + sz > _max_size) {
+      evict();
+    }
+  }
+
+  // Evicts the least recently used key of the lowest count.
+  inline void evict() {
+    Link* link = _head->entries.peek_tail();
+    if (_aging) {
+      _age = _head->count;
+    }
+    int64_t sz = _sizer(link->value.get());
+    _size -= sz;
+    unlink(link);
+    ++_stats.lfu_evicts;
+    ++_stats.num_evicted;
+    _stats.bytes_evicted += sz;
+    _index.erase(link);
+  }
+};
+
+} // namespace cache
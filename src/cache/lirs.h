@@ -0,0 +1,323 @@
+#pragma once
+
+/*
+ * Implements a LIRS cache.
+ *
+ * Jiang and Zhang. "LIRS: An Efficient Low Inter-reference Recency Set
+ * Replacement Policy to Improve Buffer Cache Performance". SIGMETRICS 2002.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "cache/cache.h"
+#include "cache/lru.h"
+
+namespace cache {
+
+// Entry of a LIRSCache. A link can be on the stack S and, at the same time,
+// on the queue Q (resident HIR keys) or the list of non-resident HIR keys, so
+// it has a pair of pointers for each.
+template <typename K, typename V, typename Ptr = std::shared_ptr<V>>
+struct LIRSLink {
+  K key;
+  // nullptr for non-resident keys.
+  Ptr value;
+  LIRSLink* s_prev;
+  LIRSLink* s_next;
+  LIRSLink* prev;
+  LIRSLink* next;
+  // A LIRSCache::State.
+  uint8_t state;
+  bool in_stack;
+
+  LIRSLink(K k, Ptr v)
+      : key{k}, value{std::move(v)}, s_prev{nullptr}, s_next{nullptr},
+        prev{nullptr}, next{nullptr}, state{0}, in_stack{false} {}
+  LIRSLink(const LIRSLink&) = delete;
+  LIRSLink operator=(const LIRSLink&) = delete;
+  LIRSLink(LIRSLink&&) = default;
+};
+
+// LIRS ranks keys by inter-reference recency (IRR), the number of other keys
+// looked up between the last two lookups of a key, rather than by recency
+// alone. Keys with a low IRR (LIR keys) get most of the cache, keys with a
+// high IRR (HIR keys) share a small part of it, by default 1%, and are the
+// only ones ever evicted. A one time key never gets out of that 1%, so scans
+// and loops larger than the cache do not flush the LIR keys, which is where
+// LRU and ARC hit nothing.
+//
+// The stack S holds keys in recency order, LIR keys and HIR keys (resident or
+// not) more recent than the least recent LIR key, which is always at its
+// bottom. A HIR key looked up while in S has a lower IRR than that bottom LIR
+// key, so it becomes LIR and the bottom LIR key is demoted to HIR. The queue Q
+// holds the resident HIR keys, evicted from its tail. A HIR key evicted while
+// in S stays in it as a non-resident key, and adding it back makes it LIR.
+//
+// Differences from the paper: sizes are in Sizer units, so a promotion demotes
+// bottom LIR keys until the LIR keys fit, and non-resident keys are bounded:
+// once there are more of them than resident keys the oldest are dropped from S.
+//
+// Stats count LIR hits and demotions as lfu_hits and lfu_evicts, HIR hits and
+// evictions as lru_hits and lru_evicts, and non-resident keys added back as
+// lru_ghost_hits.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ptr = std::shared_ptr<V>>
+class LIRSCache : public Cache<K, V> {
+  using Link = LIRSLink<K, V, Ptr>;
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  // hir is the share of size given to resident HIR keys.
+  explicit LIRSCache(int64_t size, double hir = kHIRShare)
+      : _max_size{size},
+        _hir_max{size > 0 ? std::max<int64_t>(size * hir, 1) : 0},
+        _lir_max{size - _hir_max} {
+    // Non-resident keys are bounded by resident ones.
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size * 2, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _lir_size + _hir_size; }
+  inline int64_t num_entries() const {
+    return _index.size() - _nonresident.size();
+  }
+  const Stats& stats() const { return _stats; }
+  // The resident HIR share takes the place of ARC's p.
+  inline int64_t p() const { return _hir_max; }
+  inline int64_t max_p() const { return _hir_max; }
+  inline int64_t filter_size() const { return 0; }
+  inline Lock* get_lock() { return &_lock; }
+
+  const std::string label(int64_t n) const {
+    return "lirs-" + std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache. Non-resident keys are misses.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. New keys are LIR while the LIR keys have room
+  // and HIR after that, non-resident keys come back as LIR. Keys already
+  // cached take the new value and count as used.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    int64_t sz = _sizer(value.get());
+    Link* link = _index.find(key);
+    if (link && link->state != kNonResident) {
+      resize(link, sz - _sizer(link->value.get()));
+      link->value = std::move(value);
+      touch(link);
+    } else if (link) {
+      ++_stats.lru_ghost_hits;
+      _nonresident.remove(link);
+      link->value = std::move(value);
+      link->state = kLIR;
+      _lir_size += sz;
+      _stack.move_to_head(link);
+      prune();
+    } else {
+      link = _index.emplace(key, std::move(value)).first;
+      push_stack(link);
+      if (_lir_size + sz <= _lir_max) {
+        link->state = kLIR;
+        _lir_size += sz;
+      } else {
+        link->state = kHIR;
+        _hir_size += sz;
+        _queue.insert_head(link);
+      }
+      prune();
+    }
+    fit();
+    assert(size() <= _max_size);
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    if (link->state == kNonResident) {
+      _nonresident.remove(link);
+    } else {
+      resize(link, -_sizer(value.get()));
+      if (link->state == kHIR) {
+        _queue.remove(link);
+      }
+    }
+    if (link->in_stack) {
+      _stack.remove(link);
+    }
+    _index.erase(link);
+    prune();
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    _stack.clear();
+    _queue.clear();
+    _nonresident.clear();
+    _index.clear();
+    _lir_size = 0;
+    _hir_size = 0;
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  LIRSCache() = delete;
+  LIRSCache(const LIRSCache&) = delete;
+  LIRSCache operator=(const LIRSCache&) = delete;
+
+private:
+  enum State : uint8_t { kLIR, kHIR, kNonResident };
+
+  static constexpr double kHIRShare = 0.01;
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  int64_t _hir_max;
+  int64_t _lir_max;
+  // Sizer units of LIR and resident HIR keys.
+  int64_t _lir_size = 0;
+  int64_t _hir_size = 0;
+  Index<K, Link> _index;
+  // S, most recent at the head.
+  LRUList<K, V, Link, &Link::s_prev, &Link::s_next> _stack;
+  // Q, evicted from the tail.
+  LRUList<K, V, Link> _queue;
+  // Non-resident HIR keys, all in S, oldest at the tail.
+  LRUList<K, V, Link> _nonresident;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    Link* link = _index.find(key);
+    if (link == nullptr || link->state == kNonResident) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    if (link->state == kLIR) {
+      ++_stats.lfu_hits;
+    } else {
+      ++_stats.lru_hits;
+    }
+    touch(link);
+    fit();
+    return link->value;
+  }
+
+  inline void resize(Link* link, int64_t delta) {
+    if (link->state == kLIR) {
+      _lir_size += delta;
+    } else {
+      _hir_size += delta;
+    }
+  }
+
+  inline void push_stack(Link* link) {
+    link->in_stack = true;
+    _stack.insert_head(link);
+  }
+
+  // A lookup of a resident key. A HIR key still in S becomes LIR, others move
+  // to the top of S, and HIR keys to the head of Q.
+  inline void touch(Link* link) {
+    if (link->state == kLIR) {
+      _stack.move_to_head(link);
+    } else if (link->in_stack) {
+      int64_t sz = _sizer(link->value.get());
+      _queue.remove(link);
+      _hir_size -= sz;
+      _lir_size += sz;
+      link->state = kLIR;
+      _stack.move_to_head(link);
+    } else {
+      push_stack(link);
+      _queue.move_to_head(link);
+    }
+    prune();
+  }
+
+  // Pops HIR keys off the bottom of S until a LIR key is there, forgetting
+  // the non-resident ones.
+  inline void prune() {
+    Link* link;
+    while ((link = _stack.peek_tail()) && link->state != kLIR) {
+      _stack.remove(link);
+      link->in_stack = false;
+      if (link->state == kNonResident) {
+        _nonresident.remove(link);
+        _index.erase(link);
+      }
+    }
+  }
+
+  // Demotes bottom LIR keys until the LIR keys fit, then evicts from the tail
+  // of Q until the whole cache fits.
+  inline void fit() {
+    while (_lir_size > _lir_max) {
+      Link* link = _stack.remove_tail();
+      assert(link->state == kLIR);
+      int64_t sz = _sizer(link->value.get());
+      ++_stats.lfu_evicts;
+      link->in_stack = false;
+      link->state = kHIR;
+      _lir_size -= sz;
+      _hir_size += sz;
+      _queue.insert_head(link);
+      prune();
+    }
+    while (size() > _max_size) {
+      Link* link = _queue.remove_tail();
+      int64_t sz = _sizer(link->value.get());
+      ++_stats.num_evicted;
+      ++_stats.lru_evicts;
+      _stats.bytes_evicted += sz;
+      _hir_size -= sz;
+      if (!link->in_stack) {
+        _index.erase(link);
+        continue;
+      }
+      link->state = kNonResident;
+      link->value = nullptr;
+      _nonresident.insert_head(link);
+      while (_nonresident.size() > num_entries()) {
+        Link* oldest = _nonresident.remove_tail();
+        _stack.remove(oldest);
+        _index.erase(oldest);
+      }
+    }
+  }
+};
+
+} // namespace cache
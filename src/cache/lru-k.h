@@ -0,0 +1,364 @@
+#pragma once
+
+/*
+ * Implements an LRU-K cache for K = 2.
+ *
+ * O'Neil, O'Neil and Weikum. "The LRU-K Page Replacement Algorithm For
+ * Database Disk Buffering". SIGMOD 1993.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cache/cache.h"
+#include "cache/lru.h"
+
+namespace cache {
+
+// LRU-K evicts the key whose Kth most recent reference is oldest, keys with
+// fewer than K references first, least recently used first among them. Time
+// is a count of references, every get() and add_to_cache() is one.
+//
+// With K = 2 keys referenced once are on an LRU list, keys referenced at least
+// twice on a binary heap ordered by their second most recent reference. A hit
+// on a key referenced once moves it to the heap, later hits move it down the
+// heap, so a hit is O(log n). A key evicted and added back would start over
+// as referenced once, so the history table remembers the last reference of
+// the keys evicted most recently and one of them coming back goes straight
+// onto the heap. It holds max_size keys by default and is kept apart from the
+// index as ARC's ghost lists are.
+//
+// The paper's correlated reference period, which counts references in a
+// quick burst as one, is not implemented.
+//
+// Stats count hits and evictions of keys referenced once as lru_hits and
+// lru_evicts, of the others as lfu_hits and lfu_evicts, and keys added back
+// from the history table as lru_ghost_hits.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ptr = std::shared_ptr<V>>
+class LRUKCache : public Cache<K, V> {
+  struct Link {
+    K key;
+    Ptr value;
+    // On the list of keys referenced once.
+    Link* prev;
+    Link* next;
+    // The last two references, older is 0 while there is only one.
+    int64_t last;
+    int64_t older;
+    // Position on the heap of keys referenced twice.
+    int64_t slot;
+
+    Link(K k, Ptr v)
+        : key{k}, value{std::move(v)}, prev{nullptr}, next{nullptr}, last{0},
+          older{0}, slot{-1} {}
+    Link(const Link&) = delete;
+    Link operator=(const Link&) = delete;
+    Link(Link&&) = default;
+  };
+
+  // Last reference of an evicted key.
+  struct HistoryLink {
+    K key;
+    int64_t last;
+    HistoryLink* prev;
+    HistoryLink* next;
+
+    HistoryLink(K k, int64_t l)
+        : key{k}, last{l}, prev{nullptr}, next{nullptr} {}
+    HistoryLink(const HistoryLink&) = delete;
+    HistoryLink operator=(const HistoryLink&) = delete;
+    HistoryLink(HistoryLink&&) = default;
+  };
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  // history is the number of evicted keys remembered, max_size by default.
+  explicit LRUKCache(int64_t size, int64_t history = -1)
+      : _max_size{size}, _max_history{history < 0 ? size : history} {
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size, kMaxReserve));
+      _history_index.reserve(std::min(_max_history, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _size; }
+  inline int64_t num_entries() const { return _index.size(); }
+  inline int64_t history_size() const { return _history.size(); }
+  const Stats& stats() const { return _stats; }
+  // Sizer units of the keys referenced once, in place of ARC's p.
+  inline int64_t p() const { return _once_size; }
+  inline int64_t max_p() const { return _max_once_size; }
+  inline int64_t filter_size() const { return 0; }
+  inline Lock* get_lock() { return &_lock; }
+
+  const std::string label(int64_t n) const {
+    return "lru2-" + std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache, recording the reference.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. Keys already cached take the new value and
+  // count as referenced.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    ++_now;
+    int64_t sz = _sizer(value.get());
+    Link* link = _index.find(key);
+    if (link) {
+      resize(link, sz - _sizer(link->value.get()));
+      link->value = std::move(value);
+      reference(link);
+    } else {
+      fit(sz);
+      link = _index.emplace(key, std::move(value)).first;
+      link->last = _now;
+      HistoryLink* h = _history_index.find(key);
+      if (h) {
+        ++_stats.lru_ghost_hits;
+        link->older = h->last;
+        _history.remove(h);
+        _history_index.erase(h);
+        push(link);
+      } else {
+        _once.insert_head(link);
+      }
+      resize(link, sz);
+    }
+    // Only a value larger than the cache is left over.
+    fit(0);
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      HistoryLink* h = _history_index.find(key);
+      if (h) {
+        _history.remove(h);
+        _history_index.erase(h);
+      }
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    resize(link, -_sizer(value.get()));
+    unlink(link);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    _once.clear();
+    _heap.clear();
+    _index.clear();
+    _history.clear();
+    _history_index.clear();
+    _size = 0;
+    _once_size = 0;
+    _now = 0;
+  }
+
+  void clear() {
+    _stats.clear();
+    _max_once_size = 0;
+    reset();
+  }
+
+  LRUKCache() = delete;
+  LRUKCache(const LRUKCache&) = delete;
+  LRUKCache operator=(const LRUKCache&) = delete;
+
+private:
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  int64_t _max_history;
+  int64_t _size = 0;
+  // Sizer units of the keys on _once.
+  int64_t _once_size = 0;
+  int64_t _max_once_size = 0;
+  // References so far.
+  int64_t _now = 0;
+  Index<K, Link> _index;
+  // Keys referenced once, most recent first.
+  LRUList<K, V, Link> _once;
+  // Keys referenced twice, a min heap on Link::older.
+  std::vector<Link*> _heap;
+  Index<K, HistoryLink> _history_index;
+  LRUList<K, bool, HistoryLink> _history;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    ++_now;
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    if (link->older == 0) {
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.lfu_hits;
+    }
+    reference(link);
+    return link->value;
+  }
+
+  inline void resize(Link* link, int64_t delta) {
+    _size += delta;
+    if (link->older == 0) {
+      _once_size += delta;
+      _max_once_size = std::max(_max_once_size, _once_size);
+    }
+  }
+
+  // Records a reference to link at _now.
+  inline void reference(Link* link) {
+    link->older = link->last;
+    link->last = _now;
+    if (link->slot < 0) {
+      _once.remove(link);
+      _once_size -= _sizer(link->value.get());
+      push(link);
+    } else {
+      sift_down(link->slot);
+    }
+  }
+
+  inline void unlink(Link* link) {
+    if (link->slot < 0) {
+      _once.remove(link);
+    } else {
+      remove_slot(link->slot);
+    }
+  }
+
+  inline void place(Link* link, int64_t slot) {
+    _heap[slot] = link;
+    link->slot = slot;
+  }
+
+  inline void push(Link* link) {
+    _heap.push_back(link);
+    link->slot = _heap.size() - 1;
+    sift_up(link->slot);
+  }
+
+  inline void sift_up(int64_t slot) {
+    Link* link = _heap[slot];
+    while (slot > 0) {
+      int64_t parent = (slot - 1) / 2;
+      if (_heap[parent]->older <= link->older) {
+        break;
+      }
+      place(_heap[parent], slot);
+      slot = parent;
+    }
+    place(link, slot);
+  }
+
+  inline void sift_down(int64_t slot) {
+    Link* link = _heap[slot];
+    int64_t n = _heap.size();
+    while (true) {
+      int64_t child = 2 * slot + 1;
+      if (child >= n) {
+        break;
+      }
+      if (child + 1 < n && _heap[child + 1]->older < _heap[child]->older) {
+        ++child;
+      }
+      if (link->older <= _heap[child]->older) {
+        break;
+      }
+      place(_heap[child], slot);
+      slot = child;
+    }
+    place(link, slot);
+  }
+
+  inline void remove_slot(int64_t slot) {
+    _heap[slot]->slot = -1;
+    Link* last = _heap.back();
+    _heap.pop_back();
+    if (slot < (int64_t)_heap.size()) {
+      place(last, slot);
+      sift_down(slot);
+      sift_up(last->slot);
+    }
+  }
+
+  // Remembers the last reference of an evicted key.
+  inline void remember(const Link* link) {
+    if (_max_history <= 0) {
+      return;
+    }
+    auto [h, inserted] = _history_index.emplace(link->key, link->last);
+    if (!inserted) {
+      h->last = link->last;
+      _history.move_to_head(h);
+      return;
+    }
+    _history.insert_head(h);
+    if (_history.size() > _max_history) {
+      HistoryLink* tail = _history.remove_tail();
+      _history_index.erase(tail);
+    }
+  }
+
+  // Evicts until sz more fits.
+  inline void fit(int64_t sz) {
+    while (_size > 0 && _size + sz > _max_size) {
+      evict();
+    }
+  }
+
+  // Evicts the least recently used key referenced once, or the key whose
+  // second most recent reference is oldest if there are none.
+  inline void evict() {
+    Link* link;
+    if (_once.size() > 0) {
+      link = _once.peek_tail();
+      ++_stats.lru_evicts;
+    } else {
+      link = _heap.front();
+      ++_stats.lfu_evicts;
+    }
+    int64_t sz = _sizer(link->value.get());
+    resize(link, -sz);
+    unlink(link);
+    remember(link);
+    ++_stats.num_evicted;
+    _stats.bytes_evicted += sz;
+    _index.erase(link);
+  }
+};
+
+} // namespace cache
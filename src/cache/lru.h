@@ -3,15 +3,21 @@
 /*
  * Implements a LRU cache, which in turn is necessary when building ARC.
  */
+#include <algorithm>
 #include <cassert>
 #include <memory>
 #include <mutex>
 #include <optional>
 #include <string>
 #include <tuple>
+#include <type_traits>
 #include <unordered_map>
 
+#include "cache/arena.h"
 #include "cache/cache.h"
+#include "util/compiler-util.h"
+#include "util/epoch.h"
+#include "util/striped-counter.h"
 
 // FIXME: Maybe move to different namespace?
 namespace cache {
@@ -20,23 +26,23 @@ namespace cache {
 // hashmap allows quick lookup, the linked list allows tracking. However, we
 // need some linked list operations that std::list does not seem to offer,
 // hence building it in here.
-template <typename K, typename V> struct LRULink {
+template <typename K, typename V, typename Ptr = std::shared_ptr<V>>
+struct LRULink {
   K key;
-  // FIXME: Figure out what memory management semantics we
-  // prefer. It is important to be able to
+  // It is important to be able to
   // (a) Have a link without a valid value: this is necessary for ghost
   // lists.
   // (b) Hand out values, and then invalidate without causing someone with
   // a reference from failing.
   //
-  // Given this shared_ptr seemed good, but there are obvious issues with
-  // this.
-  std::shared_ptr<V> value;
-  LRULink<K, V>* prev;
-  LRULink<K, V>* next;
+  // Ptr is std::shared_ptr by default, Pinned (cache/pinned.h) is a lighter
+  // alternative with the same semantics.
+  Ptr value;
+  LRULink* prev;
+  LRULink* next;
 
   // Adding a constructor for convenience.
-  LRULink(K k, std::shared_ptr<V> v)
+  LRULink(K k, Ptr v)
       : key{k}, value{std::move(v)}, prev{nullptr}, next{nullptr} {}
   // No copy constructor.
   LRULink(const LRULink&) = delete;
@@ -48,22 +54,27 @@ template <typename K, typename V> struct LRULink {
 
 // The actual LRU link list. Elements enter by being inserted at the head
 // and age out as they fall to the tail. Elements are removed from the tail.
-template <typename K, typename V> class LRUList {
+//
+// Prev and Next name the link's pointers for this list, so a link with two
+// pairs of them can be on two lists at once (see LIRSCache).
+template <typename K, typename V, typename Link = LRULink<K, V>,
+          Link* Link::*Prev = &Link::prev, Link* Link::*Next = &Link::next>
+class LRUList {
 public:
   LRUList() : _head{nullptr}, _tail{nullptr}, _length{0} {}
 
-  LRULink<K, V>* peek_head() const { return _head; }
+  Link* peek_head() const { return _head; }
 
-  LRULink<K, V>* peek_tail() const { return _tail; }
+  Link* peek_tail() const { return _tail; }
 
   int64_t size() const { return _length; }
 
   // Insert entry into head.
-  inline void insert_head(LRULink<K, V>* entry) {
-    entry->next = _head;
+  inline void insert_head(Link* entry) {
+    entry->*Next = _head;
     if (_head) {
-      assert(!_head->prev);
-      _head->prev = entry;
+      assert(!(_head->*Prev));
+      _head->*Prev = entry;
     }
 
     _head = entry;
@@ -78,17 +89,17 @@ public:
 
   // Remove the tail entry, this is essentially aging out
   // an entry.
-  LRULink<K, V>* remove_tail() {
-    LRULink<K, V>* ret = _tail;
+  Link* remove_tail() {
+    Link* ret = _tail;
     if (ret) {
-      _tail = ret->prev;
+      _tail = ret->*Prev;
       if (_tail) {
-        _tail->next = nullptr;
+        _tail->*Next = nullptr;
       } else {
         assert(_length == 1);
         _head = nullptr;
       }
-      ret->next = ret->prev = nullptr;
+      ret->*Next = ret->*Prev = nullptr;
       _length--;
     }
     return ret;
@@ -96,27 +107,27 @@ public:
 
   // Remove an arbitrary entry.
   // ASSUMES: entry in list.
-  inline void remove(LRULink<K, V>* entry) {
-    if (entry->prev) {
-      entry->prev->next = entry->next;
+  inline void remove(Link* entry) {
+    if (entry->*Prev) {
+      entry->*Prev->*Next = entry->*Next;
     } else {
       assert(_head == entry);
-      _head = entry->next;
+      _head = entry->*Next;
     }
 
-    if (entry->next) {
-      entry->next->prev = entry->prev;
+    if (entry->*Next) {
+      entry->*Next->*Prev = entry->*Prev;
     } else {
       assert(_tail == entry);
-      _tail = entry->prev;
+      _tail = entry->*Prev;
     }
-    entry->next = entry->prev = nullptr;
+    entry->*Next = entry->*Prev = nullptr;
     _length--;
   }
 
   // When accessing an element move it to the head to allow it to survive.
   // ASSUMES elt is in list.
-  void move_to_head(LRULink<K, V>* elt) {
+  void move_to_head(Link* elt) {
     assert(_head && _tail && _length > 0); // Cannot be an empty list.
     if (elt != _head) {
       remove(elt);
@@ -134,24 +145,187 @@ public:
   LRUList operator=(const LRUList&) = delete;
 
 private:
-  LRULink<K, V>* _head;
-  LRULink<K, V>* _tail;
+  Link* _head;
+  Link* _tail;
   int64_t _length;
 };
 
-// An LRU cache of fixed size.
+// The default index for LRUCache, a node based std::unordered_map. Links live
+// inside the map nodes, which keeps them at a stable address across rehashes
+// so the LRU list can point at them. Nodes come from a per index NodeArena so
+// erased nodes are recycled rather than freed.
+//
+// An index maps keys to links and owns the links. Any index used by LRUCache
+// must provide find(), emplace(), erase(), reserve(), size() and clear() with
+// these semantics, see FlatIndex for an alternative.
+//
+// Batched lookups also use hash(), prefetch() and the find() and emplace()
+// overloads taking a hash: a batch hashes every key and prefetches where its
+// lookup starts before probing any of them.
+//
+// kConcurrentReads says whether find() may run concurrently with the writer,
+// see ConcurrentIndex.
+template <typename K, typename Link> class NodeIndex {
+public:
+  static constexpr bool kConcurrentReads = false;
+
+  NodeIndex()
+      : _map(0, std::hash<K>(), std::equal_to<K>(),
+             ArenaAllocator<std::pair<const K, Link>>(&_arena)) {}
+
+  inline int64_t size() const { return _map.size(); }
+
+  // Preallocates buckets and nodes for n links.
+  inline void reserve(int64_t n) {
+    _arena.reserve(n);
+    _map.reserve(n);
+  }
+
+  // Returns the link for key or nullptr if it is not indexed. Lookups take K
+  // or KeyView<K>.
+  template <typename Q> inline Link* find(const Q& key) {
+    static_assert(kIsLookupKey<K, Q>, "Look up by K or KeyView<K>");
+    if constexpr (std::is_same<K, Q>::value) {
+      auto elt = _map.find(key);
+      return elt == _map.end() ? nullptr : &elt->second;
+    } else {
+      return find(key, hash(key));
+    }
+  }
+
+  // The map's hash of key; a KeyView<K> hashes as its K.
+  template <typename Q> inline size_t hash(const Q& key) const {
+    static_assert(kIsLookupKey<K, Q>, "Look up by K or KeyView<K>");
+    if constexpr (std::is_same<K, Q>::value) {
+      return _map.hash_function()(key);
+    } else {
+      return std::hash<Q>()(key);
+    }
+  }
+
+  // Prefetches the first node of the bucket of hash, where find() starts
+  // comparing keys. Reaching it loads the bucket, which does not depend on
+  // the previous key's so the loads of a batch overlap. Assumes the bucket of
+  // a hash is hash % bucket_count(), see kModBuckets; any other layout only
+  // makes this a wasted load.
+  inline void prefetch(size_t hash) const {
+    size_t n = _map.bucket_count();
+    auto first = _map.begin(hash % n);
+    if (first != _map.end(hash % n)) {
+      PREFETCH(&*first);
+    }
+  }
+
+  // As find(key) for hash == hash(key). std::unordered_map can not look up by
+  // a precomputed hash nor, until C++20, by anything but a K, so a K is
+  // rehashed by the map and a KeyView<K> is compared against the nodes of its
+  // bucket.
+  template <typename Q> inline Link* find(const Q& key, size_t hash) {
+    if constexpr (std::is_same<K, Q>::value) {
+      return find(key);
+    } else if constexpr (kModBuckets) {
+      size_t n = hash % _map.bucket_count();
+      for (auto elt = _map.begin(n); elt != _map.end(n); ++elt) {
+        if (elt->first == key) {
+          return &elt->second;
+        }
+      }
+      return nullptr;
+    } else {
+      // Assigning the view to a per thread K reuses its buffer, so this
+      // allocates only when a key is longer than any before it.
+      static thread_local K probe;
+      probe = key;
+      return find(probe);
+    }
+  }
+
+  // Returns the link for key, creating it from (key, value) if it does not
+  // exist. The boolean is true if the link was created, an existing link is
+  // returned unmodified.
+  template <typename P>
+  inline std::pair<Link*, bool> emplace(const K& key, P value) {
+    auto emplaced = _map.try_emplace(key, key, std::move(value));
+    return {&emplaced.first->second, emplaced.second};
+  }
+
+  template <typename P>
+  inline std::pair<Link*, bool> emplace(const K& key, P value, size_t) {
+    return emplace(key, std::move(value));
+  }
+
+  // Removes and destroys link.
+  // ASSUMES: link was returned by this index.
+  inline void erase(Link* link) {
+    int64_t removed VARIABLE_UNUSED = _map.erase(link->key);
+    // We should have no more than one element with the key.
+    assert(removed == 1);
+  }
+
+  inline void clear() { _map.clear(); }
+
+  NodeIndex(const NodeIndex&) = delete;
+  NodeIndex operator=(const NodeIndex&) = delete;
+
+private:
+  // Whether the map puts a hash in bucket hash % bucket_count(), which
+  // libstdc++ and libc++ do. Elsewhere KeyView<K> lookups copy the view.
+#if defined(__GLIBCXX__) || defined(_LIBCPP_VERSION)
+  static constexpr bool kModBuckets = true;
+#else
+  static constexpr bool kModBuckets = false;
+#endif
+
+  // Declared before _map, the map's nodes live in here.
+  NodeArena _arena;
+  std::unordered_map<K, Link, std::hash<K>, std::equal_to<K>,
+                     ArenaAllocator<std::pair<const K, Link>>>
+      _map;
+};
+
+// An LRU cache of fixed size. Index selects the key -> link map, NodeIndex
+// (std::unordered_map) by default or FlatIndex for an open addressing table.
+// Ptr is the value handle, see LRULink.
+//
+// With ConcurrentIndex lookups take no lock: get() runs inside an EpochGuard
+// and marks the link referenced rather than moving it to the head, and
+// eviction gives referenced links a second trip through the list (CLOCK
+// style). Writers still serialize on Lock.
 template <typename K, typename V, typename Lock = NopLock,
-          typename Sizer = ElementCount<V>>
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ptr = std::shared_ptr<V>>
 class LRUCache : public Cache<K, V> {
+  using Link = LRULink<K, V, Ptr>;
+
 public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  static constexpr bool kConcurrentReads = Index<K, Link>::kConcurrentReads;
+
   LRUCache(int64_t size)
       : _max_size{size}, _current_size{0}, _access_list{},
-        _access_map{}, _sizer{} {}
+        _access_map{}, _sizer{} {
+    // When the cache counts entries its size bounds the number of links, so
+    // size the index up front. This covers the ARC ghost lists and filters.
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _access_map.reserve(std::min(size, kMaxReserve));
+    }
+  }
 
   inline int64_t max_size() const { return _max_size; }
   inline int64_t size() const { return _current_size; }
   inline int64_t num_entries() const { return _access_list.size(); }
-  const Stats& stats() const { return _stats; }
+  Stats stats() const {
+    Stats s = _stats;
+    if constexpr (kConcurrentReads) {
+      s.num_hits = _read_stats.hits.sum();
+      s.num_misses = _read_stats.misses.sum();
+      s.bytes_hit = _read_stats.bytes_hit.sum();
+    }
+    return s;
+  }
   inline int64_t p() const { return 0; }
   inline int64_t max_p() const { return 0; }
   inline int64_t filter_size() const { return 0; }
@@ -160,40 +334,101 @@ public:
     return "lru-" + std::to_string(max_size() * 100 / n);
   }
 
+  // Hash of key for the overloads below that take one, so a caller looking
+  // the same key up in several caches with the same Index hashes it once.
+  inline size_t hash(const K& key) const { return _access_map.hash(key); }
+
+  // The lookups taking a Q (get(), contains(), remove_from_cache()) find a
+  // KeyView<K>, e.g. a std::string_view, without constructing a K.
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline size_t hash(const Q& key) const {
+    return _access_map.hash(key);
+  }
+
+  // Prefetches the index memory a lookup of hash starts at.
+  inline void prefetch(size_t hash) const { _access_map.prefetch(hash); }
+
   // Get value from the cache. If found bumps the element up in the LRU list.
-  std::shared_ptr<V> get(const K& key) {
+  Ptr get(const K& key) { return lookup(key, _access_map.hash(key)); }
+
+  // As get(key) for hash == hash(key).
+  Ptr get(const K& key, size_t hash) { return lookup(key, hash); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    return lookup(key, _access_map.hash(key));
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key, size_t hash) {
+    return lookup(key, hash);
+  }
+
+  // Returns the value for key without counting the lookup or updating
+  // recency. With a concurrent index this takes no lock.
+  Ptr peek(const K& key) { return peek(key, _access_map.hash(key)); }
+
+  Ptr peek(const K& key, size_t hash) {
+    if constexpr (kConcurrentReads) {
+      EpochGuard g;
+      Link* link = _access_map.find(key, hash);
+      return link ? link->value : nullptr;
+    } else {
+      std::lock_guard<Lock> l(_lock);
+      Link* link = _access_map.find(key, hash);
+      return link ? link->value : nullptr;
+    }
+  }
+
+  // Moves key to the head as a hit on it would, without counting the lookup.
+  // Does nothing if key is not cached.
+  void touch(const K& key) { contains_impl(key); }
+
+  // Calls fn(key) for every cached key, most recently used first.
+  template <typename Fn> void for_each_key(Fn fn) {
     std::lock_guard<Lock> l(_lock);
-    auto elt = _access_map.find(key);
-    if (elt != _access_map.end()) {
-      ++_stats.num_hits;
-      _stats.bytes_hit += _sizer(elt->second.value.get());
-      _access_list.move_to_head(&elt->second);
-      return elt->second.value;
+    for (Link* link = _access_list.peek_head(); link; link = link->next) {
+      fn(link->key);
+    }
+  }
+
+  // The key that evict_entry() would try first, nullptr if empty. Lock not
+  // taken, callers hold the lock of an enclosing cache.
+  inline const K* peek_tail_key() const {
+    Link* link = _access_list.peek_tail();
+    return link ? &link->key : nullptr;
+  }
+
+  // Gets keys[0, n) into values[0, n) under one lock acquisition, as if by n
+  // calls to get(). Keys are hashed and their index slots prefetched a batch
+  // at a time before any of them is probed. KeyArray and ValueArray are
+  // pointers or anything else indexable with [].
+  template <typename KeyArray, typename ValueArray>
+  void multi_get(KeyArray keys, size_t n, ValueArray values) {
+    if constexpr (kConcurrentReads) {
+      EpochGuard g;
+      multi_get_impl(keys, n, values);
     } else {
-      ++_stats.num_misses;
-      return nullptr;
+      std::lock_guard<Lock> l(_lock);
+      multi_get_impl(keys, n, values);
     }
   }
 
   // Check if value is in the cache. This is useful for things like ghost caches
   // where we don't have real values. Note we do bump the page up for contains,
   // this matches what ARC states in Figure 4.
-  inline bool contains(const K& key) {
-    std::lock_guard<Lock> l(_lock);
-    auto elt = _access_map.find(key);
-    if (elt != _access_map.end()) {
-      _access_list.move_to_head(&elt->second);
-      return true;
-    } else {
-      return false;
-    }
+  inline bool contains(const K& key) { return contains_impl(key); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline bool contains(const Q& key) {
+    return contains_impl(key);
   }
 
   // Insert element into cache without eviction.
   // If the same key is used then we replace the value.
-  inline void add_to_cache_no_evict(const K& key, std::shared_ptr<V> value) {
+  inline void add_to_cache_no_evict(const K& key, Ptr value) {
     std::lock_guard<Lock> l(_lock);
-    add_to_cache_no_evict_impl(key, value);
+    add_to_cache_no_evict_impl(key, value, _access_map.hash(key));
   }
 
   // Evict an entry and return the evicted entry's key.
@@ -212,32 +447,40 @@ public:
   // Insert element into the cache. Might evict a cache element if necessary.
   // If the same key is used then we replace the value.
   // Returns size of EVicted entries.
-  int64_t add_to_cache(const K& key, std::shared_ptr<V> value) {
-    // FIXME: Should input be shared_ptr? Not so sure. Revisit.
+  int64_t add_to_cache(const K& key, Ptr value) {
     // FIXME: Need to notify on eviction, this is something that the ghost
     // lists need. Alternately the no_evict form is enough?
     std::lock_guard<Lock> l(_lock);
-    add_to_cache_no_evict_impl(key, value);
-    int64_t before = _current_size;
-    while (_current_size > _max_size) {
-      size_t e;
-      evict_entry_impl(e);
+    add_to_cache_no_evict_impl(key, value, _access_map.hash(key));
+    return evict_to_fit();
+  }
+
+  // Adds keys[0, n) with values[0, n) under one lock acquisition, as if by n
+  // calls to add_to_cache(), prefetching like multi_get().
+  template <typename KeyArray, typename ValueArray>
+  void multi_add(KeyArray keys, size_t n, ValueArray values) {
+    std::lock_guard<Lock> l(_lock);
+    size_t hashes[kPrefetchBatch];
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        hashes[i] = _access_map.hash(keys[b + i]);
+        _access_map.prefetch(hashes[i]);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        add_to_cache_no_evict_impl(keys[b + i], values[b + i], hashes[i]);
+        evict_to_fit();
+      }
     }
-    // FIXME: Is this ever useful?
-    return before - _current_size;
   }
 
   // Update a cached element if it exists, do nothing otherwise. Boolean returns
   // whether or not value was updated.
-  bool update_cache(const K& key, std::shared_ptr<V> value) {
+  bool update_cache(const K& key, Ptr value) {
     std::lock_guard<Lock> l(_lock);
-    auto elt = _access_map.find(key);
-    if (elt != _access_map.end()) {
-      _access_list.move_to_head(&elt->second);
-      size_t old = _sizer(elt.first->second.value.get());
-      size_t nsz = _sizer(value.get());
-      elt.first->second.value = value;
-      _current_size += (nsz - old);
+    Link* link = _access_map.find(key);
+    if (link) {
+      replace_value(link, value);
       return true;
     } else {
       return false;
@@ -245,17 +488,23 @@ public:
   }
 
   // Remove element from cache, return value.
-  std::shared_ptr<V> remove_from_cache(const K& key) {
-    std::lock_guard<Lock> l(_lock);
-    auto elt = _access_map.find(key);
-    if (elt != _access_map.end()) {
-      _access_list.remove(&elt->second);
-      _current_size -= _sizer(elt->second.value.get());
-      auto val = std::move(elt->second.value);
-      _access_map.erase(elt);
-      return val;
-    }
-    return nullptr;
+  Ptr remove_from_cache(const K& key) {
+    return remove_key(key, _access_map.hash(key));
+  }
+
+  // As remove_from_cache(key) for hash == hash(key).
+  Ptr remove_from_cache(const K& key, size_t hash) {
+    return remove_key(key, hash);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr remove_from_cache(const Q& key) {
+    return remove_key(key, _access_map.hash(key));
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr remove_from_cache(const Q& key, size_t hash) {
+    return remove_key(key, hash);
   }
 
   // Increase the maximum cache size.
@@ -264,6 +513,13 @@ public:
   // Decrease the maximum cache size.
   void decrease_size(int64_t delta) { _max_size -= delta; }
 
+  // Set the maximum cache size, evicting until the cache fits.
+  void set_max_size(int64_t size) {
+    std::lock_guard<Lock> l(_lock);
+    _max_size = size;
+    evict_to_fit();
+  }
+
   void reset() {
     std::lock_guard<Lock> l(_lock);
     _current_size = 0;
@@ -273,6 +529,11 @@ public:
 
   void clear() {
     _stats.clear();
+    if constexpr (kConcurrentReads) {
+      _read_stats.hits.clear();
+      _read_stats.misses.clear();
+      _read_stats.bytes_hit.clear();
+    }
     reset();
   }
 
@@ -282,49 +543,177 @@ public:
   LRUCache operator=(const LRUCache&) = delete;
 
 private:
+  // Larger caches grow their index on demand.
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
   Lock _lock;
   int64_t _max_size;
   int64_t _current_size;
-  LRUList<K, V> _access_list;
-  std::unordered_map<K, LRULink<K, V>> _access_map;
+  LRUList<K, V, Link> _access_list;
+  Index<K, Link> _access_map;
   Sizer _sizer;
+  // Lookups are counted in _read_stats instead when kConcurrentReads.
   Stats _stats;
 
+  // Counts of lookups that run without the lock.
+  struct ReadStats {
+    StripedCounter hits;
+    StripedCounter misses;
+    StripedCounter bytes_hit;
+  };
+  struct NoReadStats {};
+  std::conditional_t<kConcurrentReads, ReadStats, NoReadStats> _read_stats;
+
   // FIXME: We return a key rather than a k,v pair since ARC does not need a
   // value, but is this a good design.
   inline std::optional<K> evict_entry_impl(std::size_t& evicted_size) {
     if (_current_size == 0) {
       return std::nullopt;
     }
-    LRULink<K, V>* remove = _access_list.remove_tail();
+    Link* remove = _access_list.remove_tail();
+    if constexpr (kConcurrentReads) {
+      // Second chance for links read since they last passed the tail.
+      while (Index<K, Link>::clear_referenced(remove)) {
+        _access_list.insert_head(remove);
+        remove = _access_list.remove_tail();
+      }
+    }
     K key = remove->key;
     evicted_size = _sizer(remove->value.get());
     _current_size -= evicted_size;
-    int64_t removed VARIABLE_UNUSED = _access_map.erase(remove->key);
-    // We should have no more than one element with the key.
-    assert(removed == 1);
+    _access_map.erase(remove);
     ++_stats.num_evicted;
     _stats.bytes_evicted += evicted_size;
     return key;
   }
 
+  // The public lookups for both K and KeyView<K>.
+  template <typename Q> inline Ptr lookup(const Q& key, size_t hash) {
+    if constexpr (kConcurrentReads) {
+      EpochGuard g;
+      return get_impl(_access_map.find(key, hash));
+    } else {
+      std::lock_guard<Lock> l(_lock);
+      return get_impl(_access_map.find(key, hash));
+    }
+  }
+
+  template <typename Q> inline bool contains_impl(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _access_map.find(key);
+    if (link) {
+      _access_list.move_to_head(link);
+      return true;
+    } else {
+      return false;
+    }
+  }
+
+  template <typename Q> inline Ptr remove_key(const Q& key, size_t hash) {
+    std::lock_guard<Lock> l(_lock);
+    return remove_impl(_access_map.find(key, hash));
+  }
+
+  inline Ptr get_impl(Link* link) {
+    if constexpr (kConcurrentReads) {
+      if (link) {
+        Index<K, Link>::touch(link);
+        _read_stats.hits.add(1);
+        _read_stats.bytes_hit.add(_sizer(link->value.get()));
+        return link->value;
+      }
+      _read_stats.misses.add(1);
+      return nullptr;
+    } else if (link) {
+      ++_stats.num_hits;
+      _stats.bytes_hit += _sizer(link->value.get());
+      _access_list.move_to_head(link);
+      return link->value;
+    } else {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+  }
+
+  template <typename KeyArray, typename ValueArray>
+  inline void multi_get_impl(KeyArray keys, size_t n, ValueArray values) {
+    size_t hashes[kPrefetchBatch];
+    Link* links[kPrefetchBatch];
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        hashes[i] = _access_map.hash(keys[b + i]);
+        _access_map.prefetch(hashes[i]);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        links[i] = _access_map.find(keys[b + i], hashes[i]);
+        if (!kConcurrentReads && links[i]) {
+          // move_to_head() writes both neighbours.
+          PREFETCH(links[i]->prev);
+          PREFETCH(links[i]->next);
+        }
+      }
+      for (size_t i = 0; i < m; ++i) {
+        values[b + i] = get_impl(links[i]);
+      }
+    }
+  }
+
+  inline Ptr remove_impl(Link* link) {
+    if (link) {
+      _access_list.remove(link);
+      _current_size -= _sizer(link->value.get());
+      Ptr val;
+      if constexpr (kConcurrentReads) {
+        // Readers may still be copying the value out of the link.
+        val = link->value;
+      } else {
+        val = std::move(link->value);
+      }
+      _access_map.erase(link);
+      return val;
+    }
+    return nullptr;
+  }
+
+  // Evicts until the cache fits, returns the size evicted.
+  inline int64_t evict_to_fit() {
+    int64_t before = _current_size;
+    while (_current_size > _max_size) {
+      size_t e;
+      evict_entry_impl(e);
+    }
+    // FIXME: Is this ever useful?
+    return before - _current_size;
+  }
+
   // Insert element into cache without eviction.
   // If the same key is used then we replace the value.
-  inline void add_to_cache_no_evict_impl(const K& key,
-                                         std::shared_ptr<V> value) {
-    // FIXME Maybe move to C++17 where structured binding makes this more
-    // pleasant.
+  inline void add_to_cache_no_evict_impl(const K& key, Ptr value,
+                                         size_t hash) {
     int64_t val = _sizer(value.get());
-    auto emplaced = _access_map.emplace(
-        std::make_pair(key, std::move(LRULink<K, V>(key, value))));
-    if (emplaced.second) {
-      _access_list.insert_head(&emplaced.first->second);
+    auto [link, inserted] = _access_map.emplace(key, value, hash);
+    if (inserted) {
+      _access_list.insert_head(link);
       _current_size += val;
     } else {
-      _access_list.move_to_head(&emplaced.first->second);
-      _current_size -= _sizer(emplaced.first->second.value.get());
-      emplaced.first->second.value = value;
-      _current_size += val;
+      replace_value(link, std::move(value));
+    }
+  }
+
+  // Sets the value of link and moves it to the head.
+  inline void replace_value(Link* link, Ptr value) {
+    _current_size += _sizer(value.get()) - _sizer(link->value.get());
+    if constexpr (kConcurrentReads) {
+      // Links are immutable once readers can see them, swap in a new one.
+      K key = link->key;
+      _access_list.remove(link);
+      _access_map.erase(link);
+      link = _access_map.emplace(key, std::move(value)).first;
+      _access_list.insert_head(link);
+    } else {
+      _access_list.move_to_head(link);
+      link->value = std::move(value);
     }
   }
 };
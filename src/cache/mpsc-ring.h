@@ -0,0 +1,73 @@
+#pragma once
+
+/*
+ * Implements a bounded lock-free queue for handing work from many threads to
+ * whichever thread holds a cache's lock.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace cache {
+
+// Bounded multi producer, single consumer queue. Producers claim a cell with
+// one atomic increment and publish it through the cell's sequence number, so
+// the consumer never sees a half written item.
+template <typename T, size_t Capacity> class MpscRing {
+  static_assert((Capacity & (Capacity - 1)) == 0, "Capacity is a power of 2");
+
+public:
+  MpscRing() {
+    for (size_t i = 0; i < Capacity; ++i) {
+      _cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns false if the ring is full.
+  bool push(T item) {
+    uint64_t pos = _tail.load(std::memory_order_relaxed);
+    while (true) {
+      Cell& cell = _cells[pos & (Capacity - 1)];
+      uint64_t seq = cell.seq.load(std::memory_order_acquire);
+      if (seq == pos) {
+        if (_tail.compare_exchange_weak(pos, pos + 1,
+                                        std::memory_order_relaxed)) {
+          cell.item = std::move(item);
+          cell.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (seq < pos) {
+        return false;
+      } else {
+        pos = _tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Single consumer. Returns false if no published item is at the head.
+  bool pop(T& item) {
+    Cell& cell = _cells[_head & (Capacity - 1)];
+    if (cell.seq.load(std::memory_order_acquire) != _head + 1) {
+      return false;
+    }
+    item = std::move(cell.item);
+    cell.seq.store(_head + Capacity, std::memory_order_release);
+    ++_head;
+    return true;
+  }
+
+private:
+  struct Cell {
+    std::atomic<uint64_t> seq;
+    T item;
+  };
+
+  std::array<Cell, Capacity> _cells;
+  alignas(64) std::atomic<uint64_t> _tail{0};
+  alignas(64) uint64_t _head = 0;
+};
+
+} // namespace cache
@@ -0,0 +1,99 @@
+#pragma once
+
+/*
+ * Implements Pinned, an intrusively reference counted value handle that caches
+ * can use in place of std::shared_ptr.
+ */
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+
+namespace cache {
+
+// A handle to a value allocated together with its reference count. The value
+// stays alive while any handle to it exists, so a cache can evict an entry
+// while readers still hold it.
+//
+// Compared to std::shared_ptr the handle is a single pointer (8 bytes rather
+// than 16, which shrinks every cache link), there is no weak count or type
+// erased deleter, and releasing a handle is one atomic decrement.
+//
+// Create values with make_pinned<V>(args...).
+template <typename V> class Pinned {
+public:
+  constexpr Pinned() : _block{nullptr} {}
+  constexpr Pinned(std::nullptr_t) : _block{nullptr} {}
+
+  Pinned(const Pinned& other) : _block{other._block} {
+    if (_block) {
+      _block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  Pinned(Pinned&& other) noexcept : _block{other._block} {
+    other._block = nullptr;
+  }
+
+  ~Pinned() { release(); }
+
+  Pinned& operator=(const Pinned& other) {
+    Pinned(other).swap(*this);
+    return *this;
+  }
+
+  Pinned& operator=(Pinned&& other) noexcept {
+    Pinned(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  inline V* get() const { return _block ? &_block->value : nullptr; }
+  inline V& operator*() const { return _block->value; }
+  inline V* operator->() const { return &_block->value; }
+  explicit inline operator bool() const { return _block != nullptr; }
+
+  // Number of handles to the value, 0 for a null handle.
+  inline int64_t use_count() const {
+    return _block ? _block->refs.load(std::memory_order_relaxed) : 0;
+  }
+
+  inline void swap(Pinned& other) noexcept { std::swap(_block, other._block); }
+
+  friend bool operator==(const Pinned& p, std::nullptr_t) { return !p; }
+  friend bool operator!=(const Pinned& p, std::nullptr_t) { return !!p; }
+  friend bool operator==(const Pinned& a, const Pinned& b) {
+    return a._block == b._block;
+  }
+
+  template <typename T, typename... Args>
+  friend Pinned<T> make_pinned(Args&&... args);
+
+private:
+  struct Block {
+    std::atomic<int32_t> refs;
+    V value;
+
+    template <typename... Args>
+    explicit Block(Args&&... args)
+        : refs{1}, value(std::forward<Args>(args)...) {}
+  };
+
+  Block* _block;
+
+  explicit Pinned(Block* block) : _block{block} {}
+
+  inline void release() {
+    // The last handle frees the value. acq_rel orders every other holder's
+    // use of the value before the delete.
+    if (_block && _block->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete _block;
+    }
+  }
+};
+
+template <typename V, typename... Args> Pinned<V> make_pinned(Args&&... args) {
+  return Pinned<V>(new typename Pinned<V>::Block(std::forward<Args>(args)...));
+}
+
+} // namespace cache
@@ -0,0 +1,448 @@
+#pragma once
+
+/*
+ * Implements a cache that evicts the lowest priority of a random sample of
+ * entries, with LRU, hyperbolic, GDSF and LHD priorities.
+ *
+ * Blankstein, Sen and Freedman. "Hyperbolic Caching: Flexible Caching for Web
+ * Applications". USENIX ATC 2017.
+ *
+ * Cherkasova. "Improving WWW Proxies Performance with Greedy-Dual-Size-
+ * Frequency Caching Policy". HP Labs 1998.
+ *
+ * Beckmann, Chen and Cidon. "LHD: Improving Cache Hit Rate by Maximizing Hit
+ * Density". NSDI 2018.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cache/cache.h"
+#include "cache/lru.h"
+
+namespace cache {
+
+// What a priority knows about an entry of a SampledCache. Times are counts of
+// accesses (get() and add_to_cache() calls) to the cache.
+struct SampledEntry {
+  // In Sizer units, at least 1.
+  int64_t size;
+  int64_t inserted;
+  // The last access, inserted until the first hit.
+  int64_t last;
+  int64_t hits;
+  // Whatever the priority keeps per entry, e.g. GDSF's H.
+  double value;
+};
+
+// A Priority scores entries, and the lowest scored entry of a sample is the
+// one evicted. It provides
+//   kName, the cache's label;
+//   add(e, now) when e is inserted;
+//   hit(e, age, now) after e.hits and e.last count a hit, age is how long
+//     before now e.last was;
+//   evict(e, now) before e is evicted;
+//   score(e, now).
+// The hooks may update e.value and the priority's own state.
+
+// Evicts the least recently used entry of the sample.
+struct SampledLRU {
+  static constexpr const char* kName = "sampled-lru";
+
+  inline void add(SampledEntry&, int64_t) {}
+  inline void hit(SampledEntry&, int64_t, int64_t) {}
+  inline void evict(const SampledEntry&, int64_t) {}
+  inline double score(const SampledEntry& e, int64_t) const { return e.last; }
+};
+
+// Hits per unit of time in the cache, so new entries get a chance and old
+// ones fade unless they keep being hit. Not size aware.
+struct Hyperbolic {
+  static constexpr const char* kName = "hyperbolic";
+
+  inline void add(SampledEntry&, int64_t) {}
+  inline void hit(SampledEntry&, int64_t, int64_t) {}
+  inline void evict(const SampledEntry&, int64_t) {}
+  inline double score(const SampledEntry& e, int64_t now) const {
+    return (double)(e.hits + 1) / (now - e.inserted + 1);
+  }
+};
+
+// Greedy Dual Size Frequency with a cost of 1: H = L + frequency / size, set
+// when an entry is added or hit, where L is the H of the last entry evicted.
+// Small entries are kept in preference to large ones, and L ages entries that
+// are no longer hit.
+struct GDSF {
+  static constexpr const char* kName = "gdsf";
+
+  inline void add(SampledEntry& e, int64_t) {
+    e.value = _inflation + 1.0 / e.size;
+  }
+  inline void hit(SampledEntry& e, int64_t, int64_t) {
+    e.value = _inflation + (double)(e.hits + 1) / e.size;
+  }
+  inline void evict(const SampledEntry& e, int64_t) {
+    _inflation = std::max(_inflation, e.value);
+  }
+  inline double score(const SampledEntry& e, int64_t) const { return e.value; }
+  inline double inflation() const { return _inflation; }
+
+private:
+  double _inflation = 0;
+};
+
+// Least hit density: an entry's expected hits over the rest of its lifetime,
+// divided by its expected lifetime and its size. Entries are classed by their
+// hits so far; each class keeps how many hits and evictions happened at each
+// age (time since the last access, coarsened), and every kInterval accesses
+// turns them into hit densities by age and decays them. Ages are coarsened so
+// that the ages kept span kCoverage times the mean age of the events.
+//
+// Unlike the paper, classes are not split by application.
+class LHD {
+public:
+  static constexpr const char* kName = "lhd";
+
+  LHD() {
+    for (int c = 0; c < kClasses; ++c) {
+      for (int a = 0; a < kAges; ++a) {
+        // Until the first reconfiguration younger is better, as in LRU.
+        _density[c][a] = 1.0 / (a + 1);
+      }
+    }
+  }
+
+  inline void add(SampledEntry&, int64_t) { tick(); }
+
+  inline void hit(SampledEntry& e, int64_t age, int64_t) {
+    _hits[klass(e.hits - 1)][coarsen(age)] += 1;
+    count(age);
+    tick();
+  }
+
+  inline void evict(const SampledEntry& e, int64_t now) {
+    _evictions[klass(e.hits)][coarsen(now - e.last)] += 1;
+    count(now - e.last);
+  }
+
+  inline double score(const SampledEntry& e, int64_t now) const {
+    return _density[klass(e.hits)][coarsen(now - e.last)] / e.size;
+  }
+
+  inline int age_shift() const { return _shift; }
+
+private:
+  static constexpr int kClasses = 16;
+  static constexpr int kAges = 128;
+  // Shorter than the paper's, so small caches adapt within a short trace.
+  static constexpr int64_t kInterval = 1 << 12;
+  static constexpr double kDecay = 0.9;
+  static constexpr int64_t kCoverage = 16;
+
+  double _hits[kClasses][kAges] = {};
+  double _evictions[kClasses][kAges] = {};
+  double _density[kClasses][kAges];
+  int _shift = 0;
+  int64_t _accesses = 0;
+  // Sum of the ages of the events since the last reconfiguration.
+  int64_t _age_sum = 0;
+  int64_t _events = 0;
+
+  static inline int klass(int64_t hits) {
+    return (int)std::min<int64_t>(hits, kClasses - 1);
+  }
+
+  inline int coarsen(int64_t age) const {
+    return (int)std::min<int64_t>(age >> _shift, kAges - 1);
+  }
+
+  inline void count(int64_t age) {
+    _age_sum += age;
+    ++_events;
+  }
+
+  inline void tick() {
+    if (++_accesses % kInterval == 0) {
+      reconfigure();
+    }
+  }
+
+  void reconfigure() {
+    for (int c = 0; c < kClasses; ++c) {
+      // Walking down from the oldest age, hits are the hits still to come
+      // and lifetime the time still to be spent by entries of this age.
+      double hits = 0;
+      double events = 0;
+      double lifetime = 0;
+      for (int a = kAges - 1; a >= 0; --a) {
+        double n = _hits[c][a] + _evictions[c][a];
+        hits += _hits[c][a];
+        events += n;
+        lifetime += events;
+        _density[c][a] = lifetime > 0 ? hits / lifetime : 0;
+        _hits[c][a] *= kDecay;
+        _evictions[c][a] *= kDecay;
+      }
+    }
+    if (_events > 0) {
+      int64_t span = kCoverage * _age_sum / _events;
+      _shift = 0;
+      while ((int64_t(kAges) << _shift) < span) {
+        ++_shift;
+      }
+      _age_sum = 0;
+      _events = 0;
+    }
+  }
+};
+
+// Entries are kept in one array, with the per entry state the priority needs
+// inline, and the index maps keys to links holding the value and the entry's
+// slot. Eviction scores samples random entries and evicts the lowest scored,
+// so there are no lists to keep in order: a hit counts itself in the entry in
+// place and the cost of the policy is paid on eviction.
+//
+// Stats count hits on entries not hit before and their evictions as lru_hits
+// and lru_evicts, the others as lfu_hits and lfu_evicts.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Priority = LHD, typename Ptr = std::shared_ptr<V>>
+class SampledCache : public Cache<K, V> {
+  struct Link {
+    K key;
+    Ptr value;
+    int64_t slot;
+
+    Link(K k, Ptr v) : key{k}, value{std::move(v)}, slot{-1} {}
+    Link(const Link&) = delete;
+    Link operator=(const Link&) = delete;
+    Link(Link&&) = default;
+  };
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  explicit SampledCache(int64_t size, int samples = kSamples)
+      : _max_size{size}, _samples{std::max(samples, 1)} {
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      int64_t n = std::min(size, kMaxReserve);
+      _index.reserve(n);
+      _entries.reserve(n);
+      _links.reserve(n);
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _size; }
+  inline int64_t num_entries() const { return _index.size(); }
+  inline int samples() const { return _samples; }
+  const Stats& stats() const { return _stats; }
+  inline int64_t p() const { return 0; }
+  inline int64_t max_p() const { return 0; }
+  inline int64_t filter_size() const { return 0; }
+  inline Lock* get_lock() { return &_lock; }
+  const Priority& priority() const { return _priority; }
+
+  const std::string label(int64_t n) const {
+    return std::string(Priority::kName) + "-" +
+           std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache, counting the hit in its entry.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. Keys already cached take the new value and
+  // count as hit.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    ++_now;
+    int64_t sz = _sizer(value.get());
+    Link* link = _index.find(key);
+    if (link) {
+      SampledEntry& e = _entries[link->slot];
+      _size += sz - _sizer(link->value.get());
+      e.size = std::max(sz, int64_t(1));
+      link->value = std::move(value);
+      hit(e);
+    } else {
+      fit(sz);
+      link = _index.emplace(key, std::move(value)).first;
+      link->slot = _entries.size();
+      _entries.push_back({std::max(sz, int64_t(1)), _now, _now, 0, 0});
+      _links.push_back(link);
+      _priority.add(_entries.back(), _now);
+      _size += sz;
+    }
+    // Only a value larger than the cache is left over.
+    fit(0);
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    _size -= _sizer(value.get());
+    remove_slot(link->slot);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    _entries.clear();
+    _links.clear();
+    _index.clear();
+    _priority = Priority();
+    _size = 0;
+    _now = 0;
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  SampledCache() = delete;
+  SampledCache(const SampledCache&) = delete;
+  SampledCache operator=(const SampledCache&) = delete;
+
+private:
+  // As in LHD and hyperbolic caching.
+  static constexpr int kSamples = 64;
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  int _samples;
+  int64_t _size = 0;
+  int64_t _now = 0;
+  Index<K, Link> _index;
+  // Slot i is the entry of _links[i].
+  std::vector<SampledEntry> _entries;
+  std::vector<Link*> _links;
+  Priority _priority;
+  uint64_t _rng = 0x9e3779b97f4a7c15ull;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    ++_now;
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    SampledEntry& e = _entries[link->slot];
+    if (e.hits == 0) {
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.lfu_hits;
+    }
+    hit(e);
+    return link->value;
+  }
+
+  inline void hit(SampledEntry& e) {
+    int64_t age = _now - e.last;
+    ++e.hits;
+    e.last = _now;
+    _priority.hit(e, age, _now);
+  }
+
+  // xorshift64*, the sample only has to be spread evenly.
+  inline uint64_t next_random() {
+    _rng ^= _rng >> 12;
+    _rng ^= _rng << 25;
+    _rng ^= _rng >> 27;
+    return _rng * 0x2545f4914f6cdd1dull;
+  }
+
+  // The lowest scored slot of a sample of _samples slots, or of all of them
+  // if there are no more.
+  inline int64_t victim() {
+    int64_t n = _entries.size();
+    int64_t best = 0;
+    double best_score = _priority.score(_entries[0], _now);
+    if (n <= _samples) {
+      for (int64_t i = 1; i < n; ++i) {
+        double score = _priority.score(_entries[i], _now);
+        if (score < best_score) {
+          best = i;
+          best_score = score;
+        }
+      }
+      return best;
+    }
+    for (int i = 0; i < _samples; ++i) {
+      int64_t slot = next_random() % n;
+      double score = _priority.score(_entries[slot], _now);
+      if (i == 0 || score < best_score) {
+        best = slot;
+        best_score = score;
+      }
+    }
+    return best;
+  }
+
+  // Moves the last entry into slot.
+  inline void remove_slot(int64_t slot) {
+    int64_t last = _entries.size() - 1;
+    if (slot != last) {
+      _entries[slot] = _entries[last];
+      _links[slot] = _links[last];
+      _links[slot]->slot = slot;
+    }
+    _entries.pop_back();
+    _links.pop_back();
+  }
+
+  // Evicts until sz more fits.
+  inline void fit(int64_t sz) {
+    while (_size > 0 && _size + sz > _max_size) {
+      evict();
+    }
+  }
+
+  inline void evict() {
+    int64_t slot = victim();
+    const SampledEntry& e = _entries[slot];
+    Link* link = _links[slot];
+    _priority.evict(e, _now);
+    if (e.hits == 0) {
+      ++_stats.lru_evicts;
+    } else {
+      ++_stats.lfu_evicts;
+    }
+    int64_t sz = _sizer(link->value.get());
+    _size -= sz;
+    ++_stats.num_evicted;
+    _stats.bytes_evicted += sz;
+    remove_slot(slot);
+    _index.erase(link);
+  }
+};
+
+} // namespace cache
@@ -0,0 +1,57 @@
+#pragma once
+
+/*
+ * Implements a sharded ARC whose shards adapt one shared target p.
+ */
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "cache/cache.h"
+#include "cache/ghost.h"
+#include "cache/lru.h"
+#include "cache/sharded-cache.h"
+#include "cache/unified-arc.h"
+
+namespace cache {
+
+// A ShardedCache of UnifiedARC shards, each with its own lists and lock, that
+// share one SharedTarget. With a p per shard every shard adapts on its own
+// 1/Shards of the ghost hits, with many shards p barely moves and hit rates
+// fall behind a single ARC. Here each ghost hit moves the shared p as it
+// would move the p of a single ARC of the total size, and shards read their
+// share of it without locking.
+template <typename K, typename V, int Shards, typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Filter = KeyGhost<K, Index>,
+          typename Ptr = std::shared_ptr<V>>
+class ShardedARC
+    : public ShardedCache<
+          K, V,
+          UnifiedARC<K, V, NopLock, Sizer, Index, Filter, Ptr, SharedTarget>,
+          Shards> {
+  using Base = ShardedCache<
+      K, V, UnifiedARC<K, V, NopLock, Sizer, Index, Filter, Ptr, SharedTarget>,
+      Shards>;
+
+public:
+  // Both sizes are split evenly across the shards.
+  explicit ShardedARC(int64_t size, int64_t filter_size = 0)
+      : ShardedARC(SharedTarget(size / Shards * Shards), size, filter_size) {}
+
+  inline int64_t p() const { return _target.p(); }
+  inline int64_t max_p() const { return _target.max_p(); }
+
+  const std::string label(int64_t n) const {
+    return Base::label(n) + "-shared-p";
+  }
+
+private:
+  SharedTarget _target;
+
+  ShardedARC(SharedTarget target, int64_t size, int64_t filter_size)
+      : Base(size, SplitSize{filter_size}, target), _target{target} {}
+};
+
+} // namespace cache
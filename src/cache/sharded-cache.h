@@ -0,0 +1,263 @@
+#pragma once
+
+/*
+ * Implements a cache that hash partitions keys over independent caches, each
+ * with its own lock, so operations on different shards do not contend.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "cache/cache.h"
+#include "cache/stats-aggregate.h"
+#include "util/lock.h"
+
+namespace cache {
+
+// Marks a ShardedCache constructor argument after the cache size as a size to
+// split evenly across the shards, such as a ghost or filter size.
+struct SplitSize {
+  int64_t total;
+};
+
+// C is any of the cache policies, typically instantiated with NopLock since the
+// shard lock already serializes access to it.
+//
+// Each operation on a shard publishes what changed in its stats before
+// releasing the shard lock, so stats() reads their sum without taking any.
+template <typename K, typename V, typename C, int Shards>
+class ShardedCache : public Cache<K, V> {
+  static_assert(Shards > 0, "Need at least one shard");
+
+public:
+  using ValuePtr = typename C::ValuePtr;
+  using SizerType = typename C::SizerType;
+
+  // Constructs each shard with size / Shards followed by args. Arguments
+  // wrapped in SplitSize are split across the shards like size, anything else
+  // (flags, shares, counts) is passed through as is.
+  template <typename... Args>
+  explicit ShardedCache(int64_t size, Args... args) {
+    for (Shard& shard : _shards) {
+      shard.cache.reset(new C(size / Shards, split(args)...));
+    }
+  }
+
+  inline int64_t max_size() const {
+    int64_t s = 0;
+    for (const Shard& shard : _shards) {
+      s += shard.cache->max_size();
+    }
+    return s;
+  }
+
+  inline int64_t size() const {
+    int64_t s = 0;
+    for (const Shard& shard : _shards) {
+      s += shard.cache->size();
+    }
+    return s;
+  }
+
+  inline int64_t num_entries() const {
+    int64_t s = 0;
+    for (const Shard& shard : _shards) {
+      s += shard.cache->num_entries();
+    }
+    return s;
+  }
+
+  inline int64_t p() const {
+    int64_t s = 0;
+    for (const Shard& shard : _shards) {
+      s += shard.cache->p();
+    }
+    return s;
+  }
+
+  inline int64_t max_p() const {
+    int64_t s = 0;
+    for (const Shard& shard : _shards) {
+      s = std::max(s, shard.cache->max_p());
+    }
+    return s;
+  }
+
+  inline int64_t filter_size() const {
+    int64_t s = 0;
+    for (const Shard& shard : _shards) {
+      s += shard.cache->filter_size();
+    }
+    return s;
+  }
+
+  // The sum of the shards' stats as last published.
+  Stats stats() const {
+    Stats s;
+    _published.read(&s);
+    return s;
+  }
+
+  const std::string label(int64_t n) const {
+    return "s" + std::to_string(Shards) + "-" +
+           _shards[0].cache->label(n / Shards);
+  }
+
+  auto get(const K& key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard<WordLock> l(shard.lock);
+    auto value = shard.cache->get(key);
+    publish(shard);
+    return value;
+  }
+
+  void add_to_cache(const K& key, ValuePtr value) {
+    Shard& shard = shard_for(key);
+    std::lock_guard<WordLock> l(shard.lock);
+    shard.cache->add_to_cache(key, std::move(value));
+    publish(shard);
+  }
+
+  // Gets keys[0, n) into values[0, n). Keys are grouped by shard so each
+  // shard lock is taken once per kShardBatch keys, and each group goes
+  // through the shard's own multi_get().
+  template <typename KeyArray, typename ValueArray>
+  void multi_get(KeyArray keys, size_t n, ValueArray values) {
+    for_each_shard(keys, n, [&](C* cache, const uint32_t* idx, size_t m) {
+      cache->multi_get(Gather<KeyArray>{keys, idx}, m,
+                       Gather<ValueArray>{values, idx});
+    });
+  }
+
+  // Adds keys[0, n) with values[0, n), grouped by shard like multi_get().
+  template <typename KeyArray, typename ValueArray>
+  void multi_add(KeyArray keys, size_t n, ValueArray values) {
+    for_each_shard(keys, n, [&](C* cache, const uint32_t* idx, size_t m) {
+      cache->multi_add(Gather<KeyArray>{keys, idx}, m,
+                       Gather<ValueArray>{values, idx});
+    });
+  }
+
+  auto remove_from_cache(const K& key) {
+    Shard& shard = shard_for(key);
+    std::lock_guard<WordLock> l(shard.lock);
+    auto value = shard.cache->remove_from_cache(key);
+    publish(shard);
+    return value;
+  }
+
+  void reset() {
+    for (Shard& shard : _shards) {
+      std::lock_guard<WordLock> l(shard.lock);
+      shard.cache->reset();
+      publish(shard);
+    }
+  }
+
+  void clear() {
+    for (Shard& shard : _shards) {
+      std::lock_guard<WordLock> l(shard.lock);
+      shard.cache->clear();
+      publish(shard);
+    }
+  }
+
+  // Returns the shard key maps to.
+  inline int shard_idx(const K& key) const {
+    // Indexes, ghost lists and filters inside a shard all mix std::hash by
+    // multiplying with 0x9E3779B97F4A7C15 and then home or sample keys by
+    // some of its bits, the top ones included (FingerprintGhost, TierIndex,
+    // AdaptSize). Any of those bits picking the shard would leave every key
+    // of a shard with the same value there, so the shard comes from a hash
+    // mixed differently, by murmur3's finalizer. Its upper half is scaled to
+    // [0, Shards).
+    uint64_t h = std::hash<K>{}(key);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return ((h >> 32) * Shards) >> 32;
+  }
+
+  inline C* shard(int idx) { return _shards[idx].cache.get(); }
+
+  ShardedCache(const ShardedCache&) = delete;
+  ShardedCache operator=(const ShardedCache&) = delete;
+
+private:
+  // Each shard sits on its own cache line so that taking one shard's lock does
+  // not invalidate its neighbours.
+  struct alignas(64) Shard {
+    WordLock lock;
+    std::unique_ptr<C> cache;
+    // The cache's stats as of its last publish().
+    Stats published;
+  };
+
+  // Keys grouped by shard at a time by the batched operations.
+  static constexpr size_t kShardBatch = 256;
+
+  // Views array through a permutation, array[idx[i]] for i.
+  template <typename Array> struct Gather {
+    Array array;
+    const uint32_t* idx;
+
+    inline decltype(auto) operator[](size_t i) const { return array[idx[i]]; }
+  };
+
+  std::array<Shard, Shards> _shards;
+  // A part per shard.
+  StatsAggregate _published{Shards};
+
+  template <typename T> static inline T split(T arg) { return arg; }
+  static inline int64_t split(SplitSize arg) { return arg.total / Shards; }
+
+  inline Shard& shard_for(const K& key) { return _shards[shard_idx(key)]; }
+
+  // The shard lock taken. Adds the change in its stats to _published.
+  inline void publish(Shard& shard) {
+    _published.publish(&shard - _shards.data(), shard.cache->stats(),
+                       &shard.published);
+  }
+
+  // Counting sorts each batch of keys by shard, then calls fn(cache, idx, m)
+  // under the shard lock for every shard with keys, idx being the positions
+  // of its m keys.
+  template <typename KeyArray, typename Fn>
+  void for_each_shard(KeyArray keys, size_t n, Fn fn) {
+    int shard_of[kShardBatch];
+    uint32_t order[kShardBatch];
+    for (size_t b = 0; b < n; b += kShardBatch) {
+      size_t m = std::min(kShardBatch, n - b);
+      std::array<uint32_t, Shards + 1> end{};
+      for (size_t i = 0; i < m; ++i) {
+        shard_of[i] = shard_idx(keys[b + i]);
+        ++end[shard_of[i] + 1];
+      }
+      for (int s = 0; s < Shards; ++s) {
+        end[s + 1] += end[s];
+      }
+      // Placing a key advances its shard's start, which ends up at the end.
+      for (size_t i = 0; i < m; ++i) {
+        order[end[shard_of[i]]++] = b + i;
+      }
+      uint32_t begin = 0;
+      for (int s = 0; s < Shards; ++s) {
+        if (end[s] > begin) {
+          std::lock_guard<WordLock> l(_shards[s].lock);
+          fn(_shards[s].cache.get(), order + begin, end[s] - begin);
+          publish(_shards[s]);
+        }
+        begin = end[s];
+      }
+    }
+  }
+};
+
+} // namespace cache
@@ -0,0 +1,234 @@
+#pragma once
+
+/*
+ * Implements a segmented LRU (SLRU) cache.
+ *
+ * Karedla, Love and Wherry. "Caching Strategies to Improve Disk System
+ * Performance". IEEE Computer 1994.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include "cache/cache.h"
+#include "cache/lru.h"
+#include "cache/unified-arc.h"
+
+namespace cache {
+
+// The cache is split into N LRU segments. New keys enter segment 0, the
+// probationary segment, and a hit moves a key to the head of the next segment
+// up, or of its own once it is in the top one. Segments 1 to N-1, the
+// protected segments, hold size / N each; a key pushed off the tail of one
+// goes to the head of the segment below. Keys are only evicted from the tail
+// of segment 0, so a key has to be looked up again to survive more than one
+// trip through the cache, and one that was looked up k times has k segments
+// to fall through before it is evicted.
+//
+// There is no adaptation and no ghost list: a hit is one lookup and one or two
+// moves, demotions aside. The segments share one index, as in UnifiedARC.
+//
+// Stats count segment 0 hits and evictions as lru_hits and lru_evicts, those
+// of the protected segments as lfu_hits and lfu_evicts (which only happens
+// when segment 0 is empty).
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ptr = std::shared_ptr<V>>
+class SLRUCache : public Cache<K, V> {
+  using Link = ArcLink<K, V, Ptr>;
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  // segments is clamped to [1, kMaxSegments], 1 is plain LRU.
+  explicit SLRUCache(int64_t size, int segments = kSegments)
+      : _max_size{size},
+        _num_segments{std::min(std::max(segments, 1), kMaxSegments)},
+        _segment_max{size / _num_segments},
+        _segments{new LRUList<K, V, Link>[_num_segments]},
+        _sizes(_num_segments, 0) {
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _size; }
+  inline int64_t num_entries() const { return _index.size(); }
+  inline int num_segments() const { return _num_segments; }
+  // Sizer units in segment i.
+  inline int64_t segment_size(int i) const { return _sizes[i]; }
+  const Stats& stats() const { return _stats; }
+  // The probationary segment's guaranteed share takes the place of ARC's p.
+  inline int64_t p() const {
+    return _max_size - _segment_max * (_num_segments - 1);
+  }
+  inline int64_t max_p() const { return p(); }
+  inline int64_t filter_size() const { return 0; }
+  inline Lock* get_lock() { return &_lock; }
+
+  const std::string label(int64_t n) const {
+    return "slru" + std::to_string(_num_segments) + "-" +
+           std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache, promoting it one segment.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. New keys enter segment 0, keys already cached
+  // take the new value and count as used.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link) {
+      resize(link, _sizer(value.get()) - _sizer(link->value.get()));
+      link->value = std::move(value);
+      promote(link);
+    } else {
+      insert(_index.emplace(key, std::move(value)).first, 0);
+    }
+    while (_size > _max_size) {
+      evict();
+    }
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    resize(link, -_sizer(value.get()));
+    _segments[link->list].remove(link);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    for (int i = 0; i < _num_segments; ++i) {
+      _segments[i].clear();
+    }
+    _index.clear();
+    std::fill(_sizes.begin(), _sizes.end(), 0);
+    _size = 0;
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  SLRUCache() = delete;
+  SLRUCache(const SLRUCache&) = delete;
+  SLRUCache operator=(const SLRUCache&) = delete;
+
+private:
+  static constexpr int kSegments = 2;
+  static constexpr int kMaxSegments = 16;
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  int _num_segments;
+  // Bound of each protected segment.
+  int64_t _segment_max;
+  int64_t _size = 0;
+  Index<K, Link> _index;
+  // Segment i's links, ArcLink::list is the segment.
+  std::unique_ptr<LRUList<K, V, Link>[]> _segments;
+  std::vector<int64_t> _sizes;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    if (link->list == 0) {
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.lfu_hits;
+    }
+    promote(link);
+    return link->value;
+  }
+
+  inline void resize(Link* link, int64_t delta) {
+    _sizes[link->list] += delta;
+    _size += delta;
+  }
+
+  inline void insert(Link* link, int segment) {
+    link->list = segment;
+    _segments[segment].insert_head(link);
+    resize(link, _sizer(link->value.get()));
+  }
+
+  inline void relink(Link* link, int segment) {
+    resize(link, -_sizer(link->value.get()));
+    _segments[link->list].remove(link);
+    insert(link, segment);
+  }
+
+  // Moves link to the head of the next segment up, then demotes the tails of
+  // the segments it overflows down to segment 0.
+  inline void promote(Link* link) {
+    int top = link->list + 1;
+    if (top == _num_segments) {
+      _segments[link->list].move_to_head(link);
+      return;
+    }
+    relink(link, top);
+    for (int i = top; i > 0; --i) {
+      while (_sizes[i] > _segment_max) {
+        relink(_segments[i].peek_tail(), i - 1);
+      }
+    }
+  }
+
+  // Evicts the tail of the lowest segment that is not empty.
+  inline void evict() {
+    int i = 0;
+    while (_segments[i].size() == 0) {
+      ++i;
+    }
+    Link* link = _segments[i].peek_tail();
+    int64_t sz = _sizer(link->value.get());
+    resize(link, -sz);
+    _segments[i].remove(link);
+    if (i == 0) {
+      ++_stats.lru_evicts;
+    } else {
+      ++_stats.lfu_evicts;
+    }
+    ++_stats.num_evicted;
+    _stats.bytes_evicted += sz;
+    _index.erase(link);
+  }
+};
+
+} // namespace cache
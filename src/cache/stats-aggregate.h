@@ -0,0 +1,121 @@
+#pragma once
+
+/*
+ * Implements a running sum of the Stats of several caches that can be read
+ * without locking any of them.
+ */
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "cache/cache.h"
+
+namespace cache {
+
+// Sums the Stats of the parts of a composite cache, e.g. its tiers or shards.
+// Whoever changes a part publishes what changed in its Stats since the last
+// time, under the part's own lock, and read() sums what was published without
+// taking any lock.
+//
+// Each part has its own stripe of fields, one or two cache lines, written only
+// by its publishers, so publishes to different parts never share a line and
+// a publish touches only the fields that changed. Publishes to one part must
+// be serialized, e.g. by the part's lock. A read concurrent with publishes may
+// see part of one; each field is exact once they stop.
+class StatsAggregate {
+public:
+  explicit StatsAggregate(int parts = 1) { resize(parts); }
+
+  inline int parts() const { return _parts; }
+
+  // Sets the number of parts, keeping what the first of them published. Must
+  // not run concurrently with publishes or reads.
+  void resize(int parts) {
+    std::unique_ptr<Stripe[]> stripes(new Stripe[parts]);
+    for (int p = 0; p < std::min(parts, _parts); ++p) {
+      for (int f = 0; f < kFields; ++f) {
+        stripes[p].fields[f].store(
+            _stripes[p].fields[f].load(std::memory_order_relaxed),
+            std::memory_order_relaxed);
+      }
+    }
+    _stripes.swap(stripes);
+    _parts = parts;
+  }
+
+  // Adds delta to part, which may be negative, e.g. after it was cleared.
+  inline void add(int part, const Stats& delta) {
+    Stripe& stripe = _stripes[part];
+    for (int f = 0; f < kFields; ++f) {
+      int64_t d = delta.*kField[f];
+      if (d != 0) {
+        stripe.add(f, d);
+      }
+    }
+  }
+
+  // Adds now - *last, the change in part's Stats since it last published, and
+  // sets *last to now.
+  inline void publish(int part, const Stats& now, Stats* last) {
+    Stripe& stripe = _stripes[part];
+    for (int f = 0; f < kFields; ++f) {
+      int64_t d = now.*kField[f] - last->*kField[f];
+      if (d != 0) {
+        stripe.add(f, d);
+        last->*kField[f] = now.*kField[f];
+      }
+    }
+  }
+
+  // Sets *out to the sum of everything published.
+  void read(Stats* out) const {
+    int64_t sum[kFields] = {};
+    for (int p = 0; p < _parts; ++p) {
+      for (int f = 0; f < kFields; ++f) {
+        sum[f] += _stripes[p].fields[f].load(std::memory_order_relaxed);
+      }
+    }
+    for (int f = 0; f < kFields; ++f) {
+      out->*kField[f] = sum[f];
+    }
+  }
+
+  void clear() {
+    for (int p = 0; p < _parts; ++p) {
+      for (std::atomic<int64_t>& field : _stripes[p].fields) {
+        field.store(0, std::memory_order_relaxed);
+      }
+    }
+  }
+
+  StatsAggregate(const StatsAggregate&) = delete;
+  StatsAggregate operator=(const StatsAggregate&) = delete;
+
+private:
+  static constexpr int kFields = 12;
+  static_assert(sizeof(Stats) == kFields * sizeof(int64_t),
+                "Every field of Stats must be in kField");
+  static constexpr int64_t Stats::*kField[kFields] = {
+      &Stats::num_hits,       &Stats::num_misses,     &Stats::num_evicted,
+      &Stats::bytes_hit,      &Stats::bytes_evicted,  &Stats::lfu_hits,
+      &Stats::lru_hits,       &Stats::lfu_evicts,     &Stats::lru_evicts,
+      &Stats::lfu_ghost_hits, &Stats::lru_ghost_hits, &Stats::arc_filter};
+
+  struct alignas(64) Stripe {
+    std::array<std::atomic<int64_t>, kFields> fields{};
+
+    // Publishers of the part are serialized, so no read-modify-write.
+    inline void add(int f, int64_t d) {
+      fields[f].store(fields[f].load(std::memory_order_relaxed) + d,
+                      std::memory_order_relaxed);
+    }
+  };
+
+  std::unique_ptr<Stripe[]> _stripes;
+  int _parts = 0;
+};
+
+} // namespace cache
@@ -1,81 +1,345 @@
 #pragma once
 
 /*
- * Implements a tiered cache that puts keys based on size.
- * FIXME: everything about this needs to be thought through
+ * Implements a tiered cache that puts keys based on size, and moves memory
+ * between the tiers to where it gains the most hits.
+ *
+ * Cidon, Eisenman, Alizadeh and Katti. "Cliffhanger: Scaling Performance
+ * Cliffs in Web Memory Caches". NSDI 2016.
  */
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <string>
+#include <utility>
 #include <vector>
 
 #include "cache/cache.h"
+#include "cache/ghost.h"
+#include "cache/stats-aggregate.h"
+#include "util/epoch.h"
+#include "util/striped-counter.h"
 
 namespace cache {
 
+// Open addressing map from 64 bit key fingerprints to tiers. A slot holds the
+// top 56 bits of the fingerprint and the tier plus one in the low byte, 0 is
+// empty and kTombstone erased, so an entry costs 8 bytes in a table kept at
+// most half full. Probing starts at the high bits of the fingerprint.
+//
+// find() may run concurrently with the writer, inside an EpochGuard. Writers
+// must be serialized by the caller. Entries never move within a table: erase()
+// leaves a tombstone, which set() reuses, and growing or rebuilding fills a
+// new table before publishing it, the old one freed once no reader can be on
+// it. A reader thus finds every key that was set before it started and not
+// erased since.
+class TierIndex {
+public:
+  static constexpr int kMaxTiers = 254;
+
+  TierIndex() : _table{new Table(kMinSlots)} {}
+
+  ~TierIndex() {
+    delete _table.load(std::memory_order_relaxed);
+    reclaim(EpochManager::kIdle);
+  }
+
+  inline int64_t size() const { return _size; }
+
+  // The tier fp was set to, or -1.
+  inline int find(uint64_t fp) const {
+    const Table* t = table();
+    for (uint64_t pos = t->home(fp);; pos = (pos + 1) & t->mask) {
+      uint64_t s = t->slots[pos].load(std::memory_order_relaxed);
+      if (s == 0) {
+        return -1;
+      }
+      if (s != kTombstone && tag(s) == tag(fp)) {
+        return int(s & 0xFF) - 1;
+      }
+    }
+  }
+
+  inline void set(uint64_t fp, int tier) {
+    Table* t = table();
+    if (insert(t, fp, tier)) {
+      ++_size;
+      if (++_used * 2 > (int64_t)t->mask + 1) {
+        // Drops the tombstones, and doubles the table if they were few.
+        rehash(_size * 4 > (int64_t)t->mask + 1 ? (t->mask + 1) * 2
+                                                : t->mask + 1);
+      }
+    }
+  }
+
+  inline void erase(uint64_t fp) {
+    Table* t = table();
+    for (uint64_t pos = t->home(fp);; pos = (pos + 1) & t->mask) {
+      uint64_t s = t->slots[pos].load(std::memory_order_relaxed);
+      if (s == 0) {
+        return;
+      }
+      if (s != kTombstone && tag(s) == tag(fp)) {
+        t->slots[pos].store(kTombstone, std::memory_order_relaxed);
+        --_size;
+        return;
+      }
+    }
+  }
+
+  // Replaces every entry by those fill(set) sets, sized for about n of them.
+  // Readers see the old entries until the new ones are all set.
+  template <typename Fn> void rebuild(int64_t n, Fn fill) {
+    uint64_t slots = kMinSlots;
+    while ((int64_t)slots < n * 4) {
+      slots *= 2;
+    }
+    Table* t = new Table(slots);
+    int64_t size = 0;
+    fill([&](uint64_t fp, int tier) {
+      if (insert(t, fp, tier) && ++size * 2 > (int64_t)t->mask + 1) {
+        Table* full = t;
+        t = copy(full, (full->mask + 1) * 2);
+        delete full;
+      }
+    });
+    publish(t);
+    _size = _used = size;
+  }
+
+  // Empties the map, keeping its table.
+  inline void clear() {
+    Table* t = table();
+    for (uint64_t pos = 0; pos <= t->mask; ++pos) {
+      t->slots[pos].store(0, std::memory_order_relaxed);
+    }
+    _size = _used = 0;
+  }
+
+  TierIndex(const TierIndex&) = delete;
+  TierIndex operator=(const TierIndex&) = delete;
+
+private:
+  static constexpr uint64_t kMinSlots = 64;
+  // Tier byte 0xFF, which no tier uses.
+  static constexpr uint64_t kTombstone = 0xFF;
+
+  struct Table {
+    explicit Table(uint64_t n)
+        : mask{n - 1}, shift{64 - __builtin_ctzll(n)},
+          slots{new std::atomic<uint64_t>[n]} {
+      for (uint64_t pos = 0; pos < n; ++pos) {
+        slots[pos].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    inline uint64_t home(uint64_t fp) const { return fp >> shift; }
+
+    uint64_t mask;
+    int shift;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+  };
+
+  std::atomic<Table*> _table;
+  // Entries, and entries plus tombstones.
+  int64_t _size = 0;
+  int64_t _used = 0;
+  // Replaced tables with the epoch they were retired in, oldest first.
+  std::vector<std::pair<uint64_t, Table*>> _retired;
+
+  static inline uint64_t tag(uint64_t fp) { return fp & ~uint64_t(0xFF); }
+
+  inline Table* table() const { return _table.load(std::memory_order_acquire); }
+
+  // Sets fp to tier in t, in the first tombstone or empty slot of its run if
+  // it is not there yet. Returns whether it was not.
+  static bool insert(Table* t, uint64_t fp, int tier) {
+    assert(tier >= 0 && tier < kMaxTiers);
+    uint64_t slot = tag(fp) | uint64_t(tier + 1);
+    int64_t free = -1;
+    for (uint64_t pos = t->home(fp);; pos = (pos + 1) & t->mask) {
+      uint64_t s = t->slots[pos].load(std::memory_order_relaxed);
+      if (s == 0) {
+        t->slots[free < 0 ? pos : free].store(slot, std::memory_order_relaxed);
+        return true;
+      }
+      if (s == kTombstone) {
+        if (free < 0) {
+          free = pos;
+        }
+      } else if (tag(s) == tag(fp)) {
+        t->slots[pos].store(slot, std::memory_order_relaxed);
+        return false;
+      }
+    }
+  }
+
+  // A table of slots entries with the entries of from.
+  static Table* copy(const Table* from, uint64_t slots) {
+    Table* t = new Table(slots);
+    for (uint64_t pos = 0; pos <= from->mask; ++pos) {
+      uint64_t s = from->slots[pos].load(std::memory_order_relaxed);
+      if (s != 0 && s != kTombstone) {
+        insert(t, s, int(s & 0xFF) - 1);
+      }
+    }
+    return t;
+  }
+
+  void rehash(uint64_t slots) {
+    publish(copy(table(), slots));
+    _used = _size;
+  }
+
+  void publish(Table* t) {
+    Table* old = table();
+    _table.store(t, std::memory_order_release);
+    _retired.emplace_back(EpochManager::retire_epoch(), old);
+    reclaim(EpochManager::min_active());
+  }
+
+  // Frees the tables retired before epoch min.
+  void reclaim(uint64_t min) {
+    size_t n = 0;
+    while (n < _retired.size() && _retired[n].first < min) {
+      delete _retired[n++].second;
+    }
+    _retired.erase(_retired.begin(), _retired.begin() + n);
+  }
+};
+
+// A value goes to the first tier whose threshold it is within, a value larger
+// than every threshold to the last tier. Each tier is a cache C, which must
+// provide set_max_size() and for_each_key().
+//
+// Each tier has its own Lock, and a TierIndex of key fingerprints routes a
+// lookup to the one tier that has the key, so a miss probes at most one tier
+// and most misses none. Every key a tier holds is routed, so a key with no
+// route is not cached. The index does not see evictions: a key routed to a
+// tier that no longer has it is erased on the miss, and a key evicted but
+// never looked up again keeps its route. Once the index holds kIndexSlack
+// times as many routes as the tiers hold keys, it is rebuilt from the keys
+// the tiers hold, under every lock, which drops those routes.
+//
+// A lookup reads the index without any lock and only takes the lock of the
+// tier it is routed to. A key is routed to a tier only once the tier has it,
+// under the tier's lock, and a miss erases the route under the same lock, so a
+// lookup racing an add can not drop the route of the value being added. The
+// miss only erases the route if Lock is free, a route left behind goes with
+// the next rebuild. A key added with no route, because it is new or is being
+// added concurrently, is removed from every other tier that it is not routed
+// to, so no stale copy is left behind. Lock serializes the changes to the
+// index and protects the thresholds, and is only held around them; a tier's
+// lock is always taken before it.
+//
+// With rebalancing, memory moves between the tiers by hill climbing, after
+// Cliffhanger. Each tier has a shadow queue, the fingerprints of the keys it
+// used most recently: those it holds and as many more as would fill
+// 1/kShadowShare of max_size(). A key that missed and is added to a tier whose
+// shadow queue has it would have been a hit with a little more memory, so the
+// tier takes 1/kCredit of max_size() from another tier, each in turn, that
+// keeps at least 1/kMinShare of its initial capacity. max_size() does not
+// change. The same memory buys more keys of small values, so tiers of small
+// values gain from it more often and the object hit ratio climbs.
+//
+// With boundary adaptation, every kBoundaryInterval additions each threshold
+// but the last moves by 1/kBoundaryStep towards the tier of the two next to it
+// that took fewer bytes per byte of capacity, so that one size class does not
+// churn while the next sits idle. Keys already cached stay in their tier until
+// they are added again.
+//
+// Each change to a tier publishes what changed in its stats under the tier
+// lock, so stats() reads their sum without taking any lock. Stats of a tier
+// changed other than through the TieredCache are not seen.
+//
+// reset() puts capacities and thresholds back where add_cache() set them.
 template <typename K, typename V, typename C, typename Lock = NopLock,
           typename Sizer = ElementCount<V>>
 class TieredCache : public Cache<K, V> {
 public:
-  TieredCache() {}
+  explicit TieredCache(bool rebalance = true, bool adapt_boundaries = false)
+      : _rebalance{rebalance}, _adapt_boundaries{adapt_boundaries} {}
 
   inline int64_t max_size() const { return _max_size; }
 
   inline int64_t size() const {
     int64_t s = 0;
-    for (C* c: _caches) {
-      s += c->size();
+    for (const auto& t : _tiers) {
+      s += t->cache->size();
     }
     return s;
   }
 
   inline int64_t num_entries() const {
     int64_t s = 0;
-    for (auto c: _caches) {
-      s += c->num_entries();
+    for (const auto& t : _tiers) {
+      s += t->cache->num_entries();
     }
     return s;
   }
 
   inline int64_t p() const {
     int64_t s = 0;
-    for (auto c: _caches) {
-      s += c->p();
+    for (const auto& t : _tiers) {
+      s += t->cache->p();
     }
     return s;
   }
 
   inline int64_t max_p() const {
     int64_t s = 0;
-    for (auto c: _caches) {
-      s = std::max(s, c->max_p());
+    for (const auto& t : _tiers) {
+      s = std::max(s, t->cache->max_p());
     }
     return s;
   }
 
-  // TODO: crazy expensive
-  const Stats& stats() {
-    _stats.clear();
-    for (auto c: _caches) {
-      _stats.merge(c->stats());
-    }
-    return _stats;
+  inline int num_tiers() const { return _tiers.size(); }
+  // Capacity tier i has now.
+  inline int64_t tier_max_size(int i) const {
+    return _tiers[i]->capacity.load(std::memory_order_relaxed);
+  }
+  // Largest value tier i takes now, but for the last tier which takes any.
+  inline int64_t threshold(int i) const { return _tiers[i]->threshold; }
+  // Keys added to tier i that were in its shadow queue.
+  inline int64_t shadow_hits(int i) const {
+    return _tiers[i]->shadow_hits.load(std::memory_order_relaxed);
+  }
+  // Lookups that probed no tier, the key was not routed to any.
+  inline int64_t unrouted_misses() const { return _unrouted.sum(); }
+
+  // The sum of the tiers' stats as last published.
+  Stats stats() const {
+    Stats s;
+    _published.read(&s);
+    // A tier counts the misses it was probed for, count each miss once.
+    s.num_misses = _misses.sum();
+    return s;
   }
 
   void clear() {
-    std::lock_guard<Lock> l(_lock);
-    for (auto c: _caches) {
-      c->clear();
+    auto locks = lock_all();
+    for (auto& t : _tiers) {
+      t->cache->clear();
+      t->shadow_hits = 0;
+      publish(*t);
     }
+    _misses.clear();
+    _unrouted.clear();
+    reset_locked();
   }
 
   void reset() {
-    std::lock_guard<Lock> l(_lock);
-    for (auto c: _caches) {
-      c->reset();
+    auto locks = lock_all();
+    for (auto& t : _tiers) {
+      t->cache->reset();
     }
+    reset_locked();
   }
 
   inline int64_t filter_size() const { return 0; }
@@ -86,46 +350,344 @@ public:
   }
 
   std::shared_ptr<V> get(const K& key) {
-    std::lock_guard<Lock> l(_lock);
-    for (auto c: _caches) {
-      std::shared_ptr<V> v = c->get(key);
-      if (v) return v;
+    uint64_t fp = fingerprint(key);
+    int i;
+    {
+      EpochGuard g;
+      i = _index.find(fp);
+    }
+    if (i < 0) {
+      _misses.add(1);
+      _unrouted.add(1);
+      return std::shared_ptr<V>(nullptr);
+    }
+    Tier& t = *_tiers[i];
+    std::lock_guard<Lock> tl(t.lock);
+    std::shared_ptr<V> v = t.cache->get(key);
+    if (v && _rebalance) {
+      t.shadow->add(key);
+    }
+    publish(t);
+    if (!v) {
+      _misses.add(1);
+      // Unless the key was added to another tier meanwhile.
+      std::unique_lock<Lock> l(_lock, std::try_to_lock);
+      if (l.owns_lock()) {
+        unroute(fp, i);
+      }
     }
-    return std::shared_ptr<V>(nullptr);
+    return v;
   }
 
   void add_to_cache(const K& key, std::shared_ptr<V> value) {
-    std::lock_guard<Lock> l(_lock);
+    uint64_t fp = fingerprint(key);
     int64_t size = _sizer(value.get());
-    for (int i = 0; i < _sizes.size(); ++i) {
-      if (size <= _sizes[i]) {
-        _caches[i]->add_to_cache(key, value);
-        return;
+    int i;
+    int old;
+    {
+      std::lock_guard<Lock> l(_lock);
+      i = tier_of(size);
+      old = route(fp);
+      if (_adapt_boundaries) {
+        _tiers[i]->added += size;
+        if (++_additions % kBoundaryInterval == 0) {
+          adapt_boundaries();
+        }
+      }
+    }
+    Tier& t = *_tiers[i];
+    bool shadow_hit = false;
+    bool rebuild;
+    {
+      std::lock_guard<Lock> tl(t.lock);
+      if (_rebalance) {
+        // A key routed here is held, so adding it again only updates its
+        // value. A miss drops the route, see get().
+        shadow_hit = old != i && t.shadow->contains(key);
+        t.shadow->add(key);
       }
+      t.cache->add_to_cache(key, std::move(value));
+      int64_t n = t.cache->num_entries();
+      t.entries.store(n, std::memory_order_relaxed);
+      if (_rebalance) {
+        // As many entries past the cache as fill 1/kShadowShare of
+        // max_size(), at the tier's mean value size.
+        int64_t past = n > 0 ? _max_size / kShadowShare * n /
+                                   std::max(t.cache->size(), int64_t(1))
+                             : 0;
+        t.shadow->set_max_size(n + std::max(past, kMinShadow));
+      }
+      publish(t);
+      std::lock_guard<Lock> l(_lock);
+      _index.set(fp, i);
+      rebuild = index_full();
+    }
+    // A value of another size, or one added before a threshold moved, is in
+    // the tier it was routed to. Without a route it may be in any that a
+    // concurrent add of the key just put it in.
+    for (int j = 0; j < (int)_tiers.size(); ++j) {
+      if (j != i && (old < 0 || j == old)) {
+        remove_unrouted(key, fp, j);
+      }
+    }
+    if (shadow_hit) {
+      t.shadow_hits.fetch_add(1, std::memory_order_relaxed);
+      grow(i, std::max(_max_size / kCredit, int64_t(1)));
+    }
+    if (rebuild) {
+      rebuild_index();
     }
   }
 
+  std::shared_ptr<V> remove_from_cache(const K& key) {
+    uint64_t fp = fingerprint(key);
+    int i;
+    {
+      std::lock_guard<Lock> l(_lock);
+      i = route(fp);
+      if (i >= 0) {
+        _index.erase(fp);
+      }
+    }
+    if (i < 0) {
+      return std::shared_ptr<V>(nullptr);
+    }
+    Tier& t = *_tiers[i];
+    std::lock_guard<Lock> tl(t.lock);
+    std::shared_ptr<V> v = t.cache->remove_from_cache(key);
+    t.entries.store(t.cache->num_entries(), std::memory_order_relaxed);
+    publish(t);
+    return v;
+  }
+
   // Adds a cache to the tiering. Values up to max_size are put in this cache.
   void add_cache(int64_t max_size, std::shared_ptr<C> cache) {
-    if (!_sizes.empty()) {
-      assert(max_size > _sizes[_sizes.size() - 1]);
+    assert((int)_tiers.size() < TierIndex::kMaxTiers);
+    if (!_tiers.empty()) {
+      assert(max_size > _tiers.back()->initial_threshold);
     }
-    _sizes.push_back(max_size);
-    _caches.push_back(cache);
-    _max_size += cache->max_size();
+    std::unique_ptr<Tier> t(new Tier());
+    t->idx = _tiers.size();
+    _published.resize(_tiers.size() + 1);
+    t->initial_threshold = t->threshold = max_size;
+    t->initial_size = cache->max_size();
+    t->capacity = t->initial_size;
+    t->shadow.reset(new FingerprintGhost<K>(kMinShadow));
+    t->cache = std::move(cache);
+    publish(*t);
+    _max_size += t->initial_size;
+    _tiers.push_back(std::move(t));
   }
 
   TieredCache(const TieredCache&) = delete;
   TieredCache operator=(const TieredCache&) = delete;
 
 private:
+  // The cache, its shadow queue, shadow_hits and published are under lock;
+  // thresholds, added and changes to capacity under the TieredCache lock.
+  struct Tier {
+    Lock lock;
+    std::shared_ptr<C> cache;
+    int64_t threshold = 0;
+    int64_t initial_threshold = 0;
+    int64_t initial_size = 0;
+    // The max_size the cache is set to, which it catches up with under lock.
+    std::atomic<int64_t> capacity{0};
+    // The cache's num_entries() as of its last change.
+    std::atomic<int64_t> entries{0};
+    std::unique_ptr<FingerprintGhost<K>> shadow;
+    std::atomic<int64_t> shadow_hits{0};
+    // Sizer units added since the thresholds last moved.
+    int64_t added = 0;
+    // Its part of _published, and the cache's stats as of its last publish().
+    int idx = 0;
+    Stats published;
+  };
+
+  static constexpr int64_t kShadowShare = 32;
+  static constexpr int64_t kMinShadow = 16;
+  // Share of max_size() moved on a shadow hit.
+  static constexpr int64_t kCredit = 256;
+  static constexpr int64_t kMinShare = 16;
+  static constexpr int64_t kBoundaryInterval = 4096;
+  static constexpr int64_t kBoundaryStep = 16;
+  // How much busier per byte one tier must be than the next for the
+  // threshold between them to move.
+  static constexpr double kBoundarySlack = 1.25;
+  // Routes in the index, per key cached, before it is rebuilt.
+  static constexpr int64_t kIndexSlack = 4;
+  static constexpr int64_t kMinIndex = 1024;
+
   Lock _lock;
   Sizer _sizer;
   int64_t _max_size = 0;
+  bool _rebalance;
+  bool _adapt_boundaries;
+  std::vector<std::unique_ptr<Tier>> _tiers;
+  // Routes of the keys cached, and of some evicted.
+  TierIndex _index;
+  // The tier that last gave up capacity.
+  int _victim = 0;
+  int64_t _additions = 0;
+  StripedCounter _misses;
+  StripedCounter _unrouted;
+  // A part per tier.
+  StatsAggregate _published{0};
+
+  template <typename Q> inline uint64_t fingerprint(const Q& key) const {
+    return std::hash<Q>()(key) * 0x9E3779B97F4A7C15ull;
+  }
+
+  // The tier's lock taken. Adds the change in its stats to _published.
+  inline void publish(Tier& t) {
+    _published.publish(t.idx, t.cache->stats(), &t.published);
+  }
 
-  std::vector<int64_t> _sizes;
-  std::vector<std::shared_ptr<C>> _caches;
-  Stats _stats;
+  // Lock taken. The tier of fp, or -1.
+  inline int route(uint64_t fp) const { return _index.find(fp); }
+
+  // Lock taken. Erases the route of fp if it is to tier i.
+  inline void unroute(uint64_t fp, int i) {
+    if (_index.find(fp) == i) {
+      _index.erase(fp);
+    }
+  }
+
+  // Removes key from tier j unless it is routed there. A key is only routed
+  // to j under j's lock, so the route can not change until it is removed.
+  std::shared_ptr<V> remove_unrouted(const K& key, uint64_t fp, int j) {
+    Tier& t = *_tiers[j];
+    std::lock_guard<Lock> tl(t.lock);
+    {
+      std::lock_guard<Lock> l(_lock);
+      if (_index.find(fp) == j) {
+        return std::shared_ptr<V>(nullptr);
+      }
+    }
+    std::shared_ptr<V> v = t.cache->remove_from_cache(key);
+    t.entries.store(t.cache->num_entries(), std::memory_order_relaxed);
+    publish(t);
+    return v;
+  }
+
+  // Takes every tier's lock, then Lock.
+  std::vector<std::unique_lock<Lock>> lock_all() {
+    std::vector<std::unique_lock<Lock>> locks;
+    for (auto& t : _tiers) {
+      locks.emplace_back(t->lock);
+    }
+    locks.emplace_back(_lock);
+    return locks;
+  }
+
+  // Lock taken. Whether the index holds enough routes of evicted keys to be
+  // rebuilt.
+  inline bool index_full() const {
+    int64_t entries = 0;
+    for (const auto& t : _tiers) {
+      entries += t->entries.load(std::memory_order_relaxed);
+    }
+    return _index.size() > std::max(entries * kIndexSlack, kMinIndex);
+  }
+
+  // Routes only the keys the tiers hold, unless another thread did already.
+  void rebuild_index() {
+    auto locks = lock_all();
+    if (!index_full()) {
+      return;
+    }
+    int64_t entries = 0;
+    for (const auto& t : _tiers) {
+      entries += t->entries.load(std::memory_order_relaxed);
+    }
+    _index.rebuild(entries, [&](auto set) {
+      for (int j = 0; j < (int)_tiers.size(); ++j) {
+        _tiers[j]->cache->for_each_key(
+            [&](const K& key) { set(fingerprint(key), j); });
+      }
+    });
+  }
+
+  // Lock taken.
+  inline int tier_of(int64_t size) const {
+    int last = _tiers.size() - 1;
+    for (int i = 0; i < last; ++i) {
+      if (size <= _tiers[i]->threshold) {
+        return i;
+      }
+    }
+    return last;
+  }
+
+  // Moves credit of capacity to tier i from the next tier after the last one
+  // to give some up that can spare it. The victim shrinks first.
+  void grow(int i, int64_t credit) {
+    int j = -1;
+    {
+      std::lock_guard<Lock> l(_lock);
+      int n = _tiers.size();
+      for (int k = 1; k <= n; ++k) {
+        int c = (_victim + k) % n;
+        Tier& v = *_tiers[c];
+        if (c != i && v.capacity - credit >= v.initial_size / kMinShare) {
+          j = c;
+          break;
+        }
+      }
+      if (j < 0) {
+        return;
+      }
+      _tiers[j]->capacity -= credit;
+      _tiers[i]->capacity += credit;
+      _victim = j;
+    }
+    for (int k : {j, i}) {
+      Tier& t = *_tiers[k];
+      std::lock_guard<Lock> tl(t.lock);
+      t.cache->set_max_size(t.capacity.load(std::memory_order_relaxed));
+      t.entries.store(t.cache->num_entries(), std::memory_order_relaxed);
+      publish(t);
+    }
+  }
+
+  // Lock taken.
+  inline void adapt_boundaries() {
+    for (size_t i = 0; i + 1 < _tiers.size(); ++i) {
+      Tier& lo = *_tiers[i];
+      Tier& hi = *_tiers[i + 1];
+      double lo_load =
+          (double)lo.added / std::max(lo.capacity.load(), int64_t(1));
+      double hi_load =
+          (double)hi.added / std::max(hi.capacity.load(), int64_t(1));
+      int64_t step = std::max(lo.threshold / kBoundaryStep, int64_t(1));
+      if (lo_load > hi_load * kBoundarySlack) {
+        int64_t floor = i > 0 ? _tiers[i - 1]->threshold + 1 : 1;
+        lo.threshold = std::max(lo.threshold - step, floor);
+      } else if (hi_load > lo_load * kBoundarySlack) {
+        lo.threshold = std::min(lo.threshold + step, hi.threshold - 1);
+      }
+    }
+    for (auto& t : _tiers) {
+      t->added = 0;
+    }
+  }
+
+  // Every lock taken.
+  void reset_locked() {
+    for (auto& t : _tiers) {
+      t->capacity = t->initial_size;
+      t->cache->set_max_size(t->initial_size);
+      t->entries = t->cache->num_entries();
+      publish(*t);
+      t->threshold = t->initial_threshold;
+      t->shadow->clear();
+      t->shadow->set_max_size(kMinShadow);
+      t->added = 0;
+    }
+    _index.clear();
+    _victim = 0;
+    _additions = 0;
+  }
 };
 
 }
@@ -0,0 +1,202 @@
+#pragma once
+
+/*
+ * Implements TinyLFU, an admission filter that estimates how often keys are
+ * looked up in a count-min sketch.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include "cache/cache.h"
+
+namespace cache {
+
+// Admission filter for ARC and FlexARC, used as their Filter in place of a
+// ghost list. A ghost list filter admits a key the second time it is added
+// and keeps a copy of every key it turned away. TinyLFU instead counts every
+// get() and, once the cache is full, admits a new key only if it is estimated
+// to be more frequent than the key it would evict. See "TinyLFU: A Highly
+// Efficient Cache Admission Policy" (Einziger, Friedman and Manes).
+//
+// Counts are 4 bit counters in a count-min sketch of 64 bit words, one word
+// per two keys rounded up to a power of 2. A key has one counter in each of 4
+// words, in the quarter of the word that belongs to that row. The first time
+// a key is seen it only sets 2 bits in a bloom filter, the doorkeeper, so
+// keys seen once never reach the sketch. Every 10 * size lookups all counters
+// are halved and the doorkeeper cleared, so old popularity fades.
+//
+// That is 4 to 8 bytes of sketch and 1.25 bytes of doorkeeper per key of
+// size, however large the keys are. Not thread safe, the caches only use it
+// with their lock held.
+template <typename K> class TinyLFU {
+public:
+  static constexpr bool kSized = false;
+
+  explicit TinyLFU(int64_t size) : _max_size{std::max<int64_t>(size, 0)} {
+    if (_max_size > 0) {
+      _sample_size = kSampleFactor * _max_size;
+      _table.assign(pow2((_max_size + 1) / 2), 0);
+      _door.assign(pow2((_sample_size + 63) / 64), 0);
+    }
+  }
+
+  // The number of keys the sketch is sized for, 0 turns admission off.
+  inline int64_t max_size() const { return _max_size; }
+  // Lookups recorded since the counters were last halved.
+  inline int64_t size() const { return _additions; }
+
+  // Counts a lookup of key.
+  inline void record(const K& key) { record_hash(hash(key)); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline void record(const Q& key) {
+    record_hash(hash(key));
+  }
+
+  // The hash record_hash() takes for key, so that a lookup can be hashed
+  // without the lock and counted once it is taken.
+  template <typename Q> static inline uint64_t hash(const Q& key) {
+    return std::hash<Q>()(key) * 0x9E3779B97F4A7C15ull;
+  }
+
+  // Counts a lookup of the key with hash h.
+  inline void record_hash(uint64_t h) {
+    if (_max_size == 0) {
+      return;
+    }
+    if (door_add(h)) {
+      for (int i = 0; i < kRows; ++i) {
+        increment(h, i);
+      }
+    }
+    if (++_additions >= _sample_size) {
+      age();
+    }
+  }
+
+  // Estimated lookups of key since it was last aged, 0 to 16.
+  inline int estimate(const K& key) const { return estimate_hash(hash(key)); }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  inline int estimate(const Q& key) const {
+    return estimate_hash(hash(key));
+  }
+
+  // Whether candidate should replace victim in the cache. Ties go to victim,
+  // so a scan of new keys can not push out keys of equal standing.
+  inline bool admit(const K& candidate, const K& victim) const {
+    return estimate(candidate) > estimate(victim);
+  }
+
+  void clear() {
+    std::fill(_table.begin(), _table.end(), 0);
+    std::fill(_door.begin(), _door.end(), 0);
+    _additions = 0;
+  }
+
+  TinyLFU(const TinyLFU&) = delete;
+  TinyLFU operator=(const TinyLFU&) = delete;
+
+private:
+  static constexpr int kRows = 4;
+  static constexpr int kMaxCount = 15;
+  static constexpr int64_t kSampleFactor = 10;
+  // Odd 64 bit constants, one per row.
+  static constexpr uint64_t kSeeds[kRows] = {
+      0xC3A5C85C97CB3127ull, 0xB492B66FBE98F273ull, 0x9AE16A3B2F90404Full,
+      0xCBF29CE484222325ull};
+
+  int64_t _max_size;
+  int64_t _sample_size = 0;
+  int64_t _additions = 0;
+  std::vector<uint64_t> _table;
+  // Bits, at least one per lookup in a sample.
+  std::vector<uint64_t> _door;
+
+  inline int estimate_hash(uint64_t h) const {
+    if (_max_size == 0) {
+      return 0;
+    }
+    int count = kMaxCount;
+    for (int i = 0; i < kRows; ++i) {
+      count = std::min(count, counter(h, i));
+    }
+    return count + door_contains(h);
+  }
+
+  static inline size_t pow2(int64_t n) {
+    size_t p = 1;
+    while ((int64_t)p < n) {
+      p <<= 1;
+    }
+    return p;
+  }
+
+  // The word index and bit shift of the counter for h in row i.
+  inline size_t slot(uint64_t h, int i, int& shift) const {
+    uint64_t x = (h ^ kSeeds[i]) * kSeeds[(i + 1) % kRows];
+    x ^= x >> 29;
+    shift = ((i << 2) + (x >> 62)) << 2;
+    return x & (_table.size() - 1);
+  }
+
+  inline int counter(uint64_t h, int i) const {
+    int shift;
+    size_t w = slot(h, i, shift);
+    return (_table[w] >> shift) & kMaxCount;
+  }
+
+  inline void increment(uint64_t h, int i) {
+    int shift;
+    uint64_t& w = _table[slot(h, i, shift)];
+    if (((w >> shift) & kMaxCount) < kMaxCount) {
+      w += uint64_t(1) << shift;
+    }
+  }
+
+  // The doorkeeper bits for h, from its low and high halves.
+  inline uint64_t door_bit(uint64_t h, int i) const {
+    return (i == 0 ? h : h >> 32) & (_door.size() * 64 - 1);
+  }
+
+  inline bool door_contains(uint64_t h) const {
+    for (int i = 0; i < 2; ++i) {
+      uint64_t b = door_bit(h, i);
+      if (!(_door[b >> 6] & (uint64_t(1) << (b & 63)))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Adds h to the doorkeeper, returns true if it was already there.
+  inline bool door_add(uint64_t h) {
+    bool present = true;
+    for (int i = 0; i < 2; ++i) {
+      uint64_t b = door_bit(h, i);
+      uint64_t mask = uint64_t(1) << (b & 63);
+      present &= (_door[b >> 6] & mask) != 0;
+      _door[b >> 6] |= mask;
+    }
+    return present;
+  }
+
+  // Halves every counter and empties the doorkeeper.
+  void age() {
+    for (uint64_t& w : _table) {
+      w = (w >> 1) & 0x7777777777777777ull;
+    }
+    std::fill(_door.begin(), _door.end(), 0);
+    _additions /= 2;
+  }
+};
+
+// Whether a cache's Filter is a TinyLFU rather than a ghost list. The caches
+// record their lookups in a TinyLFU and ask it about the key they would evict.
+template <typename F> constexpr bool kIsTinyLFU = false;
+template <typename K> constexpr bool kIsTinyLFU<TinyLFU<K>> = true;
+
+} // namespace cache
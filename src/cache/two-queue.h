@@ -0,0 +1,213 @@
+#pragma once
+
+/*
+ * Implements a 2Q cache.
+ *
+ * Johnson and Shasha. "2Q: A Low Overhead High Performance Buffer Management
+ * Replacement Algorithm". VLDB 1994.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "cache/cache.h"
+#include "cache/ghost.h"
+#include "cache/lru.h"
+#include "cache/unified-arc.h"
+
+namespace cache {
+
+// Full 2Q: new keys enter A1in, a FIFO of 25% of the cache. Keys falling off
+// A1in are evicted and remembered in A1out, a ghost list of half the cache,
+// and a key added back while in A1out goes to Am, an LRU of the rest. Keys
+// looked up once in a while go through A1in and out again, only keys looked
+// up again after they left A1in get into Am.
+//
+// Unlike ARC the split is fixed and there is a single ghost list, so a hit is
+// one lookup and at most one move to the head of Am, and a miss probes one
+// ghost list. A1in and Am share one index, as in UnifiedARC.
+//
+// Stats count A1in hits and evictions as lru_hits and lru_evicts, Am ones as
+// lfu_hits and lfu_evicts, and keys added back from A1out as lru_ghost_hits.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ghost = KeyGhost<K, Index>,
+          typename Ptr = std::shared_ptr<V>>
+class TwoQueueCache : public Cache<K, V> {
+  using Link = ArcLink<K, V, Ptr>;
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  // in is the share of size given to A1in, out the size of A1out as a share
+  // of size.
+  explicit TwoQueueCache(int64_t size, double in = kInShare,
+                         double out = kOutShare)
+      : _max_size{size}, _in_max{(int64_t)(size * in)},
+        _ghost{(int64_t)(size * out)} {
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _sizes[kIn] + _sizes[kMain]; }
+  inline int64_t num_entries() const { return _index.size(); }
+  const Stats& stats() const { return _stats; }
+  // A1in takes the place of ARC's p.
+  inline int64_t p() const { return _in_max; }
+  inline int64_t max_p() const { return _in_max; }
+  inline int64_t filter_size() const { return 0; }
+  inline Lock* get_lock() { return &_lock; }
+
+  const std::string label(int64_t n) const {
+    return "2q-" + std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache. Am hits move to the head of Am, A1in hits
+  // leave the FIFO as it is.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. New keys enter A1in, keys in A1out go to Am.
+  // Keys already cached take the new value and count as used.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link) {
+      _sizes[link->list] -= _sizer(link->value.get());
+      link->value = std::move(value);
+      _sizes[link->list] += _sizer(link->value.get());
+      touch(link);
+    } else if (_ghost.contains(key)) {
+      _ghost.remove(key);
+      ++_stats.lru_ghost_hits;
+      insert(_index.emplace(key, std::move(value)).first, kMain);
+    } else {
+      insert(_index.emplace(key, std::move(value)).first, kIn);
+    }
+    while (size() > _max_size) {
+      evict();
+    }
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      _ghost.remove(key);
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    _sizes[link->list] -= _sizer(value.get());
+    _lists[link->list].remove(link);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    for (LRUList<K, V, Link>& list : _lists) {
+      list.clear();
+    }
+    _index.clear();
+    _ghost.clear();
+    std::fill(std::begin(_sizes), std::end(_sizes), 0);
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  TwoQueueCache() = delete;
+  TwoQueueCache(const TwoQueueCache&) = delete;
+  TwoQueueCache operator=(const TwoQueueCache&) = delete;
+
+private:
+  enum List : uint8_t { kIn, kMain };
+
+  // The paper's recommended Kin and Kout.
+  static constexpr double kInShare = 0.25;
+  static constexpr double kOutShare = 0.5;
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  int64_t _in_max;
+  // Sizer units on A1in and Am.
+  int64_t _sizes[2] = {0, 0};
+  Index<K, Link> _index;
+  LRUList<K, V, Link> _lists[2];
+  Ghost _ghost;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    if (link->list == kIn) {
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.lfu_hits;
+    }
+    touch(link);
+    return link->value;
+  }
+
+  inline void touch(Link* link) {
+    if (link->list == kMain) {
+      _lists[kMain].move_to_head(link);
+    }
+  }
+
+  inline void insert(Link* link, List list) {
+    link->list = list;
+    _lists[list].insert_head(link);
+    _sizes[list] += _sizer(link->value.get());
+  }
+
+  // Evicts the tail of A1in to A1out while A1in is over its share, the tail
+  // of Am otherwise.
+  inline void evict() {
+    List list = kMain;
+    if (_sizes[kIn] > _in_max || _lists[kMain].size() == 0) {
+      list = kIn;
+    }
+    Link* link = _lists[list].remove_tail();
+    int64_t sz = _sizer(link->value.get());
+    _sizes[list] -= sz;
+    if (list == kIn) {
+      ++_stats.lru_evicts;
+      _ghost.add(link->key, sz);
+    } else {
+      ++_stats.lfu_evicts;
+    }
+    ++_stats.num_evicted;
+    _stats.bytes_evicted += sz;
+    _index.erase(link);
+  }
+};
+
+} // namespace cache
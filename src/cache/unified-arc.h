@@ -0,0 +1,499 @@
+#pragma once
+
+/*
+ * Implements an ARC cache with a single index for the cache and ghost lists.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "cache/cache.h"
+#include "cache/ghost.h"
+#include "cache/lru.h"
+#include "cache/tiny-lfu.h"
+
+namespace cache {
+
+// Entry of a UnifiedARC, resident (T1, T2) or a ghost (B1, B2). Ghosts keep
+// the link with an empty value.
+template <typename K, typename V, typename Ptr = std::shared_ptr<V>>
+struct ArcLink {
+  K key;
+  Ptr value;
+  ArcLink* prev;
+  ArcLink* next;
+  // The list the link is on, a UnifiedARC::List.
+  uint8_t list;
+
+  ArcLink(K k, Ptr v)
+      : key{k}, value{std::move(v)}, prev{nullptr}, next{nullptr}, list{0} {}
+  ArcLink(const ArcLink&) = delete;
+  ArcLink operator=(const ArcLink&) = delete;
+  ArcLink(ArcLink&&) = default;
+};
+
+// The adaptation target p of one UnifiedARC, the T1 size it aims for.
+class LocalTarget {
+public:
+  inline int64_t p(int64_t /* max_size */) const { return _p; }
+  inline int64_t max_p(int64_t /* max_size */) const { return _max_p; }
+
+  // Moves p by delta, within [0, max_size].
+  inline void adapt(int64_t delta, int64_t max_size) {
+    _p = std::min(std::max(_p + delta, int64_t(0)), max_size);
+    _max_p = std::max(_max_p, _p);
+  }
+
+  inline void reset() { _p = 0; }
+
+private:
+  int64_t _p = 0;
+  int64_t _max_p = 0;
+};
+
+// One target p shared by the shards of a ShardedARC. p is kept for the whole
+// cache, max_size being the sum of the shard sizes: every shard's ghost hits
+// move it as they would move the p of a single ARC, and each shard aims for
+// its share of it. Copies refer to the same target. Shards read p without
+// locking, ghost hits update it with a compare and swap.
+class SharedTarget {
+public:
+  explicit SharedTarget(int64_t max_size) : _state{new State} {
+    _state->max_size = max_size;
+  }
+
+  inline int64_t p(int64_t max_size) const {
+    return scale(_state->p.load(std::memory_order_relaxed), max_size);
+  }
+
+  inline int64_t max_p(int64_t max_size) const {
+    return scale(_state->max_p.load(std::memory_order_relaxed), max_size);
+  }
+
+  // p and max_p of the whole cache.
+  inline int64_t p() const { return _state->p.load(std::memory_order_relaxed); }
+  inline int64_t max_p() const {
+    return _state->max_p.load(std::memory_order_relaxed);
+  }
+
+  inline void adapt(int64_t delta, int64_t /* max_size */) {
+    std::atomic<int64_t>& p = _state->p;
+    int64_t cur = p.load(std::memory_order_relaxed);
+    int64_t next;
+    do {
+      next = std::min(std::max(cur + delta, int64_t(0)), _state->max_size);
+    } while (!p.compare_exchange_weak(cur, next, std::memory_order_relaxed));
+    int64_t max_p = _state->max_p.load(std::memory_order_relaxed);
+    while (next > max_p && !_state->max_p.compare_exchange_weak(
+                               max_p, next, std::memory_order_relaxed)) {
+    }
+  }
+
+  inline void reset() { _state->p.store(0, std::memory_order_relaxed); }
+
+private:
+  // On its own cache line, away from the shards.
+  struct alignas(64) State {
+    std::atomic<int64_t> p{0};
+    std::atomic<int64_t> max_p{0};
+    int64_t max_size = 0;
+  };
+
+  std::shared_ptr<State> _state;
+
+  // The share of p for a cache of max_size.
+  inline int64_t scale(int64_t p, int64_t max_size) const {
+    if (_state->max_size == 0) {
+      return 0;
+    }
+    return (double)p * max_size / _state->max_size;
+  }
+};
+
+// Same policy as AdaptiveCache, but T1, T2 and the ghost lists B1 and B2 share
+// one index mapping each key to a link tagged with its list. Every operation
+// does one lookup, and moving a key between lists (a T1 hit, an eviction to a
+// ghost list, a ghost hit) relinks it in place: the key is not copied and no
+// link is allocated or freed. Links are only freed when they fall off a ghost
+// list or are removed.
+//
+// Hit rates match AdaptiveCache with the same arguments, except that ghost
+// hits are counted in lru_ghost_hits or lfu_ghost_hits by the list that was
+// hit. The optional admission filter is still a separate Filter, a ghost list
+// holding keys that are in none of the four lists or a TinyLFU<K>.
+//
+// Target holds p, LocalTarget or a SharedTarget passed to the constructor.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Filter = KeyGhost<K, Index>,
+          typename Ptr = std::shared_ptr<V>, typename Target = LocalTarget>
+class UnifiedARC : public Cache<K, V> {
+  using Link = ArcLink<K, V, Ptr>;
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  UnifiedARC(int64_t size, int64_t filter_size = 0, Target target = Target())
+      : _max_size{size}, _target{std::move(target)}, _filter(filter_size) {
+    // Ghost lists hold up to size entries each.
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size * 3, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const { return _t1_size + _t2_size; }
+  inline int64_t num_entries() const {
+    return _lists[kT1].size() + _lists[kT2].size();
+  }
+  const Stats& stats() const { return _stats; }
+  inline int64_t p() const { return _target.p(_max_size); }
+  inline int64_t max_p() const { return _target.max_p(_max_size); }
+  inline int64_t filter_size() const { return _filter.max_size(); }
+  inline Lock* get_lock() { return &_lock; }
+
+  const std::string label(int64_t n) const {
+    if (filter_size() > 0 && kIsTinyLFU<Filter>) {
+      return "uarc-" + std::to_string(max_size() * 100 / n) + "-tinylfu";
+    } else if (filter_size() > 0) {
+      return "uarc-" + std::to_string(max_size() * 100 / n) + "-filter";
+    } else {
+      return "uarc-" + std::to_string(max_size() * 100 / n);
+    }
+  }
+
+  // Get an item from the cache. A T1 hit moves the link to T2, a miss that
+  // finds a ghost moves it to the head of its ghost list.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key, _index.hash(key));
+  }
+
+  // Add an item to the cache, see AdaptiveCache::add_to_cache().
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    add_impl(key, std::move(value), _index.hash(key));
+  }
+
+  // Gets keys[0, n) into values[0, n) under one lock acquisition, as if by n
+  // calls to get(). Keys are hashed and their index slots prefetched a batch
+  // at a time.
+  template <typename KeyArray, typename ValueArray>
+  void multi_get(KeyArray keys, size_t n, ValueArray values) {
+    std::lock_guard<Lock> l(_lock);
+    size_t hashes[kPrefetchBatch];
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        hashes[i] = _index.hash(keys[b + i]);
+        _index.prefetch(hashes[i]);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        values[b + i] = get_impl(keys[b + i], hashes[i]);
+      }
+    }
+  }
+
+  // Adds keys[0, n) with values[0, n) under one lock acquisition, as if by n
+  // calls to add_to_cache(), prefetching like multi_get().
+  template <typename KeyArray, typename ValueArray>
+  void multi_add(KeyArray keys, size_t n, ValueArray values) {
+    std::lock_guard<Lock> l(_lock);
+    size_t hashes[kPrefetchBatch];
+    for (size_t b = 0; b < n; b += kPrefetchBatch) {
+      size_t m = std::min(kPrefetchBatch, n - b);
+      for (size_t i = 0; i < m; ++i) {
+        hashes[i] = _index.hash(keys[b + i]);
+        _index.prefetch(hashes[i]);
+      }
+      for (size_t i = 0; i < m; ++i) {
+        add_impl(keys[b + i], values[b + i], hashes[i]);
+      }
+    }
+  }
+
+  // Remove key from the cache, or from the ghost lists.
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      return nullptr;
+    }
+    Ptr value;
+    if (resident(link)) {
+      value = std::move(link->value);
+      (link->list == kT1 ? _t1_size : _t2_size) -= _sizer(value.get());
+    }
+    _lists[link->list].remove(link);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    for (LRUList<K, V, Link>& list : _lists) {
+      list.clear();
+    }
+    _index.clear();
+    _filter.clear();
+    _t1_size = 0;
+    _t2_size = 0;
+    _target.reset();
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  UnifiedARC() = delete;
+  UnifiedARC(const UnifiedARC&) = delete;
+  UnifiedARC operator=(const UnifiedARC&) = delete;
+
+private:
+  enum List : uint8_t { kT1, kT2, kB1, kB2, kNone };
+
+  // Larger caches grow their index on demand.
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  Target _target;
+  // T1 and T2 in Sizer units, the ghost lists are sized in entries.
+  int64_t _t1_size = 0;
+  int64_t _t2_size = 0;
+  Index<K, Link> _index;
+  LRUList<K, V, Link> _lists[4];
+  // Ghost being moved back into the cache, see add_impl().
+  Link* _incoming = nullptr;
+  Filter _filter;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  inline Ptr get_impl(const K& key, size_t hash) {
+    if constexpr (kIsTinyLFU<Filter>) {
+      _filter.record(key);
+    }
+    Link* link = _index.find(key, hash);
+    if (link == nullptr || !resident(link)) {
+      ++_stats.num_misses;
+      if (link) {
+        _lists[link->list].move_to_head(link);
+        if (link->list == kB1) {
+          ++_stats.lru_ghost_hits;
+        } else {
+          ++_stats.lfu_ghost_hits;
+        }
+      }
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    if (link->list == kT2) {
+      ++_stats.lfu_hits;
+      _lists[kT2].move_to_head(link);
+    } else {
+      ++_stats.lru_hits;
+      relink(link, kT2);
+    }
+    assert(size() <= _max_size);
+    return link->value;
+  }
+
+  // Lock taken.
+  inline void add_impl(const K& key, Ptr value, size_t hash) {
+    Link* link = _index.find(key, hash);
+    if (link && link->list == kT1) {
+      set_value(link, std::move(value));
+      relink(link, kT2);
+      fit(false);
+      return;
+    } else if (link && link->list == kT2) {
+      set_value(link, std::move(value));
+      _lists[kT2].move_to_head(link);
+      fit(true);
+      return;
+    }
+
+    if (link) {
+      // Ghost hit, cases II and III in Figure 4 of the ARC paper. Making
+      // space may push the link off its ghost list, _incoming keeps it from
+      // being freed.
+      _lists[link->list].move_to_head(link);
+      bool lfu_ghost_hit = link->list == kB2;
+      if (lfu_ghost_hit) {
+        adapt_lfu_ghost_hit();
+      } else {
+        adapt_lru_ghost_hit();
+      }
+      _incoming = link;
+      if (size() + _sizer(value.get()) > _max_size) {
+        replace(lfu_ghost_hit);
+      }
+      _incoming = nullptr;
+      if (link->list != kNone) {
+        _lists[link->list].remove(link);
+      }
+      link->value = std::move(value);
+      insert(link, kT2);
+      fit(lfu_ghost_hit);
+      assert(size() <= _max_size);
+      return;
+    }
+
+    // Filter should only kick in for entries evicted far enough in the past.
+    if (_filter.max_size() > 0 && !admit(key, value)) {
+      ++_stats.arc_filter;
+      return;
+    }
+
+    // Case IV.
+    int64_t lru_size = _t1_size + _lists[kB1].size();
+    int64_t total_size = _t2_size + _lists[kB2].size() + lru_size;
+    if (lru_size == _max_size) {
+      if (_t1_size < _max_size) {
+        // IV(a)
+        drop_tail(kB1);
+        replace(false);
+      } else if (_t1_size > 0) {
+        evict(kT1);
+        ++_stats.num_evicted;
+      }
+    } else if (lru_size < _max_size && total_size >= _max_size) {
+      // IV(b)
+      if (total_size == 2 * _max_size) {
+        drop_tail(kB2);
+      }
+      replace(false);
+    }
+    if (size() >= _max_size) {
+      replace(false);
+    }
+    insert(_index.emplace(key, std::move(value), hash).first, kT1);
+    fit(false);
+    assert(size() <= _max_size);
+  }
+
+  // See AdaptiveCache::admit().
+  inline bool admit(const K& key, const Ptr& value) {
+    if constexpr (kIsTinyLFU<Filter>) {
+      if (size() + _sizer(value.get()) <= _max_size) {
+        return true;
+      }
+      List list =
+          _t1_size > _target.p(_max_size) || _t2_size == 0 ? kT1 : kT2;
+      const Link* victim = _lists[list].peek_tail();
+      return victim == nullptr || _filter.admit(key, victim->key);
+    } else {
+      if (_filter.contains(key)) {
+        return true;
+      }
+      _filter.add(key, _sizer(value.get()));
+      return false;
+    }
+  }
+
+  static inline bool resident(const Link* link) { return link->list <= kT2; }
+
+  inline int64_t& resident_size(uint8_t list) {
+    return list == kT1 ? _t1_size : _t2_size;
+  }
+
+  // Inserts a link on no list at the head of list.
+  inline void insert(Link* link, List list) {
+    link->list = list;
+    _lists[list].insert_head(link);
+    if (list <= kT2) {
+      resident_size(list) += _sizer(link->value.get());
+    }
+  }
+
+  // Moves a resident link to the head of the other resident list.
+  inline void relink(Link* link, List list) {
+    resident_size(link->list) -= _sizer(link->value.get());
+    _lists[link->list].remove(link);
+    insert(link, list);
+  }
+
+  inline void set_value(Link* link, Ptr value) {
+    resident_size(link->list) +=
+        _sizer(value.get()) - _sizer(link->value.get());
+    link->value = std::move(value);
+  }
+
+  // Moves the tail of T1 or T2 to the head of its ghost list.
+  inline void evict(List list) {
+    Link* link = _lists[list].remove_tail();
+    int64_t sz = _sizer(link->value.get());
+    resident_size(list) -= sz;
+    link->value = Ptr();
+    _stats.bytes_evicted += sz;
+    List ghost;
+    if (list == kT1) {
+      ++_stats.lru_evicts;
+      ghost = kB1;
+    } else {
+      ++_stats.lfu_evicts;
+      ghost = kB2;
+    }
+    insert(link, ghost);
+    if (_lists[ghost].size() > _max_size) {
+      drop_tail(ghost);
+    }
+  }
+
+  // Forgets the tail of a ghost list, if any.
+  inline void drop_tail(List ghost) {
+    Link* link = _lists[ghost].remove_tail();
+    if (link == _incoming) {
+      link->list = kNone;
+    } else if (link) {
+      _index.erase(link);
+    }
+  }
+
+  inline void adapt_lru_ghost_hit() {
+    int64_t b1 = _lists[kB1].size();
+    int64_t b2 = _lists[kB2].size();
+    _target.adapt(b1 >= b2 ? 1 : b2 / b1, _max_size);
+  }
+
+  inline void adapt_lfu_ghost_hit() {
+    int64_t b1 = _lists[kB1].size();
+    int64_t b2 = _lists[kB2].size();
+    _target.adapt(b2 >= b1 ? -1 : -(b1 / b2), _max_size);
+  }
+
+  // Evicts one entry, from T1 or T2 depending on p, see
+  // AdaptiveCache::replace().
+  inline void replace(bool in_lfu_ghost) {
+    int64_t p = _target.p(_max_size);
+    if (_t1_size > 0 && (_t1_size > p || (_t1_size == p && in_lfu_ghost))) {
+      evict(kT1);
+    } else if (_t2_size > 0) {
+      evict(kT2);
+    } else if (_t1_size >= _max_size && _t1_size > 0) {
+      evict(kT1);
+    } else {
+      --_stats.num_evicted;
+    }
+    ++_stats.num_evicted;
+  }
+
+  inline void fit(bool lfu_hit) {
+    while (size() > _max_size) {
+      replace(lfu_hit);
+    }
+  }
+};
+
+} // namespace cache
@@ -0,0 +1,259 @@
+#pragma once
+
+/*
+ * Implements a W-TinyLFU cache: an LRU admission window in front of a
+ * segmented LRU, with a TinyLFU sketch deciding what moves from one to the
+ * other.
+ */
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+
+#include "cache/cache.h"
+#include "cache/lru.h"
+#include "cache/tiny-lfu.h"
+#include "cache/unified-arc.h"
+
+namespace cache {
+
+// New keys go to the head of a small LRU window, by default 1% of the cache.
+// Keys falling off the window are candidates for the main cache, a segmented
+// LRU of a probation list (20% of it) and a protected list (80%). While the
+// main cache has room a candidate joins probation. Once it is full the
+// candidate and the tail of probation, the main cache's victim, are compared
+// in a TinyLFU sketch of lookups and the less frequent of the two is dropped.
+// A hit in probation moves the key to protected, whose tail is demoted back
+// to probation when protected is over its share. See "A Highly Efficient
+// Cache Admission Policy" (Einziger, Friedman and Manes).
+//
+// The window lets bursts of new keys in, the sketch keeps one time keys (scans)
+// out of the main cache. Unlike ARC nothing is remembered of dropped keys but
+// their sketch counts, and a hit does one lookup and moves one link, like
+// UnifiedARC the lists share one index and links are relinked in place.
+//
+// The sketch counts keys whatever the Sizer: sketch_size is the number of
+// keys it tracks, by default size. Stats count window hits and evictions as
+// lru_hits and lru_evicts, main cache ones as lfu_hits and lfu_evicts, and
+// candidates the sketch turned away as arc_filter.
+template <typename K, typename V, typename Lock = NopLock,
+          typename Sizer = ElementCount<V>,
+          template <typename, typename> class Index = NodeIndex,
+          typename Ptr = std::shared_ptr<V>>
+class WTinyLFU : public Cache<K, V> {
+  using Link = ArcLink<K, V, Ptr>;
+
+public:
+  using ValuePtr = Ptr;
+  using SizerType = Sizer;
+
+  // window is the share of size given to the window.
+  explicit WTinyLFU(int64_t size, int64_t sketch_size = 0,
+                    double window = kWindowShare)
+      : _max_size{size},
+        _window_max{size > 0 ? std::max<int64_t>(size * window, 1) : 0},
+        _main_max{size - _window_max},
+        _protected_max{(int64_t)(_main_max * kProtectedShare)},
+        _sketch(sketch_size > 0 ? sketch_size : size) {
+    if (std::is_same<Sizer, ElementCount<V>>::value && size > 0) {
+      _index.reserve(std::min(size, kMaxReserve));
+    }
+  }
+
+  inline int64_t max_size() const { return _max_size; }
+  inline int64_t size() const {
+    return _sizes[kWindow] + _sizes[kProbation] + _sizes[kProtected];
+  }
+  inline int64_t num_entries() const { return _index.size(); }
+  const Stats& stats() const { return _stats; }
+  // The window takes the place of ARC's p, it is the recency side.
+  inline int64_t p() const { return _window_max; }
+  inline int64_t max_p() const { return _window_max; }
+  inline int64_t filter_size() const { return _sketch.max_size(); }
+  inline Lock* get_lock() { return &_lock; }
+
+  const std::string label(int64_t n) const {
+    return "wtlfu-" + std::to_string(max_size() * 100 / n);
+  }
+
+  // Get an item from the cache. A probation hit promotes the key to
+  // protected, other hits move it to the head of its list.
+  Ptr get(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  template <typename Q, typename = EnableIfKeyView<K, Q>>
+  Ptr get(const Q& key) {
+    std::lock_guard<Lock> l(_lock);
+    return get_impl(key);
+  }
+
+  // Add an item to the cache. New keys enter the window, keys already cached
+  // take the new value and count as used.
+  void add_to_cache(const K& key, Ptr value) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link) {
+      _sizes[link->list] -= _sizer(link->value.get());
+      link->value = std::move(value);
+      _sizes[link->list] += _sizer(link->value.get());
+      touch(link);
+    } else {
+      insert(_index.emplace(key, std::move(value)).first, kWindow);
+    }
+    fit();
+    assert(size() <= _max_size);
+  }
+
+  Ptr remove_from_cache(const K& key) {
+    std::lock_guard<Lock> l(_lock);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      return nullptr;
+    }
+    Ptr value = std::move(link->value);
+    _sizes[link->list] -= _sizer(value.get());
+    _lists[link->list].remove(link);
+    _index.erase(link);
+    return value;
+  }
+
+  void reset() {
+    std::lock_guard<Lock> l(_lock);
+    for (LRUList<K, V, Link>& list : _lists) {
+      list.clear();
+    }
+    _index.clear();
+    _sketch.clear();
+    std::fill(std::begin(_sizes), std::end(_sizes), 0);
+  }
+
+  void clear() {
+    _stats.clear();
+    reset();
+  }
+
+  WTinyLFU() = delete;
+  WTinyLFU(const WTinyLFU&) = delete;
+  WTinyLFU operator=(const WTinyLFU&) = delete;
+
+private:
+  enum List : uint8_t { kWindow, kProbation, kProtected };
+
+  static constexpr double kWindowShare = 0.01;
+  static constexpr double kProtectedShare = 0.8;
+  static constexpr int64_t kMaxReserve = 1 << 16;
+
+  Lock _lock;
+  int64_t _max_size;
+  int64_t _window_max;
+  int64_t _main_max;
+  int64_t _protected_max;
+  // Sizer units on each list.
+  int64_t _sizes[3] = {0, 0, 0};
+  Index<K, Link> _index;
+  LRUList<K, V, Link> _lists[3];
+  TinyLFU<K> _sketch;
+  Sizer _sizer;
+  Stats _stats;
+
+  // Lock taken.
+  template <typename Q> inline Ptr get_impl(const Q& key) {
+    _sketch.record(key);
+    Link* link = _index.find(key);
+    if (link == nullptr) {
+      ++_stats.num_misses;
+      return nullptr;
+    }
+    ++_stats.num_hits;
+    _stats.bytes_hit += _sizer(link->value.get());
+    if (link->list == kWindow) {
+      ++_stats.lru_hits;
+    } else {
+      ++_stats.lfu_hits;
+    }
+    touch(link);
+    return link->value;
+  }
+
+  // Moves link to the head of its list, promoting it out of probation.
+  inline void touch(Link* link) {
+    if (link->list != kProbation) {
+      _lists[link->list].move_to_head(link);
+      return;
+    }
+    relink(link, kProtected);
+    while (_sizes[kProtected] > _protected_max) {
+      relink(_lists[kProtected].peek_tail(), kProbation);
+    }
+  }
+
+  // Inserts a link on no list at the head of list.
+  inline void insert(Link* link, List list) {
+    link->list = list;
+    _lists[list].insert_head(link);
+    _sizes[list] += _sizer(link->value.get());
+  }
+
+  inline void unlink(Link* link) {
+    _sizes[link->list] -= _sizer(link->value.get());
+    _lists[link->list].remove(link);
+  }
+
+  inline void relink(Link* link, List list) {
+    unlink(link);
+    insert(link, list);
+  }
+
+  // Frees a link that is on no list.
+  inline void drop(Link* link) {
+    int64_t sz = _sizer(link->value.get());
+    ++_stats.num_evicted;
+    _stats.bytes_evicted += sz;
+    _index.erase(link);
+  }
+
+  // The main cache's next victim: the tail of probation, or of protected if
+  // probation is empty.
+  inline Link* victim() const {
+    Link* link = _lists[kProbation].peek_tail();
+    return link ? link : _lists[kProtected].peek_tail();
+  }
+
+  // Moves candidates off the window until it fits, then evicts from the main
+  // cache until the whole cache fits.
+  inline void fit() {
+    while (_sizes[kWindow] > _window_max) {
+      Link* candidate = _lists[kWindow].peek_tail();
+      unlink(candidate);
+      int64_t main_size = _sizes[kProbation] + _sizes[kProtected];
+      Link* v = victim();
+      if (main_size + _sizer(candidate->value.get()) > _main_max && v &&
+          !_sketch.admit(candidate->key, v->key)) {
+        ++_stats.arc_filter;
+        ++_stats.lru_evicts;
+        drop(candidate);
+        continue;
+      }
+      insert(candidate, kProbation);
+    }
+    while (size() > _max_size) {
+      Link* v = victim();
+      if (v == nullptr) {
+        v = _lists[kWindow].peek_tail();
+        ++_stats.lru_evicts;
+      } else {
+        ++_stats.lfu_evicts;
+      }
+      unlink(v);
+      drop(v);
+    }
+  }
+};
+
+} // namespace cache
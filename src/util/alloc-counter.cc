@@ -0,0 +1,88 @@
+#include "util/alloc-counter.h"
+
+#include <cstdlib>
+#include <malloc.h>
+#include <new>
+
+namespace {
+
+thread_local int64_t num_allocs = 0;
+thread_local int64_t live_bytes = 0;
+
+inline void* counted(void* p) {
+  if (p != nullptr) {
+    ++num_allocs;
+    live_bytes += malloc_usable_size(p);
+  }
+  return p;
+}
+
+inline void release(void* p) {
+  if (p != nullptr) {
+    live_bytes -= malloc_usable_size(p);
+    free(p);
+  }
+}
+
+inline void* counted_malloc(size_t size) {
+  // malloc(0) may return nullptr, operator new must not.
+  void* p = counted(malloc(size == 0 ? 1 : size));
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+inline void* counted_aligned_malloc(size_t size, std::align_val_t align) {
+  size_t a = static_cast<size_t>(align);
+  // aligned_alloc requires size to be a multiple of the alignment.
+  void* p = counted(aligned_alloc(a, (size + a - 1) / a * a));
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+} // anonymous namespace
+
+namespace cache {
+
+int64_t AllocCounter::num_allocs() { return ::num_allocs; }
+
+int64_t AllocCounter::live_bytes() { return ::live_bytes; }
+
+} // namespace cache
+
+//
+// Replacements for the global allocation functions. Every form is replaced so
+// that memory is always released by the matching allocator.
+//
+void* operator new(size_t size) { return counted_malloc(size); }
+void* operator new[](size_t size) { return counted_malloc(size); }
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return counted(malloc(size == 0 ? 1 : size));
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return counted(malloc(size == 0 ? 1 : size));
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+  return counted_aligned_malloc(size, align);
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+  return counted_aligned_malloc(size, align);
+}
+
+void operator delete(void* p) noexcept { release(p); }
+void operator delete[](void* p) noexcept { release(p); }
+void operator delete(void* p, size_t) noexcept { release(p); }
+void operator delete[](void* p, size_t) noexcept { release(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { release(p); }
+void operator delete(void* p, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, std::align_val_t) noexcept { release(p); }
+void operator delete(void* p, size_t, std::align_val_t) noexcept { release(p); }
+void operator delete[](void* p, size_t, std::align_val_t) noexcept { release(p); }
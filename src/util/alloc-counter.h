@@ -0,0 +1,21 @@
+#pragma once
+
+#include <cstdint>
+
+namespace cache {
+
+// Counts heap allocations made through operator new by the calling thread.
+// Linking this in replaces the global operator new/delete, which also hides
+// new/delete mismatches from the sanitizers, so it is its own AllocCounter
+// library, linked only by the benchmarks and tests that count allocations.
+class AllocCounter {
+public:
+  // Number of allocations made by this thread so far.
+  static int64_t num_allocs();
+
+  // Bytes allocated minus bytes freed by this thread so far, as reported by
+  // malloc_usable_size() so allocator rounding is included.
+  static int64_t live_bytes();
+};
+
+} // namespace cache
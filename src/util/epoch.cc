@@ -0,0 +1,51 @@
+#include "util/epoch.h"
+
+#include <algorithm>
+#include <thread>
+
+namespace cache {
+
+std::atomic<uint64_t> EpochManager::_epoch{0};
+std::atomic<EpochManager::Slot*> EpochManager::_slots{nullptr};
+
+EpochManager::ThreadState::~ThreadState() {
+  if (slot) {
+    slot->epoch.store(kIdle, std::memory_order_release);
+    slot->in_use.store(false, std::memory_order_release);
+  }
+}
+
+EpochManager::Slot* EpochManager::claim_slot() {
+  // Reuse the slot of an exited thread if there is one.
+  for (Slot* s = _slots.load(std::memory_order_acquire); s; s = s->next) {
+    bool free = false;
+    if (!s->in_use.load(std::memory_order_relaxed) &&
+        s->in_use.compare_exchange_strong(free, true)) {
+      return s;
+    }
+  }
+  Slot* s = new Slot();
+  s->in_use.store(true, std::memory_order_relaxed);
+  s->next = _slots.load(std::memory_order_relaxed);
+  while (!_slots.compare_exchange_weak(s->next, s, std::memory_order_release,
+                                       std::memory_order_relaxed)) {
+  }
+  return s;
+}
+
+uint64_t EpochManager::min_active() {
+  uint64_t min = kIdle;
+  for (Slot* s = _slots.load(std::memory_order_acquire); s; s = s->next) {
+    min = std::min(min, s->epoch.load(std::memory_order_seq_cst));
+  }
+  return min;
+}
+
+void EpochManager::synchronize() {
+  uint64_t e = retire_epoch();
+  while (min_active() <= e) {
+    std::this_thread::yield();
+  }
+}
+
+} // namespace cache
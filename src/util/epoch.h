@@ -0,0 +1,105 @@
+#pragma once
+
+/*
+ * Implements epoch based reclamation, which lets readers traverse shared
+ * structures without locks while writers defer freeing what they unlink.
+ */
+
+#include <atomic>
+#include <cstdint>
+
+namespace cache {
+
+// Process wide epoch domain. A reader brackets its traversal with an
+// EpochGuard, which publishes the global epoch it started in. A writer that
+// unlinks an object tags it with retire_epoch() and may free it once
+// min_active() is greater than the tag: every reader still running started
+// after the unlink and can not reach the object.
+//
+// Each thread owns a slot for its epoch, claimed on its first guard and
+// released when the thread exits. Slots are kept on a list that only grows.
+class EpochManager {
+public:
+  // Epoch of a slot whose thread is not reading.
+  static constexpr uint64_t kIdle = UINT64_MAX;
+
+  // Advances the global epoch and returns the epoch to tag an object with
+  // that was unlinked before the call.
+  static inline uint64_t retire_epoch() {
+    return _epoch.fetch_add(1, std::memory_order_seq_cst);
+  }
+
+  // Smallest epoch any reader is in, kIdle if there are no readers.
+  static uint64_t min_active();
+
+  // Returns once every reader that was running at the call has finished.
+  // Must not be called from inside an EpochGuard.
+  static void synchronize();
+
+private:
+  friend class EpochGuard;
+
+  struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{kIdle};
+    std::atomic<bool> in_use{false};
+    Slot* next = nullptr;
+  };
+
+  static std::atomic<uint64_t> _epoch;
+  static std::atomic<Slot*> _slots;
+
+  // This thread's slot and guard nesting depth.
+  struct ThreadState {
+    Slot* slot = nullptr;
+    int depth = 0;
+
+    ~ThreadState();
+  };
+
+  static ThreadState& thread_state() {
+    static thread_local ThreadState state;
+    return state;
+  }
+
+  static Slot* claim_slot();
+
+  static inline void enter() {
+    ThreadState& state = thread_state();
+    if (state.depth++ > 0) {
+      return;
+    }
+    if (!state.slot) {
+      state.slot = claim_slot();
+    }
+    // Publish the epoch, then check it did not advance before the publish was
+    // visible, otherwise a writer could have missed this reader.
+    uint64_t e = _epoch.load(std::memory_order_seq_cst);
+    while (true) {
+      state.slot->epoch.store(e, std::memory_order_seq_cst);
+      uint64_t now = _epoch.load(std::memory_order_seq_cst);
+      if (now == e) {
+        return;
+      }
+      e = now;
+    }
+  }
+
+  static inline void exit() {
+    ThreadState& state = thread_state();
+    if (--state.depth == 0) {
+      state.slot->epoch.store(kIdle, std::memory_order_release);
+    }
+  }
+};
+
+// Marks the calling thread as reading for its lifetime. Guards nest.
+class EpochGuard {
+public:
+  EpochGuard() { EpochManager::enter(); }
+  ~EpochGuard() { EpochManager::exit(); }
+
+  EpochGuard(const EpochGuard&) = delete;
+  EpochGuard operator=(const EpochGuard&) = delete;
+};
+
+} // namespace cache
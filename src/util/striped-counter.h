@@ -0,0 +1,60 @@
+#pragma once
+
+/*
+ * Implements a counter that many threads can bump without sharing a cache
+ * line.
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace cache {
+
+// A counter split over cache line sized stripes. Threads are spread over the
+// stripes round robin, so add() rarely contends; sum() reads every stripe and
+// is only as exact as a relaxed read of concurrent adds can be.
+class StripedCounter {
+public:
+  static constexpr int kStripes = 16;
+
+  StripedCounter() = default;
+
+  inline void add(int64_t v) {
+    _stripes[stripe()].value.fetch_add(v, std::memory_order_relaxed);
+  }
+
+  int64_t sum() const {
+    int64_t s = 0;
+    for (const Stripe& stripe : _stripes) {
+      s += stripe.value.load(std::memory_order_relaxed);
+    }
+    return s;
+  }
+
+  void clear() {
+    for (Stripe& stripe : _stripes) {
+      stripe.value.store(0, std::memory_order_relaxed);
+    }
+  }
+
+  // The stripe of the calling thread.
+  static inline int stripe() {
+    static std::atomic<int> next{0};
+    static thread_local int idx =
+        next.fetch_add(1, std::memory_order_relaxed) % kStripes;
+    return idx;
+  }
+
+  StripedCounter(const StripedCounter&) = delete;
+  StripedCounter operator=(const StripedCounter&) = delete;
+
+private:
+  struct alignas(64) Stripe {
+    std::atomic<int64_t> value{0};
+  };
+
+  std::array<Stripe, kStripes> _stripes;
+};
+
+} // namespace cache
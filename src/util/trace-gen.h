@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
 #include <sstream>
@@ -49,6 +50,16 @@ struct Request {
   template<typename K>
   const K& get_key() const;
 
+  // The key's bytes, from the external copy if there is one. Lets a string
+  // keyed cache be probed the way a caller holding the key outside a
+  // std::string would.
+  std::string_view key_view() const {
+    if (test_key.ptr != nullptr) {
+      return std::string_view(test_key.ptr, test_key.len);
+    }
+    return key;
+  }
+
   Request() = default;
   Request(std::string_view k, int64_t v, const char* ext_ptr)
     : key(k), value(v),
@@ -143,10 +154,20 @@ public:
   }
 
   virtual const Request* next() {
-    std::string line;
-    if ((_limit == 0 || _count < _limit) && std::getline(_file, line)) {
-      std::stringstream l(line);
-      l >> _r.key >> _r.value;
+    if ((_limit == 0 || _count < _limit) && std::getline(_file, _line)) {
+      // "<key> <value>". Parsed in place, _line and _r.key keep their buffers
+      // from line to line so reading does not allocate.
+      size_t begin = _line.find_first_not_of(" \t");
+      size_t end = _line.find_first_of(" \t", begin);
+      if (begin == std::string::npos) {
+        _r.key.clear();
+        _r.value = 0;
+      } else {
+        _r.key.assign(_line, begin, end - begin);
+        _r.value = end == std::string::npos
+                       ? 0
+                       : std::strtoll(_line.c_str() + end, nullptr, 10);
+      }
       if (_pool != nullptr) {
         char* ext = _pool->allocate_and_copy(_r.key);
         _r.test_key = TestKey(ext, _r.key.size());
@@ -164,6 +185,7 @@ private:
   int64_t _limit;
   int64_t _count;
   Request _r;
+  std::string _line;
   MemoryPool* _pool;
 };
 
@@ -0,0 +1,135 @@
+#include "cache/adapt-size.h"
+#include "cache/arc.h"
+#include "cache/flex-arc.h"
+#include "util/lock.h"
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <thread>
+#include <vector>
+
+using namespace cache;
+using namespace std;
+
+typedef AdaptiveCache<string, int64_t, NopLock, TraceSizer> Arc;
+typedef FlexARC<string, int64_t, NopLock, TraceSizer> Farc;
+typedef LRUCache<string, int64_t, NopLock, TraceSizer> Lru;
+
+// Requests hot keys of 2 bytes in turn, each followed by a key of 30 bytes
+// never seen again.
+template <class Cache> void TestScan(Cache* cache, int n) {
+  for (int i = 0; i < n; ++i) {
+    string hot = "hot" + to_string(i % 20);
+    string large = "large" + to_string(i);
+    for (const string& key : {hot, large}) {
+      if (!cache->get(key)) {
+        cache->add_to_cache(key, make_shared<int64_t>(key == hot ? 2 : 30));
+      }
+    }
+  }
+}
+
+TEST(AdaptSizeCache, SmallCache) {
+  AdaptSizeCache<string, int64_t, Arc> cache(100);
+  ASSERT_EQ(cache.label(100), "as-arc-100");
+  ASSERT_TRUE(isinf(cache.c()));
+  cache.add_to_cache("Baby Yoda", make_shared<int64_t>(60));
+  cache.add_to_cache("The Mandalorian", make_shared<int64_t>(30));
+  ASSERT_EQ(*cache.get("Baby Yoda"), 60);
+  ASSERT_EQ(cache.size(), 90);
+  ASSERT_EQ(cache.num_entries(), 2);
+  ASSERT_EQ(cache.max_size(), 100);
+  ASSERT_EQ(cache.stats().num_hits, 1);
+  ASSERT_EQ(cache.stats().arc_filter, 0);
+
+  shared_ptr<int64_t> p = cache.remove_from_cache("Baby Yoda");
+  ASSERT_EQ(*p, 60);
+  ASSERT_EQ(cache.size(), 30);
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.stats().num_hits, 0);
+}
+
+// The keys of 30 bytes push the hot keys out of an LRU cache; once tuned, the
+// wrapper turns most of them away and the hot keys stay.
+TEST(AdaptSizeCache, Scan) {
+  Lru lru(60);
+  TestScan(&lru, 2000);
+  AdaptSizeCache<string, int64_t, Lru> as_lru(60);
+  as_lru.set_interval(200);
+  ASSERT_EQ(as_lru.interval(), 200);
+  TestScan(&as_lru, 2000);
+  ASSERT_EQ(lru.stats().num_hits, 0);
+  ASSERT_GT(as_lru.stats().num_hits, 1000);
+  ASSERT_GT(as_lru.stats().arc_filter, 1000);
+  ASSERT_LT(as_lru.c(), 30);
+  ASSERT_LE(as_lru.size(), 60);
+
+  AdaptSizeCache<string, int64_t, Arc> as_arc(60);
+  as_arc.set_interval(200);
+  TestScan(&as_arc, 2000);
+  AdaptSizeCache<string, int64_t, Farc> as_farc(60, 240);
+  as_farc.set_interval(200);
+  TestScan(&as_farc, 2000);
+  ASSERT_EQ(as_farc.label(60), "as-farc-100-400");
+  ASSERT_GT(as_arc.stats().num_hits, 1000);
+  ASSERT_GT(as_farc.stats().num_hits, 1000);
+}
+
+// Counts the keys removed from any of them.
+class CountingLru : public Lru {
+public:
+  using Lru::Lru;
+
+  shared_ptr<int64_t> remove_from_cache(const string& key) {
+    ++removes;
+    return Lru::remove_from_cache(key);
+  }
+
+  static inline int removes = 0;
+};
+
+// Turning a value away only removes the key when it is cached, so the ghost
+// entries of keys not cached are left alone.
+TEST(AdaptSizeCache, RejectRemovesCached) {
+  AdaptSizeCache<string, int64_t, CountingLru> cache(60);
+  cache.set_interval(200);
+  TestScan(&cache, 2000);
+  ASSERT_GT(cache.stats().arc_filter, 1000);
+  ASSERT_EQ(CountingLru::removes, 0);
+  ASSERT_NE(cache.get("hot0"), nullptr);
+  cache.add_to_cache("hot0", make_shared<int64_t>(1000));
+  ASSERT_EQ(CountingLru::removes, 1);
+  ASSERT_EQ(cache.get("hot0"), nullptr);
+}
+
+// Nothing is turned away when everything fits.
+TEST(AdaptSizeCache, Fits) {
+  AdaptSizeCache<string, int64_t, Arc> cache(100000);
+  cache.set_interval(200);
+  TestScan(&cache, 2000);
+  ASSERT_TRUE(isinf(cache.c()));
+  ASSERT_EQ(cache.stats().arc_filter, 0);
+  ASSERT_EQ(cache.num_entries(), 2020);
+}
+
+// Threads share the wrapper; the one ending an interval tunes c while the
+// others keep going.
+TEST(AdaptSizeCache, Threads) {
+  AdaptSizeCache<string, int64_t,
+                 LRUCache<string, int64_t, WordLock, TraceSizer>, TraceSizer,
+                 WordLock>
+      cache(60);
+  cache.set_interval(200);
+  vector<thread> workers;
+  for (int t = 0; t < 4; ++t) {
+    workers.emplace_back([&]() { TestScan(&cache, 2000); });
+  }
+  for (thread& t : workers) {
+    t.join();
+  }
+  ASSERT_GT(cache.stats().num_hits, 4000);
+  ASSERT_LT(cache.c(), 30);
+  ASSERT_LE(cache.size(), 60);
+}
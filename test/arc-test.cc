@@ -45,6 +45,24 @@ TEST(ArcCache, SmallCacheSized) {
   ASSERT_EQ(cache.size(), 12);
 }
 
+// With SizedGhost the ghost lists hold bytes and p moves by the bytes of the
+// key that came back.
+TEST(ArcCache, SizedGhost) {
+  AdaptiveCache<string, string, NopLock, StringSizer, NodeIndex,
+                SizedGhost<string>>
+      cache(10);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("012345"));
+  cache.add_to_cache("K2", make_shared<string>("01"));
+  ASSERT_EQ(cache.get("K0"), nullptr);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  // K0 came back from the T1 ghost.
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+  ASSERT_EQ(cache.stats().lfu_ghost_hits, 0);
+  ASSERT_EQ(cache.p(), 4);
+  ASSERT_EQ(*cache.get("K0"), "0123");
+}
+
 TEST(ArcCache, LRUOnly) {
   AdaptiveCache<string, string> cache(2);
   ASSERT_EQ(cache.size(), 0);
@@ -0,0 +1,76 @@
+#include "cache/arc.h"
+#include "cache/arena.h"
+#include "cache/flex-arc.h"
+#include "util/alloc-counter.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+using namespace cache;
+using namespace std;
+
+TEST(NodeArena, Recycle) {
+  NodeArena arena;
+  ASSERT_TRUE(arena.serves(sizeof(int64_t)));
+  ASSERT_FALSE(arena.serves(1024));
+  void* a = arena.allocate();
+  void* b = arena.allocate();
+  ASSERT_NE(a, b);
+  ASSERT_EQ(arena.num_chunks(), 1);
+  arena.deallocate(a);
+  // Freed blocks are handed out again before carving new ones.
+  ASSERT_EQ(arena.allocate(), a);
+  arena.deallocate(b);
+  arena.deallocate(a);
+  ASSERT_EQ(arena.num_chunks(), 1);
+}
+
+TEST(NodeArena, Reserve) {
+  NodeArena arena;
+  arena.reserve(1000);
+  ASSERT_TRUE(arena.serves(32));
+  for (int i = 0; i < 1000; ++i) {
+    arena.allocate();
+  }
+  ASSERT_EQ(arena.num_chunks(), 1);
+  arena.allocate();
+  ASSERT_EQ(arena.num_chunks(), 2);
+}
+
+// Runs the trace through the cache and returns the number of allocations made
+// by the cache calls.
+template <class Cache> int64_t CountAllocs(Cache* cache, Trace* trace) {
+  trace->Reset();
+  int64_t allocs = 0;
+  while (true) {
+    const Request* r = trace->next();
+    if (r == nullptr)
+      break;
+    int64_t before = AllocCounter::num_allocs();
+    shared_ptr<int64_t> val = cache->get(r->ref_key);
+    allocs += AllocCounter::num_allocs() - before;
+    if (!val) {
+      shared_ptr<int64_t> v = make_shared<int64_t>(r->value);
+      before = AllocCounter::num_allocs();
+      cache->add_to_cache(r->ref_key, std::move(v));
+      allocs += AllocCounter::num_allocs() - before;
+    }
+  }
+  return allocs;
+}
+
+// Once warm, inserts, evictions and ghost transitions must not allocate.
+TEST(NodeArena, SteadyStateArc) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 20000, 2000, 0.7, 1));
+  AdaptiveCache<RefCountKey, int64_t> cache(200);
+  ASSERT_GT(CountAllocs(&cache, &trace), 0);
+  ASSERT_EQ(CountAllocs(&cache, &trace), 0);
+  ASSERT_GT(cache.stats().num_evicted, 0);
+  ASSERT_GT(cache.stats().lru_evicts + cache.stats().lfu_evicts, 0);
+}
+
+TEST(NodeArena, SteadyStateFlexArc) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 20000, 2000, 0.7, 1));
+  FlexARC<RefCountKey, int64_t> cache(200, 400, 100);
+  CountAllocs(&cache, &trace);
+  ASSERT_EQ(CountAllocs(&cache, &trace), 0);
+}
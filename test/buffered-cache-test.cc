@@ -0,0 +1,148 @@
+#include "cache/arc.h"
+#include "cache/buffered-cache.h"
+#include "cache/concurrent-index.h"
+#include "cache/flex-arc.h"
+#include "cache/lru.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+#include <thread>
+
+using namespace cache;
+using namespace std;
+
+typedef LRUCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                 ConcurrentIndex>
+    ConcurrentLru;
+typedef AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                      ConcurrentIndex>
+    ConcurrentArc;
+typedef FlexARC<string, int64_t, NopLock, ElementCount<int64_t>,
+                ConcurrentIndex>
+    ConcurrentFarc;
+typedef BufferedCache<string, int64_t, ConcurrentLru> BufferedLru;
+typedef BufferedCache<string, int64_t, ConcurrentArc> BufferedArc;
+typedef BufferedCache<string, int64_t, ConcurrentFarc> BufferedFarc;
+
+TEST(MpscRing, Basic) {
+  MpscRing<int, 4> ring;
+  int v;
+  ASSERT_FALSE(ring.pop(v));
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_TRUE(ring.push(i));
+  }
+  ASSERT_FALSE(ring.push(4));
+  ASSERT_TRUE(ring.pop(v));
+  ASSERT_EQ(v, 0);
+  ASSERT_TRUE(ring.push(4));
+  for (int i = 1; i <= 4; ++i) {
+    ASSERT_TRUE(ring.pop(v));
+    ASSERT_EQ(v, i);
+  }
+  ASSERT_FALSE(ring.pop(v));
+}
+
+TEST(BufferedCache, Basic) {
+  BufferedArc cache(2);
+  ASSERT_EQ(cache.label(2), "buf-arc-100");
+  ASSERT_EQ(cache.get("a"), nullptr);
+  // Uncontended writes are drained right away.
+  cache.add_to_cache("a", make_shared<int64_t>(1));
+  cache.add_to_cache("b", make_shared<int64_t>(2));
+  ASSERT_EQ(*cache.get("a"), 1);
+  ASSERT_EQ(*cache.get("b"), 2);
+  ASSERT_EQ(cache.size(), 2);
+
+  // Hits are replayed into the policy once drained, without counting them
+  // again there.
+  cache.drain();
+  ASSERT_EQ(cache.stats().num_hits, 2);
+  ASSERT_EQ(cache.stats().bytes_hit, 2);
+  ASSERT_EQ(cache.cache()->stats().num_hits, 0);
+  ASSERT_EQ(cache.cache()->stats().num_misses, 0);
+
+  ASSERT_EQ(*cache.remove_from_cache("a"), 1);
+  ASSERT_EQ(cache.get("a"), nullptr);
+  ASSERT_EQ(cache.stats().num_hits, 2);
+  ASSERT_EQ(cache.stats().num_misses, 2);
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.stats().num_hits, 0);
+}
+
+// A second write of a cached key, e.g. from two threads missing it at once,
+// neither replaces its value nor counts as a hit that promotes it to T2.
+TEST(BufferedCache, AddIfAbsent) {
+  BufferedArc cache(2);
+  cache.add_to_cache("a", make_shared<int64_t>(1));
+  cache.add_to_cache("a", make_shared<int64_t>(2));
+  ASSERT_EQ(*cache.cache()->peek("a"), 1);
+  cache.add_to_cache("b", make_shared<int64_t>(2));
+  // "a" is still the oldest key in T1, so "c" evicts it.
+  cache.add_to_cache("c", make_shared<int64_t>(3));
+  ASSERT_EQ(cache.get("a"), nullptr);
+  ASSERT_EQ(*cache.get("b"), 2);
+  ASSERT_EQ(*cache.get("c"), 3);
+}
+
+// Delaying recency updates by a read buffer barely changes hit ratios.
+template <typename Buffered, typename Plain, typename... Args>
+void CheckHitRatio(Args... args) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 50000, 5000, 0.8, 1));
+  Buffered buffered(args...);
+  Plain plain(args...);
+  while (true) {
+    const Request* r = trace.next();
+    if (r == nullptr)
+      break;
+    if (!buffered.get(r->key)) {
+      buffered.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    if (!plain.get(r->key)) {
+      plain.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+  }
+  ASSERT_LE(buffered.size(), buffered.max_size());
+  ASSERT_GE(buffered.stats().num_hits, plain.stats().num_hits * 0.95);
+}
+
+TEST(BufferedCache, HitRatio) {
+  CheckHitRatio<BufferedLru, LRUCache<string, int64_t>>(500);
+  CheckHitRatio<BufferedArc, AdaptiveCache<string, int64_t>>(500);
+  CheckHitRatio<BufferedFarc, FlexARC<string, int64_t>>(500, 2000);
+}
+
+// Every value read must belong to its key while threads add and evict.
+template <typename Cache, typename... Args> void CheckThreads(Args... args) {
+  Cache cache(args...);
+  vector<Request> trace =
+      TraceGen::ZipfianDistribution(42, 100000, 5000, 0.9, 1);
+  atomic<int64_t> bad{0};
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = t * 1000; i < trace.size(); i += 2) {
+        const Request& r = trace[i];
+        auto v = cache.get(r.key);
+        if (!v) {
+          cache.add_to_cache(r.key, make_shared<int64_t>(stoll(r.key)));
+        } else if (*v != stoll(r.key)) {
+          ++bad;
+        }
+      }
+    });
+  }
+  for (thread& t : threads) {
+    t.join();
+  }
+  cache.drain();
+  ASSERT_EQ(bad, 0);
+  ASSERT_LE(cache.size(), cache.max_size());
+  ASSERT_GT(cache.stats().num_hits, 0);
+}
+
+TEST(BufferedCache, Threads) {
+  CheckThreads<BufferedArc>(1000);
+  CheckThreads<BufferedFarc>(1000, 4000);
+}
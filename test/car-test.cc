@@ -0,0 +1,85 @@
+#include "cache/arc.h"
+#include "cache/car.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+TEST(CARCache, SmallCache) {
+  CARCache<string, string> cache(3);
+  ASSERT_EQ(cache.label(3), "car-100");
+  ASSERT_EQ(cache.p(), 0);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+  ASSERT_EQ(cache.stats().lru_hits, 2);
+  ASSERT_EQ(cache.size(), 3);
+
+  // The hand passes Grogu, who was looked up and moves to T2, and evicts the
+  // Mandalorian to B1.
+  cache.add_to_cache("Assassin", make_shared<string>("Fennec Shand"));
+  ASSERT_EQ(cache.size(), 3);
+  ASSERT_EQ(cache.stats().lru_evicts, 1);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+
+  // Back from B1, the Mandalorian goes to T2 and p grows. Boba Fett goes to
+  // B1.
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+  ASSERT_EQ(cache.p(), 1);
+  ASSERT_EQ(cache.max_p(), 1);
+  ASSERT_EQ(cache.stats().num_evicted, 2);
+  ASSERT_EQ(cache.get("Bounty Hunter"), nullptr);
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+  ASSERT_EQ(cache.stats().lfu_hits, 2);
+  ASSERT_EQ(cache.stats().lfu_evicts, 0);
+
+  TestRemoveAndClear(&cache, "Baby Yoda");
+  ASSERT_EQ(cache.p(), 0);
+}
+
+TEST(CARCache, SmallCacheSized) {
+  CARCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  cache.add_to_cache("K3", make_shared<string>("0123"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K4", make_shared<string>("012"));
+  ASSERT_EQ(cache.size(), 12);
+  ASSERT_EQ(cache.get("K2"), nullptr);
+  ASSERT_NE(cache.get("K1"), nullptr);
+}
+
+// Keys looked up again while in T1 survive a scan of new keys, which only goes
+// through T1.
+TEST(CARCache, ScanResistant) {
+  CARCache<string, int64_t> car(100);
+  TestScanResistant(&car, 250, 1000);
+}
+
+TEST(CARCache, Zipf) {
+  CARCache<string, int64_t> car(100);
+  TestZipf(&car, 0.95);
+  ASSERT_GT(car.stats().lru_ghost_hits + car.stats().lfu_ghost_hits, 0);
+  ASSERT_GT(car.max_p(), 0);
+}
+
+TEST(CARCache, SizedGhost) {
+  FixedTrace trace = ZipfTrace();
+  CARCache<string, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+           SizedGhost<string>>
+      cache(100);
+  TestTrace(&cache, &trace);
+  ASSERT_EQ(cache.size(), 100);
+  ASSERT_GT(cache.stats().lru_ghost_hits + cache.stats().lfu_ghost_hits, 0);
+}
@@ -0,0 +1,120 @@
+#include "cache/arc.h"
+#include "cache/clock-pro.h"
+#include "cache/flat-index.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+using namespace cache;
+using namespace std;
+
+TEST(ClockProCache, SmallCache) {
+  ClockProCache<string, string> cache(2);
+  ASSERT_EQ(cache.size(), 0);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Unknown Name"));
+  ASSERT_EQ(cache.size(), 1);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.size(), 2);
+  // Baby Yoda is referenced, so the cold hand evicts The Mandalorian.
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_EQ(cache.stats().num_evicted, 1);
+
+  shared_ptr<string> p = cache.remove_from_cache("Baby Yoda");
+  ASSERT_EQ(p.use_count(), 1);
+  ASSERT_EQ(*p, "Grogu");
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+}
+
+TEST(ClockProCache, SmallCacheSized) {
+  ClockProCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_LE(cache.size(), 16);
+  ASSERT_NE(cache.get("K1"), nullptr);
+}
+
+TEST(ClockProCache, GhostHitIsHot) {
+  ClockProCache<string, int64_t> cache(4);
+  // The first three keys fill the hot area, the rest are cold.
+  for (int i = 0; i < 5; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(i));
+  }
+  ASSERT_EQ(cache.hot_size(), 3);
+  // "3" was evicted during its test period and is remembered.
+  ASSERT_EQ(cache.get("3"), nullptr);
+  ASSERT_EQ(cache.ghost_size(), 1);
+  int64_t cold_target = cache.p();
+  cache.add_to_cache("3", make_shared<int64_t>(3));
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+  ASSERT_EQ(cache.p(), cold_target + 1);
+  ASSERT_EQ(cache.ghost_size(), 1);
+  ASSERT_EQ(cache.size(), 4);
+  ASSERT_LE(cache.hot_size(), cache.max_size() - cache.p());
+  ASSERT_NE(cache.get("3"), nullptr);
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+}
+
+// With large pages the cache holds far fewer pages than its size, and no more
+// of them are remembered than are resident.
+TEST(ClockProCache, GhostBoundedByEntries) {
+  ClockProCache<string, string, NopLock, StringSizer> cache(1000);
+  for (int i = 0; i < 500; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<string>(100, 'x'));
+    ASSERT_LE(cache.ghost_size(), cache.num_entries());
+  }
+  ASSERT_EQ(cache.num_entries(), 10);
+  ASSERT_GT(cache.ghost_size(), 0);
+}
+
+TEST(ClockProCache, SingleKey) {
+  ClockProCache<string, int64_t> cache(2);
+  FixedTrace trace(TraceGen::SameKeyTrace(100, "key", 4));
+  TestTrace(&cache, &trace);
+  ASSERT_EQ(99, cache.stats().num_hits);
+  ASSERT_EQ(1, cache.stats().num_misses);
+}
+
+TEST(ClockProCache, SmallCycle) {
+  ClockProCache<string, int64_t> cache(100);
+  FixedTrace trace(TraceGen::CycleTrace(100, 20, 8));
+  TestTrace(&cache, &trace);
+  ASSERT_EQ(80, cache.stats().num_hits);
+  ASSERT_EQ(20, cache.stats().num_misses);
+}
+
+// A hot working set survives a long scan of unique keys.
+TEST(ClockProCache, ScanResistant) {
+  ClockProCache<string, int64_t> clock_pro(100);
+  TestScanResistant(&clock_pro, 1000, 2000);
+}
+
+TEST(ClockProCache, Zipf) {
+  ClockProCache<string, int64_t> clock_pro(100);
+  TestZipf(&clock_pro, 0.9);
+  ASSERT_EQ(clock_pro.hot_size() + clock_pro.cold_size(), 100);
+}
+
+TEST(ClockProCache, MatchesFlatIndex) {
+  ClockProCache<string, int64_t> node_cache(100);
+  ClockProCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_cache(100);
+  TestMatchesFlatIndex(&node_cache, &flat_cache);
+  ASSERT_EQ(node_cache.p(), flat_cache.p());
+
+  node_cache.clear();
+  ASSERT_EQ(node_cache.size(), 0);
+  ASSERT_EQ(node_cache.ghost_size(), 0);
+  FixedTrace trace = ZipfTrace();
+  TestTrace(&node_cache, &trace);
+  ASSERT_EQ(node_cache.stats().num_hits, flat_cache.stats().num_hits);
+}
@@ -0,0 +1,237 @@
+#include "cache/arc.h"
+#include "cache/concurrent-index.h"
+#include "cache/lru.h"
+#include "util/epoch.h"
+#include "util/lock.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+using namespace cache;
+using namespace std;
+
+typedef LRULink<int, int> IntLink;
+typedef ConcurrentIndex<int, IntLink> IntIndex;
+typedef LRUCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                 ConcurrentIndex>
+    ConcurrentLru;
+typedef AdaptiveCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                      ConcurrentIndex>
+    ConcurrentArc;
+
+TEST(Epoch, Guard) {
+  ASSERT_EQ(EpochManager::min_active(), EpochManager::kIdle);
+  uint64_t e = EpochManager::retire_epoch();
+  {
+    EpochGuard g;
+    ASSERT_EQ(EpochManager::min_active(), e + 1);
+    {
+      // Nested guards keep the outer epoch.
+      EpochGuard nested;
+      EpochManager::retire_epoch();
+      ASSERT_EQ(EpochManager::min_active(), e + 1);
+    }
+    ASSERT_EQ(EpochManager::min_active(), e + 1);
+  }
+  ASSERT_EQ(EpochManager::min_active(), EpochManager::kIdle);
+  EpochManager::synchronize();
+}
+
+TEST(Epoch, SynchronizeWaitsForReaders) {
+  atomic<bool> entered{false};
+  atomic<bool> done{false};
+  thread reader([&]() {
+    EpochGuard g;
+    entered = true;
+    this_thread::sleep_for(chrono::milliseconds(50));
+    done = true;
+  });
+  while (!entered) {
+    this_thread::yield();
+  }
+  EpochManager::synchronize();
+  ASSERT_TRUE(done);
+  reader.join();
+}
+
+TEST(ConcurrentIndex, Basic) {
+  IntIndex index;
+  ASSERT_EQ(index.size(), 0);
+  ASSERT_EQ(index.find(1), nullptr);
+
+  auto [l1, inserted] = index.emplace(1, make_shared<int>(10));
+  ASSERT_TRUE(inserted);
+  ASSERT_EQ(index.find(1), l1);
+  ASSERT_EQ(*l1->value, 10);
+
+  auto [l2, inserted2] = index.emplace(1, make_shared<int>(20));
+  ASSERT_FALSE(inserted2);
+  ASSERT_EQ(l1, l2);
+  ASSERT_EQ(*l2->value, 10);
+
+  ASSERT_FALSE(IntIndex::clear_referenced(l1));
+  IntIndex::touch(l1);
+  ASSERT_TRUE(IntIndex::clear_referenced(l1));
+  ASSERT_FALSE(IntIndex::clear_referenced(l1));
+
+  index.erase(l1);
+  ASSERT_EQ(index.size(), 0);
+  ASSERT_EQ(index.find(1), nullptr);
+}
+
+TEST(ConcurrentIndex, GrowAndErase) {
+  const int N = 10000;
+  IntIndex index;
+  vector<IntLink*> links;
+  for (int i = 0; i < N; ++i) {
+    links.push_back(index.emplace(i, make_shared<int>(i)).first);
+  }
+  ASSERT_EQ(index.size(), N);
+  for (int i = 0; i < N; ++i) {
+    ASSERT_EQ(index.find(i), links[i]);
+  }
+  for (int i = 0; i < N; i += 2) {
+    index.erase(links[i]);
+  }
+  ASSERT_EQ(index.size(), N / 2);
+  for (int i = 0; i < N; ++i) {
+    ASSERT_EQ(index.find(i), i % 2 ? links[i] : nullptr);
+  }
+  index.clear();
+  ASSERT_EQ(index.size(), 0);
+  ASSERT_EQ(index.find(1), nullptr);
+}
+
+// A link erased while a reader is inside its epoch stays readable.
+TEST(ConcurrentIndex, RetiredWhileReading) {
+  IntIndex index;
+  IntLink* link = index.emplace(1, make_shared<int>(10)).first;
+  EpochGuard g;
+  ASSERT_EQ(index.find(1), link);
+  index.erase(link);
+  // Enough erases to trigger reclamation.
+  for (int i = 2; i < 1000; ++i) {
+    index.erase(index.emplace(i, make_shared<int>(i)).first);
+  }
+  ASSERT_EQ(link->key, 1);
+  ASSERT_EQ(*link->value, 10);
+}
+
+TEST(ConcurrentIndex, LRUCache) {
+  ConcurrentLru cache(2);
+  cache.add_to_cache("a", make_shared<int64_t>(1));
+  cache.add_to_cache("b", make_shared<int64_t>(2));
+  // a was read, so b is evicted first even though a is older.
+  ASSERT_EQ(*cache.get("a"), 1);
+  cache.add_to_cache("c", make_shared<int64_t>(3));
+  ASSERT_EQ(cache.get("b"), nullptr);
+  ASSERT_EQ(*cache.get("a"), 1);
+  ASSERT_EQ(*cache.get("c"), 3);
+
+  // Replacing a value swaps in a new link, readers holding the old value keep
+  // it.
+  shared_ptr<int64_t> old = cache.get("c");
+  cache.add_to_cache("c", make_shared<int64_t>(4));
+  ASSERT_EQ(*old, 3);
+  ASSERT_EQ(*cache.get("c"), 4);
+  ASSERT_TRUE(cache.update_cache("c", make_shared<int64_t>(5)));
+  ASSERT_EQ(*cache.get("c"), 5);
+  ASSERT_EQ(cache.size(), 2);
+
+  ASSERT_EQ(*cache.remove_from_cache("c"), 5);
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(cache.stats().num_hits, 6);
+  ASSERT_EQ(cache.stats().num_misses, 1);
+  cache.clear();
+  ASSERT_EQ(cache.stats().num_hits, 0);
+  ASSERT_EQ(cache.size(), 0);
+}
+
+// Second chance is close to LRU on a skewed trace, and ARC keeps its edge.
+TEST(ConcurrentIndex, HitRatio) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 100000, 10000, 0.8, 1));
+  LRUCache<string, int64_t> lru(1000);
+  ConcurrentLru clru(1000);
+  AdaptiveCache<string, int64_t> arc(1000);
+  ConcurrentArc carc(1000);
+  while (true) {
+    const Request* r = trace.next();
+    if (r == nullptr)
+      break;
+    if (!lru.get(r->key)) {
+      lru.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    if (!clru.get(r->key)) {
+      clru.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    if (!arc.get(r->key)) {
+      arc.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    if (!carc.get(r->key)) {
+      carc.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+  }
+  ASSERT_EQ(clru.size(), 1000);
+  ASSERT_LE(carc.size(), 1000);
+  ASSERT_EQ(carc.stats().num_hits + carc.stats().num_misses, 100000);
+  ASSERT_GE(clru.stats().num_hits, lru.stats().num_hits * 0.95);
+  ASSERT_GE(carc.stats().num_hits, arc.stats().num_hits * 0.95);
+  ASSERT_GT(carc.stats().lfu_hits, carc.stats().lru_hits);
+}
+
+// Readers check every value they get against its key while writers add and
+// evict. Freed links would show up under ASan.
+template <typename Cache> void ReadWhileWriting() {
+  const int64_t kKeys = 5000;
+  Cache cache(kKeys / 4);
+  vector<Request> trace =
+      TraceGen::ZipfianDistribution(42, 100000, kKeys, 0.9, 1);
+  atomic<int64_t> bad{0};
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = t * 1000; i < trace.size(); i += 2) {
+        const Request& r = trace[i];
+        auto v = cache.get(r.key);
+        if (!v) {
+          cache.add_to_cache(r.key, make_shared<int64_t>(stoll(r.key)));
+        } else if (*v != stoll(r.key)) {
+          ++bad;
+        }
+      }
+    });
+  }
+  for (thread& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(bad, 0);
+  ASSERT_LE(cache.size(), kKeys / 4);
+  ASSERT_GT(cache.stats().num_hits, 0);
+}
+
+TEST(ConcurrentIndex, LRUThreads) { ReadWhileWriting<ConcurrentLru>(); }
+
+TEST(ConcurrentIndex, ARCThreads) { ReadWhileWriting<ConcurrentArc>(); }
+
+TEST(ConcurrentIndex, MultiGet) {
+  ConcurrentArc cache(100);
+  vector<string> keys;
+  vector<shared_ptr<int64_t>> values;
+  for (int i = 0; i < 50; ++i) {
+    keys.push_back(to_string(i));
+    values.push_back(make_shared<int64_t>(i));
+  }
+  cache.multi_add(keys.data(), keys.size(), values.data());
+  vector<shared_ptr<int64_t>> out(keys.size());
+  // First reads promote from T1 under the lock, second ones hit T2.
+  cache.multi_get(keys.data(), keys.size(), out.data());
+  cache.multi_get(keys.data(), keys.size(), out.data());
+  for (int i = 0; i < 50; ++i) {
+    ASSERT_EQ(*out[i], i);
+  }
+  ASSERT_EQ(cache.stats().num_hits, 100);
+  ASSERT_EQ(cache.stats().lfu_hits, 50);
+  ASSERT_EQ(cache.stats().lru_hits, 50);
+}
@@ -0,0 +1,160 @@
+#include "cache/arc.h"
+#include "cache/car.h"
+#include "cache/flat-index.h"
+#include "cache/lfu.h"
+#include "cache/lirs.h"
+#include "cache/lru-k.h"
+#include "cache/lru.h"
+#include "cache/s3-fifo.h"
+#include "cache/sampled.h"
+#include "cache/slru.h"
+#include "cache/two-queue.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+using namespace cache;
+using namespace std;
+
+typedef LRULink<int, int> IntLink;
+
+TEST(FlatIndex, Basic) {
+  FlatIndex<int, IntLink> index;
+  ASSERT_EQ(index.size(), 0);
+  ASSERT_EQ(index.find(1), nullptr);
+
+  auto [l1, inserted] = index.emplace(1, make_shared<int>(10));
+  ASSERT_TRUE(inserted);
+  ASSERT_EQ(index.size(), 1);
+  ASSERT_EQ(index.find(1), l1);
+  ASSERT_EQ(*l1->value, 10);
+
+  // Emplacing an existing key returns the existing link untouched.
+  auto [l2, inserted2] = index.emplace(1, make_shared<int>(20));
+  ASSERT_FALSE(inserted2);
+  ASSERT_EQ(l1, l2);
+  ASSERT_EQ(*l2->value, 10);
+
+  index.erase(l1);
+  ASSERT_EQ(index.size(), 0);
+  ASSERT_EQ(index.find(1), nullptr);
+}
+
+TEST(FlatIndex, GrowAndErase) {
+  const int N = 10000;
+  FlatIndex<int, IntLink> index;
+  vector<IntLink*> links;
+  for (int i = 0; i < N; ++i) {
+    links.push_back(index.emplace(i, make_shared<int>(i)).first);
+  }
+  ASSERT_EQ(index.size(), N);
+  // Links must not move as the table grows.
+  for (int i = 0; i < N; ++i) {
+    ASSERT_EQ(index.find(i), links[i]);
+    ASSERT_EQ(*index.find(i)->value, i);
+  }
+
+  // Erase every other key, the rest must still be found after the backward
+  // shifts.
+  for (int i = 0; i < N; i += 2) {
+    index.erase(links[i]);
+  }
+  ASSERT_EQ(index.size(), N / 2);
+  for (int i = 0; i < N; ++i) {
+    if (i % 2 == 0) {
+      ASSERT_EQ(index.find(i), nullptr);
+    } else {
+      ASSERT_EQ(index.find(i), links[i]);
+    }
+  }
+
+  // Freed links are recycled.
+  for (int i = 0; i < N; i += 2) {
+    ASSERT_TRUE(index.emplace(i, nullptr).second);
+  }
+  ASSERT_EQ(index.size(), N);
+
+  index.clear();
+  ASSERT_EQ(index.size(), 0);
+  ASSERT_EQ(index.find(1), nullptr);
+}
+
+TEST(FlatIndex, LRUCache) {
+  LRUCache<string, string, NopLock, ElementCount<string>, FlatIndex> cache(2);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  shared_ptr<string> p = cache.remove_from_cache("Bounty Hunter");
+  ASSERT_EQ(p.use_count(), 1);
+  ASSERT_EQ(*p, "Boba Fett");
+  ASSERT_EQ(cache.size(), 1);
+}
+
+// The index must not change caching decisions.
+TEST(FlatIndex, MatchesNodeIndex) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 20000, 1000, 0.8, 1));
+  AdaptiveCache<string, int64_t> node_cache(100);
+  AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_cache(100);
+  while (true) {
+    const Request* r = trace.next();
+    if (r == nullptr)
+      break;
+    if (!node_cache.get(r->key)) {
+      node_cache.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    if (!flat_cache.get(r->key)) {
+      flat_cache.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+  }
+  ASSERT_EQ(node_cache.stats().num_hits, flat_cache.stats().num_hits);
+  ASSERT_EQ(node_cache.stats().num_evicted, flat_cache.stats().num_evicted);
+  ASSERT_EQ(node_cache.p(), flat_cache.p());
+}
+
+// Nor those of the other policies.
+TEST(FlatIndex, MatchesNodeIndexPolicies) {
+  LIRSCache<string, int64_t> lirs(100);
+  LIRSCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_lirs(100);
+  TestMatchesFlatIndex(&lirs, &flat_lirs);
+
+  S3FIFOCache<string, int64_t> s3fifo(100);
+  S3FIFOCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_s3fifo(100);
+  TestMatchesFlatIndex(&s3fifo, &flat_s3fifo);
+
+  TwoQueueCache<string, int64_t> two_queue(100);
+  TwoQueueCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_two_queue(100);
+  TestMatchesFlatIndex(&two_queue, &flat_two_queue);
+
+  SLRUCache<string, int64_t> slru(100);
+  SLRUCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_slru(100);
+  TestMatchesFlatIndex(&slru, &flat_slru);
+
+  CARCache<string, int64_t> car(100);
+  CARCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_car(100);
+  TestMatchesFlatIndex(&car, &flat_car);
+
+  LFUCache<string, int64_t> lfu_da(100, true);
+  LFUCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_lfu_da(100, true);
+  TestMatchesFlatIndex(&lfu_da, &flat_lfu_da);
+  ASSERT_EQ(lfu_da.p(), flat_lfu_da.p());
+
+  LRUKCache<string, int64_t> lru2(100);
+  LRUKCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_lru2(100);
+  TestMatchesFlatIndex(&lru2, &flat_lru2);
+
+  SampledCache<string, int64_t> lhd(100);
+  SampledCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      flat_lhd(100);
+  TestMatchesFlatIndex(&lhd, &flat_lhd);
+}
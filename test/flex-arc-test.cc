@@ -45,6 +45,21 @@ TEST(FlexArc, SmallCacheSized) {
   ASSERT_EQ(cache.size(), 12);
 }
 
+TEST(FlexArc, SizedGhost) {
+  FlexARC<string, string, NopLock, StringSizer, NodeIndex, SizedGhost<string>>
+      cache(10, 10);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("012345"));
+  cache.add_to_cache("K2", make_shared<string>("01"));
+  ASSERT_EQ(cache.get("K0"), nullptr);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  ASSERT_EQ(cache.p(), 4);
+  // Hits in T1 and T2 both count their bytes.
+  ASSERT_EQ(*cache.get("K0"), "0123");
+  ASSERT_EQ(*cache.get("K2"), "01");
+  ASSERT_EQ(cache.stats().bytes_hit, 6);
+}
+
 TEST(FlexArc, LRUOnly) {
   FlexARC<string, string> cache(2, 2);
   ASSERT_EQ(cache.size(), 0);
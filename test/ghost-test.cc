@@ -0,0 +1,148 @@
+#include "cache/arc.h"
+#include "cache/flex-arc.h"
+#include "cache/ghost.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+using namespace cache;
+using namespace std;
+
+template <class Ghost> void TestGhost() {
+  Ghost ghost(3);
+  ASSERT_EQ(ghost.size(), 0);
+  ASSERT_EQ(ghost.max_size(), 3);
+  ASSERT_FALSE(ghost.contains("Grogu"));
+
+  ghost.add("Grogu");
+  ghost.add("Din Djarin");
+  ghost.add("Boba Fett");
+  ASSERT_EQ(ghost.size(), 3);
+  // Adding an existing key only moves it to the head.
+  ghost.add("Grogu");
+  ASSERT_EQ(ghost.size(), 3);
+
+  // Full, the least recently used key goes.
+  ghost.add("Fennec Shand");
+  ASSERT_EQ(ghost.size(), 3);
+  ASSERT_FALSE(ghost.contains("Din Djarin"));
+
+  // contains() also counts as a use.
+  ASSERT_TRUE(ghost.contains("Boba Fett"));
+  ghost.evict();
+  ASSERT_FALSE(ghost.contains("Grogu"));
+  ASSERT_EQ(ghost.size(), 2);
+
+  ghost.remove("Boba Fett");
+  ASSERT_FALSE(ghost.contains("Boba Fett"));
+  ASSERT_TRUE(ghost.contains("Fennec Shand"));
+  ASSERT_EQ(ghost.size(), 1);
+
+  ghost.clear();
+  ASSERT_EQ(ghost.size(), 0);
+  ASSERT_FALSE(ghost.contains("Fennec Shand"));
+  ghost.evict();
+  ASSERT_EQ(ghost.size(), 0);
+}
+
+TEST(Ghost, KeyGhost) { TestGhost<KeyGhost<string>>(); }
+
+TEST(Ghost, FingerprintGhost) { TestGhost<FingerprintGhost<string>>(); }
+
+TEST(Ghost, SizedGhost) {
+  SizedGhost<string> ghost(10);
+  ghost.add("Grogu", 4);
+  ghost.add("Din Djarin", 4);
+  ASSERT_EQ(ghost.size(), 8);
+  ASSERT_EQ(ghost.num_entries(), 2);
+
+  // Over 10 bytes, the least recently used key goes.
+  ghost.add("Boba Fett", 3);
+  ASSERT_EQ(ghost.size(), 7);
+  ASSERT_FALSE(ghost.contains("Grogu"));
+
+  // Adding an existing key takes its new size.
+  ghost.add("Din Djarin", 6);
+  ASSERT_EQ(ghost.size(), 9);
+  ASSERT_EQ(ghost.num_entries(), 2);
+
+  // A key larger than the list leaves it empty.
+  ghost.add("Fennec Shand", 11);
+  ASSERT_EQ(ghost.size(), 0);
+  ASSERT_EQ(ghost.num_entries(), 0);
+
+  ghost.add("Grogu", 5);
+  ghost.add("Boba Fett", 2);
+  ghost.remove("Grogu");
+  ASSERT_EQ(ghost.size(), 2);
+  ghost.evict();
+  ASSERT_EQ(ghost.size(), 0);
+  ghost.add("Grogu", 5);
+  ghost.clear();
+  ASSERT_EQ(ghost.size(), 0);
+  ASSERT_FALSE(ghost.contains("Grogu"));
+}
+
+TEST(Ghost, FingerprintGhostGrow) {
+  const int N = 10000;
+  FingerprintGhost<int> ghost(N);
+  for (int i = 0; i < 2 * N; ++i) {
+    ghost.add(i);
+  }
+  ASSERT_EQ(ghost.size(), N);
+  for (int i = 0; i < N; ++i) {
+    ASSERT_FALSE(ghost.contains(i));
+    ASSERT_TRUE(ghost.contains(i + N));
+  }
+  // Removing keys must leave the rest of each probe sequence reachable.
+  for (int i = N; i < 2 * N; i += 2) {
+    ghost.remove(i);
+  }
+  ASSERT_EQ(ghost.size(), N / 2);
+  for (int i = N; i < 2 * N; ++i) {
+    ASSERT_EQ(ghost.contains(i), i % 2 == 1);
+  }
+}
+
+TEST(Ghost, ZeroSize) {
+  FingerprintGhost<int> ghost(0);
+  ghost.add(1);
+  ASSERT_EQ(ghost.size(), 0);
+  ASSERT_FALSE(ghost.contains(1));
+}
+
+// Without fingerprint collisions the ghost list type must not change caching
+// decisions.
+TEST(Ghost, MatchesKeyGhost) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 20000, 1000, 0.8, 1));
+  AdaptiveCache<string, int64_t> key_arc(100, 200);
+  AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+                FingerprintGhost<string>>
+      fp_arc(100, 200);
+  FlexARC<string, int64_t> key_farc(100, 400);
+  FlexARC<string, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+          FingerprintGhost<string>>
+      fp_farc(100, 400);
+  while (true) {
+    const Request* r = trace.next();
+    if (r == nullptr)
+      break;
+    auto value = make_shared<int64_t>(r->value);
+    if (!key_arc.get(r->key)) {
+      key_arc.add_to_cache(r->key, value);
+    }
+    if (!fp_arc.get(r->key)) {
+      fp_arc.add_to_cache(r->key, value);
+    }
+    if (!key_farc.get(r->key)) {
+      key_farc.add_to_cache(r->key, value);
+    }
+    if (!fp_farc.get(r->key)) {
+      fp_farc.add_to_cache(r->key, value);
+    }
+  }
+  ASSERT_EQ(key_arc.stats().num_hits, fp_arc.stats().num_hits);
+  ASSERT_EQ(key_arc.stats().arc_filter, fp_arc.stats().arc_filter);
+  ASSERT_EQ(key_arc.p(), fp_arc.p());
+  ASSERT_EQ(key_farc.stats().num_hits, fp_farc.stats().num_hits);
+  ASSERT_EQ(key_farc.p(), fp_farc.p());
+}
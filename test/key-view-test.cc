@@ -0,0 +1,115 @@
+#include "cache/arc.h"
+#include "cache/concurrent-index.h"
+#include "cache/flat-index.h"
+#include "cache/flex-arc.h"
+#include "cache/ghost.h"
+#include "cache/lru.h"
+#include "util/alloc-counter.h"
+#include "gtest/gtest.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+typedef shared_ptr<int64_t> Val;
+
+// Longer than the small string buffer, so building a std::string allocates.
+string Key(int i) { return "a key longer than inline storage " + to_string(i); }
+
+template <typename Cache> void CheckLRU() {
+  Cache cache(10);
+  for (int i = 0; i < 10; ++i) {
+    cache.add_to_cache(Key(i), make_shared<int64_t>(i));
+  }
+  for (int i = 0; i < 10; ++i) {
+    string k = Key(i);
+    string_view v = k;
+    ASSERT_EQ(*cache.get(v), i);
+    ASSERT_EQ(*cache.get(v, cache.hash(v)), i);
+    ASSERT_TRUE(cache.contains(v));
+  }
+  ASSERT_EQ(cache.get(string_view("missing")), nullptr);
+  ASSERT_FALSE(cache.contains(string_view("missing")));
+
+  string k = Key(3);
+  ASSERT_EQ(*cache.remove_from_cache(string_view(k)), 3);
+  ASSERT_EQ(cache.get(k), nullptr);
+  ASSERT_EQ(cache.remove_from_cache(string_view(k)), nullptr);
+  ASSERT_EQ(cache.size(), 9);
+  ASSERT_EQ(cache.stats().num_hits, 20);
+  ASSERT_EQ(cache.stats().num_misses, 2);
+}
+
+TEST(KeyView, LRUCache) {
+  CheckLRU<LRUCache<string, int64_t>>();
+  CheckLRU<LRUCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                    FlatIndex>>();
+  CheckLRU<LRUCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                    ConcurrentIndex>>();
+}
+
+// Views find entries in T1 and T2 and count ghost hits like keys do.
+template <typename Cache, typename... Args> void CheckARC(Args... args) {
+  Cache cache(args...);
+  string a = Key(1);
+  string b = Key(2);
+  string c = Key(3);
+  cache.add_to_cache(a, make_shared<int64_t>(1));
+  cache.add_to_cache(b, make_shared<int64_t>(2));
+  // T1 hit, moves a to T2, then a T2 hit.
+  ASSERT_EQ(*cache.get(string_view(a)), 1);
+  ASSERT_EQ(*cache.get(string_view(a)), 1);
+  ASSERT_EQ(cache.stats().lru_hits, 1);
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+
+  // c evicts b into the T1 ghost.
+  cache.add_to_cache(c, make_shared<int64_t>(3));
+  ASSERT_EQ(cache.get(string_view(b)), nullptr);
+  ASSERT_EQ(cache.stats().lfu_ghost_hits + cache.stats().lru_ghost_hits, 1);
+
+  ASSERT_EQ(*cache.remove_from_cache(string_view(a)), 1);
+  ASSERT_EQ(cache.get(a), nullptr);
+  ASSERT_EQ(*cache.get(c), 3);
+}
+
+TEST(KeyView, ARC) {
+  CheckARC<AdaptiveCache<string, int64_t>>(2);
+  CheckARC<AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                         FlatIndex, FingerprintGhost<string>>>(2);
+  CheckARC<AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                         ConcurrentIndex>>(2);
+  CheckARC<FlexARC<string, int64_t>>(2, 4);
+  CheckARC<FlexARC<string, int64_t, NopLock, ElementCount<int64_t>,
+                   FlatIndex>>(2, 4);
+}
+
+// Hits and misses by view allocate nothing, T2 hits included.
+template <typename Cache, typename... Args> void CheckNoAllocs(Args... args) {
+  Cache cache(args...);
+  vector<string> keys;
+  for (int i = 0; i < 200; ++i) {
+    keys.push_back(Key(i));
+  }
+  for (int i = 0; i < 100; ++i) {
+    cache.add_to_cache(keys[i], make_shared<int64_t>(i));
+    cache.get(keys[i]);
+  }
+
+  int64_t before = AllocCounter::num_allocs();
+  for (const string& k : keys) {
+    Val v = cache.get(string_view(k));
+  }
+  ASSERT_EQ(AllocCounter::num_allocs() - before, 0);
+  ASSERT_EQ(cache.stats().num_hits, 200);
+}
+
+TEST(KeyView, NoAllocs) {
+  CheckNoAllocs<AdaptiveCache<string, int64_t>>(100);
+  CheckNoAllocs<AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                              FlatIndex>>(100);
+  CheckNoAllocs<AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                              FlatIndex, FingerprintGhost<string>>>(100);
+  CheckNoAllocs<FlexARC<string, int64_t, NopLock, ElementCount<int64_t>,
+                        FlatIndex>>(100, 400);
+}
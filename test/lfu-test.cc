@@ -0,0 +1,105 @@
+#include "cache/arc.h"
+#include "cache/lfu.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+TEST(LFUCache, SmallCache) {
+  LFUCache<string, string> cache(3);
+  ASSERT_EQ(cache.label(3), "lfu-100");
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+  ASSERT_EQ(cache.count("Baby Yoda"), 3);
+  ASSERT_EQ(cache.count("The Mandalorian"), 2);
+  ASSERT_EQ(cache.count("Assassin"), 0);
+
+  // Boba Fett was never looked up.
+  cache.add_to_cache("Assassin", make_shared<string>("Fennec Shand"));
+  ASSERT_EQ(cache.size(), 3);
+  ASSERT_EQ(cache.get("Bounty Hunter"), nullptr);
+
+  // Fennec Shand ties with the Mandalorian, who was used less recently.
+  ASSERT_EQ(*cache.get("Assassin"), "Fennec Shand");
+  cache.add_to_cache("Marshal", make_shared<string>("Cobb Vanth"));
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_NE(cache.get("Assassin"), nullptr);
+  ASSERT_EQ(cache.stats().lfu_hits, 5);
+  ASSERT_EQ(cache.stats().lfu_evicts, 2);
+  ASSERT_EQ(cache.stats().num_evicted, 2);
+  ASSERT_EQ(cache.p(), 0);
+
+  TestRemoveAndClear(&cache, "Baby Yoda");
+}
+
+TEST(LFUCache, SmallCacheSized) {
+  LFUCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K0"), "0123");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_EQ(cache.size(), 13);
+  ASSERT_EQ(cache.get("K1"), nullptr);
+  ASSERT_NE(cache.get("K0"), nullptr);
+}
+
+// Grogu is looked up often early on, then never again. Plain LFU keeps him
+// for good, with aging newer keys start at higher counts and push him out.
+TEST(LFUCache, Aging) {
+  LFUCache<string, string> lfu(2);
+  LFUCache<string, string> lfu_da(2, true);
+  ASSERT_EQ(lfu_da.label(2), "lfu-da-100");
+  ASSERT_TRUE(lfu_da.aging());
+  for (auto* cache : {&lfu, &lfu_da}) {
+    cache->add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+    for (int i = 0; i < 3; ++i) {
+      cache->get("Baby Yoda");
+    }
+    for (int i = 0; i < 5; ++i) {
+      cache->add_to_cache(to_string(i), make_shared<string>(to_string(i)));
+    }
+  }
+  ASSERT_NE(lfu.get("Baby Yoda"), nullptr);
+  ASSERT_EQ(lfu.p(), 0);
+
+  // 0, 1 and 2 were evicted at counts 1, 2 and 3, so 3 came in at 4, the
+  // same count as Grogu, and Grogu, used less recently, made room for 4.
+  ASSERT_EQ(lfu_da.get("Baby Yoda"), nullptr);
+  ASSERT_EQ(lfu_da.p(), 4);
+  ASSERT_EQ(lfu_da.count("4"), 5);
+  ASSERT_EQ(lfu_da.num_entries(), 2);
+
+  lfu_da.clear();
+  ASSERT_EQ(lfu_da.p(), 0);
+}
+
+// A scan of new keys never gets past the working set's counts.
+TEST(LFUCache, ScanResistant) {
+  LFUCache<string, int64_t> lfu(100);
+  TestScanResistant(&lfu, 250, 1000);
+}
+
+// Zipf keys are drawn independently from a fixed distribution, which is what
+// LFU is best at.
+TEST(LFUCache, Zipf) {
+  LFUCache<string, int64_t> lfu(100);
+  TestZipf(&lfu, 1.0);
+  FixedTrace trace = ZipfTrace();
+  LFUCache<string, int64_t> lfu_da(100, true);
+  TestTrace(&lfu_da, &trace);
+  LRUCache<string, int64_t> lru(100);
+  TestTrace(&lru, &trace);
+  // Aging gives up some of that to adapt when the distribution changes.
+  ASSERT_GT(lfu_da.stats().num_hits, lru.stats().num_hits);
+}
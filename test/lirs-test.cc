@@ -0,0 +1,84 @@
+#include "cache/arc.h"
+#include "cache/lirs.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+TEST(LIRSCache, SmallCache) {
+  // Two LIR keys and one resident HIR key.
+  LIRSCache<string, string> cache(3);
+  ASSERT_EQ(cache.label(3), "lirs-100");
+  ASSERT_EQ(cache.p(), 1);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Unknown Name"));
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.size(), 3);
+
+  // Boba Fett is HIR, evicted for Fennec Shand but remembered.
+  cache.add_to_cache("Assassin", make_shared<string>("Fennec Shand"));
+  ASSERT_EQ(cache.size(), 3);
+  ASSERT_EQ(cache.stats().num_evicted, 1);
+  ASSERT_EQ(cache.get("Bounty Hunter"), nullptr);
+
+  // Fennec Shand is reused while in S, Grogu at the bottom of S is demoted.
+  ASSERT_EQ(*cache.get("Assassin"), "Fennec Shand");
+  ASSERT_EQ(cache.stats().lru_hits, 1);
+  ASSERT_EQ(cache.stats().lfu_evicts, 1);
+
+  // Boba Fett comes back as LIR, the Mandalorian is demoted and Grogu, the
+  // oldest HIR key, evicted.
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+  ASSERT_EQ(cache.stats().lfu_evicts, 2);
+  ASSERT_EQ(cache.stats().num_evicted, 2);
+  ASSERT_EQ(cache.size(), 3);
+  ASSERT_EQ(cache.num_entries(), 3);
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+  ASSERT_EQ(*cache.get("Bounty Hunter"), "Boba Fett");
+  ASSERT_EQ(cache.stats().lfu_hits, 3);
+
+  TestRemoveAndClear(&cache, "Bounty Hunter");
+}
+
+TEST(LIRSCache, SmallCacheSized) {
+  LIRSCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_LE(cache.size(), 16);
+  ASSERT_NE(cache.get("K1"), nullptr);
+}
+
+// A loop twice the size of the cache, where LRU hits nothing and ARC next to
+// nothing. LIRS keeps 99 keys of the loop as LIR and hits them on every pass
+// after the first.
+TEST(LIRSCache, Loop) {
+  FixedTrace trace(TraceGen::CycleTrace(2000, 200, 1));
+  LIRSCache<string, int64_t> lirs(100);
+  TestTrace(&lirs, &trace);
+  AdaptiveCache<string, int64_t> arc(100);
+  TestTrace(&arc, &trace);
+  ASSERT_LT(arc.stats().num_hits, 100);
+  ASSERT_EQ(lirs.stats().num_hits, 9 * 99);
+  ASSERT_EQ(lirs.stats().lfu_hits, 9 * 99);
+  ASSERT_EQ(lirs.size(), 100);
+}
+
+TEST(LIRSCache, Zipf) {
+  LIRSCache<string, int64_t> lirs(100);
+  TestZipf(&lirs, 0.9);
+}
@@ -0,0 +1,79 @@
+#include "cache/arc.h"
+#include "cache/lru-k.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+TEST(LRUKCache, SmallCache) {
+  LRUKCache<string, string> cache(3);
+  ASSERT_EQ(cache.label(3), "lru2-100");
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.p(), 3);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+  ASSERT_EQ(cache.stats().lru_hits, 1);
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+  ASSERT_EQ(cache.p(), 2);
+
+  // The Mandalorian was only referenced once, and before Boba Fett.
+  cache.add_to_cache("Assassin", make_shared<string>("Fennec Shand"));
+  ASSERT_EQ(cache.size(), 3);
+  ASSERT_EQ(cache.stats().lru_evicts, 1);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_EQ(cache.history_size(), 1);
+
+  // The history table remembers his last reference, so he comes back as
+  // referenced twice and Boba Fett goes.
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+  ASSERT_EQ(cache.stats().lru_evicts, 2);
+  ASSERT_EQ(*cache.get("Assassin"), "Fennec Shand");
+  ASSERT_EQ(cache.p(), 0);
+
+  // Everything was referenced twice, the Mandalorian's second most recent
+  // reference is the oldest.
+  cache.add_to_cache("Marshal", make_shared<string>("Cobb Vanth"));
+  ASSERT_EQ(cache.stats().lfu_evicts, 1);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_NE(cache.get("Baby Yoda"), nullptr);
+  ASSERT_NE(cache.get("Assassin"), nullptr);
+  ASSERT_EQ(cache.stats().num_evicted, 3);
+  ASSERT_EQ(cache.history_size(), 2);
+
+  TestRemoveAndClear(&cache, "Baby Yoda");
+  ASSERT_EQ(cache.history_size(), 0);
+}
+
+TEST(LRUKCache, SmallCacheSized) {
+  LRUKCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  cache.add_to_cache("K3", make_shared<string>("0123"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K4", make_shared<string>("012"));
+  ASSERT_EQ(cache.size(), 12);
+  ASSERT_EQ(cache.get("K2"), nullptr);
+  ASSERT_NE(cache.get("K1"), nullptr);
+}
+
+// A scan of keys referenced once only pushes out keys referenced once.
+TEST(LRUKCache, ScanResistant) {
+  LRUKCache<string, int64_t> lru2(100);
+  TestScanResistant(&lru2, 250, 1000);
+  ASSERT_EQ(lru2.stats().lfu_evicts, 0);
+}
+
+TEST(LRUKCache, Zipf) {
+  LRUKCache<string, int64_t> lru2(100);
+  TestZipf(&lru2, 0.95);
+  ASSERT_EQ(lru2.history_size(), 100);
+}
@@ -0,0 +1,125 @@
+#include "cache/arc.h"
+#include "cache/flat-index.h"
+#include "cache/flex-arc.h"
+#include "cache/lru.h"
+#include "cache/sharded-cache.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+using namespace cache;
+using namespace std;
+
+typedef LRUCache<string, int64_t> Lru;
+typedef LRUCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+    FlatLru;
+typedef AdaptiveCache<string, int64_t> Arc;
+typedef AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                      FlatIndex>
+    FlatArc;
+typedef FlexARC<string, int64_t> Farc;
+typedef FlexARC<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+    FlatFarc;
+typedef ShardedCache<string, int64_t, Arc, 4> ShardedArc;
+
+// Replays the trace in batches: multi_get the batch, then multi_add its misses,
+// against one cache, and the same calls one key at a time against another.
+// Both must return the same values and end with the same stats.
+template <typename Cache, typename... Args>
+void CheckBatches(size_t batch, Args... args) {
+  vector<Request> trace =
+      TraceGen::ZipfianDistribution(42, 20000, 2000, 0.8, 1);
+  Cache batched(args...);
+  Cache single(args...);
+  vector<string> keys(batch);
+  vector<shared_ptr<int64_t>> values(batch);
+  vector<string> miss_keys;
+  vector<shared_ptr<int64_t>> miss_values;
+  for (size_t b = 0; b < trace.size(); b += batch) {
+    size_t n = min(batch, trace.size() - b);
+    for (size_t i = 0; i < n; ++i) {
+      keys[i] = trace[b + i].key;
+    }
+    batched.multi_get(keys.data(), n, values.data());
+    miss_keys.clear();
+    miss_values.clear();
+    for (size_t i = 0; i < n; ++i) {
+      auto v = single.get(keys[i]);
+      ASSERT_EQ(v == nullptr, values[i] == nullptr) << trace[b + i].key;
+      if (v) {
+        ASSERT_EQ(*v, *values[i]);
+      } else {
+        miss_keys.push_back(keys[i]);
+        miss_values.push_back(make_shared<int64_t>(trace[b + i].value));
+      }
+    }
+    for (size_t i = 0; i < miss_keys.size(); ++i) {
+      single.add_to_cache(miss_keys[i], miss_values[i]);
+    }
+    batched.multi_add(miss_keys.data(), miss_keys.size(), miss_values.data());
+  }
+  ASSERT_GT(single.stats().num_hits, 0);
+  ASSERT_EQ(single.stats().num_hits, batched.stats().num_hits);
+  ASSERT_EQ(single.stats().num_misses, batched.stats().num_misses);
+  ASSERT_EQ(single.stats().num_evicted, batched.stats().num_evicted);
+  ASSERT_EQ(single.size(), batched.size());
+  ASSERT_EQ(single.p(), batched.p());
+}
+
+// Batch sizes below, at and across kPrefetchBatch.
+const size_t kBatches[] = {1, 7, kPrefetchBatch, 100};
+
+TEST(MultiGet, LRUCache) {
+  for (size_t batch : kBatches) {
+    CheckBatches<Lru>(batch, 200);
+    CheckBatches<FlatLru>(batch, 200);
+  }
+}
+
+TEST(MultiGet, AdaptiveCache) {
+  for (size_t batch : kBatches) {
+    CheckBatches<Arc>(batch, 200);
+    CheckBatches<FlatArc>(batch, 200);
+    CheckBatches<Arc>(batch, 200, 100);
+  }
+}
+
+TEST(MultiGet, FlexARC) {
+  for (size_t batch : kBatches) {
+    CheckBatches<Farc>(batch, 200, 800);
+    CheckBatches<FlatFarc>(batch, 200, 800);
+  }
+}
+
+TEST(MultiGet, ShardedCache) {
+  for (size_t batch : kBatches) {
+    CheckBatches<ShardedArc>(batch, 200);
+  }
+  // Groups larger than one shard batch.
+  CheckBatches<ShardedArc>(1000, 200);
+}
+
+TEST(MultiGet, Empty) {
+  Lru cache(10);
+  cache.multi_get((const string*)nullptr, 0, (shared_ptr<int64_t>*)nullptr);
+  cache.multi_add((const string*)nullptr, 0,
+                  (const shared_ptr<int64_t>*)nullptr);
+  ASSERT_EQ(cache.stats().num_misses, 0);
+  ASSERT_EQ(cache.size(), 0);
+}
+
+// A key repeated in one batch is added once, its last value wins.
+TEST(MultiGet, DuplicateKeys) {
+  Lru cache(10);
+  string keys[] = {"a", "b", "a"};
+  shared_ptr<int64_t> values[] = {make_shared<int64_t>(1),
+                                  make_shared<int64_t>(2),
+                                  make_shared<int64_t>(3)};
+  cache.multi_add(keys, 3, values);
+  ASSERT_EQ(cache.size(), 2);
+  shared_ptr<int64_t> out[3];
+  cache.multi_get(keys, 3, out);
+  ASSERT_EQ(*out[0], 3);
+  ASSERT_EQ(*out[1], 2);
+  ASSERT_EQ(*out[2], 3);
+  ASSERT_EQ(cache.stats().num_hits, 3);
+}
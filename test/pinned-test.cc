@@ -0,0 +1,115 @@
+#include "cache/arc.h"
+#include "cache/lru.h"
+#include "cache/pinned.h"
+#include "cache/sharded-cache.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+#include <thread>
+
+using namespace cache;
+using namespace std;
+
+typedef LRUCache<string, string, NopLock, ElementCount<string>, NodeIndex,
+                 Pinned<string>>
+    PinnedLru;
+typedef AdaptiveCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                      NodeIndex, KeyGhost<string>, Pinned<int64_t>>
+    PinnedArc;
+
+TEST(Pinned, Handle) {
+  Pinned<string> empty;
+  ASSERT_FALSE(empty);
+  ASSERT_EQ(empty, nullptr);
+  ASSERT_EQ(empty.get(), nullptr);
+  ASSERT_EQ(empty.use_count(), 0);
+  ASSERT_EQ(sizeof(empty), sizeof(void*));
+
+  Pinned<string> p = make_pinned<string>("Grogu");
+  ASSERT_TRUE(p);
+  ASSERT_EQ(*p, "Grogu");
+  ASSERT_EQ(p->size(), 5);
+  ASSERT_EQ(p.use_count(), 1);
+
+  Pinned<string> copy = p;
+  ASSERT_EQ(p.use_count(), 2);
+  ASSERT_EQ(copy, p);
+  Pinned<string> moved = std::move(copy);
+  ASSERT_EQ(copy, nullptr);
+  ASSERT_EQ(p.use_count(), 2);
+
+  moved = nullptr;
+  ASSERT_EQ(p.use_count(), 1);
+  p = p;
+  ASSERT_EQ(*p, "Grogu");
+}
+
+TEST(Pinned, LRUCache) {
+  PinnedLru cache(2);
+  cache.add_to_cache("Baby Yoda", make_pinned<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_pinned<string>("Din Djarin"));
+  Pinned<string> v = cache.get("The Mandalorian");
+  ASSERT_EQ(*v, "Din Djarin");
+  ASSERT_EQ(v.use_count(), 2);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+
+  // Evicting the entry leaves the reader's handle valid.
+  cache.add_to_cache("Bounty Hunter", make_pinned<string>("Boba Fett"));
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_EQ(v.use_count(), 1);
+  ASSERT_EQ(*v, "Din Djarin");
+
+  Pinned<string> p = cache.remove_from_cache("Bounty Hunter");
+  ASSERT_EQ(p.use_count(), 1);
+  ASSERT_EQ(*p, "Boba Fett");
+  ASSERT_EQ(cache.size(), 1);
+}
+
+// The handle type must not change caching decisions.
+TEST(Pinned, MatchesSharedPtr) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 20000, 1000, 0.8, 1));
+  AdaptiveCache<string, int64_t> shared_cache(100);
+  PinnedArc pinned_cache(100);
+  while (true) {
+    const Request* r = trace.next();
+    if (r == nullptr)
+      break;
+    if (!shared_cache.get(r->key)) {
+      shared_cache.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    if (!pinned_cache.get(r->key)) {
+      pinned_cache.add_to_cache(r->key, make_pinned<int64_t>(r->value));
+    }
+  }
+  ASSERT_EQ(shared_cache.stats().num_hits, pinned_cache.stats().num_hits);
+  ASSERT_EQ(shared_cache.p(), pinned_cache.p());
+}
+
+// Readers keep using values while other threads evict them.
+TEST(Pinned, Threads) {
+  const int kThreads = 8;
+  vector<Request> trace = TraceGen::ZipfianDistribution(42, 20000, 1000, 0.8, 1);
+  ShardedCache<string, int64_t,
+               LRUCache<string, int64_t, NopLock, ElementCount<int64_t>,
+                        NodeIndex, Pinned<int64_t>>,
+               4>
+      cache(100);
+  vector<thread> workers;
+  for (int t = 0; t < kThreads; ++t) {
+    workers.emplace_back([&, t]() {
+      for (size_t i = t; i < trace.size(); ++i) {
+        const Request& r = trace[i];
+        Pinned<int64_t> v = cache.get(r.key);
+        if (v) {
+          ASSERT_EQ(*v, r.value);
+        } else {
+          cache.add_to_cache(r.key, make_pinned<int64_t>(r.value));
+        }
+      }
+    });
+  }
+  for (thread& w : workers) {
+    w.join();
+  }
+  ASSERT_LE(cache.size(), 100);
+}
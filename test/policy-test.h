@@ -0,0 +1,106 @@
+#pragma once
+
+/*
+ * Checks shared by the tests of the replacement policies. Each takes a cache
+ * built by the test, so the test only states what is particular to its policy.
+ */
+
+#include "cache/arc.h"
+#include "cache/lru.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+#include <memory>
+#include <string>
+
+// Looks up every request of the trace, adding the ones that miss.
+template <class Cache> void TestTrace(Cache* cache, cache::Trace* trace) {
+  trace->Reset();
+  while (true) {
+    const cache::Request* r = trace->next();
+    if (r == nullptr)
+      break;
+    std::shared_ptr<int64_t> val = cache->get(r->key);
+    if (!val) {
+      cache->add_to_cache(r->key, std::make_shared<int64_t>(r->value));
+    }
+  }
+}
+
+// For a cache counting entries: removing key, which is cached, hands back its
+// only reference, and clear() empties the cache and its stats.
+template <class Cache>
+void TestRemoveAndClear(Cache* cache, const std::string& key) {
+  int64_t size = cache->size();
+  auto value = cache->remove_from_cache(key);
+  ASSERT_NE(value, nullptr);
+  ASSERT_EQ(value.use_count(), 1);
+  ASSERT_EQ(cache->size(), size - 1);
+  ASSERT_EQ(cache->get(key), nullptr);
+
+  cache->clear();
+  ASSERT_EQ(cache->size(), 0);
+  ASSERT_EQ(cache->num_entries(), 0);
+  ASSERT_EQ(cache->stats().num_hits, 0);
+}
+
+// 20000 requests over 1000 keys.
+inline cache::FixedTrace ZipfTrace() {
+  return cache::FixedTrace(
+      cache::TraceGen::ZipfianDistribution(42, 20000, 1000, 0.8, 1));
+}
+
+// For a cache of 16 bytes of strings: replacing a value changes the size, and
+// a value bigger than the cache is not kept.
+template <class Cache> void TestResize(Cache* cache) {
+  cache->add_to_cache("K0", std::make_shared<std::string>("Abcd"));
+  ASSERT_EQ(cache->size(), 4);
+  cache->add_to_cache("K0", std::make_shared<std::string>("Abcde"));
+  ASSERT_EQ(cache->size(), 5);
+  cache->add_to_cache("K0",
+                      std::make_shared<std::string>("012345678901234567"));
+  ASSERT_EQ(cache->size(), 0);
+  ASSERT_EQ(cache->num_entries(), 0);
+}
+
+// A working set of 50 keys is looked up hot_requests times, then a scan of
+// scan_keys new keys, then the working set once more. The scan starts with the
+// working set so LRU gets hot_requests hits, a scan resistant cache keeps the
+// working set through the rest of the scan and gets 50 more.
+template <class Cache>
+void TestScanResistant(Cache* cache, int hot_requests, int scan_keys) {
+  cache::FixedTrace trace(cache::TraceGen::CycleTrace(hot_requests, 50, 4));
+  trace.Add(cache::TraceGen::CycleTrace(scan_keys, scan_keys, 4));
+  trace.Add(cache::TraceGen::CycleTrace(50, 50, 4));
+
+  TestTrace(cache, &trace);
+  cache::LRUCache<std::string, int64_t> lru(cache->max_size());
+  TestTrace(&lru, &trace);
+  ASSERT_EQ(lru.stats().num_hits, hot_requests);
+  ASSERT_EQ(cache->stats().num_hits, hot_requests + 50);
+  ASSERT_EQ(cache->size(), cache->max_size());
+}
+
+// Runs ZipfTrace(), after which the cache is full, and expects more than
+// ratio times the hits of ARC.
+template <class Cache> void TestZipf(Cache* cache, double ratio) {
+  cache::FixedTrace trace = ZipfTrace();
+  TestTrace(cache, &trace);
+  cache::AdaptiveCache<std::string, int64_t> arc(cache->max_size());
+  TestTrace(&arc, &trace);
+  ASSERT_EQ(cache->stats().num_hits + cache->stats().num_misses, 20000);
+  ASSERT_EQ(cache->size(), cache->max_size());
+  ASSERT_EQ(cache->num_entries(), cache->max_size());
+  ASSERT_GT(cache->stats().num_hits, arc.stats().num_hits * ratio);
+}
+
+// The index must not change what the policy does, two caches that differ only
+// in it get the same hits on ZipfTrace().
+template <class NodeCache, class FlatCache>
+void TestMatchesFlatIndex(NodeCache* node_cache, FlatCache* flat_cache) {
+  cache::FixedTrace trace = ZipfTrace();
+  TestTrace(node_cache, &trace);
+  TestTrace(flat_cache, &trace);
+  ASSERT_EQ(node_cache->stats().num_hits, flat_cache->stats().num_hits);
+  ASSERT_EQ(node_cache->num_entries(), flat_cache->num_entries());
+}
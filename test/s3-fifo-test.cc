@@ -0,0 +1,157 @@
+#include "cache/arc.h"
+#include "cache/buffered-cache.h"
+#include "cache/concurrent-index.h"
+#include "cache/s3-fifo.h"
+#include "util/lock.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <atomic>
+#include <string_view>
+#include <thread>
+
+using namespace cache;
+using namespace std;
+
+typedef S3FIFOCache<string, int64_t, WordLock, ElementCount<int64_t>,
+                    ConcurrentIndex>
+    ConcurrentS3Fifo;
+typedef BufferedCache<string, int64_t,
+                      S3FIFOCache<string, int64_t, NopLock,
+                                  ElementCount<int64_t>, ConcurrentIndex>>
+    BufferedS3Fifo;
+
+TEST(S3FIFOCache, SmallCache) {
+  S3FIFOCache<string, string> cache(10);
+  ASSERT_EQ(cache.label(10), "s3fifo-100");
+  ASSERT_EQ(cache.p(), 1);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+  ASSERT_EQ(cache.stats().lru_hits, 2);
+  for (int i = 0; i < 8; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<string>(to_string(i)));
+  }
+  ASSERT_EQ(cache.size(), 10);
+  ASSERT_EQ(cache.stats().num_evicted, 0);
+
+  // Grogu was looked up twice and moves to main, the Mandalorian was not and
+  // is evicted to the ghost list.
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.size(), 10);
+  ASSERT_EQ(cache.stats().lru_evicts, 1);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+
+  // Back from the ghost list, the Mandalorian goes to main.
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+  ASSERT_EQ(cache.stats().num_evicted, 2);
+  ASSERT_EQ(cache.get("0"), nullptr);
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(cache.stats().lfu_hits, 2);
+
+  TestRemoveAndClear(&cache, "Baby Yoda");
+}
+
+TEST(S3FIFOCache, SmallCacheSized) {
+  S3FIFOCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_EQ(cache.size(), 14);
+  ASSERT_EQ(cache.get("K0"), nullptr);
+  ASSERT_NE(cache.get("K1"), nullptr);
+}
+
+// A working set looked up a few times moves to main when a scan of new keys
+// pushes it out of the small queue, and the scan leaves through the small
+// queue.
+TEST(S3FIFOCache, ScanResistant) {
+  S3FIFOCache<string, int64_t> s3fifo(100);
+  TestScanResistant(&s3fifo, 250, 1000);
+  ASSERT_EQ(s3fifo.stats().lfu_evicts, 0);
+}
+
+TEST(S3FIFOCache, Zipf) {
+  S3FIFOCache<string, int64_t> s3fifo(100);
+  TestZipf(&s3fifo, 0.95);
+}
+
+// Lookups never move links, so on one thread ConcurrentIndex gives the same
+// hits.
+TEST(S3FIFOCache, MatchesConcurrentIndex) {
+  FixedTrace trace = ZipfTrace();
+  S3FIFOCache<string, int64_t> node_cache(100);
+  ConcurrentS3Fifo concurrent_cache(100);
+  TestTrace(&node_cache, &trace);
+  TestTrace(&concurrent_cache, &trace);
+  ASSERT_EQ(node_cache.stats().num_hits, concurrent_cache.stats().num_hits);
+  ASSERT_EQ(node_cache.stats().num_misses,
+            concurrent_cache.stats().num_misses);
+  ASSERT_EQ(node_cache.stats().num_evicted,
+            concurrent_cache.stats().num_evicted);
+}
+
+TEST(S3FIFOCache, MultiGet) {
+  ConcurrentS3Fifo cache(100);
+  vector<string> keys;
+  vector<shared_ptr<int64_t>> values;
+  for (int64_t i = 0; i < 40; ++i) {
+    keys.push_back(to_string(i));
+    values.push_back(make_shared<int64_t>(i));
+  }
+  cache.multi_add(keys.data(), 20, values.data());
+  vector<shared_ptr<int64_t>> got(40);
+  cache.multi_get(keys.data(), 40, got.data());
+  for (int64_t i = 0; i < 40; ++i) {
+    if (i < 20) {
+      ASSERT_EQ(*got[i], i);
+    } else {
+      ASSERT_EQ(got[i], nullptr);
+    }
+  }
+  ASSERT_EQ(cache.stats().num_hits, 20);
+  ASSERT_EQ(cache.stats().num_misses, 20);
+}
+
+// Readers check every value they get against its key while writers add and
+// evict. Freed links would show up under ASan.
+template <typename Cache> void ReadWhileWriting() {
+  const int64_t kKeys = 5000;
+  Cache cache(kKeys / 4);
+  vector<Request> trace =
+      TraceGen::ZipfianDistribution(42, 100000, kKeys, 0.9, 1);
+  atomic<int64_t> bad{0};
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = t * 1000; i < trace.size(); i += 2) {
+        const Request& r = trace[i];
+        auto v = cache.get(r.key);
+        if (!v) {
+          cache.add_to_cache(r.key, make_shared<int64_t>(stoll(r.key)));
+        } else if (*v != stoll(r.key)) {
+          ++bad;
+        }
+      }
+    });
+  }
+  for (thread& t : threads) {
+    t.join();
+  }
+  ASSERT_EQ(bad, 0);
+  ASSERT_LE(cache.size(), kKeys / 4);
+  ASSERT_GT(cache.stats().num_hits, 0);
+}
+
+TEST(S3FIFOCache, Threads) {
+  ReadWhileWriting<ConcurrentS3Fifo>();
+  ReadWhileWriting<BufferedS3Fifo>();
+}
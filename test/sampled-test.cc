@@ -0,0 +1,127 @@
+#include "cache/arc.h"
+#include "cache/sampled.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+template <typename Priority>
+using StringCache = SampledCache<string, string, NopLock, ElementCount<string>,
+                                 NodeIndex, Priority>;
+
+// With no more entries than samples every entry is scored, so sampled LRU is
+// LRU.
+TEST(SampledCache, SmallCache) {
+  StringCache<SampledLRU> cache(3);
+  ASSERT_EQ(cache.label(3), "sampled-lru-100");
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+
+  cache.add_to_cache("Assassin", make_shared<string>("Fennec Shand"));
+  ASSERT_EQ(cache.size(), 3);
+  ASSERT_EQ(cache.get("Bounty Hunter"), nullptr);
+  cache.add_to_cache("Marshal", make_shared<string>("Cobb Vanth"));
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+  ASSERT_NE(cache.get("Assassin"), nullptr);
+  ASSERT_EQ(cache.stats().lru_hits, 3);
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+  ASSERT_EQ(cache.stats().lru_evicts, 1);
+  ASSERT_EQ(cache.stats().lfu_evicts, 1);
+  ASSERT_EQ(cache.stats().num_evicted, 2);
+
+  // Removing an entry moves the last one into its slot.
+  ASSERT_NE(cache.remove_from_cache("Assassin"), nullptr);
+  ASSERT_EQ(*cache.get("Marshal"), "Cobb Vanth");
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+  TestRemoveAndClear(&cache, "Marshal");
+}
+
+TEST(SampledCache, SmallCacheSized) {
+  SampledCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K0"), "0123");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_LE(cache.size(), 16);
+  ASSERT_EQ(cache.num_entries(), 3);
+}
+
+// GDSF keeps small values over large ones hit as often, and ages out values
+// no longer hit.
+TEST(SampledCache, GDSF) {
+  SampledCache<string, string, NopLock, StringSizer, NodeIndex, GDSF> cache(
+      16);
+  ASSERT_EQ(cache.label(16), "gdsf-100");
+  cache.add_to_cache("Large", make_shared<string>("0123456789"));
+  cache.add_to_cache("Small", make_shared<string>("0123"));
+  cache.add_to_cache("New", make_shared<string>("01234"));
+  ASSERT_EQ(cache.get("Large"), nullptr);
+  ASSERT_EQ(cache.priority().inflation(), 0.1);
+  ASSERT_EQ(cache.size(), 9);
+
+  // Small is hit often, then never again: L catches up with it.
+  for (int i = 0; i < 3; ++i) {
+    ASSERT_NE(cache.get("Small"), nullptr);
+  }
+  for (int i = 0; i < 40; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<string>("01234"));
+  }
+  ASSERT_EQ(cache.get("Small"), nullptr);
+  ASSERT_GT(cache.priority().inflation(), 1.0);
+}
+
+// Hyperbolic gives new keys a chance, then keeps the ones hit per unit of time
+// the most.
+TEST(SampledCache, Hyperbolic) {
+  StringCache<Hyperbolic> cache(2);
+  ASSERT_EQ(cache.label(2), "hyperbolic-100");
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  for (int i = 0; i < 5; ++i) {
+    cache.get("Baby Yoda");
+  }
+  for (int i = 0; i < 5; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<string>(to_string(i)));
+  }
+  ASSERT_NE(cache.get("Baby Yoda"), nullptr);
+  ASSERT_NE(cache.get("4"), nullptr);
+  ASSERT_EQ(cache.get("3"), nullptr);
+}
+
+// Zipf keys are drawn independently from a fixed distribution, the priorities
+// that count hits do better than recency, LHD even better than ARC.
+TEST(SampledCache, Zipf) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 100000, 1000, 0.8, 1));
+  SampledCache<string, int64_t> lhd(100);
+  TestTrace(&lhd, &trace);
+  SampledCache<string, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+               Hyperbolic>
+      hyperbolic(100);
+  TestTrace(&hyperbolic, &trace);
+  SampledCache<string, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+               SampledLRU>
+      sampled_lru(100);
+  TestTrace(&sampled_lru, &trace);
+  LRUCache<string, int64_t> lru(100);
+  TestTrace(&lru, &trace);
+  AdaptiveCache<string, int64_t> arc(100);
+  TestTrace(&arc, &trace);
+  ASSERT_EQ(lhd.label(1000), "lhd-10");
+  ASSERT_EQ(lhd.stats().num_hits + lhd.stats().num_misses, 100000);
+  ASSERT_EQ(lhd.size(), 100);
+  ASSERT_EQ(lhd.num_entries(), 100);
+  ASSERT_GT(lhd.stats().num_hits, arc.stats().num_hits);
+  ASSERT_GT(hyperbolic.stats().num_hits, lru.stats().num_hits);
+  // Sampling gets close to the real thing.
+  ASSERT_GT(sampled_lru.stats().num_hits, lru.stats().num_hits * 0.95);
+}
@@ -0,0 +1,222 @@
+#include "cache/arc.h"
+#include "cache/flat-index.h"
+#include "cache/flex-arc.h"
+#include "cache/lfu.h"
+#include "cache/lirs.h"
+#include "cache/lru.h"
+#include "cache/sharded-arc.h"
+#include "cache/sharded-cache.h"
+#include "cache/slru.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <set>
+#include <thread>
+
+using namespace cache;
+using namespace std;
+
+TEST(ShardedCache, SplitSizes) {
+  ShardedCache<string, int64_t, FlexARC<string, int64_t>, 4> cache(
+      400, SplitSize{800}, SplitSize{40});
+  ASSERT_EQ(cache.max_size(), 400);
+  ASSERT_EQ(cache.filter_size(), 40);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(cache.shard(i)->max_size(), 100);
+    ASSERT_EQ(cache.shard(i)->ghost_size(), 200);
+  }
+  ASSERT_EQ(cache.label(1000), "s4-farc-40-200");
+}
+
+// Arguments other than sizes reach every shard unchanged.
+TEST(ShardedCache, PassThroughArgs) {
+  ShardedCache<string, int64_t, LFUCache<string, int64_t>, 4> lfu(400, true);
+  ShardedCache<string, int64_t, SLRUCache<string, int64_t>, 4> slru(400, 4);
+  ShardedCache<string, int64_t, LIRSCache<string, int64_t>, 4> lirs(400, .5);
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(lfu.shard(i)->max_size(), 100);
+    ASSERT_TRUE(lfu.shard(i)->aging());
+    ASSERT_EQ(slru.shard(i)->max_size(), 100);
+    ASSERT_EQ(slru.shard(i)->num_segments(), 4);
+    ASSERT_EQ(lirs.shard(i)->max_size(), 100);
+    ASSERT_EQ(lirs.shard(i)->p(), 50);
+  }
+}
+
+TEST(ShardedCache, Basic) {
+  ShardedCache<string, string, LRUCache<string, string>, 4> cache(400);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(cache.get("Bounty Hunter"), nullptr);
+  ASSERT_EQ(*cache.remove_from_cache("Baby Yoda"), "Grogu");
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+  ASSERT_EQ(cache.size(), 1);
+
+  const Stats& stats = cache.stats();
+  ASSERT_EQ(stats.num_hits, 1);
+  ASSERT_EQ(stats.num_misses, 2);
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.stats().num_hits, 0);
+}
+
+TEST(ShardedCache, KeysStayInShard) {
+  ShardedCache<string, int64_t, LRUCache<string, int64_t>, 8> cache(800);
+  for (int i = 0; i < 400; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(i));
+  }
+  for (int i = 0; i < 400; ++i) {
+    string key = to_string(i);
+    ASSERT_NE(cache.shard(cache.shard_idx(key))->get(key), nullptr);
+  }
+}
+
+// Shards are picked by other hash bits than those the structures in a shard
+// home keys by, so the keys of one shard still spread over all of them: the
+// bits above bit 32 for FlatIndex, the top bits for FingerprintGhost.
+TEST(ShardedCache, ShardsSpreadOverIndex) {
+  typedef LRUCache<string, int64_t, NopLock, ElementCount<int64_t>, FlatIndex>
+      FlatLru;
+  ShardedCache<string, int64_t, FlatLru, 16> cache(16 * 1024);
+  FlatIndex<string, int> index;
+  set<size_t> homes;
+  set<uint64_t> top_homes;
+  for (int i = 0; i < 100000; ++i) {
+    string key = to_string(i);
+    if (cache.shard_idx(key) == 3) {
+      homes.insert(index.hash(key) & 1023);
+      uint64_t fp = std::hash<string>{}(key) * 0x9E3779B97F4A7C15ull;
+      top_homes.insert(fp >> 54);
+    }
+  }
+  ASSERT_GT(homes.size(), 1000);
+  ASSERT_GT(top_homes.size(), 1000);
+
+  // Any number of shards gets its share of keys.
+  ShardedCache<string, int64_t, FlatLru, 5> five(5 * 1024);
+  int count[5] = {};
+  for (int i = 0; i < 100000; ++i) {
+    ++count[five.shard_idx(to_string(i))];
+  }
+  for (int c : count) {
+    ASSERT_NEAR(c, 20000, 1000);
+  }
+}
+
+TEST(ShardedCache, Threads) {
+  const int kThreads = 8;
+  vector<Request> trace = TraceGen::ZipfianDistribution(42, 20000, 1000, 0.8, 1);
+  ShardedCache<string, int64_t, AdaptiveCache<string, int64_t>, 4> cache(400);
+  atomic<bool> done{false};
+  // Two scrapers read stats while the others run, taking no shard lock.
+  vector<thread> scrapers;
+  for (int t = 0; t < 2; ++t) {
+    scrapers.emplace_back([&]() {
+      while (!done) {
+        Stats stats = cache.stats();
+        ASSERT_LE(stats.num_hits + stats.num_misses, kThreads * trace.size());
+      }
+    });
+  }
+  vector<thread> workers;
+  for (int t = 0; t < kThreads; ++t) {
+    workers.emplace_back([&]() {
+      for (const Request& r : trace) {
+        if (!cache.get(r.key)) {
+          cache.add_to_cache(r.key, make_shared<int64_t>(r.value));
+        }
+      }
+    });
+  }
+  for (thread& w : workers) {
+    w.join();
+  }
+  done = true;
+  for (thread& s : scrapers) {
+    s.join();
+  }
+  const Stats& stats = cache.stats();
+  ASSERT_EQ(stats.num_hits + stats.num_misses, kThreads * trace.size());
+  ASSERT_LE(cache.size(), 400);
+  Stats sum;
+  for (int i = 0; i < 4; ++i) {
+    sum.merge(cache.shard(i)->stats());
+  }
+  ASSERT_EQ(stats.num_evicted, sum.num_evicted);
+  ASSERT_EQ(stats.lfu_hits, sum.lfu_hits);
+}
+
+TEST(ShardedARC, SharedP) {
+  ShardedARC<string, int64_t, 4> cache(400);
+  ASSERT_EQ(cache.label(1000), "s4-uarc-40-shared-p");
+  for (int i = 0; i < 800; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(i));
+  }
+  ASSERT_EQ(cache.p(), 0);
+  // Ghost hits in any shard move the one p, each shard aims for its share.
+  for (int i = 0; i < 400; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(i));
+  }
+  ASSERT_GT(cache.p(), 0);
+  ASSERT_EQ(cache.max_p(), cache.p());
+  for (int i = 0; i < 4; ++i) {
+    ASSERT_EQ(cache.shard(i)->p(), cache.p() / 4);
+  }
+  ASSERT_LE(cache.size(), 400);
+
+  cache.reset();
+  ASSERT_EQ(cache.p(), 0);
+  ASSERT_EQ(cache.size(), 0);
+}
+
+// A p per shard adapts on a 16th of the ghost hits each, the shared p on all
+// of them like a single ARC.
+TEST(ShardedARC, HitRatio) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(0, 20000, 20000, 0.7, 1));
+  trace.Add(TraceGen::CycleTrace(20000, 20000, 1));
+  trace.Add(TraceGen::ZipfianDistribution(0, 20000, 20000, 0.7, 1));
+  UnifiedARC<string, int64_t> single(5000);
+  ShardedARC<string, int64_t, 16> shared(5000);
+  for (int i = 0; i < 2; ++i) {
+    trace.Reset();
+    while (const Request* r = trace.next()) {
+      if (!single.get(r->key)) {
+        single.add_to_cache(r->key, make_shared<int64_t>(r->value));
+      }
+      if (!shared.get(r->key)) {
+        shared.add_to_cache(r->key, make_shared<int64_t>(r->value));
+      }
+    }
+  }
+  ASSERT_GE(shared.stats().num_hits, single.stats().num_hits * 0.99);
+}
+
+TEST(ShardedARC, Threads) {
+  const int kThreads = 8;
+  vector<Request> trace = TraceGen::ZipfianDistribution(42, 20000, 1000, 0.8, 1);
+  ShardedARC<string, int64_t, 4> cache(400);
+  vector<thread> workers;
+  for (int t = 0; t < kThreads; ++t) {
+    workers.emplace_back([&]() {
+      for (const Request& r : trace) {
+        auto v = cache.get(r.key);
+        if (!v) {
+          cache.add_to_cache(r.key, make_shared<int64_t>(stoll(r.key)));
+        } else {
+          ASSERT_EQ(*v, stoll(r.key));
+        }
+      }
+    });
+  }
+  for (thread& w : workers) {
+    w.join();
+  }
+  const Stats& stats = cache.stats();
+  ASSERT_EQ(stats.num_hits + stats.num_misses, kThreads * trace.size());
+  ASSERT_LE(cache.size(), 400);
+  ASSERT_LE(cache.p(), 400);
+}
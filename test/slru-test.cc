@@ -0,0 +1,130 @@
+#include "cache/arc.h"
+#include "cache/lru.h"
+#include "cache/slru.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+TEST(SLRUCache, SmallCache) {
+  // The protected segment holds 2 keys.
+  SLRUCache<string, string> cache(4);
+  ASSERT_EQ(cache.label(4), "slru2-100");
+  ASSERT_EQ(cache.p(), 2);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  cache.add_to_cache("Assassin", make_shared<string>("Fennec Shand"));
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("The Mandalorian")), "Din Djarin");
+  ASSERT_EQ(cache.segment_size(1), 2);
+
+  // Boba Fett is promoted and Grogu, at the tail, demoted.
+  ASSERT_EQ(*cache.get("Bounty Hunter"), "Boba Fett");
+  ASSERT_EQ(cache.stats().lru_hits, 3);
+  ASSERT_EQ(cache.segment_size(0), 2);
+  ASSERT_EQ(cache.segment_size(1), 2);
+
+  // Fennec Shand was never looked up and goes first.
+  cache.add_to_cache("Marshal", make_shared<string>("Cobb Vanth"));
+  ASSERT_EQ(cache.size(), 4);
+  ASSERT_EQ(cache.stats().lru_evicts, 1);
+  ASSERT_EQ(cache.get("Assassin"), nullptr);
+  ASSERT_EQ(*cache.get("Bounty Hunter"), "Boba Fett");
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+
+  // Then Grogu, demoted ahead of the Marshal.
+  cache.add_to_cache("Assassin", make_shared<string>("Fennec Shand"));
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+  ASSERT_EQ(*cache.get("Marshal"), "Cobb Vanth");
+  ASSERT_EQ(cache.stats().num_evicted, 2);
+
+  TestRemoveAndClear(&cache, "Marshal");
+}
+
+TEST(SLRUCache, Segments) {
+  SLRUCache<string, string> cache(6, 3);
+  ASSERT_EQ(cache.label(6), "slru3-100");
+  ASSERT_EQ(cache.p(), 2);
+  for (int i = 0; i < 6; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<string>(to_string(i)));
+  }
+  // 0 and 1 go up two segments, 2 and 3 one.
+  for (const char* key : {"0", "1", "0", "1", "2", "3"}) {
+    cache.get(key);
+  }
+  ASSERT_EQ(cache.segment_size(0), 2);
+  ASSERT_EQ(cache.segment_size(1), 2);
+  ASSERT_EQ(cache.segment_size(2), 2);
+  ASSERT_EQ(cache.stats().lru_hits, 4);
+  ASSERT_EQ(cache.stats().lfu_hits, 2);
+
+  // New keys only go through segment 0.
+  for (int i = 6; i < 12; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<string>(to_string(i)));
+  }
+  ASSERT_EQ(cache.stats().num_evicted, 6);
+  ASSERT_EQ(cache.stats().lfu_evicts, 0);
+  ASSERT_EQ(cache.get("4"), nullptr);
+
+  // 2 is promoted over 0, which goes back to the head of segment 1. Then 11
+  // is promoted over 3, which goes back to the head of segment 0, so 10 is
+  // evicted first.
+  cache.get("2");
+  cache.get("11");
+  ASSERT_EQ(cache.segment_size(2), 2);
+  ASSERT_EQ(cache.segment_size(1), 2);
+  ASSERT_EQ(cache.segment_size(0), 2);
+  cache.add_to_cache("12", make_shared<string>("12"));
+  ASSERT_EQ(cache.get("10"), nullptr);
+  ASSERT_NE(cache.get("3"), nullptr);
+  ASSERT_NE(cache.get("0"), nullptr);
+
+  // One segment is LRU.
+  SLRUCache<string, string> lru(2, 1);
+  ASSERT_EQ(lru.label(2), "slru1-100");
+  lru.add_to_cache("0", make_shared<string>("0"));
+  lru.add_to_cache("1", make_shared<string>("1"));
+  lru.get("0");
+  lru.add_to_cache("2", make_shared<string>("2"));
+  ASSERT_EQ(lru.get("1"), nullptr);
+  ASSERT_NE(lru.get("0"), nullptr);
+}
+
+TEST(SLRUCache, SmallCacheSized) {
+  SLRUCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_EQ(cache.size(), 14);
+  ASSERT_EQ(cache.get("K0"), nullptr);
+  ASSERT_NE(cache.get("K1"), nullptr);
+}
+
+// A working set looked up a few times is protected, and a scan of new keys
+// only goes through the probationary segment.
+TEST(SLRUCache, ScanResistant) {
+  SLRUCache<string, int64_t> slru(100);
+  TestScanResistant(&slru, 250, 1000);
+  ASSERT_EQ(slru.stats().lfu_evicts, 0);
+}
+
+TEST(SLRUCache, Zipf) {
+  FixedTrace trace = ZipfTrace();
+  SLRUCache<string, int64_t> slru(100);
+  TestZipf(&slru, 0.9);
+  SLRUCache<string, int64_t> slru4(100, 4);
+  TestTrace(&slru4, &trace);
+  LRUCache<string, int64_t> lru(100);
+  TestTrace(&lru, &trace);
+  ASSERT_GT(slru.stats().num_hits, lru.stats().num_hits);
+  ASSERT_GT(slru4.stats().num_hits, slru.stats().num_hits);
+}
@@ -0,0 +1,96 @@
+#include "cache/stats-aggregate.h"
+#include "gtest/gtest.h"
+
+#include <thread>
+#include <vector>
+
+using namespace cache;
+using namespace std;
+
+TEST(StatsAggregate, Publish) {
+  StatsAggregate sum(2);
+  Stats a, b, last_a, last_b, out;
+  a.num_hits = 3;
+  a.bytes_hit = 30;
+  b.num_hits = 1;
+  b.arc_filter = 7;
+  sum.publish(0, a, &last_a);
+  sum.publish(1, b, &last_b);
+  sum.read(&out);
+  ASSERT_EQ(out.num_hits, 4);
+  ASSERT_EQ(out.bytes_hit, 30);
+  ASSERT_EQ(out.arc_filter, 7);
+  ASSERT_EQ(out.num_misses, 0);
+  ASSERT_EQ(last_a.num_hits, 3);
+
+  // Only the change since the last publish is added.
+  ++a.num_hits;
+  ++a.num_misses;
+  sum.publish(0, a, &last_a);
+  sum.publish(0, a, &last_a);
+  sum.read(&out);
+  ASSERT_EQ(out.num_hits, 5);
+  ASSERT_EQ(out.num_misses, 1);
+
+  // A part that was cleared takes its share back out.
+  a.clear();
+  sum.publish(0, a, &last_a);
+  sum.read(&out);
+  ASSERT_EQ(out.num_hits, 1);
+  ASSERT_EQ(out.bytes_hit, 0);
+  ASSERT_EQ(out.arc_filter, 7);
+
+  sum.add(1, b);
+  sum.read(&out);
+  ASSERT_EQ(out.arc_filter, 14);
+
+  // A part added later starts empty, the others keep what they published.
+  sum.resize(3);
+  ASSERT_EQ(sum.parts(), 3);
+  Stats last_c;
+  sum.publish(2, b, &last_c);
+  sum.read(&out);
+  ASSERT_EQ(out.arc_filter, 21);
+  ASSERT_EQ(out.num_hits, 3);
+  sum.clear();
+  sum.read(&out);
+  ASSERT_EQ(out.num_hits, 0);
+  ASSERT_EQ(out.arc_filter, 0);
+}
+
+// Threads publish their own parts while another reads; once they are done the
+// sum is exact, and no read sees more than was published.
+TEST(StatsAggregate, Threads) {
+  const int kThreads = 8;
+  const int kIters = 20000;
+  StatsAggregate sum(kThreads);
+  atomic<bool> done{false};
+  thread reader([&]() {
+    Stats out;
+    while (!done) {
+      sum.read(&out);
+      ASSERT_LE(out.num_hits, kThreads * kIters);
+      ASSERT_LE(out.bytes_hit, 2 * kThreads * kIters);
+    }
+  });
+  vector<thread> writers;
+  for (int t = 0; t < kThreads; ++t) {
+    writers.emplace_back([&, t]() {
+      Stats part, last;
+      for (int i = 0; i < kIters; ++i) {
+        ++part.num_hits;
+        part.bytes_hit += 2;
+        sum.publish(t, part, &last);
+      }
+    });
+  }
+  for (thread& w : writers) {
+    w.join();
+  }
+  done = true;
+  reader.join();
+  Stats out;
+  sum.read(&out);
+  ASSERT_EQ(out.num_hits, kThreads * kIters);
+  ASSERT_EQ(out.bytes_hit, 2 * kThreads * kIters);
+}
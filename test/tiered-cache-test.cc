@@ -0,0 +1,351 @@
+#include "cache/arc.h"
+#include "cache/tiered-cache.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+
+using namespace cache;
+using namespace std;
+
+typedef AdaptiveCache<string, int64_t, NopLock, TraceSizer> Arc;
+typedef TieredCache<string, int64_t, Arc, NopLock, TraceSizer> Tiered;
+
+// Loops over n small keys of 2 bytes, each followed by a key of 30 bytes never
+// seen again.
+void TestLoop(Tiered* cache, int iters, int n) {
+  for (int i = 0; i < iters; ++i) {
+    string small = "small" + to_string(i % n);
+    string large = "large" + to_string(i);
+    for (const string& key : {small, large}) {
+      if (!cache->get(key)) {
+        cache->add_to_cache(key, make_shared<int64_t>(key == small ? 2 : 30));
+      }
+    }
+  }
+}
+
+TEST(TieredCache, SmallCache) {
+  Tiered cache(false);
+  cache.add_cache(10, make_shared<Arc>(40));
+  cache.add_cache(50, make_shared<Arc>(120));
+  ASSERT_EQ(cache.num_tiers(), 2);
+  ASSERT_EQ(cache.max_size(), 160);
+  ASSERT_EQ(cache.label(160), "tiered-100");
+
+  cache.add_to_cache("Baby Yoda", make_shared<int64_t>(5));
+  cache.add_to_cache("The Mandalorian", make_shared<int64_t>(30));
+  // Larger than every threshold, so in the last tier.
+  cache.add_to_cache("Razor Crest", make_shared<int64_t>(60));
+  ASSERT_EQ(*cache.get("Baby Yoda"), 5);
+  ASSERT_EQ(*cache.get("The Mandalorian"), 30);
+  ASSERT_EQ(*cache.get("Razor Crest"), 60);
+  ASSERT_EQ(cache.size(), 95);
+  ASSERT_EQ(cache.num_entries(), 3);
+  ASSERT_EQ(cache.stats().num_hits, 3);
+  ASSERT_EQ(cache.get("Ahsoka Tano"), nullptr);
+  ASSERT_EQ(cache.unrouted_misses(), 1);
+  ASSERT_EQ(cache.stats().num_misses, 1);
+
+  // A new size moves the key to its tier.
+  cache.add_to_cache("Baby Yoda", make_shared<int64_t>(20));
+  ASSERT_EQ(*cache.get("Baby Yoda"), 20);
+  ASSERT_EQ(cache.num_entries(), 3);
+  ASSERT_EQ(*cache.remove_from_cache("Baby Yoda"), 20);
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.stats().num_hits, 0);
+}
+
+// A lookup probes only the tier its key was added to, and a miss for a key
+// added to none probes no tier.
+TEST(TieredCache, Routing) {
+  Tiered cache(false);
+  vector<shared_ptr<Arc>> tiers;
+  for (int i = 0; i < 8; ++i) {
+    tiers.push_back(make_shared<Arc>(1000 << i));
+    cache.add_cache(1 << i, tiers.back());
+  }
+  for (int i = 0; i < 800; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(1 << (i % 8)));
+  }
+  for (int i = 0; i < 1600; ++i) {
+    shared_ptr<int64_t> v = cache.get(to_string(i));
+    ASSERT_EQ(v != nullptr, i < 800);
+    if (v) {
+      ASSERT_EQ(*v, 1 << (i % 8));
+    }
+  }
+  for (const shared_ptr<Arc>& t : tiers) {
+    ASSERT_EQ(t->stats().num_hits, 100);
+    ASSERT_EQ(t->stats().num_misses, 0);
+  }
+  ASSERT_EQ(cache.unrouted_misses(), 800);
+  ASSERT_EQ(cache.stats().num_misses, 800);
+
+  // Evicted from its tier, the key misses there once and then is forgotten.
+  tiers[0]->remove_from_cache("0");
+  ASSERT_EQ(cache.get("0"), nullptr);
+  ASSERT_EQ(tiers[0]->stats().num_misses, 1);
+  ASSERT_EQ(cache.get("0"), nullptr);
+  ASSERT_EQ(tiers[0]->stats().num_misses, 1);
+  ASSERT_EQ(cache.unrouted_misses(), 801);
+}
+
+// The small keys do not fit the first tier and miss every time, but each is
+// in its shadow queue: the first tier takes capacity from the second, whose
+// keys are never hit, until they fit.
+TEST(TieredCache, Rebalance) {
+  Tiered fixed(false);
+  fixed.add_cache(10, make_shared<Arc>(20));
+  fixed.add_cache(100, make_shared<Arc>(200));
+  TestLoop(&fixed, 2000, 15);
+
+  Tiered cache;
+  cache.add_cache(10, make_shared<Arc>(20));
+  cache.add_cache(100, make_shared<Arc>(200));
+  TestLoop(&cache, 2000, 15);
+  ASSERT_GT(cache.shadow_hits(0), 0);
+  ASSERT_EQ(cache.shadow_hits(1), 0);
+  ASSERT_GE(cache.tier_max_size(0), 30);
+  ASSERT_EQ(cache.tier_max_size(0) + cache.tier_max_size(1), 220);
+  ASSERT_LE(cache.size(), 220);
+  ASSERT_GT(cache.stats().num_hits, fixed.stats().num_hits + 1000);
+
+  cache.reset();
+  ASSERT_EQ(cache.tier_max_size(0), 20);
+  ASSERT_EQ(cache.tier_max_size(1), 200);
+  ASSERT_EQ(cache.size(), 0);
+}
+
+// Adding a key the tier holds updates its value and earns no capacity.
+TEST(TieredCache, RebalanceUpdate) {
+  Tiered cache;
+  cache.add_cache(10, make_shared<Arc>(20));
+  cache.add_cache(100, make_shared<Arc>(200));
+  for (int i = 0; i < 100; ++i) {
+    cache.add_to_cache("Grogu", make_shared<int64_t>(2));
+  }
+  ASSERT_EQ(cache.shadow_hits(0), 0);
+  ASSERT_EQ(cache.tier_max_size(0), 20);
+  ASSERT_EQ(cache.tier_max_size(1), 200);
+}
+
+// Routes of evicted keys pile up until the index is rebuilt from the keys the
+// tiers hold. A key still cached keeps its route however long it is not
+// looked up.
+TEST(TieredCache, RebuildIndex) {
+  Tiered cache(false);
+  auto small = make_shared<Arc>(100);
+  auto large = make_shared<Arc>(1000);
+  cache.add_cache(10, small);
+  cache.add_cache(100, large);
+  cache.add_to_cache("Din Djarin", make_shared<int64_t>(50));
+  for (int i = 0; i < 10000; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(5));
+  }
+  ASSERT_EQ(*cache.get("Din Djarin"), 50);
+  ASSERT_EQ(cache.unrouted_misses(), 0);
+  // An evicted key whose route was dropped misses without probing its tier.
+  ASSERT_EQ(cache.get("0"), nullptr);
+  ASSERT_EQ(cache.unrouted_misses(), 1);
+  ASSERT_EQ(small->stats().num_misses, 0);
+
+  // Added again in another size class, its old copy is removed.
+  cache.add_to_cache("Din Djarin", make_shared<int64_t>(5));
+  ASSERT_EQ(large->num_entries(), 0);
+  ASSERT_EQ(*cache.get("Din Djarin"), 5);
+  ASSERT_EQ(*cache.remove_from_cache("Din Djarin"), 5);
+  ASSERT_EQ(cache.get("Din Djarin"), nullptr);
+}
+
+// Only the first tier takes values, so its threshold falls until they spill
+// over into the second.
+TEST(TieredCache, AdaptBoundaries) {
+  Tiered cache(false, true);
+  cache.add_cache(10, make_shared<Arc>(100));
+  cache.add_cache(100, make_shared<Arc>(100));
+  for (int i = 0; i < 4096 * 2; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(8));
+  }
+  ASSERT_EQ(cache.threshold(0), 8);
+  for (int i = 0; i < 4096 * 8; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<int64_t>(8));
+  }
+  ASSERT_GE(cache.threshold(0), 7);
+  ASSERT_LE(cache.threshold(0), 9);
+  ASSERT_LE(cache.size(), cache.max_size());
+  ASSERT_EQ(cache.threshold(1), 100);
+
+  cache.reset();
+  ASSERT_EQ(cache.threshold(0), 10);
+}
+
+// Every value read must belong to its key while threads add, evict and move
+// memory between the tiers.
+TEST(TieredCache, Threads) {
+  typedef TieredCache<string, int64_t, Arc, std::mutex, TraceSizer>
+      LockedTiered;
+  LockedTiered cache(true, true);
+  cache.add_cache(500, make_shared<Arc>(100000));
+  cache.add_cache(1000, make_shared<Arc>(100000));
+  cache.add_cache(2000, make_shared<Arc>(100000));
+  cache.add_cache(5000, make_shared<Arc>(100000));
+  vector<Request> trace =
+      TraceGen::ZipfianDistribution(42, 100000, 5000, 0.9, 1);
+  atomic<int64_t> bad{0};
+  atomic<bool> done{false};
+  // Scrapes stats while the others run, it takes no tier lock.
+  thread scraper([&]() {
+    while (!done) {
+      const Stats& stats = cache.stats();
+      ASSERT_LE(stats.num_hits, 2 * (int64_t)trace.size());
+    }
+  });
+  vector<thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = t * 1000; i < trace.size(); i += 2) {
+        const Request& r = trace[i];
+        auto v = cache.get(r.key);
+        if (!v) {
+          cache.add_to_cache(r.key, make_shared<int64_t>(stoll(r.key) + 1));
+        } else if (*v != stoll(r.key) + 1) {
+          ++bad;
+        }
+      }
+    });
+  }
+  for (thread& t : threads) {
+    t.join();
+  }
+  done = true;
+  scraper.join();
+  ASSERT_EQ(bad, 0);
+  int64_t capacity = 0;
+  for (int i = 0; i < cache.num_tiers(); ++i) {
+    capacity += cache.tier_max_size(i);
+  }
+  ASSERT_EQ(capacity, cache.max_size());
+  ASSERT_LE(cache.size(), cache.max_size());
+  ASSERT_GT(cache.stats().num_hits, 0);
+}
+
+// stats() is the sum of the tiers' stats, but for misses which are counted
+// once, whatever moved them: lookups, adds, evictions and capacity moves.
+TEST(TieredCache, Stats) {
+  Tiered cache;
+  vector<shared_ptr<Arc>> tiers;
+  for (int i = 0; i < 3; ++i) {
+    tiers.push_back(make_shared<Arc>(200));
+    cache.add_cache(10 << i, tiers.back());
+  }
+  vector<Request> trace = TraceGen::ZipfianDistribution(42, 20000, 500, 0.8, 1);
+  for (const Request& r : trace) {
+    if (!cache.get(r.key)) {
+      cache.add_to_cache(r.key, make_shared<int64_t>(stoll(r.key) % 40 + 1));
+    }
+  }
+  Stats sum;
+  for (const shared_ptr<Arc>& t : tiers) {
+    sum.merge(t->stats());
+  }
+  const Stats& stats = cache.stats();
+  ASSERT_GT(sum.num_evicted, 0);
+  ASSERT_EQ(stats.num_hits, sum.num_hits);
+  ASSERT_EQ(stats.bytes_hit, sum.bytes_hit);
+  ASSERT_EQ(stats.num_evicted, sum.num_evicted);
+  ASSERT_EQ(stats.bytes_evicted, sum.bytes_evicted);
+  ASSERT_EQ(stats.lfu_hits + stats.lru_hits, stats.num_hits);
+  ASSERT_EQ(stats.num_hits + stats.num_misses, (int64_t)trace.size());
+
+  cache.clear();
+  ASSERT_EQ(cache.stats().num_hits, 0);
+  ASSERT_EQ(cache.stats().num_evicted, 0);
+  ASSERT_EQ(cache.stats().num_misses, 0);
+}
+
+// Writers add the same keys in two size classes while readers look them up,
+// missing and erasing routes as the adds land. Nothing is evicted, so every
+// key is found afterwards, in one tier only.
+TEST(TieredCache, ThreadsFindAdded) {
+  typedef TieredCache<string, int64_t, Arc, std::mutex, TraceSizer>
+      LockedTiered;
+  const int kKeys = 5000;
+  LockedTiered cache(false);
+  cache.add_cache(10, make_shared<Arc>(1000000));
+  cache.add_cache(100, make_shared<Arc>(1000000));
+  atomic<bool> done{false};
+  vector<thread> readers;
+  for (int t = 0; t < 2; ++t) {
+    readers.emplace_back([&, t]() {
+      while (!done) {
+        for (int i = t; i < kKeys; i += 2) {
+          cache.get(to_string(i));
+        }
+      }
+    });
+  }
+  vector<thread> writers;
+  for (int t = 0; t < 2; ++t) {
+    writers.emplace_back([&, t]() {
+      for (int i = 0; i < kKeys; ++i) {
+        cache.add_to_cache(to_string(i), make_shared<int64_t>(t ? 50 : 5));
+      }
+    });
+  }
+  for (thread& w : writers) {
+    w.join();
+  }
+  done = true;
+  for (thread& r : readers) {
+    r.join();
+  }
+  for (int i = 0; i < kKeys; ++i) {
+    ASSERT_NE(cache.get(to_string(i)), nullptr) << i;
+  }
+  ASSERT_EQ(cache.num_entries(), kKeys);
+}
+
+// Readers look up keys that stay cached, without taking Lock, while a writer
+// churns another tier so the index grows, erases and is rebuilt under them.
+// They never miss.
+TEST(TieredCache, ThreadsNoFalseMiss) {
+  typedef TieredCache<string, int64_t, Arc, std::mutex, TraceSizer>
+      LockedTiered;
+  LockedTiered cache(false);
+  cache.add_cache(10, make_shared<Arc>(100));
+  cache.add_cache(100, make_shared<Arc>(1000));
+  for (int i = 0; i < 10; ++i) {
+    cache.add_to_cache("large" + to_string(i), make_shared<int64_t>(50));
+  }
+  atomic<bool> done{false};
+  atomic<int64_t> missed{0};
+  vector<thread> readers;
+  for (int t = 0; t < 2; ++t) {
+    readers.emplace_back([&]() {
+      while (!done) {
+        for (int i = 0; i < 10; ++i) {
+          if (!cache.get("large" + to_string(i))) {
+            ++missed;
+          }
+        }
+      }
+    });
+  }
+  for (int i = 0; i < 20000; ++i) {
+    string key = to_string(i);
+    if (!cache.get(key)) {
+      cache.add_to_cache(key, make_shared<int64_t>(5));
+    }
+  }
+  done = true;
+  for (thread& r : readers) {
+    r.join();
+  }
+  ASSERT_EQ(missed, 0);
+}
@@ -0,0 +1,148 @@
+#include "cache/arc.h"
+#include "cache/concurrent-index.h"
+#include "cache/flex-arc.h"
+#include "cache/tiny-lfu.h"
+#include "cache/unified-arc.h"
+#include "gtest/gtest.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+TEST(TinyLFU, Estimate) {
+  TinyLFU<string> filter(100);
+  ASSERT_EQ(filter.max_size(), 100);
+  ASSERT_EQ(filter.estimate("Grogu"), 0);
+  // The first lookup only reaches the doorkeeper.
+  filter.record("Grogu");
+  ASSERT_EQ(filter.estimate("Grogu"), 1);
+  filter.record("Grogu");
+  ASSERT_EQ(filter.estimate("Grogu"), 2);
+  for (int i = 0; i < 20; ++i) {
+    filter.record("Grogu");
+  }
+  ASSERT_EQ(filter.estimate("Grogu"), 16);
+  ASSERT_EQ(filter.size(), 22);
+
+  // Views count as their key.
+  filter.record(string_view("Din Djarin"));
+  ASSERT_EQ(filter.estimate(string("Din Djarin")), 1);
+
+  // Ties go to the victim.
+  ASSERT_FALSE(filter.admit("Boba Fett", "Fennec Shand"));
+  ASSERT_TRUE(filter.admit("Grogu", "Din Djarin"));
+  ASSERT_FALSE(filter.admit("Din Djarin", "Grogu"));
+
+  filter.clear();
+  ASSERT_EQ(filter.size(), 0);
+  ASSERT_EQ(filter.estimate("Grogu"), 0);
+}
+
+TEST(TinyLFU, Aging) {
+  TinyLFU<int64_t> filter(1000);
+  for (int i = 0; i < 9; ++i) {
+    filter.record(1);
+  }
+  ASSERT_EQ(filter.estimate(1), 9);
+  // The 10000th lookup halves the counters and clears the doorkeeper.
+  for (int i = 0; i < 9991; ++i) {
+    filter.record(2);
+  }
+  ASSERT_EQ(filter.size(), 5000);
+  ASSERT_EQ(filter.estimate(1), 4);
+  ASSERT_EQ(filter.estimate(2), 7);
+}
+
+TEST(TinyLFU, Disabled) {
+  TinyLFU<int64_t> filter(0);
+  filter.record(1);
+  ASSERT_EQ(filter.estimate(1), 0);
+  ASSERT_EQ(filter.size(), 0);
+}
+
+template <typename Cache> void Access(Cache* cache, int64_t key) {
+  if (!cache->get(key)) {
+    cache->add_to_cache(key, make_shared<int64_t>(key));
+  }
+}
+
+// Keys looked up a few times stay through a scan of new keys, which TinyLFU
+// turns away rather than evict them for.
+template <typename Cache> void TestScan(Cache* cache, int64_t filtered) {
+  for (int pass = 0; pass < 5; ++pass) {
+    for (int64_t k = 0; k < 100; ++k) {
+      Access(cache, k);
+    }
+  }
+  ASSERT_EQ(cache->stats().arc_filter, 0);
+  for (int64_t k = 1000; k < 1500; ++k) {
+    Access(cache, k);
+  }
+  ASSERT_EQ(cache->stats().arc_filter, filtered);
+  int64_t hits = cache->stats().num_hits;
+  for (int64_t k = 0; k < 100; ++k) {
+    Access(cache, k);
+  }
+  ASSERT_EQ(cache->stats().num_hits - hits, 100);
+
+  // A new key looked up often enough gets in.
+  for (int i = 0; i < 10; ++i) {
+    Access(cache, 2000);
+  }
+  ASSERT_NE(cache->get(2000), nullptr);
+}
+
+TEST(TinyLFU, Arc) {
+  AdaptiveCache<int64_t, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+                KeyGhost<int64_t>, shared_ptr<int64_t>, TinyLFU<int64_t>>
+      cache(100, 100);
+  ASSERT_EQ(cache.label(100), "arc-100-tinylfu");
+  TestScan(&cache, 500);
+}
+
+typedef AdaptiveCache<int64_t, int64_t, NopLock, ElementCount<int64_t>,
+                      ConcurrentIndex, KeyGhost<int64_t, ConcurrentIndex>,
+                      shared_ptr<int64_t>, TinyLFU<int64_t>>
+    ConcurrentArc;
+
+TEST(TinyLFU, ConcurrentArc) {
+  ConcurrentArc scanned(100, 100);
+  TestScan(&scanned, 500);
+
+  // T2 hits take no lock but still count, so keys only ever hit there keep
+  // their place against a new key looked up less often.
+  ConcurrentArc cache(2, 100);
+  for (int64_t k : {1, 2}) {
+    Access(&cache, k);
+    Access(&cache, k);
+  }
+  for (int i = 0; i < 10; ++i) {
+    ASSERT_NE(cache.get(1), nullptr);
+    ASSERT_NE(cache.get(2), nullptr);
+  }
+  for (int i = 0; i < 5; ++i) {
+    Access(&cache, 3);
+  }
+  ASSERT_EQ(cache.get(3), nullptr);
+  ASSERT_NE(cache.get(1), nullptr);
+  ASSERT_NE(cache.get(2), nullptr);
+}
+
+TEST(TinyLFU, FlexArc) {
+  FlexARC<int64_t, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+          KeyGhost<int64_t>, shared_ptr<int64_t>, TinyLFU<int64_t>>
+      cache(100, 400, 100);
+  ASSERT_EQ(cache.label(100), "farc-100-400-tinylfu");
+  // With p at 0 and T1 empty, FlexARC evicts each new key to B1 as soon as
+  // it is added, so no cached key is at stake and all are admitted.
+  TestScan(&cache, 0);
+}
+
+TEST(TinyLFU, UnifiedArc) {
+  UnifiedARC<int64_t, int64_t, NopLock, ElementCount<int64_t>, NodeIndex,
+             TinyLFU<int64_t>>
+      cache(100, 100);
+  ASSERT_EQ(cache.label(100), "uarc-100-tinylfu");
+  TestScan(&cache, 500);
+}
@@ -0,0 +1,104 @@
+#include "cache/arc.h"
+#include "cache/lru.h"
+#include "cache/two-queue.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+#include "policy-test.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+// Looks up prefix0 to prefixN-1, adding the misses.
+template <class Cache> void Touch(Cache* cache, const string& prefix, int n) {
+  for (int i = 0; i < n; ++i) {
+    string key = prefix + to_string(i);
+    if (!cache->get(key)) {
+      cache->add_to_cache(key, make_shared<int64_t>(i));
+    }
+  }
+}
+
+TEST(TwoQueueCache, SmallCache) {
+  // A1in holds 2 keys once the cache is full, A1out remembers 4.
+  TwoQueueCache<string, string> cache(8);
+  ASSERT_EQ(cache.label(8), "2q-100");
+  ASSERT_EQ(cache.p(), 2);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+  ASSERT_EQ(cache.stats().lru_hits, 2);
+  for (int i = 0; i < 6; ++i) {
+    cache.add_to_cache(to_string(i), make_shared<string>(to_string(i)));
+  }
+  ASSERT_EQ(cache.size(), 8);
+  ASSERT_EQ(cache.stats().num_evicted, 0);
+
+  // A1in is a FIFO, Grogu leaves first for all the lookups.
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.size(), 8);
+  ASSERT_EQ(cache.stats().lru_evicts, 1);
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+
+  // Back from A1out, Grogu goes to Am and the Mandalorian leaves A1in.
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+  ASSERT_EQ(cache.stats().lru_evicts, 2);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 2);
+  ASSERT_EQ(cache.get("0"), nullptr);
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+  ASSERT_EQ(cache.stats().lfu_hits, 2);
+  ASSERT_EQ(cache.stats().lfu_evicts, 0);
+
+  TestRemoveAndClear(&cache, "Baby Yoda");
+}
+
+TEST(TwoQueueCache, SmallCacheSized) {
+  TwoQueueCache<string, string, NopLock, StringSizer> cache(16);
+  TestResize(&cache);
+  // K0 was evicted to A1out, so it comes back to Am and outlives K1.
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_EQ(cache.size(), 13);
+  ASSERT_EQ(cache.get("K1"), nullptr);
+  ASSERT_NE(cache.get("K0"), nullptr);
+}
+
+// A working set pushed out of A1in and added back from A1out lives in Am, and
+// a scan of new keys twice the size of the cache only goes through A1in.
+TEST(TwoQueueCache, ScanResistant) {
+  TwoQueueCache<string, int64_t> two_queue(100);
+  LRUCache<string, int64_t> lru(100);
+  for (int pass = 0; pass < 2; ++pass) {
+    Touch(&two_queue, "w", 30);
+    Touch(&lru, "w", 30);
+    if (pass == 0) {
+      Touch(&two_queue, "f", 100);
+      Touch(&lru, "f", 100);
+    }
+  }
+  ASSERT_EQ(two_queue.stats().lru_ghost_hits, 30);
+  Touch(&two_queue, "s", 200);
+  Touch(&lru, "s", 200);
+  Touch(&two_queue, "w", 30);
+  Touch(&lru, "w", 30);
+  ASSERT_EQ(lru.stats().num_hits, 0);
+  ASSERT_EQ(two_queue.stats().num_hits, 30);
+  ASSERT_EQ(two_queue.stats().lfu_hits, 30);
+  ASSERT_EQ(two_queue.stats().lfu_evicts, 0);
+  ASSERT_EQ(two_queue.size(), 100);
+}
+
+TEST(TwoQueueCache, Zipf) {
+  TwoQueueCache<string, int64_t> two_queue(100);
+  TestZipf(&two_queue, 0.95);
+}
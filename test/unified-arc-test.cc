@@ -0,0 +1,144 @@
+#include "cache/arc.h"
+#include "cache/flat-index.h"
+#include "cache/unified-arc.h"
+#include "util/alloc-counter.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+using namespace cache;
+using namespace std;
+
+TEST(UnifiedARC, SmallCache) {
+  UnifiedARC<string, string> cache(2);
+  ASSERT_EQ(cache.label(2), "uarc-100");
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Unknown Name"));
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_EQ(cache.stats().lru_ghost_hits, 1);
+
+  // Ghost hit, comes back into T2.
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.p(), 1);
+  ASSERT_EQ(*cache.get("The Mandalorian"), "Din Djarin");
+  ASSERT_EQ(cache.stats().lfu_hits, 2);
+
+  shared_ptr<string> p = cache.remove_from_cache("The Mandalorian");
+  ASSERT_EQ(p.use_count(), 1);
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  // Baby Yoda made room for it in B2.
+  ASSERT_EQ(cache.remove_from_cache("Baby Yoda"), nullptr);
+  ASSERT_EQ(*cache.get("Bounty Hunter"), "Boba Fett");
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.stats().num_hits, 0);
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+}
+
+TEST(UnifiedARC, SmallCacheSized) {
+  UnifiedARC<string, string, NopLock, StringSizer> cache(16);
+  cache.add_to_cache("K0", make_shared<string>("Abcd"));
+  ASSERT_EQ(cache.size(), 4);
+  cache.add_to_cache("K0", make_shared<string>("Abcde"));
+  ASSERT_EQ(cache.size(), 5);
+  cache.add_to_cache("K0", make_shared<string>("012345678901234567"));
+  ASSERT_EQ(cache.size(), 0);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_EQ(cache.size(), 12);
+}
+
+// Runs trace through both caches one request at a time, they must agree on
+// every hit and on p.
+template <typename Unified, typename Arc, typename... Args>
+void CheckSameAsArc(Trace* trace, Args... args) {
+  Unified unified(args...);
+  Arc arc(args...);
+  trace->Reset();
+  while (true) {
+    const Request* r = trace->next();
+    if (r == nullptr)
+      break;
+    // Sizes from 1 to 7, only TraceSizer looks at them.
+    int64_t value = 1 + stoll(r->key) % 7;
+    bool hit = unified.get(r->key) != nullptr;
+    ASSERT_EQ(hit, arc.get(r->key) != nullptr) << r->key;
+    if (!hit) {
+      unified.add_to_cache(r->key, make_shared<int64_t>(value));
+      arc.add_to_cache(r->key, make_shared<int64_t>(value));
+    }
+    ASSERT_EQ(unified.p(), arc.p());
+    ASSERT_EQ(unified.size(), arc.size());
+  }
+  const Stats& u = unified.stats();
+  const Stats& a = arc.stats();
+  ASSERT_EQ(u.lru_hits, a.lru_hits);
+  ASSERT_EQ(u.lfu_hits, a.lfu_hits);
+  ASSERT_EQ(u.lru_evicts, a.lru_evicts);
+  ASSERT_EQ(u.lfu_evicts, a.lfu_evicts);
+  ASSERT_EQ(u.num_evicted, a.num_evicted);
+  ASSERT_EQ(u.bytes_evicted, a.bytes_evicted);
+  ASSERT_EQ(u.arc_filter, a.arc_filter);
+  ASSERT_EQ(u.lru_ghost_hits, a.lru_ghost_hits);
+  ASSERT_EQ(u.lfu_ghost_hits, a.lfu_ghost_hits);
+  ASSERT_EQ(unified.max_p(), arc.max_p());
+}
+
+// Zipf, a scan, then a shifted working set.
+TEST(UnifiedARC, SameAsArc) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 10000, 2000, 0.8, 1));
+  trace.Add(TraceGen::CycleTrace(3000, 3000, 1));
+  trace.Add(TraceGen::ZipfianDistribution(43, 10000, 2000, 0.8, 1));
+  trace.Add(TraceGen::NormalDistribution(5000, 1000, 100, 1));
+  for (int64_t size : {1, 2, 10, 100, 500}) {
+    CheckSameAsArc<UnifiedARC<string, int64_t>,
+                   AdaptiveCache<string, int64_t>>(&trace, size);
+    CheckSameAsArc<UnifiedARC<string, int64_t>,
+                   AdaptiveCache<string, int64_t>>(&trace, size, size);
+    CheckSameAsArc<UnifiedARC<string, int64_t, NopLock, ElementCount<int64_t>,
+                              FlatIndex>,
+                   AdaptiveCache<string, int64_t>>(&trace, size);
+  }
+}
+
+TEST(UnifiedARC, SameAsArcSized) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(7, 20000, 2000, 0.9, 1));
+  CheckSameAsArc<UnifiedARC<string, int64_t, NopLock, TraceSizer>,
+                 AdaptiveCache<string, int64_t, NopLock, TraceSizer>>(&trace,
+                                                                      1000);
+}
+
+// Once the index stops growing, T1 hits, evictions to ghosts and ghost hits
+// only relink: the allocations left are the values and new keys.
+TEST(UnifiedARC, NoAllocsOnPromotion) {
+  UnifiedARC<int64_t, int64_t> cache(100);
+  for (int64_t i = 0; i < 300; ++i) {
+    cache.add_to_cache(i, make_shared<int64_t>(i));
+  }
+  // 200..299 in T1, 100..199 in B1.
+  int64_t before = AllocCounter::num_allocs();
+  for (int64_t i = 200; i < 300; ++i) {
+    ASSERT_NE(cache.get(i), nullptr);
+  }
+  ASSERT_EQ(AllocCounter::num_allocs() - before, 0);
+  ASSERT_EQ(cache.stats().lru_hits, 100);
+
+  // Ghost hits evict T2 into B2 and bring B1 back into T2.
+  shared_ptr<int64_t> value = make_shared<int64_t>(0);
+  before = AllocCounter::num_allocs();
+  for (int64_t i = 100; i < 200; ++i) {
+    cache.add_to_cache(i, value);
+  }
+  ASSERT_EQ(AllocCounter::num_allocs() - before, 0);
+  ASSERT_EQ(cache.num_entries(), 100);
+  ASSERT_EQ(cache.stats().lfu_evicts, 100);
+}
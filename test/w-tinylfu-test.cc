@@ -0,0 +1,107 @@
+#include "cache/arc.h"
+#include "cache/w-tinylfu.h"
+#include "util/trace-gen.h"
+#include "gtest/gtest.h"
+
+#include <string_view>
+
+using namespace cache;
+using namespace std;
+
+TEST(WTinyLFU, SmallCache) {
+  WTinyLFU<string, string> cache(2);
+  ASSERT_EQ(cache.label(2), "wtlfu-100");
+  ASSERT_EQ(cache.p(), 1);
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Unknown Name"));
+  cache.add_to_cache("Baby Yoda", make_shared<string>("Grogu"));
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get(string_view("Baby Yoda")), "Grogu");
+
+  // Grogu leaves the window for the empty main cache.
+  cache.add_to_cache("The Mandalorian", make_shared<string>("Din Djarin"));
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(cache.stats().arc_filter, 0);
+
+  // The main cache is full, the Mandalorian was looked up less than Grogu.
+  cache.add_to_cache("Bounty Hunter", make_shared<string>("Boba Fett"));
+  ASSERT_EQ(cache.size(), 2);
+  ASSERT_EQ(cache.stats().arc_filter, 1);
+  ASSERT_EQ(cache.get("The Mandalorian"), nullptr);
+  ASSERT_EQ(*cache.get("Baby Yoda"), "Grogu");
+  ASSERT_EQ(*cache.get("Bounty Hunter"), "Boba Fett");
+  ASSERT_EQ(cache.stats().lru_hits, 3);
+  ASSERT_EQ(cache.stats().lfu_hits, 1);
+
+  shared_ptr<string> p = cache.remove_from_cache("Baby Yoda");
+  ASSERT_EQ(p.use_count(), 1);
+  ASSERT_EQ(cache.size(), 1);
+  ASSERT_EQ(cache.get("Baby Yoda"), nullptr);
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0);
+  ASSERT_EQ(cache.num_entries(), 0);
+  ASSERT_EQ(cache.stats().num_hits, 0);
+}
+
+TEST(WTinyLFU, SmallCacheSized) {
+  WTinyLFU<string, string, NopLock, StringSizer> cache(16, 16);
+  cache.add_to_cache("K0", make_shared<string>("Abcd"));
+  ASSERT_EQ(cache.size(), 4);
+  cache.add_to_cache("K0", make_shared<string>("Abcde"));
+  ASSERT_EQ(cache.size(), 5);
+  cache.add_to_cache("K0", make_shared<string>("012345678901234567"));
+  ASSERT_EQ(cache.size(), 0);
+  cache.add_to_cache("K0", make_shared<string>("0123"));
+  cache.add_to_cache("K1", make_shared<string>("01234"));
+  cache.add_to_cache("K2", make_shared<string>("012345"));
+  ASSERT_EQ(*cache.get("K1"), "01234");
+  ASSERT_EQ(cache.size(), 15);
+  cache.add_to_cache("K3", make_shared<string>("012"));
+  ASSERT_LE(cache.size(), 16);
+}
+
+// Keys looked up a few times stay through a scan of new keys.
+TEST(WTinyLFU, Scan) {
+  WTinyLFU<int64_t, int64_t> cache(100);
+  auto access = [&](int64_t k) {
+    if (!cache.get(k)) {
+      cache.add_to_cache(k, make_shared<int64_t>(k));
+    }
+  };
+  for (int pass = 0; pass < 5; ++pass) {
+    for (int64_t k = 0; k < 99; ++k) {
+      access(k);
+    }
+  }
+  for (int64_t k = 1000; k < 1500; ++k) {
+    access(k);
+  }
+  ASSERT_GE(cache.stats().arc_filter, 499);
+  int64_t hits = cache.stats().num_hits;
+  for (int64_t k = 0; k < 99; ++k) {
+    access(k);
+  }
+  ASSERT_EQ(cache.stats().num_hits - hits, 99);
+  ASSERT_EQ(cache.num_entries(), 100);
+}
+
+// Never worse than ARC by much on a scan resistant workload, and better on
+// zipf followed by a scan.
+TEST(WTinyLFU, HitRatio) {
+  FixedTrace trace(TraceGen::ZipfianDistribution(42, 20000, 2000, 0.8, 1));
+  trace.Add(TraceGen::CycleTrace(5000, 5000, 1));
+  trace.Add(TraceGen::ZipfianDistribution(43, 20000, 2000, 0.8, 1));
+  WTinyLFU<string, int64_t> wtlfu(200);
+  AdaptiveCache<string, int64_t> arc(200);
+  while (const Request* r = trace.next()) {
+    if (!wtlfu.get(r->key)) {
+      wtlfu.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    if (!arc.get(r->key)) {
+      arc.add_to_cache(r->key, make_shared<int64_t>(r->value));
+    }
+    ASSERT_LE(wtlfu.size(), 200);
+  }
+  ASSERT_GT(wtlfu.stats().num_hits, arc.stats().num_hits);
+}